@@ -0,0 +1,49 @@
+#ifndef CCC_ALLOCATION_H
+#define CCC_ALLOCATION_H
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+#include "analysis.h"
+#include "dataflow.h"
+#include "ir.h"
+
+namespace ccc {
+namespace ir {
+
+// Assignment of the values of a function to a small set of variables
+//
+// Two values interfere when one is defined while the other is live; values
+// that never interfere and have the same type can share a variable. Phis
+// are copied into at the end of each predecessor, so a phi also interferes
+// with everything live out of its predecessors, except the incoming value
+// it copies when that value dies on the edge; the two are then given the
+// same variable where possible and the copy disappears. Values are colored
+// greedily in reverse postorder, which for SSA form is near optimal.
+//
+// The analyses must describe the function as it will be lowered, after
+// critical edges are split.
+class VariableAllocation {
+public:
+  VariableAllocation(const CFG& cfg, const Liveness& liveness);
+
+  // Variables are numbered from 0; each holds values of a single type
+  size_t size() const { return types.size(); }
+  Type type(unsigned variable) const { return types[variable]; }
+
+  // Variable of a value-producing instruction
+  unsigned variable(const Value* value) const { return variables.at(value); }
+
+  // Most values live at any one point, a lower bound on size()
+  size_t maxLive() const { return pressure; }
+
+private:
+  std::vector<Type> types;
+  std::unordered_map<const Value*, unsigned> variables;
+  size_t pressure = 0;
+};
+
+} // namespace ir
+} // namespace ccc
+
+#endif // CCC_ALLOCATION_H
@@ -0,0 +1,284 @@
+#ifndef CCC_ANALYSIS_H
+#define CCC_ANALYSIS_H
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "ir.h"
+
+namespace ccc {
+namespace ir {
+
+// Control-flow graph of a function
+//
+// A snapshot of the reachable blocks numbered in reverse postorder, with
+// predecessor and successor lists by number so analyses can use dense
+// arrays. Blocks control never reaches are left out and have no number.
+class CFG {
+public:
+  static constexpr unsigned NONE = UINT32_MAX;
+
+  explicit CFG(Function& function);
+
+  size_t size() const { return order.size(); }
+  Function& getFunction() const { return function; }
+
+  // Reachable blocks in reverse postorder; entry is first
+  const std::vector<BasicBlock*>& reversePostOrder() const { return order; }
+  BasicBlock* block(unsigned index) const { return order[index]; }
+
+  // Reverse postorder number, or NONE for unreachable blocks
+  unsigned index(const BasicBlock* block) const;
+  bool isReachable(const BasicBlock* block) const { return index(block) != NONE; }
+
+  // Edges between reachable blocks, by number
+  const std::vector<unsigned>& predecessors(unsigned index) const { return predecessorIndices[index]; }
+  const std::vector<unsigned>& successors(unsigned index) const { return successorIndices[index]; }
+
+  // Blocks that leave the function (end in RET)
+  const std::vector<unsigned>& exits() const { return exitIndices; }
+
+private:
+  Function& function;
+  std::vector<BasicBlock*> order;
+  std::unordered_map<const BasicBlock*, unsigned> numbers;
+  std::vector<std::vector<unsigned>> predecessorIndices;
+  std::vector<std::vector<unsigned>> successorIndices;
+  std::vector<unsigned> exitIndices;
+};
+
+// Dominator or post-dominator tree with dominance frontiers
+//
+// Immediate dominators are computed with the iterative algorithm of Cooper,
+// Harvey and Kennedy ("A Simple, Fast Dominance Algorithm") over the CFG
+// numbering, and frontiers with their join-point walk. The post-dominator
+// tree is the same computation on the reversed CFG, rooted at a virtual
+// exit that every RET block flows into; its frontiers are the blocks each
+// block is control dependent on. Blocks that never reach a RET (infinite
+// loops) have no post-dominator.
+class DominatorTree {
+public:
+  DominatorTree(const CFG& cfg, bool postDominators = false);
+
+  bool isPostDominatorTree() const { return post; }
+
+  // Immediate (post-)dominator; null for the root, for blocks only the
+  // virtual exit post-dominates, and for blocks outside the tree
+  BasicBlock* idom(const BasicBlock* block) const;
+
+  // Every block dominates itself
+  bool dominates(const BasicBlock* a, const BasicBlock* b) const;
+  bool strictlyDominates(const BasicBlock* a, const BasicBlock* b) const { return a != b && dominates(a, b); }
+
+  // Whether the value defined by a is available at b
+  bool dominates(const Instruction* a, const Instruction* b) const;
+
+  // Children in the tree, and roots (the entry, or the RET blocks and the
+  // other blocks the virtual exit immediately post-dominates)
+  const std::vector<BasicBlock*>& children(const BasicBlock* block) const;
+  const std::vector<BasicBlock*>& roots() const { return rootBlocks; }
+
+  // Blocks where the (post-)dominance of block ends
+  const std::vector<BasicBlock*>& frontier(const BasicBlock* block) const;
+
+  // Blocks of the tree in preorder (parents before children)
+  std::vector<BasicBlock*> preorder() const;
+
+private:
+  const CFG& cfg;
+  bool post;
+
+  // Per CFG number; post-dominator trees have an extra node for the virtual exit
+  std::vector<unsigned> idoms;
+  std::vector<std::vector<BasicBlock*>> childBlocks;
+  std::vector<std::vector<BasicBlock*>> frontiers;
+  std::vector<BasicBlock*> rootBlocks;
+
+  // Preorder entry and exit times for constant-time dominance queries
+  std::vector<unsigned> entryTime;
+  std::vector<unsigned> exitTime;
+
+  static const std::vector<BasicBlock*> empty;
+
+  unsigned node(const BasicBlock* block) const;
+  void computeIdoms(const std::vector<std::vector<unsigned>>& predecessors,
+                    const std::vector<unsigned>& order, unsigned root);
+};
+
+// Natural loop: a header that dominates every block of the loop, and the
+// blocks that reach one of its back edges without passing the header
+class Loop {
+public:
+  explicit Loop(BasicBlock* header) : header(header) {}
+
+  BasicBlock* header;
+  Loop* parent = nullptr;
+  std::vector<Loop*> subLoops;
+  unsigned depth = 1;
+
+  // All blocks, including those of subloops; the header is first
+  std::vector<BasicBlock*> blocks;
+
+  // Sources of the back edges
+  std::vector<BasicBlock*> latches;
+
+  bool contains(const BasicBlock* block) const { return members.count(block) != 0; }
+  bool contains(const Loop* loop) const;
+  bool isInnermost() const { return subLoops.empty(); }
+
+  // The only predecessor of the header outside the loop, if it has no other
+  // successor; null when there is none (see LoopInfo::insertPreheader)
+  BasicBlock* preheader() const;
+
+  // Blocks in the loop with a successor outside it, and those successors
+  std::vector<BasicBlock*> exitingBlocks() const;
+  std::vector<BasicBlock*> exitBlocks() const;
+
+private:
+  friend class LoopInfo;
+  std::unordered_set<const BasicBlock*> members;
+};
+
+// Loop nest of a function
+class LoopInfo {
+public:
+  LoopInfo(const CFG& cfg, const DominatorTree& dominators);
+
+  // Outermost loops, in reverse postorder of their headers
+  const std::vector<Loop*>& topLevelLoops() const { return outermost; }
+
+  // Every loop, innermost loops before the loops containing them
+  std::vector<Loop*> loopsInnermostFirst() const;
+
+  // Innermost loop containing block, or null
+  Loop* loopFor(const BasicBlock* block) const;
+  unsigned depth(const BasicBlock* block) const;
+  bool isHeader(const BasicBlock* block) const;
+
+  bool empty() const { return loops.empty(); }
+
+  // Give a loop a preheader: a new block that all edges entering the
+  // header from outside the loop go through, so code can be hoisted out of
+  // the loop. Returns the existing preheader if there is one. The loop nest
+  // is updated; other analyses of the function are stale afterwards.
+  BasicBlock* insertPreheader(Loop* loop);
+
+  // Record a block created by a transformation as part of loop (and the
+  // loops enclosing it); a null loop means outside every loop
+  void addBlock(BasicBlock* block, Loop* loop);
+
+private:
+  std::vector<std::unique_ptr<Loop>> loops;
+  std::vector<Loop*> outermost;
+  std::unordered_map<const BasicBlock*, Loop*> innermost;
+};
+
+// Loop run by a counter: a header phi that each iteration steps by a
+// constant, compared by the header against a bound that does not change in
+// the loop. The header is the only block leaving the loop, and it leaves
+// as soon as the comparison fails.
+struct CountedLoop {
+  Instruction* counter = nullptr;
+  BasicBlock* entering = nullptr;   // The one predecessor outside the loop
+  Value* start = nullptr;           // Counter value flowing in from entering
+  int64_t step = 0;
+
+  // The loop keeps going while counter <predicate> bound
+  Opcode predicate = Opcode::CMP_NE;
+  Value* bound = nullptr;
+
+  // Times the body runs, when start and bound are constants; -1 when it
+  // is not known or the counter would wrap before the test fails
+  int64_t tripCount = -1;
+};
+
+// Recognize a counted loop: a single latch and a single entering edge, an
+// I32 counter phi whose latch value is counter + constant or counter -
+// constant, and a header CONDBR on a comparison of the counter (a
+// subtraction, or the counter itself, tests for inequality). Returns false
+// for any other loop.
+bool analyzeCountedLoop(const Loop& loop, CountedLoop& counted);
+
+// Loop-invariant integer: a constant plus invariant values times constant
+// factors
+struct LinearValue {
+  int64_t constant = 0;
+  std::vector<std::pair<Value*, int64_t>> terms;
+
+  bool isConstant() const { return terms.empty(); }
+  bool operator==(const LinearValue& other) const {
+      return constant == other.constant && terms == other.terms;
+  }
+};
+
+// Value of a loop as scale * iv + offset, where iv is a basic induction
+// variable of the loop and scale and offset are loop invariant; iv is null
+// for invariant values
+struct InductionValue {
+  Instruction* iv = nullptr;
+  LinearValue scale;
+  LinearValue offset;
+  bool multiplies = false;  // Computing it from iv takes a MUL or SHL
+};
+
+// Induction variables of a loop (scalar evolution limited to affine
+// recurrences)
+//
+// Basic induction variables are I32 header phis that the latch steps by a
+// constant. I32 values computed in the loop from them, constants and
+// values defined outside the loop with ADD, SUB, NEG, SHL by a constant,
+// and MUL where the result stays linear are described as scale * iv +
+// offset, all arithmetic modulo 2^32. Loops with several latches have
+// none.
+class InductionVariables {
+public:
+  explicit InductionVariables(const Loop& loop);
+
+  // Basic induction variables in header order, with their steps
+  const std::vector<std::pair<Instruction*, int64_t>>& basic() const { return basicVariables; }
+
+  // Description of an instruction of the loop, or null
+  const InductionValue* find(const Value* value) const;
+
+private:
+  const Loop& loop;
+  std::vector<std::pair<Instruction*, int64_t>> basicVariables;
+  std::unordered_map<const Value*, InductionValue> values;
+
+  bool describe(Value* operand, InductionValue& result) const;
+  bool describeInstruction(const Instruction* instruction, InductionValue& result) const;
+};
+
+// Reduction: a header phi that each iteration combines with one value by
+// an associative operation, phi = phi op x, where nothing else in the loop
+// uses phi or the result. The iterations may then accumulate into several
+// partial results, each starting from the operation's identity, and merge
+// them with combine once the loop is done. A maximum or minimum, phi =
+// select(x > phi, x, phi), combines with SELECT: of two partial results a
+// and b, a when a predicate b holds (CMP_GT for a maximum, CMP_LT for a
+// minimum). It has no identity; its partial results start from the value
+// the phi enters with, which repeating does not change.
+struct Reduction {
+  Instruction* phi = nullptr;
+  Instruction* update = nullptr;    // phi op x, the value on the back edge
+  Opcode combine = Opcode::ADD;     // Merges partial results
+  Opcode predicate = Opcode::CMP_GT;
+  int64_t identity = 0;
+};
+
+// Recognize a reduction of a loop with a single latch. Integer ADD, SUB
+// (phi - x, whose partial results add up), MUL, AND, OR and XOR qualify,
+// on I32 vectors lane by lane too; wrapping arithmetic can be regrouped
+// freely, and so can a maximum or minimum (a SELECT between phi and x on
+// a comparison of the two used nowhere else). Floating-point ADD, SUB,
+// MUL, maximum and minimum qualify only with relaxedMath, since
+// regrouping changes the rounding, or which NaN or zero comes out. Basic
+// induction variables are left to InductionVariables.
+bool analyzeReduction(const Loop& loop, Instruction* phi, bool relaxedMath, Reduction& reduction);
+
+} // namespace ir
+} // namespace ccc
+
+#endif // CCC_ANALYSIS_H
@@ -4,27 +4,70 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include "constant.h"
 #include "token.h"
 
 namespace ccc {
 
+// Semantic information attached to nodes by SemanticAnalyzer (see semantic.h)
+struct TypeInfo;
+struct SymbolInfo;
+
+// Concrete node kinds, used for static dispatch (see ast_visitor.h)
+enum class NodeKind {
+  // Expressions
+  LITERAL,
+  VARIABLE,
+  UNARY,
+  BINARY,
+  CALL,
+  ARRAY_ACCESS,
+  MEMBER_ACCESS,
+  CONDITIONAL,
+  
+  // Statements
+  EXPRESSION_STATEMENT,
+  BLOCK,
+  VARIABLE_DECLARATION,
+  IF,
+  WHILE,
+  DO_WHILE,
+  FOR,
+  RETURN,
+  BREAK,
+  CONTINUE,
+  
+  // Declarations and types
+  TYPE,
+  PARAMETER,
+  FUNCTION_DECLARATION,
+  PROGRAM
+};
+
 // Base class for all AST nodes
 class ASTNode {
 public:
+  explicit ASTNode(NodeKind kind) : kind(kind) {}
   virtual ~ASTNode() = default;
   virtual std::string getNodeType() const = 0;
+  
+  const NodeKind kind;
 };
 
 // Expression nodes
 class ExpressionNode : public ASTNode {
 public:
+  explicit ExpressionNode(NodeKind kind) : ASTNode(kind) {}
   virtual ~ExpressionNode() = default;
+  
+  const TypeInfo* type = nullptr;  // Interned type, set by semantic analysis
+  ConstantValue constant;          // Folded value, set by semantic analysis
 };
 
 // Literal expression (numbers, strings, etc.)
 class LiteralNode : public ExpressionNode {
 public:
-  LiteralNode(const Token& token) : token(token) {}
+  LiteralNode(const Token& token) : ExpressionNode(NodeKind::LITERAL), token(token) {}
   virtual ~LiteralNode() = default;
   
   std::string getNodeType() const override { return "LiteralNode"; }
@@ -35,19 +78,20 @@ public:
 // Variable reference
 class VariableNode : public ExpressionNode {
 public:
-  VariableNode(const Token& name) : name(name) {}
+  VariableNode(const Token& name) : ExpressionNode(NodeKind::VARIABLE), name(name) {}
   virtual ~VariableNode() = default;
   
   std::string getNodeType() const override { return "VariableNode"; }
   
   Token name;
+  const SymbolInfo* symbol = nullptr;  // Resolved declaration, set by semantic analysis
 };
 
 // Unary operation
 class UnaryNode : public ExpressionNode {
 public:
   UnaryNode(const Token& op, std::unique_ptr<ExpressionNode> operand)
-      : op(op), operand(std::move(operand)) {}
+      : ExpressionNode(NodeKind::UNARY), op(op), operand(std::move(operand)) {}
   virtual ~UnaryNode() = default;
   
   std::string getNodeType() const override { return "UnaryNode"; }
@@ -60,7 +104,7 @@ public:
 class BinaryNode : public ExpressionNode {
 public:
   BinaryNode(std::unique_ptr<ExpressionNode> left, const Token& op, std::unique_ptr<ExpressionNode> right)
-      : left(std::move(left)), op(op), right(std::move(right)) {}
+      : ExpressionNode(NodeKind::BINARY), left(std::move(left)), op(op), right(std::move(right)) {}
   virtual ~BinaryNode() = default;
   
   std::string getNodeType() const override { return "BinaryNode"; }
@@ -74,7 +118,7 @@ public:
 class CallNode : public ExpressionNode {
 public:
   CallNode(std::unique_ptr<ExpressionNode> callee, std::vector<std::unique_ptr<ExpressionNode>> arguments)
-      : callee(std::move(callee)), arguments(std::move(arguments)) {}
+      : ExpressionNode(NodeKind::CALL), callee(std::move(callee)), arguments(std::move(arguments)) {}
   virtual ~CallNode() = default;
   
   std::string getNodeType() const override { return "CallNode"; }
@@ -87,7 +131,7 @@ public:
 class ArrayAccessNode : public ExpressionNode {
 public:
   ArrayAccessNode(std::unique_ptr<ExpressionNode> array, std::unique_ptr<ExpressionNode> index)
-      : array(std::move(array)), index(std::move(index)) {}
+      : ExpressionNode(NodeKind::ARRAY_ACCESS), array(std::move(array)), index(std::move(index)) {}
   virtual ~ArrayAccessNode() = default;
   
   std::string getNodeType() const override { return "ArrayAccessNode"; }
@@ -100,7 +144,7 @@ public:
 class MemberAccessNode : public ExpressionNode {
 public:
   MemberAccessNode(std::unique_ptr<ExpressionNode> object, const Token& op, const Token& member)
-      : object(std::move(object)), op(op), member(member) {}
+      : ExpressionNode(NodeKind::MEMBER_ACCESS), object(std::move(object)), op(op), member(member) {}
   virtual ~MemberAccessNode() = default;
   
   std::string getNodeType() const override { return "MemberAccessNode"; }
@@ -116,7 +160,7 @@ public:
   ConditionalNode(std::unique_ptr<ExpressionNode> condition, 
                   std::unique_ptr<ExpressionNode> trueExpr, 
                   std::unique_ptr<ExpressionNode> falseExpr)
-      : condition(std::move(condition)), 
+      : ExpressionNode(NodeKind::CONDITIONAL), condition(std::move(condition)), 
         trueExpr(std::move(trueExpr)), 
         falseExpr(std::move(falseExpr)) {}
   virtual ~ConditionalNode() = default;
@@ -132,10 +176,10 @@ public:
 class TypeNode : public ASTNode {
 public:
   TypeNode(const Token& name, bool isConst = false, bool isVolatile = false)
-      : name(name), isConst(isConst), isVolatile(isVolatile), isPointer(false), pointerLevel(0) {}
+      : ASTNode(NodeKind::TYPE), name(name), isConst(isConst), isVolatile(isVolatile), isPointer(false), pointerLevel(0) {}
   
   TypeNode(const Token& name, bool isConst, bool isVolatile, bool isPointer, int pointerLevel)
-      : name(name), isConst(isConst), isVolatile(isVolatile), isPointer(isPointer), pointerLevel(pointerLevel) {}
+      : ASTNode(NodeKind::TYPE), name(name), isConst(isConst), isVolatile(isVolatile), isPointer(isPointer), pointerLevel(pointerLevel) {}
   
   virtual ~TypeNode() = default;
   
@@ -151,6 +195,7 @@ public:
 // Statement nodes
 class StatementNode : public ASTNode {
 public:
+  explicit StatementNode(NodeKind kind) : ASTNode(kind) {}
   virtual ~StatementNode() = default;
 };
 
@@ -158,7 +203,7 @@ public:
 class ExpressionStatementNode : public StatementNode {
 public:
   ExpressionStatementNode(std::unique_ptr<ExpressionNode> expression)
-      : expression(std::move(expression)) {}
+      : StatementNode(NodeKind::EXPRESSION_STATEMENT), expression(std::move(expression)) {}
   virtual ~ExpressionStatementNode() = default;
   
   std::string getNodeType() const override { return "ExpressionStatementNode"; }
@@ -170,7 +215,7 @@ public:
 class BlockNode : public StatementNode {
 public:
   BlockNode(std::vector<std::unique_ptr<StatementNode>> statements)
-      : statements(std::move(statements)) {}
+      : StatementNode(NodeKind::BLOCK), statements(std::move(statements)) {}
   virtual ~BlockNode() = default;
   
   std::string getNodeType() const override { return "BlockNode"; }
@@ -183,7 +228,7 @@ class VariableDeclarationNode : public StatementNode {
 public:
   VariableDeclarationNode(std::unique_ptr<TypeNode> type, const Token& name, 
                         std::unique_ptr<ExpressionNode> initializer = nullptr)
-      : type(std::move(type)), name(name), initializer(std::move(initializer)) {}
+      : StatementNode(NodeKind::VARIABLE_DECLARATION), type(std::move(type)), name(name), initializer(std::move(initializer)) {}
   virtual ~VariableDeclarationNode() = default;
   
   std::string getNodeType() const override { return "VariableDeclarationNode"; }
@@ -191,6 +236,7 @@ public:
   std::unique_ptr<TypeNode> type;
   Token name;
   std::unique_ptr<ExpressionNode> initializer;
+  const SymbolInfo* symbol = nullptr;  // Declared symbol, set by semantic analysis
 };
 
 // If statement
@@ -198,7 +244,7 @@ class IfNode : public StatementNode {
 public:
   IfNode(std::unique_ptr<ExpressionNode> condition, std::unique_ptr<StatementNode> thenBranch,
         std::unique_ptr<StatementNode> elseBranch = nullptr)
-      : condition(std::move(condition)), thenBranch(std::move(thenBranch)), elseBranch(std::move(elseBranch)) {}
+      : StatementNode(NodeKind::IF), condition(std::move(condition)), thenBranch(std::move(thenBranch)), elseBranch(std::move(elseBranch)) {}
   virtual ~IfNode() = default;
   
   std::string getNodeType() const override { return "IfNode"; }
@@ -212,7 +258,7 @@ public:
 class WhileNode : public StatementNode {
 public:
   WhileNode(std::unique_ptr<ExpressionNode> condition, std::unique_ptr<StatementNode> body)
-      : condition(std::move(condition)), body(std::move(body)) {}
+      : StatementNode(NodeKind::WHILE), condition(std::move(condition)), body(std::move(body)) {}
   virtual ~WhileNode() = default;
   
   std::string getNodeType() const override { return "WhileNode"; }
@@ -225,7 +271,7 @@ public:
 class DoWhileNode : public StatementNode {
 public:
   DoWhileNode(std::unique_ptr<StatementNode> body, std::unique_ptr<ExpressionNode> condition)
-      : body(std::move(body)), condition(std::move(condition)) {}
+      : StatementNode(NodeKind::DO_WHILE), body(std::move(body)), condition(std::move(condition)) {}
   virtual ~DoWhileNode() = default;
   
   std::string getNodeType() const override { return "DoWhileNode"; }
@@ -239,7 +285,7 @@ class ForNode : public StatementNode {
 public:
   ForNode(std::unique_ptr<StatementNode> initializer, std::unique_ptr<ExpressionNode> condition,
           std::unique_ptr<ExpressionNode> increment, std::unique_ptr<StatementNode> body)
-      : initializer(std::move(initializer)), condition(std::move(condition)), 
+      : StatementNode(NodeKind::FOR), initializer(std::move(initializer)), condition(std::move(condition)), 
         increment(std::move(increment)), body(std::move(body)) {}
   virtual ~ForNode() = default;
   
@@ -255,7 +301,7 @@ public:
 class ReturnNode : public StatementNode {
 public:
   ReturnNode(std::unique_ptr<ExpressionNode> value = nullptr)
-      : value(std::move(value)) {}
+      : StatementNode(NodeKind::RETURN), value(std::move(value)) {}
   virtual ~ReturnNode() = default;
   
   std::string getNodeType() const override { return "ReturnNode"; }
@@ -266,7 +312,7 @@ public:
 // Break statement
 class BreakNode : public StatementNode {
 public:
-  BreakNode() {}
+  BreakNode() : StatementNode(NodeKind::BREAK) {}
   virtual ~BreakNode() = default;
   
   std::string getNodeType() const override { return "BreakNode"; }
@@ -275,7 +321,7 @@ public:
 // Continue statement
 class ContinueNode : public StatementNode {
 public:
-  ContinueNode() {}
+  ContinueNode() : StatementNode(NodeKind::CONTINUE) {}
   virtual ~ContinueNode() = default;
   
   std::string getNodeType() const override { return "ContinueNode"; }
@@ -285,13 +331,14 @@ public:
 class ParameterNode : public ASTNode {
 public:
   ParameterNode(std::unique_ptr<TypeNode> type, const Token& name)
-      : type(std::move(type)), name(name) {}
+      : ASTNode(NodeKind::PARAMETER), type(std::move(type)), name(name) {}
   virtual ~ParameterNode() = default;
   
   std::string getNodeType() const override { return "ParameterNode"; }
   
   std::unique_ptr<TypeNode> type;
   Token name;
+  const SymbolInfo* symbol = nullptr;  // Declared symbol, set by semantic analysis
 };
 
 // Function declaration
@@ -300,7 +347,7 @@ public:
   FunctionDeclarationNode(std::unique_ptr<TypeNode> returnType, const Token& name,
                         std::vector<std::unique_ptr<ParameterNode>> parameters,
                         std::unique_ptr<BlockNode> body = nullptr)
-      : returnType(std::move(returnType)), name(name), 
+      : ASTNode(NodeKind::FUNCTION_DECLARATION), returnType(std::move(returnType)), name(name), 
         parameters(std::move(parameters)), body(std::move(body)) {}
   virtual ~FunctionDeclarationNode() = default;
   
@@ -310,13 +357,14 @@ public:
   Token name;
   std::vector<std::unique_ptr<ParameterNode>> parameters;
   std::unique_ptr<BlockNode> body;
+  const SymbolInfo* symbol = nullptr;  // Declared symbol, set by semantic analysis
 };
 
 // Program node (top-level)
 class ProgramNode : public ASTNode {
 public:
   ProgramNode(std::vector<std::unique_ptr<ASTNode>> declarations)
-      : declarations(std::move(declarations)) {}
+      : ASTNode(NodeKind::PROGRAM), declarations(std::move(declarations)) {}
   virtual ~ProgramNode() = default;
   
   std::string getNodeType() const override { return "ProgramNode"; }
@@ -0,0 +1,284 @@
+#ifndef CCC_AST_VISITOR_H
+#define CCC_AST_VISITOR_H
+
+#include "ast.h"
+
+namespace ccc {
+
+// Statically dispatched AST visitor (CRTP)
+//
+// A pass derives from ASTVisitor<Pass, ExprResult> and defines the visitX
+// hooks it cares about. Dispatch switches on ASTNode::kind and calls the
+// hook on the derived class directly, so there is no virtual call or
+// getNodeType() string compare per node and the hooks can be inlined.
+// Hooks the pass does not define fall back to the defaults below, which
+// walk the node's children. A pass that overrides a hook and still wants
+// the default walk calls ASTVisitor::visitX(node) explicitly.
+//
+// ExprResult is the value produced by expression hooks (void when the pass
+// only walks the tree). Calling stopTraversal() makes the default walks
+// return without visiting any further nodes.
+//
+// Hooks may be private in the derived class as long as it befriends its
+// ASTVisitor base.
+template <typename Derived, typename ExprResult = void>
+class ASTVisitor {
+public:
+  // Dispatch any node to the matching hook
+  void visit(ASTNode* node) {
+      if (!node || stopped) return;
+
+      switch (node->kind) {
+          case NodeKind::LITERAL:
+          case NodeKind::VARIABLE:
+          case NodeKind::UNARY:
+          case NodeKind::BINARY:
+          case NodeKind::CALL:
+          case NodeKind::ARRAY_ACCESS:
+          case NodeKind::MEMBER_ACCESS:
+          case NodeKind::CONDITIONAL:
+              derived().visitExpression(static_cast<ExpressionNode*>(node));
+              break;
+          case NodeKind::TYPE:
+              derived().visitType(static_cast<TypeNode*>(node));
+              break;
+          case NodeKind::PARAMETER:
+              derived().visitParameter(static_cast<ParameterNode*>(node));
+              break;
+          case NodeKind::FUNCTION_DECLARATION:
+              derived().visitFunctionDeclaration(static_cast<FunctionDeclarationNode*>(node));
+              break;
+          case NodeKind::PROGRAM:
+              derived().visitProgram(static_cast<ProgramNode*>(node));
+              break;
+          default:
+              derived().visitStatement(static_cast<StatementNode*>(node));
+              break;
+      }
+  }
+
+  // Dispatch a statement to the matching hook
+  void visitStatement(StatementNode* node) {
+      if (!node || stopped) return;
+
+      switch (node->kind) {
+          case NodeKind::EXPRESSION_STATEMENT:
+              derived().visitExpressionStatement(static_cast<ExpressionStatementNode*>(node));
+              break;
+          case NodeKind::BLOCK:
+              derived().visitBlock(static_cast<BlockNode*>(node));
+              break;
+          case NodeKind::VARIABLE_DECLARATION:
+              derived().visitVariableDeclaration(static_cast<VariableDeclarationNode*>(node));
+              break;
+          case NodeKind::IF:
+              derived().visitIfStatement(static_cast<IfNode*>(node));
+              break;
+          case NodeKind::WHILE:
+              derived().visitWhileStatement(static_cast<WhileNode*>(node));
+              break;
+          case NodeKind::DO_WHILE:
+              derived().visitDoWhileStatement(static_cast<DoWhileNode*>(node));
+              break;
+          case NodeKind::FOR:
+              derived().visitForStatement(static_cast<ForNode*>(node));
+              break;
+          case NodeKind::RETURN:
+              derived().visitReturnStatement(static_cast<ReturnNode*>(node));
+              break;
+          case NodeKind::BREAK:
+              derived().visitBreakStatement(static_cast<BreakNode*>(node));
+              break;
+          case NodeKind::CONTINUE:
+              derived().visitContinueStatement(static_cast<ContinueNode*>(node));
+              break;
+          default:
+              derived().visitInvalidStatement(node);
+              break;
+      }
+  }
+
+  // Dispatch an expression to the matching hook
+  ExprResult visitExpression(ExpressionNode* node) {
+      if (!node) {
+          return derived().visitInvalidExpression(node);
+      }
+
+      switch (node->kind) {
+          case NodeKind::LITERAL:
+              return derived().visitLiteral(static_cast<LiteralNode*>(node));
+          case NodeKind::VARIABLE:
+              return derived().visitVariable(static_cast<VariableNode*>(node));
+          case NodeKind::UNARY:
+              return derived().visitUnary(static_cast<UnaryNode*>(node));
+          case NodeKind::BINARY:
+              return derived().visitBinary(static_cast<BinaryNode*>(node));
+          case NodeKind::CALL:
+              return derived().visitCall(static_cast<CallNode*>(node));
+          case NodeKind::ARRAY_ACCESS:
+              return derived().visitArrayAccess(static_cast<ArrayAccessNode*>(node));
+          case NodeKind::MEMBER_ACCESS:
+              return derived().visitMemberAccess(static_cast<MemberAccessNode*>(node));
+          case NodeKind::CONDITIONAL:
+              return derived().visitConditional(static_cast<ConditionalNode*>(node));
+          default:
+              return derived().visitInvalidExpression(node);
+      }
+  }
+
+  // Early exit
+  void stopTraversal() { stopped = true; }
+  bool traversalStopped() const { return stopped; }
+  void resetTraversal() { stopped = false; }
+
+  // Default hooks: declarations
+  void visitProgram(ProgramNode* node) {
+      for (const auto& declaration : node->declarations) {
+          if (stopped) return;
+          derived().visit(declaration.get());
+      }
+  }
+
+  void visitFunctionDeclaration(FunctionDeclarationNode* node) {
+      derived().visitType(node->returnType.get());
+      for (const auto& param : node->parameters) {
+          if (stopped) return;
+          derived().visitParameter(param.get());
+      }
+      if (node->body && !stopped) {
+          derived().visitBlock(node->body.get());
+      }
+  }
+
+  void visitParameter(ParameterNode* node) {
+      derived().visitType(node->type.get());
+  }
+
+  void visitType(TypeNode*) {}
+
+  // Default hooks: statements
+  void visitVariableDeclaration(VariableDeclarationNode* node) {
+      derived().visitType(node->type.get());
+      if (node->initializer && !stopped) {
+          derived().visitExpression(node->initializer.get());
+      }
+  }
+
+  void visitBlock(BlockNode* node) {
+      for (const auto& statement : node->statements) {
+          if (stopped) return;
+          derived().visitStatement(statement.get());
+      }
+  }
+
+  void visitExpressionStatement(ExpressionStatementNode* node) {
+      derived().visitExpression(node->expression.get());
+  }
+
+  void visitIfStatement(IfNode* node) {
+      derived().visitExpression(node->condition.get());
+      derived().visitStatement(node->thenBranch.get());
+      derived().visitStatement(node->elseBranch.get());
+  }
+
+  void visitWhileStatement(WhileNode* node) {
+      derived().visitExpression(node->condition.get());
+      derived().visitStatement(node->body.get());
+  }
+
+  void visitDoWhileStatement(DoWhileNode* node) {
+      derived().visitStatement(node->body.get());
+      if (stopped) return;
+      derived().visitExpression(node->condition.get());
+  }
+
+  void visitForStatement(ForNode* node) {
+      derived().visitStatement(node->initializer.get());
+      if (node->condition && !stopped) {
+          derived().visitExpression(node->condition.get());
+      }
+      if (node->increment && !stopped) {
+          derived().visitExpression(node->increment.get());
+      }
+      derived().visitStatement(node->body.get());
+  }
+
+  void visitReturnStatement(ReturnNode* node) {
+      if (node->value) {
+          derived().visitExpression(node->value.get());
+      }
+  }
+
+  void visitBreakStatement(BreakNode*) {}
+  void visitContinueStatement(ContinueNode*) {}
+  void visitInvalidStatement(StatementNode*) {}
+
+  // Default hooks: expressions
+  ExprResult visitLiteral(LiteralNode*) {
+      return ExprResult();
+  }
+
+  ExprResult visitVariable(VariableNode*) {
+      return ExprResult();
+  }
+
+  ExprResult visitUnary(UnaryNode* node) {
+      derived().visitExpression(node->operand.get());
+      return ExprResult();
+  }
+
+  ExprResult visitBinary(BinaryNode* node) {
+      derived().visitExpression(node->left.get());
+      if (!stopped) {
+          derived().visitExpression(node->right.get());
+      }
+      return ExprResult();
+  }
+
+  ExprResult visitCall(CallNode* node) {
+      derived().visitExpression(node->callee.get());
+      for (const auto& argument : node->arguments) {
+          if (stopped) break;
+          derived().visitExpression(argument.get());
+      }
+      return ExprResult();
+  }
+
+  ExprResult visitArrayAccess(ArrayAccessNode* node) {
+      derived().visitExpression(node->array.get());
+      if (!stopped) {
+          derived().visitExpression(node->index.get());
+      }
+      return ExprResult();
+  }
+
+  ExprResult visitMemberAccess(MemberAccessNode* node) {
+      derived().visitExpression(node->object.get());
+      return ExprResult();
+  }
+
+  ExprResult visitConditional(ConditionalNode* node) {
+      derived().visitExpression(node->condition.get());
+      if (!stopped) {
+          derived().visitExpression(node->trueExpr.get());
+      }
+      if (!stopped) {
+          derived().visitExpression(node->falseExpr.get());
+      }
+      return ExprResult();
+  }
+
+  // Called for a null expression or a node that is not an expression
+  ExprResult visitInvalidExpression(ExpressionNode*) {
+      return ExprResult();
+  }
+
+protected:
+  Derived& derived() { return *static_cast<Derived*>(this); }
+
+  bool stopped = false;
+};
+
+} // namespace ccc
+
+#endif // CCC_AST_VISITOR_H
@@ -5,33 +5,40 @@
 #include <vector>
 #include <unordered_map>
 #include <memory>
-#include <stack>
+#include <ostream>
 #include "ast.h"
 #include "error.h"
+#include "ir.h"
+#include "peephole.h"
 #include "coil/binary_format.h"
 #include "coil/instruction_set.h"
 #include "coil/type_system.h"
 
 namespace ccc {
 
-// Represents a variable during code generation
-struct Variable {
-  std::string name;
-  uint16_t varId;  // COIL variable ID
-  uint16_t type;   // COIL type
-  
-  Variable(const std::string& name, uint16_t varId, uint16_t type)
-      : name(name), varId(varId), type(type) {}
-};
-
 // Code generator class
+//
+// Builds SSA IR from the annotated AST and lowers each function to COIL.
+// SSA values are assigned COIL variables by liveness (values never live at
+// the same time share one), declared at function entry; phis become copies
+// at the end of their predecessors.
 class CodeGenerator {
 public:
   CodeGenerator(int optimizationLevel, ErrorHandler& errorHandler);
-  
+
   // Generate COIL code from AST
   coil::CoilObject generate(ASTNode* root);
-  
+
+  // Print the IR of each function to out before it is lowered
+  void setIRDump(std::ostream* out) { irDump = out; }
+
+  // Report the optimizer's decisions (inlining and the like) to out
+  void setRemarks(std::ostream* out) { remarks = out; }
+
+  // Let the optimizer regroup floating-point arithmetic (reductions), which
+  // may change how results round
+  void setRelaxedMath(bool relaxed) { relaxedMath = relaxed; }
+
 private:
   // State for code generation
   int optimizationLevel;
@@ -40,68 +47,91 @@ private:
   uint16_t textSectionIndex;
   uint16_t dataSectionIndex;
   uint16_t bssSectionIndex;
-  
-  // Variable tracking
-  std::unordered_map<std::string, Variable> variables;
+  std::ostream* irDump;
+  std::ostream* remarks;
+  bool relaxedMath;
+
+  // COIL variable ids of the current function's values, and labels of its blocks
+  std::unordered_map<const ir::Value*, uint16_t> valueVariables;
+  std::unordered_map<const ir::BasicBlock*, std::string> blockLabels;
   uint16_t nextVarId;
-  
-  // Stack of active scopes for nested blocks
-  std::stack<std::vector<std::string>> scopeStack;
-  
-  // Current function context
-  std::string currentFunction;
-  
+
+  // Temporaries used within the lowering of one instruction; they are
+  // released after it and reused by the next. Element variables are the
+  // ones INDEX binds to memory: a MOV into one stores, so they are only
+  // ever reused by another INDEX, never as plain temporaries. All are
+  // declared with the function's other variables once it is lowered.
+  struct ScratchVariable {
+      uint16_t varId;
+      ir::Type type;
+      bool element;
+      bool busy;
+  };
+  std::vector<ScratchVariable> scratchVariables;
+
+  // Set when the function being lowered needs more variables than COIL
+  // ids exist; its code is then dropped
+  bool outOfVariables;
+
   // Control flow labels
   int labelCounter;
   
+  // Instructions emitted since the last flush: those of the function being
+  // lowered, which the peephole optimizer sees before they go into the object
+  std::vector<MachineInstruction> pendingInstructions;
+
   // Initialize COIL object (create sections, etc.)
   void initialize();
-  
+
   // Generate various parts of the program
-  void generateProgram(ProgramNode* node);
-  void generateFunctionDeclaration(FunctionDeclarationNode* node);
-  void generateVariableDeclaration(VariableDeclarationNode* node, bool isGlobal = false);
-  void generateBlock(BlockNode* node);
-  void generateStatement(StatementNode* node);
-  void generateExpressionStatement(ExpressionStatementNode* node);
-  void generateIfStatement(IfNode* node);
-  void generateWhileStatement(WhileNode* node);
-  void generateDoWhileStatement(DoWhileNode* node);
-  void generateForStatement(ForNode* node);
-  void generateReturnStatement(ReturnNode* node);
-  void generateBreakStatement(BreakNode* node);
-  void generateContinueStatement(ContinueNode* node);
-  
-  // Expression generation
-  uint16_t generateExpression(ExpressionNode* node);
-  uint16_t generateLiteral(LiteralNode* node);
-  uint16_t generateVariable(VariableNode* node);
-  uint16_t generateUnary(UnaryNode* node);
-  uint16_t generateBinary(BinaryNode* node);
-  uint16_t generateCall(CallNode* node);
-  uint16_t generateArrayAccess(ArrayAccessNode* node);
-  uint16_t generateMemberAccess(MemberAccessNode* node);
-  uint16_t generateConditional(ConditionalNode* node);
+  void generateGlobalVariable(VariableDeclarationNode* node);
+  void lowerFunction(ir::Function& function);
+  void lowerInstruction(const ir::Instruction& instruction);
+  void lowerTerminator(const ir::Instruction& terminator, const ir::BasicBlock* next);
+  void lowerPhiCopies(const ir::BasicBlock* from, const ir::BasicBlock* to);
   
+  // A comparison only the CONDBR or SELECT right after it uses is not
+  // lowered by itself: that compares its operands and tests the flags
+  bool isFusedComparison(const ir::Instruction& instruction) const;
+
+  // A tail call passing the caller's own parameters on unchanged, in
+  // order, is lowered to a BR to the callee: the callee reads the same
+  // parameters and returns straight to our caller. Other tail calls stay
+  // CALLs: COIL passes arguments only through the operands of CALL (the
+  // ABI's PARAM slots can be read, not written), so a jump cannot hand
+  // the callee values of its own.
+  bool isSiblingTailCall(const ir::Instruction& instruction) const;
+
+  // Operand for a value: the variable holding it, or an immediate for a
+  // constant (symbols are used directly for call targets)
+  MachineOperand valueOperand(const ir::Value* value);
+  MachineOperand immediateOperand(const ir::Constant* constant);
+
+  // Operand for one lane of a vector value, addressed through laneVarId
+  // (an element variable created on first use); the value itself when it
+  // is not a vector
+  MachineOperand laneOperand(const ir::Value* value, unsigned lane, uint16_t& laneVarId);
+
   // Helper methods
   uint16_t getNextVarId() { return nextVarId++; }
-  uint16_t createTempVar(uint16_t type);
-  uint16_t translateType(TypeNode* typeNode);
+  uint16_t createTempVar(ir::Type type, bool element = false);
+  uint16_t createElementVar(ir::Type type) { return createTempVar(type, true); }
+  void releaseTempVars();
+  uint16_t translateType(ir::Type type);
   std::string generateLabel(const std::string& prefix);
   uint16_t addSymbol(const std::string& name, uint32_t attributes = 0, uint16_t sectionIndex = 0);
-  void enterScope();
-  void leaveScope();
-  
+
   // Emit COIL instructions
-  void emitInstruction(uint8_t opcode, const std::vector<coil::Operand>& operands);
+  void emitInstruction(uint8_t opcode, const std::vector<MachineOperand>& operands);
+  void flushInstructions();
   void emitScopeEnter();
   void emitScopeLeave();
-  void emitVarDeclaration(uint16_t varId, uint16_t type, uint16_t initializer = 0);
+  void emitVarDeclaration(uint16_t varId, ir::Type type, uint16_t initializer = 0);
   void emitLabel(const std::string& label);
   void emitJump(const std::string& label);
-  void emitConditionalJump(const std::string& label, const std::string& condition);
+  void emitConditionalJump(const std::string& label, uint8_t condition);
 };
 
 } // namespace ccc
 
-#endif // CCC_CODEGEN_H
\ No newline at end of file
+#endif // CCC_CODEGEN_H
@@ -0,0 +1,87 @@
+#ifndef CCC_CONSTANT_H
+#define CCC_CONSTANT_H
+
+#include <cstdint>
+
+namespace ccc {
+
+class ErrorHandler;
+class ExpressionNode;
+class LiteralNode;
+class UnaryNode;
+class BinaryNode;
+class ConditionalNode;
+struct TypeInfo;
+
+// Folded value of a constant expression
+//
+// Integer values are stored sign-extended in 64 bits and already wrapped to
+// the width of the expression's type; floating values are already rounded
+// to float when the expression has type float.
+struct ConstantValue {
+  enum class Kind {
+      NONE,       // Not a constant expression
+      INTEGER,
+      FLOATING
+  };
+
+  Kind kind = Kind::NONE;
+  int64_t integer = 0;
+  double floating = 0.0;
+
+  static ConstantValue makeInteger(int64_t value) {
+      ConstantValue result;
+      result.kind = Kind::INTEGER;
+      result.integer = value;
+      return result;
+  }
+
+  static ConstantValue makeFloating(double value) {
+      ConstantValue result;
+      result.kind = Kind::FLOATING;
+      result.floating = value;
+      return result;
+  }
+
+  bool isConstant() const { return kind != Kind::NONE; }
+  bool isInteger() const { return kind == Kind::INTEGER; }
+  bool isFloating() const { return kind == Kind::FLOATING; }
+
+  // Truth value as used by conditions (only meaningful for constants)
+  bool isTrue() const { return isInteger() ? integer != 0 : floating != 0.0; }
+};
+
+// Folds constant expressions following C's arithmetic rules
+//
+// evaluate() folds a single node from the annotations already recorded on
+// its operands, so running it bottom-up (as SemanticAnalyzer does) folds
+// whole subtrees without re-walking them. Operands are converted to the
+// node's type, which semantic analysis has already derived through the
+// integer promotions and usual arithmetic conversions. Signed overflow,
+// division by zero and out-of-range shifts are reported as warnings; an
+// overflowing result is still folded (wrapped), the other two are not.
+class ConstantEvaluator {
+public:
+  explicit ConstantEvaluator(ErrorHandler& errorHandler);
+
+  // Fold one expression node; returns a NONE value if it is not constant
+  ConstantValue evaluate(ExpressionNode* node);
+
+  // Convert a value to a scalar type (reports out-of-range float to integer)
+  ConstantValue convert(const ConstantValue& value, const TypeInfo* type, int line = 0, int column = 0);
+
+private:
+  ErrorHandler& errorHandler;
+
+  ConstantValue evaluateLiteral(LiteralNode* node);
+  ConstantValue evaluateUnary(UnaryNode* node);
+  ConstantValue evaluateBinary(BinaryNode* node);
+  ConstantValue evaluateConditional(ConditionalNode* node);
+
+  // Wrap an exact integer result to the width of type, warning if it changed
+  ConstantValue wrapInteger(int64_t value, const TypeInfo* type, int line, int column);
+};
+
+} // namespace ccc
+
+#endif // CCC_CONSTANT_H
@@ -0,0 +1,217 @@
+#ifndef CCC_DATAFLOW_H
+#define CCC_DATAFLOW_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "analysis.h"
+#include "ir.h"
+
+namespace ccc {
+namespace ir {
+
+// Fixed-size dense bit vector
+//
+// Set operations work a 64-bit word at a time in plain loops the compiler
+// vectorizes, so a dataflow step over thousands of facts is a few hundred
+// word operations.
+class BitVector {
+public:
+  static constexpr size_t NPOS = SIZE_MAX;
+
+  BitVector() = default;
+  explicit BitVector(size_t size, bool value = false);
+
+  size_t size() const { return bits; }
+
+  bool test(size_t i) const { return (words[i / 64] >> (i % 64)) & 1; }
+  void set(size_t i) { words[i / 64] |= uint64_t(1) << (i % 64); }
+  void reset(size_t i) { words[i / 64] &= ~(uint64_t(1) << (i % 64)); }
+  void setAll();
+  void clear();
+
+  bool any() const;
+  size_t count() const;
+
+  // In-place set operations; each returns whether this vector changed
+  bool unionWith(const BitVector& other);
+  bool intersectWith(const BitVector& other);
+  bool subtract(const BitVector& other);
+
+  // this = gen | (in & ~kill), the transfer function of gen/kill problems
+  bool assignTransfer(const BitVector& gen, const BitVector& in, const BitVector& kill);
+
+  // First set bit at or after from, or NPOS
+  size_t findNext(size_t from) const;
+
+  template <typename Function>
+  void forEach(Function function) const {
+      for (size_t w = 0; w < words.size(); w++) {
+          uint64_t word = words[w];
+          while (word) {
+              function(w * 64 + __builtin_ctzll(word));
+              word &= word - 1;
+          }
+      }
+  }
+
+  bool operator==(const BitVector& other) const { return bits == other.bits && words == other.words; }
+  bool operator!=(const BitVector& other) const { return !(*this == other); }
+
+private:
+  size_t bits = 0;
+  std::vector<uint64_t> words;
+
+  void clearUnusedBits();
+};
+
+// A gen/kill dataflow problem over the blocks of a CFG
+//
+// Facts are bit positions. Each block transforms its incoming facts as
+// gen | (in & ~kill); facts from several neighbours are combined by union
+// (may problems) or intersection (must problems).
+struct DataflowProblem {
+  enum class Direction {
+      FORWARD,
+      BACKWARD
+  };
+
+  enum class Meet {
+      UNION,
+      INTERSECTION
+  };
+
+  Direction direction = Direction::FORWARD;
+  Meet meet = Meet::UNION;
+  size_t facts = 0;
+
+  // Per CFG number
+  std::vector<BitVector> gen;
+  std::vector<BitVector> kill;
+
+  // Facts at function entry (forward) or at the RET blocks (backward)
+  BitVector boundary;
+};
+
+// Facts at the start (in) and end (out) of each block, by CFG number
+struct DataflowResult {
+  std::vector<BitVector> in;
+  std::vector<BitVector> out;
+};
+
+// Solve a problem to its fixpoint with a worklist visited in reverse
+// postorder (forward) or postorder (backward), so acyclic regions settle in
+// one sweep and each loop adds about one more
+DataflowResult solve(const CFG& cfg, const DataflowProblem& problem);
+
+// Memory accesses address base[index] (LOAD base, index; STORE base,
+// index, value), and the elements after it for vector accesses. Two
+// accesses must alias when they use the same base and index values and are
+// as wide, and cannot alias when they share a base and constant indices
+// whose elements do not overlap. Pointers are not tracked, so anything else
+// may alias.
+bool mustAlias(const Instruction* a, const Instruction* b);
+bool mayAlias(const Instruction* a, const Instruction* b);
+
+// Live SSA values
+//
+// A value is live where a later use may still read it. Phi operands are
+// used on the edge from their incoming block: they are live at the end of
+// that block, not at the start of the phi's block, and phis are defined at
+// the start of their block, so liveIn never contains a block's own phis.
+class Liveness {
+public:
+  explicit Liveness(const CFG& cfg);
+
+  // Dense numbering of the instructions that produce values
+  size_t size() const { return values.size(); }
+  unsigned index(const Value* value) const;
+  Instruction* value(unsigned index) const { return values[index]; }
+
+  const BitVector& liveIn(const BasicBlock* block) const { return result.in[cfg.index(block)]; }
+  const BitVector& liveOut(const BasicBlock* block) const { return result.out[cfg.index(block)]; }
+
+  bool isLiveIn(const Value* value, const BasicBlock* block) const;
+  bool isLiveOut(const Value* value, const BasicBlock* block) const;
+
+private:
+  const CFG& cfg;
+  std::vector<Instruction*> values;
+  std::unordered_map<const Value*, unsigned> numbers;
+  DataflowResult result;
+};
+
+// Reaching definitions of memory
+//
+// Registers are SSA values with one definition each, so the definitions
+// tracked are the instructions that write memory: stores, and calls, which
+// may write anything. A store stops the stores to the same location from
+// reaching further.
+class ReachingDefinitions {
+public:
+  explicit ReachingDefinitions(const CFG& cfg);
+
+  size_t size() const { return definitions.size(); }
+  unsigned index(const Instruction* definition) const;
+  Instruction* definition(unsigned index) const { return definitions[index]; }
+
+  const BitVector& reachingIn(const BasicBlock* block) const { return result.in[cfg.index(block)]; }
+  const BitVector& reachingOut(const BasicBlock* block) const { return result.out[cfg.index(block)]; }
+
+  // Definitions reaching the point just before position
+  BitVector reachingBefore(const Instruction* position) const;
+
+private:
+  const CFG& cfg;
+  std::vector<Instruction*> definitions;
+  std::unordered_map<const Instruction*, unsigned> numbers;
+
+  // Stores each definition overwrites (same location)
+  std::vector<BitVector> overwrites;
+  DataflowResult result;
+
+  void step(BitVector& facts, const Instruction* instruction) const;
+};
+
+// Available expressions
+//
+// An expression is an opcode applied to operands; instructions computing
+// the same opcode on the same operands share one. Arithmetic and
+// comparisons of SSA values stay valid once computed; loads become
+// unavailable at stores that may alias them and at calls.
+class AvailableExpressions {
+public:
+  static constexpr unsigned NONE = UINT32_MAX;
+
+  explicit AvailableExpressions(const CFG& cfg);
+
+  size_t size() const { return expressions.size(); }
+
+  // Expression an instruction computes, or NONE
+  unsigned expressionOf(const Instruction* instruction) const;
+
+  // First instruction seen computing an expression
+  Instruction* representative(unsigned expression) const { return expressions[expression]; }
+
+  const BitVector& availableIn(const BasicBlock* block) const { return result.in[cfg.index(block)]; }
+  const BitVector& availableOut(const BasicBlock* block) const { return result.out[cfg.index(block)]; }
+
+  // Whether expression has been computed on every path to just before position
+  bool isAvailable(unsigned expression, const Instruction* position) const;
+
+private:
+  const CFG& cfg;
+  std::vector<Instruction*> expressions;
+  std::unordered_map<const Instruction*, unsigned> numbers;
+  std::vector<unsigned> loads;
+  DataflowResult result;
+
+  bool clobbers(const Instruction* write, unsigned load) const;
+  void step(BitVector& facts, const Instruction* instruction) const;
+};
+
+} // namespace ir
+} // namespace ccc
+
+#endif // CCC_DATAFLOW_H
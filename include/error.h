@@ -117,6 +117,18 @@ public:
       return count;
   }
   
+  // Append the entries of another handler (e.g. a per-thread buffer),
+  // stamping entries without a filename with this handler's current file
+  void append(const ErrorHandler& other) {
+      for (const auto& error : other.errors) {
+          errors.push_back(error);
+          if (errors.back().filename.empty()) {
+              errors.back().filename = currentFilename;
+          }
+      }
+      hadError = hadError || other.hadError;
+  }
+  
   // Clear all errors
   void clear() {
       errors.clear();
@@ -0,0 +1,374 @@
+#ifndef CCC_IR_H
+#define CCC_IR_H
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ccc {
+namespace ir {
+
+// Mid-level SSA IR
+//
+// Each function is a list of basic blocks. Every block ends in exactly one
+// terminator (BR, CONDBR or RET) and starts with its phi nodes. Values are
+// instructions, constants or undef; each instruction that produces a value
+// is assigned exactly once, and every value knows the instructions that use
+// it so passes can rewrite uses in place. The IR is built from the
+// annotated AST by IRBuilder, optimized, and lowered to COIL by
+// CodeGenerator.
+
+class Instruction;
+class BasicBlock;
+class Function;
+
+// Machine-level value types (mirroring the COIL types we emit)
+enum class Type {
+  VOID,
+  I8,
+  I32,
+  F32,
+  F64,
+  PTR,
+
+  // Four 32-bit lanes, operated on all at once
+  V4I32,
+  V4F32
+};
+
+inline bool isIntegerType(Type type) { return type == Type::I8 || type == Type::I32; }
+inline bool isFloatType(Type type) { return type == Type::F32 || type == Type::F64; }
+inline bool isVectorType(Type type) { return type == Type::V4I32 || type == Type::V4F32; }
+
+// Lanes of a value of the type (1 for scalars) and the type of each lane
+inline unsigned laneCount(Type type) { return isVectorType(type) ? 4 : 1; }
+inline Type laneType(Type type) {
+  switch (type) {
+      case Type::V4I32: return Type::I32;
+      case Type::V4F32: return Type::F32;
+      default:          return type;
+  }
+}
+
+// Vector of lanes of the given type; VOID when there is none
+inline Type vectorType(Type lane) {
+  switch (lane) {
+      case Type::I32: return Type::V4I32;
+      case Type::F32: return Type::V4F32;
+      default:        return Type::VOID;
+  }
+}
+
+const char* typeName(Type type);
+
+enum class Opcode {
+  // Arithmetic and bitwise; NEG and NOT take one operand, the rest two
+  ADD,
+  SUB,
+  MUL,
+  DIV,
+  MOD,
+  NEG,
+  NOT,
+  AND,
+  OR,
+  XOR,
+  SHL,
+  SHR,
+
+  // Conversions of their one operand to the instruction's type: SEXT
+  // widens an integer and TRUNC narrows one, SITOFP and FPTOSI convert
+  // between (signed) integers and floating point, rounding toward zero,
+  // and FPEXT and FPTRUNC between float and double
+  SEXT,
+  TRUNC,
+  SITOFP,
+  FPTOSI,
+  FPEXT,
+  FPTRUNC,
+
+  // Comparisons; the result is an I32 0 or 1
+  CMP_EQ,
+  CMP_NE,
+  CMP_LT,
+  CMP_LE,
+  CMP_GT,
+  CMP_GE,
+
+  // SELECT condition, a, b -> a when condition is not 0, b otherwise;
+  // with vector operands lane by lane (the condition a V4I32 of 0 and 1)
+  SELECT,
+
+  // Memory: LOAD base, index -> element; STORE base, index, value. With a
+  // vector type they access that many consecutive elements from index on.
+  // ADDR base, index, size -> address of element index, size bytes each
+  LOAD,
+  STORE,
+  ADDR,
+
+  // Vectors: SPLAT value -> value in every lane; EXTRACT vector, lane ->
+  // the lane (a constant)
+  SPLAT,
+  EXTRACT,
+
+  // PARAM reads incoming argument `index`; CALL calls `callee` with the operands
+  PARAM,
+  CALL,
+
+  // One operand per entry in `blocks`, the value flowing in from that block
+  PHI,
+
+  // Terminators: BR blocks[0]; CONDBR operand, blocks[0] (true), blocks[1]
+  // (false); RET with an optional operand
+  BR,
+  CONDBR,
+  RET
+};
+
+const char* opcodeName(Opcode opcode);
+
+// Opcode converting a value of type from to type to, two different
+// integer or floating-point types
+Opcode conversionOpcode(Type from, Type to);
+
+// Base of everything that can be an instruction operand
+class Value {
+public:
+  enum class Kind {
+      CONSTANT,
+      UNDEF,
+      INSTRUCTION
+  };
+
+  Value(Kind valueKind, Type type) : valueKind(valueKind), type(type) {}
+  virtual ~Value() = default;
+
+  Value(const Value&) = delete;
+  Value& operator=(const Value&) = delete;
+
+  bool isConstant() const { return valueKind == Kind::CONSTANT; }
+  bool isUndef() const { return valueKind == Kind::UNDEF; }
+  bool isInstruction() const { return valueKind == Kind::INSTRUCTION; }
+
+  // Users, one entry per operand slot that refers to this value
+  const std::vector<Instruction*>& getUsers() const { return users; }
+  bool hasUsers() const { return !users.empty(); }
+
+  // Make every user refer to replacement instead
+  void replaceAllUsesWith(Value* replacement);
+
+  const Kind valueKind;
+  Type type;
+  uint32_t id = 0;   // Unique within the function, for printing and maps
+
+private:
+  friend class Instruction;
+  std::vector<Instruction*> users;
+};
+
+// Integer or floating-point constant, interned per function
+class Constant : public Value {
+public:
+  Constant(Type type, int64_t integer, double floating)
+      : Value(Kind::CONSTANT, type), integer(integer), floating(floating) {}
+
+  bool isZero() const { return isFloatType(type) ? floating == 0.0 : integer == 0; }
+
+  const int64_t integer;
+  const double floating;
+};
+
+// Unspecified value (read of an uninitialized variable)
+class Undef : public Value {
+public:
+  explicit Undef(Type type) : Value(Kind::UNDEF, type) {}
+};
+
+class Instruction : public Value {
+public:
+  Instruction(Opcode opcode, Type type) : Value(Kind::INSTRUCTION, type), opcode(opcode) {}
+  ~Instruction() override;
+
+  // Operand access; all changes keep the operands' user lists up to date
+  size_t numOperands() const { return operands.size(); }
+  Value* getOperand(size_t i) const { return operands[i]; }
+  const std::vector<Value*>& getOperands() const { return operands; }
+  void setOperand(size_t i, Value* value);
+  void addOperand(Value* value);
+  void removeOperand(size_t i);
+  void dropOperands();
+
+  // Phi helpers
+  void addIncoming(Value* value, BasicBlock* block);
+  void removeIncoming(BasicBlock* block);
+  Value* incomingFor(const BasicBlock* block) const;
+
+  bool isTerminator() const;
+  bool isPhi() const { return opcode == Opcode::PHI; }
+  bool isComparison() const;
+  bool isConversion() const;
+
+  // A CALL right before its block's RET, which returns the call's result
+  // if it has one: nothing is left to do in the caller once it returns
+  bool isTailCall() const;
+  bool producesValue() const { return type != Type::VOID; }
+
+  // Effects other than computing the result
+  bool hasSideEffects() const;
+  bool readsMemory() const;
+  bool writesMemory() const;
+
+  // Successor blocks for terminators, incoming blocks for phis
+  std::vector<BasicBlock*> blocks;
+
+  Opcode opcode;
+  BasicBlock* parent = nullptr;
+  std::string callee;   // CALL target
+  uint32_t index = 0;   // PARAM argument index
+
+private:
+  std::vector<Value*> operands;
+};
+
+class BasicBlock {
+public:
+  using InstructionList = std::list<std::unique_ptr<Instruction>>;
+
+  BasicBlock(Function* parent, uint32_t id, const std::string& name)
+      : parent(parent), id(id), name(name) {}
+
+  // Instructions, phis first and the terminator last
+  InstructionList instructions;
+
+  // Predecessors; kept current by Function::recomputePredecessors()
+  std::vector<BasicBlock*> predecessors;
+
+  Function* parent;
+  uint32_t id;
+  std::string name;
+
+  // Set on the header of a loop that only finishes what a transformed copy
+  // of it left over, which unrolling would just make bigger
+  bool noUnroll = false;
+
+  Instruction* getTerminator() const;
+  std::vector<BasicBlock*> successors() const;
+  std::vector<Instruction*> phis() const;
+
+  // Take ownership of an instruction and place it
+  Instruction* append(std::unique_ptr<Instruction> instruction);
+  Instruction* insertBefore(std::unique_ptr<Instruction> instruction, Instruction* position);
+  Instruction* insertBeforeTerminator(std::unique_ptr<Instruction> instruction);
+  Instruction* insertPhi(std::unique_ptr<Instruction> instruction);
+
+  // Move an instruction out of its block into this one, before position
+  // (or before the terminator when position is null)
+  void moveHere(Instruction* instruction, Instruction* position = nullptr);
+
+  // Drop an instruction's operands and delete it; it must have no users
+  void erase(Instruction* instruction);
+
+  InstructionList::iterator find(const Instruction* instruction);
+};
+
+class Function {
+public:
+  Function(const std::string& name, Type returnType, const std::vector<Type>& paramTypes)
+      : name(name), returnType(returnType), paramTypes(paramTypes) {}
+  ~Function();
+
+  Function(const Function&) = delete;
+  Function& operator=(const Function&) = delete;
+
+  std::string name;
+  Type returnType;
+  std::vector<Type> paramTypes;
+
+  // Blocks in layout order; blocks[0] is the entry
+  std::vector<std::unique_ptr<BasicBlock>> blocks;
+
+  BasicBlock* entry() const { return blocks.empty() ? nullptr : blocks.front().get(); }
+  BasicBlock* createBlock(const std::string& name);
+
+  // Remove a block; its instructions must already be unused elsewhere
+  void removeBlock(BasicBlock* block);
+
+  // Move a block right before another block
+  void moveBefore(BasicBlock* block, BasicBlock* position);
+
+  // Lay the blocks out in the given order; blocks not listed follow in
+  // their current order
+  void arrangeBlocks(const std::vector<BasicBlock*>& order);
+
+  // Create an instruction with a fresh id (not yet placed in a block)
+  std::unique_ptr<Instruction> create(Opcode opcode, Type type, const std::vector<Value*>& operands = {});
+
+  // Interned constants and undef values
+  Constant* getInteger(Type type, int64_t value);
+  Constant* getFloating(Type type, double value);
+  Undef* getUndef(Type type);
+
+  // Rebuild every block's predecessor list from the terminators
+  void recomputePredecessors();
+
+  // Move position and the instructions after it into a new block placed
+  // right after position's block, which then jumps to it; phis of the
+  // successors see the new block as their predecessor
+  BasicBlock* splitBlock(Instruction* position, const std::string& name);
+
+  // Split edges from blocks with several successors to blocks with
+  // several predecessors and phis, so the phis' copies can be placed on a
+  // single edge
+  void splitCriticalEdges();
+
+  // Delete blocks the entry no longer reaches, and the phis left merging a
+  // single value; returns whether anything was removed
+  bool removeUnreachableBlocks();
+
+  uint32_t nextValueId() { return valueCounter++; }
+
+private:
+  // Constants by type and bit pattern (integer value or the bits of the
+  // double), so 0.0 and -0.0 stay distinct
+  struct ConstantKey {
+      Type type;
+      bool floating;
+      uint64_t bits;
+
+      bool operator==(const ConstantKey& other) const {
+          return type == other.type && floating == other.floating && bits == other.bits;
+      }
+  };
+
+  struct ConstantKeyHash {
+      size_t operator()(const ConstantKey& key) const;
+  };
+
+  Constant* intern(const ConstantKey& key, int64_t integer, double floating);
+
+  std::vector<std::unique_ptr<Constant>> constants;
+  std::unordered_map<ConstantKey, Constant*, ConstantKeyHash> constantTable;
+  std::vector<std::unique_ptr<Undef>> undefs;
+  uint32_t valueCounter = 0;
+  uint32_t blockCounter = 0;
+};
+
+class Module {
+public:
+  std::vector<std::unique_ptr<Function>> functions;
+
+  Function* findFunction(const std::string& name) const;
+};
+
+// Textual form for debugging (-dump-ir)
+void print(std::ostream& out, const Function& function);
+void print(std::ostream& out, const Module& module);
+
+} // namespace ir
+} // namespace ccc
+
+#endif // CCC_IR_H
@@ -0,0 +1,158 @@
+#ifndef CCC_IR_BUILDER_H
+#define CCC_IR_BUILDER_H
+
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "ast.h"
+#include "ast_visitor.h"
+#include "error.h"
+#include "ir.h"
+#include "types.h"
+
+namespace ccc {
+
+// Builds SSA IR from the annotated AST
+//
+// SSA form is constructed directly while walking the AST, following Braun
+// et al., "Simple and Efficient Construction of Static Single Assignment
+// Form": each block records the current value of every local variable, a
+// read in a block without a definition asks its predecessors, and phis are
+// only placed where those answers differ. Blocks whose predecessors are not
+// all known yet (loop headers) are "unsealed"; reads there create
+// placeholder phis that are completed when the block is sealed. Trivial
+// phis are removed as they are found, so no separate pass is needed.
+class IRBuilder : public ASTVisitor<IRBuilder, ir::Value*> {
+  friend class ASTVisitor<IRBuilder, ir::Value*>;
+
+public:
+  explicit IRBuilder(ErrorHandler& errorHandler);
+
+  // Build IR for every function definition in the program
+  std::unique_ptr<ir::Module> build(ProgramNode* program);
+
+  // Map a semantic type to its IR value type
+  static ir::Type translateType(const TypeInfo* type);
+
+private:
+  ErrorHandler& errorHandler;
+
+  // Module being built and current insertion point
+  ir::Module* module;
+  ir::Function* function;
+  ir::BasicBlock* block;
+
+  // Break and continue targets of the enclosing loops
+  struct LoopTargets {
+      ir::BasicBlock* breakTarget;
+      ir::BasicBlock* continueTarget;
+  };
+  std::vector<LoopTargets> loops;
+
+  // SSA construction state
+  std::unordered_map<const ir::BasicBlock*, std::unordered_map<const SymbolInfo*, ir::Value*>> currentDef;
+  std::unordered_map<const ir::BasicBlock*, std::vector<std::pair<const SymbolInfo*, ir::Instruction*>>> incompletePhis;
+  std::unordered_set<const ir::BasicBlock*> sealedBlocks;
+  
+  // Trivial phis that were replaced; they are deleted when the function is
+  // done so that pointers to them stay valid during construction
+  std::unordered_map<ir::Value*, ir::Value*> replacedPhis;
+  std::vector<ir::Instruction*> removedPhis;
+
+  // Blocks in the order they were started, which becomes their layout
+  std::vector<ir::BasicBlock*> layout;
+
+  void writeVariable(const SymbolInfo* variable, ir::BasicBlock* block, ir::Value* value);
+  ir::Value* readVariable(const SymbolInfo* variable, ir::BasicBlock* block);
+  ir::Value* resolve(ir::Value* value) const;
+  ir::Value* readVariableRecursive(const SymbolInfo* variable, ir::BasicBlock* block);
+  ir::Value* addPhiOperands(const SymbolInfo* variable, ir::Instruction* phi);
+  ir::Value* tryRemoveTrivialPhi(ir::Instruction* phi);
+  void sealBlock(ir::BasicBlock* block);
+
+  // Instruction creation at the insertion point
+  ir::Instruction* emit(ir::Opcode opcode, ir::Type type, const std::vector<ir::Value*>& operands = {});
+  void emitBranch(ir::BasicBlock* target);
+  void emitCondBranch(ir::Value* condition, ir::BasicBlock* ifTrue, ir::BasicBlock* ifFalse);
+
+  // Branch on a condition expression: && and || branch between their
+  // operands (short-circuit evaluation), and ! swaps the targets
+  void emitCondition(ExpressionNode* condition, ir::BasicBlock* ifTrue, ir::BasicBlock* ifFalse);
+
+  // Start emitting into a block, placing it after the blocks emitted so
+  // far so that the layout follows the source
+  void startBlock(ir::BasicBlock* target);
+  void startUnreachableBlock();
+
+  // Whether the insertion point has already been terminated
+  bool isTerminated() const { return block->getTerminator() != nullptr; }
+
+  // True for parameters and block-scope variables (which live in SSA values)
+  static bool isLocal(const SymbolInfo* symbol);
+
+  // Visitor hooks (dispatched by ASTVisitor)
+  void visitFunctionDeclaration(FunctionDeclarationNode* node);
+  void visitVariableDeclaration(VariableDeclarationNode* node);
+  void visitBlock(BlockNode* node);
+  void visitExpressionStatement(ExpressionStatementNode* node);
+  void visitIfStatement(IfNode* node);
+  void visitWhileStatement(WhileNode* node);
+  void visitDoWhileStatement(DoWhileNode* node);
+  void visitForStatement(ForNode* node);
+  void visitReturnStatement(ReturnNode* node);
+  void visitBreakStatement(BreakNode* node);
+  void visitContinueStatement(ContinueNode* node);
+  void visitInvalidStatement(StatementNode* node);
+
+  // Expression hooks; each returns the value of the expression.
+  // visitExpression turns expressions folded by semantic analysis into constants.
+  ir::Value* visitExpression(ExpressionNode* node);
+  ir::Value* visitInvalidExpression(ExpressionNode* node);
+  ir::Value* visitLiteral(LiteralNode* node);
+  ir::Value* visitVariable(VariableNode* node);
+  ir::Value* visitUnary(UnaryNode* node);
+  ir::Value* visitBinary(BinaryNode* node);
+  ir::Value* visitCall(CallNode* node);
+  ir::Value* visitArrayAccess(ArrayAccessNode* node);
+  ir::Value* visitMemberAccess(MemberAccessNode* node);
+  ir::Value* visitConditional(ConditionalNode* node);
+
+  // a = b or a op= b: evaluate the object a designates once, then store
+  // b, or a op b, into it
+  ir::Value* assign(BinaryNode* node);
+
+  // old op value for a op= b, in the type a op b would have
+  ir::Value* combine(ir::Opcode opcode, ir::Value* old, ir::Value* value);
+
+  // left op right in type; the operands are converted first, to type or,
+  // for a comparison, to their common type
+  ir::Value* operate(ir::Opcode opcode, ir::Type type, ir::Value* left, ir::Value* right);
+
+  // Value of && or ||, 0 or 1. When the right operand may be evaluated
+  // whatever the left one gives, both are and their truth values are
+  // combined without a branch; otherwise the right operand gets a block
+  // of its own and a phi merges the result.
+  ir::Value* logical(BinaryNode* node);
+
+  // Whether evaluating an expression early, or when the program would
+  // not, is harmless: no side effects and nothing that can trap (loads,
+  // division by a divisor not known)
+  static bool isSpeculatable(const ExpressionNode* node);
+
+  // value != 0 as 0 or 1, reusing value when it already is one
+  ir::Value* truthValue(ir::Value* value);
+
+  ir::Value* zero(ir::Type type);
+
+  // Value converted to type, as C converts implicitly on assignment, in
+  // arguments and returns, and between the operands of an operator;
+  // constants are converted right away. Pointers are left as they are.
+  ir::Value* convert(ir::Value* value, ir::Type type);
+
+  ir::Value* constant(const ConstantValue& value, ir::Type type);
+};
+
+} // namespace ccc
+
+#endif // CCC_IR_BUILDER_H
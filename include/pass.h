@@ -0,0 +1,114 @@
+#ifndef CCC_PASS_H
+#define CCC_PASS_H
+
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "analysis.h"
+#include "dataflow.h"
+#include "ir.h"
+
+namespace ccc {
+namespace ir {
+
+// What a pass leaves intact when it changes a function
+enum class Preserved {
+  NOTHING,   // The CFG changed: every analysis is recomputed
+  CFG,       // Only instructions changed: CFG-shaped analyses stay valid
+  ALL
+};
+
+// Analyses of one function, computed on first use and cached until a pass
+// invalidates them
+class AnalysisManager {
+public:
+  explicit AnalysisManager(Function& function) : function(function) {}
+
+  Function& getFunction() { return function; }
+
+  const CFG& getCFG();
+  const DominatorTree& getDominators();
+  const DominatorTree& getPostDominators();
+  LoopInfo& getLoops();
+  const Liveness& getLiveness();
+  const ReachingDefinitions& getReachingDefinitions();
+  const AvailableExpressions& getAvailableExpressions();
+
+  void invalidate(Preserved preserved);
+
+private:
+  Function& function;
+  std::unique_ptr<CFG> cfg;
+  std::unique_ptr<DominatorTree> dominators;
+  std::unique_ptr<DominatorTree> postDominators;
+  std::unique_ptr<LoopInfo> loops;
+  std::unique_ptr<Liveness> liveness;
+  std::unique_ptr<ReachingDefinitions> reachingDefinitions;
+  std::unique_ptr<AvailableExpressions> availableExpressions;
+};
+
+// What every pass has: a name and somewhere to report what it did
+class PassBase {
+public:
+  virtual ~PassBase() = default;
+
+  virtual const char* name() const = 0;
+
+  // Optimization remarks go to out (null for none)
+  void setRemarks(std::ostream* out) { remarks = out; }
+
+protected:
+  // Report a transformation made or declined, as
+  // "remark: <function>: <pass>: <message>"
+  void remark(const Function& function, const std::string& message) const;
+  bool remarksEnabled() const { return remarks != nullptr; }
+
+private:
+  std::ostream* remarks = nullptr;
+};
+
+// A transformation of one function
+class Pass : public PassBase {
+public:
+  // Transform the function; returns whether anything changed
+  virtual bool run(Function& function, AnalysisManager& analyses) = 0;
+
+  // Analyses still valid after run() changed the function
+  virtual Preserved preserved() const { return Preserved::NOTHING; }
+};
+
+// A transformation that works across functions
+class ModulePass : public PassBase {
+public:
+  virtual bool run(Module& module) = 0;
+};
+
+// Runs the module passes, then the pipeline of function passes over each
+// function, invalidating analyses after every pass that changes something
+class PassManager {
+public:
+  void add(std::unique_ptr<Pass> pass);
+  void add(std::unique_ptr<ModulePass> pass);
+  bool empty() const { return passes.empty() && modulePasses.empty(); }
+
+  // Optimization remarks of every pass go to out (null for none)
+  void setRemarks(std::ostream* out);
+
+  bool run(Module& module);
+  bool run(Function& function);
+
+private:
+  std::vector<std::unique_ptr<ModulePass>> modulePasses;
+  std::vector<std::unique_ptr<Pass>> passes;
+  std::ostream* remarks = nullptr;
+};
+
+// Fill a pass manager with the pipeline for an optimization level (-O0 to
+// -O3); relaxedMath lets floating-point arithmetic be regrouped
+void addStandardPasses(PassManager& passes, int optimizationLevel, bool relaxedMath);
+
+} // namespace ir
+} // namespace ccc
+
+#endif // CCC_PASS_H
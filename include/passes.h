@@ -0,0 +1,238 @@
+#ifndef CCC_PASSES_H
+#define CCC_PASSES_H
+
+#include <vector>
+#include "ir.h"
+#include "pass.h"
+
+namespace ccc {
+namespace ir {
+
+// Fold an instruction whose operands are all constants; null when the
+// result is not a compile-time constant (division by zero, out-of-range
+// shifts, signed overflow of division)
+Constant* foldInstruction(Function& function, Opcode opcode, Type type,
+                          const std::vector<const Constant*>& operands);
+
+// Merge two partial results of a reduction at the end of block
+Value* combinePartials(Function& function, BasicBlock* block, const Reduction& reduction, Value* a, Value* b);
+
+// Loop-invariant arithmetic placed at the end of a preheader, folded when
+// the operands are constants (I32 unless given a type)
+class PreheaderBuilder {
+public:
+  PreheaderBuilder(Function& function, BasicBlock* preheader) : function(function), preheader(preheader) {}
+
+  Value* constant(int64_t value);
+  Value* add(Value* a, Value* b);
+  Value* sub(Value* a, Value* b);
+  Value* mul(Value* a, Value* b);
+  Value* linear(const LinearValue& value);
+  Value* emit(Opcode opcode, Type type, const std::vector<Value*>& operands);
+
+  // Starting value of a partial result of the reduction, of type (which
+  // may be a vector of the reduction's type): the operation's identity,
+  // or for a maximum or minimum the value the phi enters with
+  Value* identity(const Reduction& reduction, Type type);
+
+private:
+  Function& function;
+  BasicBlock* preheader;
+};
+
+// Tail recursion elimination
+//
+// A function returning the result of a call to itself (return f(n - 1,
+// acc)) has nothing left to do after the call, so instead of calling it
+// jumps back to its start with the arguments as the new parameter values.
+// The recursion becomes a loop the loop passes can work on, and no longer
+// grows the stack.
+class TailRecursionPass : public Pass {
+public:
+  const char* name() const override { return "tailrecursion"; }
+  bool run(Function& function, AnalysisManager& analyses) override;
+};
+
+// Sparse conditional constant propagation (Wegman and Zadeck)
+//
+// Propagates constants through the SSA graph while only following branches
+// that can be taken, so values merged from arms a constant condition never
+// reaches do not block folding. Constant values are replaced by constants,
+// constant branches become jumps and the arms they skip are deleted.
+class SCCPPass : public Pass {
+public:
+  const char* name() const override { return "sccp"; }
+  bool run(Function& function, AnalysisManager& analyses) override;
+};
+
+// Global value numbering
+//
+// Walks the dominator tree keeping the expressions computed in the blocks
+// above; an instruction computing the same opcode on the same operands as
+// a dominating one is replaced by it. Loads reuse the value last loaded
+// from or stored to the same address when no store that may alias it, and
+// no call, can have run in between, including on the paths into a join.
+class GVNPass : public Pass {
+public:
+  const char* name() const override { return "gvn"; }
+  bool run(Function& function, AnalysisManager& analyses) override;
+  Preserved preserved() const override { return Preserved::CFG; }
+};
+
+// Loop-invariant code motion
+//
+// Moves instructions whose operands do not change in a loop to its
+// preheader, innermost loops first. Loads move when nothing in the loop
+// may write what they read. Loads and divisions that could fault are only
+// moved from blocks that run whenever the loop does; for a loop tested at
+// the top, the ones in its body move behind a copy of the loop test, so a
+// loop that runs zero times never executes them.
+class LICMPass : public Pass {
+public:
+  const char* name() const override { return "licm"; }
+  bool run(Function& function, AnalysisManager& analyses) override;
+};
+
+// Induction variable simplification
+//
+// Uses InductionVariables on each loop, innermost first. Basic induction
+// variables stepping by the same amount as another (or its negation) are
+// computed from it instead. Values computed from an induction variable with
+// a multiplication (a[i * 4 + j]) become induction variables of their own,
+// started in the preheader and stepped by an addition on the back edge,
+// which leaves the multiplication dead. All variables are already I32, the
+// widest integer type of the IR, so none are widened.
+class IndVarsPass : public Pass {
+public:
+  const char* name() const override { return "indvars"; }
+  bool run(Function& function, AnalysisManager& analyses) override;
+};
+
+// Loop vectorization
+//
+// Rewrites innermost counted loops whose counter steps by 1 to run four
+// iterations at a time: consecutive I32 and F32 elements are loaded and
+// stored four at once, element-wise arithmetic, comparisons and selects
+// work on all lanes, values that do not change in the loop are splatted to
+// every lane, and reductions (see analyzeReduction) keep a partial result
+// per lane, merged after the loop; F32 ones only with relaxedMath.
+// Accesses to the same array must not depend on each other
+// fewer than four elements apart; arrays reached through different
+// pointers are checked at run time not to overlap. The original loop stays
+// as the scalar epilogue: it runs the iterations left over, and the whole
+// loop when a check fails. Every decision is reported as a remark.
+class VectorizePass : public Pass {
+public:
+  explicit VectorizePass(bool relaxedMath) : relaxedMath(relaxedMath) {}
+
+  const char* name() const override { return "vectorize"; }
+  bool run(Function& function, AnalysisManager& analyses) override;
+
+private:
+  bool relaxedMath;
+};
+
+// Loop unrolling
+//
+// Unrolls innermost counted loops (see analyzeCountedLoop) whose copies fit
+// the level's size budget. A loop with a small constant trip count is
+// unrolled completely: the copies run one after the other and the tests
+// disappear. Otherwise the body is repeated up to maxFactor times behind a
+// single test that that many iterations remain, and the original loop
+// runs the iterations left over. Each copy accumulates into its own partial
+// result of a reduction (floating-point ones only with relaxedMath), so the
+// copies do not wait for each other; the results merge before the
+// remainder loop. Epilogues of vectorized loops are left alone. Every
+// decision is reported as a remark.
+class UnrollPass : public Pass {
+public:
+  UnrollPass(int optimizationLevel, bool relaxedMath);
+
+  const char* name() const override { return "unroll"; }
+  bool run(Function& function, AnalysisManager& analyses) override;
+
+private:
+  // Instructions allowed for all copies of a completely unrolled loop,
+  // and for the copies in a partially unrolled one
+  unsigned fullBudget;
+  unsigned partialBudget;
+  unsigned maxFactor;
+  bool relaxedMath;
+};
+
+// Dead store elimination
+//
+// Removes stores whose location is written again on every path before
+// anything may read it (a load that may alias it, a call, or the return to
+// the caller).
+class DSEPass : public Pass {
+public:
+  const char* name() const override { return "dse"; }
+  bool run(Function& function, AnalysisManager& analyses) override;
+  Preserved preserved() const override { return Preserved::CFG; }
+};
+
+// Aggressive dead code elimination
+//
+// Assumes everything dead and marks live only what stores, calls and
+// returns need: the values they use and the branches deciding whether
+// they run (control dependence, from the post-dominance frontiers).
+// Unmarked instructions are deleted, an unmarked branch becomes a jump to
+// its immediate post-dominator, and blocks left unreachable are removed.
+class DCEPass : public Pass {
+public:
+  const char* name() const override { return "dce"; }
+  bool run(Function& function, AnalysisManager& analyses) override;
+};
+
+// CFG simplification
+//
+// Cleans up the branches the builder and the other passes leave behind:
+// branches on a constant or with both edges to one block become jumps,
+// predecessors of a block that only jumps on jump to its target directly,
+// predecessors bringing a constant into a block that only branches on it
+// go the way the branch would, a branch around empty blocks that only
+// picks one phi value becomes a SELECT, and a block jumping to a successor
+// with no other predecessor absorbs it. Repeats until nothing changes.
+class SimplifyCFGPass : public Pass {
+public:
+  const char* name() const override { return "simplifycfg"; }
+  bool run(Function& function, AnalysisManager& analyses) override;
+};
+
+// Function inlining
+//
+// Visits the call graph callees first and decides each call on its own:
+// the cost is the callee's size less what the call sequence costs (a CALL,
+// the result move and one parameter move per argument, more for constant
+// arguments that fold in the copy). Calls with a cost of zero or less
+// shrink the code and are inlined first and always; others need the cost
+// to be within the level's threshold, which is raised inside loops, and
+// the caller to stay under a size cap. Recursive calls are unrolled at
+// most recursionLimit times, except tail calls of a function to itself,
+// which TailRecursionPass turns into loops. Every decision is reported as
+// a remark.
+class InlinerPass : public ModulePass {
+public:
+  explicit InlinerPass(int optimizationLevel);
+
+  const char* name() const override { return "inline"; }
+  bool run(Module& module) override;
+
+private:
+  int threshold;
+  int loopBonus;
+  unsigned recursionLimit;
+  unsigned maxCallerSize;
+
+  bool inlineCalls(Module& module, Function& caller);
+  int cost(const Instruction& call, const Function& callee) const;
+
+  // Replace call by a copy of callee's body; returns the calls in the copy
+  std::vector<Instruction*> inlineCall(Function& caller, Instruction* call, Function& callee);
+};
+
+} // namespace ir
+} // namespace ccc
+
+#endif // CCC_PASSES_H
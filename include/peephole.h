@@ -0,0 +1,95 @@
+#ifndef CCC_PEEPHOLE_H
+#define CCC_PEEPHOLE_H
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+#include "coil/instruction_set.h"
+
+namespace ccc {
+
+// Operand of a COIL instruction that has not gone into the object yet:
+// what coil::Operand would hold, in a form instructions can be compared by
+class MachineOperand {
+public:
+  enum class Kind : uint8_t { VARIABLE, SYMBOL, IMMEDIATE };
+
+  static MachineOperand variable(uint16_t id) { return MachineOperand(Kind::VARIABLE, Format::NONE, id); }
+  static MachineOperand symbol(uint16_t index) { return MachineOperand(Kind::SYMBOL, Format::NONE, index); }
+
+  // An immediate of T's width (int8_t, uint8_t, uint16_t, int32_t, float
+  // or double, as coil::Operand::createImmediate takes them)
+  template <typename T>
+  static MachineOperand immediate(T value) {
+      static_assert(formatOf<T>() != Format::NONE, "no COIL immediate of this type");
+      uint64_t bits = 0;
+      std::memcpy(&bits, &value, sizeof(T));
+      return MachineOperand(Kind::IMMEDIATE, formatOf<T>(), bits);
+  }
+
+  Kind kind() const { return operandKind; }
+  bool isVariable() const { return operandKind == Kind::VARIABLE; }
+  bool isSymbol() const { return operandKind == Kind::SYMBOL; }
+
+  // Variable id or symbol index
+  uint16_t id() const { return static_cast<uint16_t>(bits); }
+
+  // Whether this is an integer immediate of the given value
+  bool isInteger(int64_t value) const;
+
+  bool operator==(const MachineOperand& other) const {
+      return operandKind == other.operandKind && format == other.format && bits == other.bits;
+  }
+  bool operator!=(const MachineOperand& other) const { return !(*this == other); }
+
+  coil::Operand lower() const;
+
+private:
+  enum class Format : uint8_t { NONE, I8, U8, U16, I32, F32, F64 };
+
+  MachineOperand(Kind kind, Format format, uint64_t bits) : operandKind(kind), format(format), bits(bits) {}
+
+  template <typename T>
+  static constexpr Format formatOf() {
+      if (std::is_same<T, int8_t>::value) return Format::I8;
+      if (std::is_same<T, uint8_t>::value) return Format::U8;
+      if (std::is_same<T, uint16_t>::value) return Format::U16;
+      if (std::is_same<T, int32_t>::value) return Format::I32;
+      if (std::is_same<T, float>::value) return Format::F32;
+      if (std::is_same<T, double>::value) return Format::F64;
+      return Format::NONE;
+  }
+
+  Kind operandKind;
+  Format format;
+  uint64_t bits;   // Id, index, or the immediate's bytes
+};
+
+struct MachineInstruction {
+  uint8_t opcode;
+  std::vector<MachineOperand> operands;
+};
+
+// Peephole optimizer over the COIL instructions of one function
+//
+// Runs on the instruction stream just before it goes into the object,
+// to clean up what lowering one IR instruction at a time leaves behind.
+// The rewrites are listed in a table in peephole.cpp: each names the
+// opcode it starts at and a function that rewrites the instructions from
+// there, turning those it removes into NOPs. The table is applied at every
+// position until nothing changes, and the NOPs are dropped. What the
+// rewrites need to know about the function as a whole (where labels are,
+// which are branched to, variable types) is gathered once per sweep
+// rather than searched for at each position. Flags set by
+// CMP are assumed to be read only by BR. A variable an INDEX binds names
+// memory, so the copy rewrites never touch MOVs to or from one.
+class PeepholeOptimizer {
+public:
+  // Returns the number of instructions removed
+  unsigned run(std::vector<MachineInstruction>& instructions);
+};
+
+} // namespace ccc
+
+#endif // CCC_PEEPHOLE_H
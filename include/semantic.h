@@ -1,96 +1,19 @@
 #ifndef CCC_SEMANTIC_H
 #define CCC_SEMANTIC_H
 
+#include <cstdint>
+#include <deque>
 #include <string>
-#include <unordered_map>
 #include <vector>
 #include <memory>
 #include "ast.h"
+#include "ast_visitor.h"
+#include "constant.h"
 #include "error.h"
+#include "types.h"
 
 namespace ccc {
 
-// Type information for semantic analysis
-struct TypeInfo {
-  enum class Kind {
-      VOID,
-      CHAR,
-      INT,
-      FLOAT,
-      DOUBLE,
-      STRUCT,
-      ARRAY,
-      POINTER,
-      FUNCTION
-  };
-  
-  Kind kind;
-  bool isConst;
-  bool isVolatile;
-  int size;                          // Size in bytes
-  std::unique_ptr<TypeInfo> base;    // For pointers, arrays, and functions
-  std::vector<TypeInfo> parameters;  // For functions
-  
-  TypeInfo(Kind kind, bool isConst = false, bool isVolatile = false, int size = 0)
-      : kind(kind), isConst(isConst), isVolatile(isVolatile), size(size) {}
-  
-  // Deep copy constructor
-  TypeInfo(const TypeInfo& other)
-      : kind(other.kind), isConst(other.isConst), isVolatile(other.isVolatile), size(other.size) {
-      if (other.base) {
-          base = std::make_unique<TypeInfo>(*other.base);
-      }
-      for (const auto& param : other.parameters) {
-          parameters.push_back(param);
-      }
-  }
-  
-  bool isScalar() const {
-      return kind == Kind::CHAR || kind == Kind::INT || 
-              kind == Kind::FLOAT || kind == Kind::DOUBLE ||
-              kind == Kind::POINTER;
-  }
-  
-  bool isNumeric() const {
-      return kind == Kind::CHAR || kind == Kind::INT || 
-              kind == Kind::FLOAT || kind == Kind::DOUBLE;
-  }
-  
-  bool isInteger() const {
-      return kind == Kind::CHAR || kind == Kind::INT;
-  }
-  
-  bool isFloatingPoint() const {
-      return kind == Kind::FLOAT || kind == Kind::DOUBLE;
-  }
-  
-  // Create standard type infos
-  static TypeInfo createVoid() { return TypeInfo(Kind::VOID, false, false, 0); }
-  static TypeInfo createChar() { return TypeInfo(Kind::CHAR, false, false, 1); }
-  static TypeInfo createInt() { return TypeInfo(Kind::INT, false, false, 4); }
-  static TypeInfo createFloat() { return TypeInfo(Kind::FLOAT, false, false, 4); }
-  static TypeInfo createDouble() { return TypeInfo(Kind::DOUBLE, false, false, 8); }
-  
-  static TypeInfo createPointer(const TypeInfo& baseType) { 
-      TypeInfo info(Kind::POINTER, false, false, 8);
-      info.base = std::make_unique<TypeInfo>(baseType);
-      return info;
-  }
-  
-  static TypeInfo createArray(const TypeInfo& elementType, int size) {
-      TypeInfo info(Kind::ARRAY, false, false, elementType.size * size);
-      info.base = std::make_unique<TypeInfo>(elementType);
-      return info;
-  }
-  
-  static TypeInfo createFunction(const TypeInfo& returnType, const std::vector<TypeInfo>& paramTypes) {
-      TypeInfo info(Kind::FUNCTION, false, false, 0);
-      info.base = std::make_unique<TypeInfo>(returnType);
-      info.parameters = paramTypes;
-      return info;
-  }
-};
-
 // Symbol information for semantic analysis
 struct SymbolInfo {
   enum class Kind {
@@ -101,18 +24,62 @@ struct SymbolInfo {
   };
   
   Kind kind;
-  TypeInfo type;
+  const TypeInfo* type;
   std::string name;
   int scopeLevel;
   
-  SymbolInfo(Kind kind, const TypeInfo& type, const std::string& name, int scopeLevel)
+  SymbolInfo(Kind kind, const TypeInfo* type, const std::string& name, int scopeLevel)
       : kind(kind), type(type), name(name), scopeLevel(scopeLevel) {}
 };
 
+// Interns identifier spellings to dense 32-bit ids (open addressing)
+class IdentifierTable {
+public:
+  static constexpr uint32_t INVALID_ID = UINT32_MAX;
+  
+  IdentifierTable();
+  
+  // Get the id for a name, adding it if it is new
+  uint32_t intern(const std::string& name);
+  
+  // Get the id for a name, or INVALID_ID if it was never interned
+  uint32_t find(const std::string& name) const;
+  
+  const std::string& spelling(uint32_t id) const { return names[id]; }
+  size_t size() const { return names.size(); }
+  
+  void clear();
+
+private:
+  static uint32_t hashName(const std::string& name);
+  size_t findSlot(const std::string& name, uint32_t hash) const;
+  void grow();
+  
+  std::vector<std::string> names;   // Indexed by id
+  std::vector<uint32_t> hashes;     // Cached hash per id
+  std::vector<uint32_t> slots;      // Ids, INVALID_ID for empty; size is a power of two
+};
+
 // Symbol table to track variables, functions, etc.
+//
+// All scopes share one table indexed by identifier id. Each id maps to its
+// innermost binding, and every binding links to the binding it shadows, so
+// a lookup is a single probe no matter how deeply scopes are nested.
+// Bindings made in a scope are recorded in an undo log that leaveScope()
+// pops to restore the shadowed bindings. SymbolInfo objects are never
+// freed before clear(), so pointers to them stay valid after their scope
+// is left.
+//
+// A table can be layered over an enclosing table (the global scope during
+// per-function analysis). Names not bound locally are looked up in the
+// enclosing table, but only among the bindings it had when this table was
+// created, so a function body does not see globals declared after it.
+// Lookups never modify the enclosing table, so several layered tables can
+// share one enclosing table from different threads.
 class SymbolTable {
 public:
-  SymbolTable();
+  explicit SymbolTable(IdentifierTable& identifiers, const SymbolTable* enclosing = nullptr,
+                       size_t enclosingMark = 0);
   
   // Enter and leave scopes
   void enterScope();
@@ -120,29 +87,62 @@ public:
   int currentScopeLevel() const;
   
   // Add symbols
-  void addVariable(const std::string& name, const TypeInfo& type);
-  void addFunction(const std::string& name, const TypeInfo& type);
-  void addParameter(const std::string& name, const TypeInfo& type);
-  void addTypedef(const std::string& name, const TypeInfo& type);
+  const SymbolInfo* addVariable(const std::string& name, const TypeInfo* type);
+  const SymbolInfo* addFunction(const std::string& name, const TypeInfo* type);
+  const SymbolInfo* addParameter(const std::string& name, const TypeInfo* type);
+  const SymbolInfo* addTypedef(const std::string& name, const TypeInfo* type);
   
   // Lookup symbols
   bool exists(const std::string& name) const;
   bool existsInCurrentScope(const std::string& name) const;
   const SymbolInfo* lookup(const std::string& name) const;
+  const SymbolInfo* lookup(uint32_t id) const;
+  
+  // Number of bindings made so far; bindings made later are hidden from
+  // tables layered over this one with this mark
+  size_t mark() const { return bindings.size(); }
   
   // Clear the table
   void clear();
 
 private:
-  // Symbol storage - maps names to symbols
-  std::vector<std::unordered_map<std::string, SymbolInfo>> scopes;
+  struct Binding {
+      SymbolInfo symbol;
+      Binding* shadowed;   // Next outer binding of the same identifier
+      size_t sequence;     // Order in which the binding was made
+      
+      Binding(const SymbolInfo& symbol, Binding* shadowed, size_t sequence)
+          : symbol(symbol), shadowed(shadowed), sequence(sequence) {}
+  };
+  
+  const SymbolInfo* bind(SymbolInfo::Kind kind, const std::string& name, const TypeInfo* type, int scopeLevel);
+  const SymbolInfo* lookupBefore(uint32_t id, size_t limit) const;
+  
+  IdentifierTable& identifiers;
+  const SymbolTable* enclosing;
+  size_t enclosingMark;
+  std::deque<Binding> bindings;        // Stable storage for every binding ever made
+  std::vector<Binding*> innermost;     // Indexed by identifier id
+  std::vector<uint32_t> undoLog;       // Identifier ids bound in open scopes
+  std::vector<size_t> scopeMarks;      // Undo log size at each enterScope()
   int currentScope;
 };
 
 // Semantic analyzer
-class SemanticAnalyzer {
+//
+// Analysis runs in two phases. A serial pass walks the top-level
+// declarations in source order, checks global variables and function
+// signatures and binds them in the global symbol table. Function bodies
+// only read that table, so they are then checked in parallel, each with
+// its own symbol table layered over the globals and its own diagnostic
+// buffer. The buffers are merged into the error handler in source order,
+// so the output does not depend on thread scheduling.
+class SemanticAnalyzer : public ASTVisitor<SemanticAnalyzer, const TypeInfo*> {
+  friend class ASTVisitor<SemanticAnalyzer, const TypeInfo*>;
+  
 public:
-  SemanticAnalyzer(ErrorHandler& errorHandler);
+  // threadCount 0 uses one thread per hardware core
+  SemanticAnalyzer(ErrorHandler& errorHandler, TypeContext& types, unsigned threadCount = 0);
   
   // Analyze the AST
   void analyze(ASTNode* root);
@@ -151,21 +151,45 @@ public:
   bool hasErrors() const;
   
 private:
+  // Worker that analyzes one top-level declaration, reporting into its own
+  // buffer and binding into the given symbol table
+  SemanticAnalyzer(SemanticAnalyzer& parent, ErrorHandler& diagnostics, SymbolTable& scope);
+  
   // Error reporting
   ErrorHandler& errorHandler;
   
-  // Symbol table
-  SymbolTable symbolTable;
+  // Interned types (shared by all workers)
+  TypeContext& types;
+  
+  // Folds constant subtrees as their types are computed
+  ConstantEvaluator constants;
+  
+  // Identifier interning and symbol tables. Workers borrow the parent's
+  // identifiers; symbolTable points at the globals or a function's table.
+  IdentifierTable ownIdentifiers;
+  IdentifierTable& identifiers;
+  SymbolTable* symbolTable;
+  std::unique_ptr<SymbolTable> globals;
+  
+  // Per-function tables stay alive after analysis because the AST
+  // annotations point at the symbols they own
+  std::vector<std::unique_ptr<SymbolTable>> functionScopes;
+  
+  unsigned threadCount;
   
   // Function context
-  TypeInfo* currentFunctionReturnType;
+  const TypeInfo* currentFunctionReturnType;
   bool hasReturn;
   
-  // Visitors for analysis
-  void visitProgram(ProgramNode* node);
+  // Phase 2: check one function body against the global snapshot
+  void checkFunctionBody(FunctionDeclarationNode* node);
+  
+  // Visitor hooks for analysis (dispatched by ASTVisitor); for functions
+  // this only checks and binds the signature
   void visitFunctionDeclaration(FunctionDeclarationNode* node);
   void visitVariableDeclaration(VariableDeclarationNode* node);
   void visitParameter(ParameterNode* node);
+  void declareParameter(ParameterNode* node, const TypeInfo* type);
   void visitBlock(BlockNode* node);
   void visitExpressionStatement(ExpressionStatementNode* node);
   void visitIfStatement(IfNode* node);
@@ -176,21 +200,32 @@ private:
   void visitBreakStatement(BreakNode* node);
   void visitContinueStatement(ContinueNode* node);
   
-  TypeInfo visitExpression(ExpressionNode* node);
-  TypeInfo visitLiteral(LiteralNode* node);
-  TypeInfo visitVariable(VariableNode* node);
-  TypeInfo visitUnary(UnaryNode* node);
-  TypeInfo visitBinary(BinaryNode* node);
-  TypeInfo visitCall(CallNode* node);
-  TypeInfo visitArrayAccess(ArrayAccessNode* node);
-  TypeInfo visitMemberAccess(MemberAccessNode* node);
-  TypeInfo visitConditional(ConditionalNode* node);
+  // Visit a loop or if body, giving non-block statements their own scope
+  void visitScopedStatement(StatementNode* node);
+  
+  // Expression hooks; visitExpression also annotates each node with its
+  // type and, for constant expressions, its folded value
+  const TypeInfo* visitExpression(ExpressionNode* node);
+  const TypeInfo* visitInvalidExpression(ExpressionNode* node);
+  const TypeInfo* visitLiteral(LiteralNode* node);
+  const TypeInfo* visitVariable(VariableNode* node);
+  const TypeInfo* visitUnary(UnaryNode* node);
+  const TypeInfo* visitBinary(BinaryNode* node);
+  const TypeInfo* visitCall(CallNode* node);
+  const TypeInfo* visitArrayAccess(ArrayAccessNode* node);
+  const TypeInfo* visitMemberAccess(MemberAccessNode* node);
+  const TypeInfo* visitConditional(ConditionalNode* node);
+  
+  const TypeInfo* getTypeFromTypeNode(TypeNode* node);
   
-  TypeInfo getTypeFromTypeNode(TypeNode* node);
+  // Result type of a binary operator applied to operands of the given
+  // types; reports invalid operands and gives void for them
+  const TypeInfo* binaryType(const Token& op, const TypeInfo* leftType, const TypeInfo* rightType);
   
   // Type checking
-  bool areTypesCompatible(const TypeInfo& source, const TypeInfo& target);
-  TypeInfo getCommonType(const TypeInfo& a, const TypeInfo& b);
+  bool areTypesCompatible(const TypeInfo* source, const TypeInfo* target);
+  const TypeInfo* promote(const TypeInfo* type);
+  const TypeInfo* getCommonType(const TypeInfo* a, const TypeInfo* b);
 };
 
 } // namespace ccc
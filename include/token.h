@@ -123,6 +123,10 @@ struct Token {
   std::string toString() const;
 };
 
+// Operator a compound assignment applies (OP_PLUS for +=), UNKNOWN for
+// any other token
+TokenType compoundOperator(TokenType type);
+
 // Keyword map
 extern const std::unordered_map<std::string, TokenType> Keywords;
 
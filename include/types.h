@@ -0,0 +1,123 @@
+#ifndef CCC_TYPES_H
+#define CCC_TYPES_H
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace ccc {
+
+// Type information for semantic analysis
+//
+// TypeInfo objects are hash-consed: every distinct type exists exactly once,
+// owned by a TypeContext, and is referred to through a const TypeInfo*.
+// Two types are identical exactly when their pointers are equal, and
+// passing a type around never copies or allocates.
+struct TypeInfo {
+  enum class Kind {
+      VOID,
+      CHAR,
+      INT,
+      FLOAT,
+      DOUBLE,
+      STRUCT,
+      ARRAY,
+      POINTER,
+      FUNCTION
+  };
+
+  Kind kind;
+  bool isConst;
+  bool isVolatile;
+  int size;                                 // Size in bytes
+  int length;                               // Element count for arrays
+  const TypeInfo* base;                     // For pointers, arrays, and functions
+  std::vector<const TypeInfo*> parameters;  // For functions
+  uint32_t id;                              // Dense id, unique per distinct type
+
+  TypeInfo(Kind kind, bool isConst = false, bool isVolatile = false, int size = 0)
+      : kind(kind), isConst(isConst), isVolatile(isVolatile), size(size),
+        length(0), base(nullptr), id(0) {}
+
+  bool isScalar() const {
+      return kind == Kind::CHAR || kind == Kind::INT ||
+              kind == Kind::FLOAT || kind == Kind::DOUBLE ||
+              kind == Kind::POINTER;
+  }
+
+  bool isNumeric() const {
+      return kind == Kind::CHAR || kind == Kind::INT ||
+              kind == Kind::FLOAT || kind == Kind::DOUBLE;
+  }
+
+  bool isInteger() const {
+      return kind == Kind::CHAR || kind == Kind::INT;
+  }
+
+  bool isFloatingPoint() const {
+      return kind == Kind::FLOAT || kind == Kind::DOUBLE;
+  }
+
+  // Readable spelling for diagnostics (e.g. "const int*")
+  std::string toString() const;
+};
+
+// Owner and interning table for all types of a compilation
+//
+// The get* methods may be called from several threads at once. getById()
+// and size() are not synchronized and should only be used once no other
+// thread is creating types.
+class TypeContext {
+public:
+  TypeContext();
+
+  TypeContext(const TypeContext&) = delete;
+  TypeContext& operator=(const TypeContext&) = delete;
+
+  // Standard types
+  const TypeInfo* getVoid() const { return voidType; }
+  const TypeInfo* getChar() const { return charType; }
+  const TypeInfo* getInt() const { return intType; }
+  const TypeInfo* getFloat() const { return floatType; }
+  const TypeInfo* getDouble() const { return doubleType; }
+
+  // Get or create types
+  const TypeInfo* getPrimitive(TypeInfo::Kind kind, bool isConst = false, bool isVolatile = false);
+  const TypeInfo* getPointer(const TypeInfo* baseType);
+  const TypeInfo* getArray(const TypeInfo* elementType, int length);
+  const TypeInfo* getFunction(const TypeInfo* returnType, const std::vector<const TypeInfo*>& paramTypes);
+
+  // Lookup by dense id
+  const TypeInfo* getById(uint32_t id) const { return ordered[id]; }
+  size_t size() const { return ordered.size(); }
+
+private:
+  struct TypeHash {
+      size_t operator()(const TypeInfo* type) const;
+  };
+
+  struct TypeEqual {
+      bool operator()(const TypeInfo* a, const TypeInfo* b) const;
+  };
+
+  // Return the canonical instance structurally equal to candidate
+  const TypeInfo* intern(const TypeInfo& candidate);
+
+  std::deque<TypeInfo> storage;                            // Stable addresses
+  std::vector<const TypeInfo*> ordered;                    // Indexed by id
+  std::unordered_set<const TypeInfo*, TypeHash, TypeEqual> table;
+  std::mutex mutex;                                        // Guards intern()
+
+  const TypeInfo* voidType;
+  const TypeInfo* charType;
+  const TypeInfo* intType;
+  const TypeInfo* floatType;
+  const TypeInfo* doubleType;
+};
+
+} // namespace ccc
+
+#endif // CCC_TYPES_H
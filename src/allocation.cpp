@@ -0,0 +1,139 @@
+#include "allocation.h"
+#include <algorithm>
+
+namespace ccc {
+namespace ir {
+
+VariableAllocation::VariableAllocation(const CFG& cfg, const Liveness& liveness) {
+  size_t count = liveness.size();
+  std::vector<std::vector<unsigned>> interferences(count);
+  std::vector<std::vector<unsigned>> copies(count);
+
+  auto interfere = [&](unsigned a, unsigned b) {
+      if (a == b || liveness.value(a)->type != liveness.value(b)->type) return;
+      interferences[a].push_back(b);
+      interferences[b].push_back(a);
+  };
+
+  for (unsigned b = 0; b < cfg.size(); b++) {
+      const BasicBlock* block = cfg.block(b);
+
+      // Walk backwards from the end: a definition interferes with
+      // everything live just after it
+      BitVector live = liveness.liveOut(block);
+      pressure = std::max(pressure, live.count());
+      for (auto it = block->instructions.rbegin(); it != block->instructions.rend(); ++it) {
+          const Instruction* instruction = it->get();
+          if (instruction->producesValue()) {
+              unsigned defined = liveness.index(instruction);
+              live.reset(defined);
+              live.forEach([&](size_t other) { interfere(defined, static_cast<unsigned>(other)); });
+          }
+          if (instruction->isPhi()) continue;
+          for (const Value* operand : instruction->getOperands()) {
+              unsigned used = liveness.index(operand);
+              if (used != CFG::NONE) live.set(used);
+          }
+          pressure = std::max(pressure, live.count());
+      }
+
+      // Phis of a block are written one after another by the copies
+      std::vector<Instruction*> phis = block->phis();
+      for (size_t i = 0; i < phis.size(); i++) {
+          for (size_t j = i + 1; j < phis.size(); j++) {
+              interfere(liveness.index(phis[i]), liveness.index(phis[j]));
+          }
+      }
+  }
+
+  // The copies into phis happen at the end of each predecessor, while
+  // everything live out of it is still needed
+  for (unsigned p = 0; p < cfg.size(); p++) {
+      const BasicBlock* predecessor = cfg.block(p);
+      const BitVector& liveOut = liveness.liveOut(predecessor);
+
+      // How often each value is read past the end of the block
+      std::unordered_map<unsigned, unsigned> reads;
+      for (const BasicBlock* successor : predecessor->successors()) {
+          liveness.liveIn(successor).forEach([&](size_t value) { reads[static_cast<unsigned>(value)]++; });
+          for (const Instruction* phi : successor->phis()) {
+              unsigned incoming = liveness.index(phi->incomingFor(predecessor));
+              if (incoming != CFG::NONE) reads[incoming]++;
+          }
+      }
+
+      for (const BasicBlock* successor : predecessor->successors()) {
+          for (const Instruction* phi : successor->phis()) {
+              unsigned defined = liveness.index(phi);
+              unsigned incoming = liveness.index(phi->incomingFor(predecessor));
+              liveOut.forEach([&](size_t other) {
+                  // A value that dies in the copy can share the phi's variable
+                  if (other == incoming && reads[incoming] == 1) {
+                      copies[defined].push_back(incoming);
+                      copies[incoming].push_back(defined);
+                      return;
+                  }
+                  interfere(defined, static_cast<unsigned>(other));
+              });
+          }
+      }
+  }
+
+  // Greedy coloring in definition order, trying the variable of a copy
+  // partner first and then the lowest free variable of the same type
+  std::vector<unsigned> assigned(count, CFG::NONE);
+  std::vector<std::vector<unsigned>> byType;
+  std::vector<bool> taken;
+  auto pick = [&](Type type, const std::vector<unsigned>& neighbours, const std::vector<unsigned>& partners) {
+      for (unsigned other : neighbours) {
+          if (assigned[other] != CFG::NONE) taken[assigned[other]] = true;
+      }
+
+      unsigned chosen = CFG::NONE;
+      for (unsigned other : partners) {
+          if (assigned[other] != CFG::NONE && !taken[assigned[other]]) {
+              chosen = assigned[other];
+              break;
+          }
+      }
+      size_t typeIndex = static_cast<size_t>(type);
+      if (typeIndex >= byType.size()) byType.resize(typeIndex + 1);
+      if (chosen == CFG::NONE) {
+          for (unsigned variable : byType[typeIndex]) {
+              if (!taken[variable]) {
+                  chosen = variable;
+                  break;
+              }
+          }
+      }
+      if (chosen == CFG::NONE) {
+          chosen = static_cast<unsigned>(types.size());
+          types.push_back(type);
+          byType[typeIndex].push_back(chosen);
+          taken.push_back(false);
+      }
+
+      for (unsigned other : neighbours) {
+          if (assigned[other] != CFG::NONE) taken[assigned[other]] = false;
+      }
+      return chosen;
+  };
+
+  for (unsigned v = 0; v < count; v++) {
+      assigned[v] = pick(liveness.value(v)->type, interferences[v], copies[v]);
+      variables[liveness.value(v)] = assigned[v];
+  }
+
+  // Values in blocks control never reaches can go anywhere
+  static const std::vector<unsigned> none;
+  for (const auto& block : cfg.getFunction().blocks) {
+      for (const auto& instruction : block->instructions) {
+          if (instruction->producesValue() && !variables.count(instruction.get())) {
+              variables[instruction.get()] = pick(instruction->type, none, none);
+          }
+      }
+  }
+}
+
+} // namespace ir
+} // namespace ccc
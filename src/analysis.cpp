@@ -0,0 +1,863 @@
+#include "analysis.h"
+#include <algorithm>
+
+namespace ccc {
+namespace ir {
+
+// Control-flow graph
+
+CFG::CFG(Function& function) : function(function) {
+  function.recomputePredecessors();
+  BasicBlock* entry = function.entry();
+  if (!entry) return;
+
+  // Iterative depth-first search for the postorder
+  std::unordered_set<const BasicBlock*> visited = {entry};
+  std::vector<std::pair<BasicBlock*, std::vector<BasicBlock*>>> stack;
+  stack.emplace_back(entry, entry->successors());
+  while (!stack.empty()) {
+      auto& top = stack.back();
+      if (top.second.empty()) {
+          order.push_back(top.first);
+          stack.pop_back();
+          continue;
+      }
+      // Visit the last successor first, so the true arm of a branch comes
+      // first in reverse postorder
+      BasicBlock* successor = top.second.back();
+      top.second.pop_back();
+      if (visited.insert(successor).second) {
+          stack.emplace_back(successor, successor->successors());
+      }
+  }
+  std::reverse(order.begin(), order.end());
+
+  numbers.reserve(order.size());
+  for (unsigned i = 0; i < order.size(); i++) {
+      numbers[order[i]] = i;
+  }
+
+  predecessorIndices.resize(order.size());
+  successorIndices.resize(order.size());
+  for (unsigned i = 0; i < order.size(); i++) {
+      for (BasicBlock* successor : order[i]->successors()) {
+          unsigned target = numbers.at(successor);
+          successorIndices[i].push_back(target);
+          predecessorIndices[target].push_back(i);
+      }
+      Instruction* terminator = order[i]->getTerminator();
+      if (terminator && terminator->opcode == Opcode::RET) {
+          exitIndices.push_back(i);
+      }
+  }
+}
+
+unsigned CFG::index(const BasicBlock* block) const {
+  auto it = numbers.find(block);
+  return it != numbers.end() ? it->second : NONE;
+}
+
+// Dominators
+
+const std::vector<BasicBlock*> DominatorTree::empty;
+
+DominatorTree::DominatorTree(const CFG& cfg, bool postDominators)
+  : cfg(cfg), post(postDominators) {
+  size_t blockCount = cfg.size();
+  if (blockCount == 0) return;
+
+  // The graph dominance is computed on: the CFG itself, or the reversed
+  // CFG with a virtual exit (node blockCount) flowing into every RET block
+  size_t nodeCount = post ? blockCount + 1 : blockCount;
+  unsigned root = post ? static_cast<unsigned>(blockCount) : 0;
+  std::vector<std::vector<unsigned>> predecessors(nodeCount);
+  std::vector<std::vector<unsigned>> successors(nodeCount);
+  for (unsigned i = 0; i < blockCount; i++) {
+      for (unsigned successor : cfg.successors(i)) {
+          if (post) {
+              predecessors[i].push_back(successor);
+              successors[successor].push_back(i);
+          } else {
+              predecessors[successor].push_back(i);
+              successors[i].push_back(successor);
+          }
+      }
+  }
+  if (post) {
+      for (unsigned exit : cfg.exits()) {
+          predecessors[exit].push_back(root);
+          successors[root].push_back(exit);
+      }
+  }
+
+  // Reverse postorder of that graph; the CFG numbering already is one
+  std::vector<unsigned> order;
+  if (post) {
+      std::vector<bool> visited(nodeCount, false);
+      std::vector<std::pair<unsigned, size_t>> stack = {{root, 0}};
+      visited[root] = true;
+      while (!stack.empty()) {
+          auto& top = stack.back();
+          if (top.second == successors[top.first].size()) {
+              order.push_back(top.first);
+              stack.pop_back();
+              continue;
+          }
+          unsigned next = successors[top.first][top.second++];
+          if (!visited[next]) {
+              visited[next] = true;
+              stack.emplace_back(next, 0);
+          }
+      }
+      std::reverse(order.begin(), order.end());
+  } else {
+      for (unsigned i = 0; i < blockCount; i++) {
+          order.push_back(i);
+      }
+  }
+
+  computeIdoms(predecessors, order, root);
+
+  // Tree edges; children of the virtual exit are the roots
+  childBlocks.resize(nodeCount);
+  for (unsigned node : order) {
+      if (node == root) continue;
+      if (idoms[node] == root && post) {
+          rootBlocks.push_back(cfg.block(node));
+      } else {
+          childBlocks[idoms[node]].push_back(cfg.block(node));
+      }
+  }
+  if (!post) {
+      rootBlocks.push_back(cfg.block(0));
+  }
+
+  // Frontiers: walk up from each predecessor of a join point to its idom
+  frontiers.resize(nodeCount);
+  for (unsigned node : order) {
+      if (node == root || predecessors[node].size() < 2) continue;
+      for (unsigned predecessor : predecessors[node]) {
+          unsigned runner = predecessor;
+          while (idoms[runner] != CFG::NONE && runner != idoms[node]) {
+              std::vector<BasicBlock*>& frontier = frontiers[runner];
+              if (frontier.empty() || frontier.back() != cfg.block(node)) {
+                  frontier.push_back(cfg.block(node));
+              }
+              runner = idoms[runner];
+          }
+      }
+  }
+
+  // Preorder numbering of the tree
+  entryTime.assign(nodeCount, CFG::NONE);
+  exitTime.assign(nodeCount, CFG::NONE);
+  unsigned clock = 0;
+  std::vector<std::pair<unsigned, size_t>> stack = {{root, 0}};
+  entryTime[root] = clock++;
+  while (!stack.empty()) {
+      auto& top = stack.back();
+      const std::vector<BasicBlock*>& below = (post && top.first == root) ? rootBlocks : childBlocks[top.first];
+      if (top.second == below.size()) {
+          exitTime[top.first] = clock++;
+          stack.pop_back();
+          continue;
+      }
+      unsigned child = cfg.index(below[top.second++]);
+      entryTime[child] = clock++;
+      stack.emplace_back(child, 0);
+  }
+}
+
+void DominatorTree::computeIdoms(const std::vector<std::vector<unsigned>>& predecessors,
+                                 const std::vector<unsigned>& order, unsigned root) {
+  std::vector<unsigned> position(predecessors.size(), CFG::NONE);
+  for (unsigned i = 0; i < order.size(); i++) {
+      position[order[i]] = i;
+  }
+
+  idoms.assign(predecessors.size(), CFG::NONE);
+  idoms[root] = root;
+
+  // Walk both fingers up the partial tree until they meet
+  auto intersect = [&](unsigned a, unsigned b) {
+      while (a != b) {
+          while (position[a] > position[b]) a = idoms[a];
+          while (position[b] > position[a]) b = idoms[b];
+      }
+      return a;
+  };
+
+  bool changed = true;
+  while (changed) {
+      changed = false;
+      for (unsigned node : order) {
+          if (node == root) continue;
+
+          unsigned newIdom = CFG::NONE;
+          for (unsigned predecessor : predecessors[node]) {
+              if (idoms[predecessor] == CFG::NONE) continue;
+              newIdom = newIdom == CFG::NONE ? predecessor : intersect(predecessor, newIdom);
+          }
+          if (newIdom != idoms[node]) {
+              idoms[node] = newIdom;
+              changed = true;
+          }
+      }
+  }
+}
+
+unsigned DominatorTree::node(const BasicBlock* block) const {
+  unsigned index = cfg.index(block);
+  if (index == CFG::NONE || index >= entryTime.size() || entryTime[index] == CFG::NONE) {
+      return CFG::NONE;
+  }
+  return index;
+}
+
+BasicBlock* DominatorTree::idom(const BasicBlock* block) const {
+  unsigned index = node(block);
+  if (index == CFG::NONE) return nullptr;
+  unsigned parent = idoms[index];
+  if (parent == index || parent >= cfg.size()) return nullptr;
+  return cfg.block(parent);
+}
+
+bool DominatorTree::dominates(const BasicBlock* a, const BasicBlock* b) const {
+  if (a == b) return true;
+  unsigned na = node(a);
+  unsigned nb = node(b);
+  if (na == CFG::NONE || nb == CFG::NONE) return false;
+  return entryTime[na] <= entryTime[nb] && exitTime[nb] <= exitTime[na];
+}
+
+bool DominatorTree::dominates(const Instruction* a, const Instruction* b) const {
+  if (a->parent != b->parent) {
+      return dominates(a->parent, b->parent);
+  }
+
+  // Same block: whichever comes first (last, for post-dominance)
+  for (const auto& instruction : a->parent->instructions) {
+      if (instruction.get() == a) return !post || a == b;
+      if (instruction.get() == b) return post;
+  }
+  return false;
+}
+
+const std::vector<BasicBlock*>& DominatorTree::children(const BasicBlock* block) const {
+  unsigned index = node(block);
+  return index == CFG::NONE ? empty : childBlocks[index];
+}
+
+const std::vector<BasicBlock*>& DominatorTree::frontier(const BasicBlock* block) const {
+  unsigned index = node(block);
+  return index == CFG::NONE ? empty : frontiers[index];
+}
+
+std::vector<BasicBlock*> DominatorTree::preorder() const {
+  std::vector<BasicBlock*> result;
+  std::vector<BasicBlock*> stack(rootBlocks.rbegin(), rootBlocks.rend());
+  while (!stack.empty()) {
+      BasicBlock* block = stack.back();
+      stack.pop_back();
+      result.push_back(block);
+      const std::vector<BasicBlock*>& below = children(block);
+      stack.insert(stack.end(), below.rbegin(), below.rend());
+  }
+  return result;
+}
+
+// Loops
+
+bool Loop::contains(const Loop* loop) const {
+  for (; loop; loop = loop->parent) {
+      if (loop == this) return true;
+  }
+  return false;
+}
+
+BasicBlock* Loop::preheader() const {
+  BasicBlock* candidate = nullptr;
+  for (BasicBlock* predecessor : header->predecessors) {
+      if (contains(predecessor)) continue;
+      if (candidate) return nullptr;
+      candidate = predecessor;
+  }
+  if (!candidate || candidate->successors().size() != 1) return nullptr;
+  return candidate;
+}
+
+std::vector<BasicBlock*> Loop::exitingBlocks() const {
+  std::vector<BasicBlock*> result;
+  for (BasicBlock* block : blocks) {
+      for (BasicBlock* successor : block->successors()) {
+          if (!contains(successor)) {
+              result.push_back(block);
+              break;
+          }
+      }
+  }
+  return result;
+}
+
+std::vector<BasicBlock*> Loop::exitBlocks() const {
+  std::vector<BasicBlock*> result;
+  for (BasicBlock* block : blocks) {
+      for (BasicBlock* successor : block->successors()) {
+          if (!contains(successor) && std::find(result.begin(), result.end(), successor) == result.end()) {
+              result.push_back(successor);
+          }
+      }
+  }
+  return result;
+}
+
+LoopInfo::LoopInfo(const CFG& cfg, const DominatorTree& dominators) {
+  // One loop per header, with all of its back edges
+  for (unsigned h = 0; h < cfg.size(); h++) {
+      BasicBlock* header = cfg.block(h);
+      std::vector<unsigned> latches;
+      for (unsigned predecessor : cfg.predecessors(h)) {
+          if (dominators.dominates(header, cfg.block(predecessor))) {
+              latches.push_back(predecessor);
+          }
+      }
+      if (latches.empty()) continue;
+
+      // Body: everything that reaches a latch without passing the header
+      std::unique_ptr<Loop> loop(new Loop(header));
+      std::vector<unsigned> body = {h};
+      loop->members.insert(header);
+      std::vector<unsigned> worklist;
+      for (unsigned latch : latches) {
+          loop->latches.push_back(cfg.block(latch));
+          if (loop->members.insert(cfg.block(latch)).second) {
+              body.push_back(latch);
+              worklist.push_back(latch);
+          }
+      }
+      while (!worklist.empty()) {
+          unsigned current = worklist.back();
+          worklist.pop_back();
+          for (unsigned predecessor : cfg.predecessors(current)) {
+              if (loop->members.insert(cfg.block(predecessor)).second) {
+                  body.push_back(predecessor);
+                  worklist.push_back(predecessor);
+              }
+          }
+      }
+
+      // Header first, then the rest in reverse postorder
+      std::sort(body.begin(), body.end());
+      for (unsigned index : body) {
+          loop->blocks.push_back(cfg.block(index));
+      }
+      loops.push_back(std::move(loop));
+  }
+
+  // Natural loops with different headers are nested or disjoint, so the
+  // parent of a loop is the smallest other loop containing its header
+  std::vector<Loop*> bySize;
+  for (const auto& loop : loops) {
+      bySize.push_back(loop.get());
+  }
+  std::stable_sort(bySize.begin(), bySize.end(), [](const Loop* a, const Loop* b) {
+      return a->blocks.size() < b->blocks.size();
+  });
+  for (size_t i = 0; i < bySize.size(); i++) {
+      for (size_t j = i + 1; j < bySize.size(); j++) {
+          if (bySize[j]->contains(bySize[i]->header)) {
+              bySize[i]->parent = bySize[j];
+              break;
+          }
+      }
+      for (BasicBlock* block : bySize[i]->blocks) {
+          innermost.emplace(block, bySize[i]);
+      }
+  }
+
+  // Loops are in reverse postorder of their headers, so every parent is
+  // seen before its subloops
+  for (const auto& loop : loops) {
+      if (loop->parent) {
+          loop->depth = loop->parent->depth + 1;
+          loop->parent->subLoops.push_back(loop.get());
+      } else {
+          outermost.push_back(loop.get());
+      }
+  }
+}
+
+std::vector<Loop*> LoopInfo::loopsInnermostFirst() const {
+  std::vector<Loop*> result;
+  std::vector<std::pair<Loop*, size_t>> stack;
+  for (Loop* top : outermost) {
+      stack.emplace_back(top, 0);
+      while (!stack.empty()) {
+          auto& current = stack.back();
+          if (current.second == current.first->subLoops.size()) {
+              result.push_back(current.first);
+              stack.pop_back();
+              continue;
+          }
+          stack.emplace_back(current.first->subLoops[current.second++], 0);
+      }
+  }
+  return result;
+}
+
+Loop* LoopInfo::loopFor(const BasicBlock* block) const {
+  auto it = innermost.find(block);
+  return it != innermost.end() ? it->second : nullptr;
+}
+
+unsigned LoopInfo::depth(const BasicBlock* block) const {
+  Loop* loop = loopFor(block);
+  return loop ? loop->depth : 0;
+}
+
+bool LoopInfo::isHeader(const BasicBlock* block) const {
+  Loop* loop = loopFor(block);
+  return loop && loop->header == block;
+}
+
+BasicBlock* LoopInfo::insertPreheader(Loop* loop) {
+  if (BasicBlock* existing = loop->preheader()) {
+      return existing;
+  }
+
+  BasicBlock* header = loop->header;
+  Function* function = header->parent;
+  std::vector<BasicBlock*> outside;
+  for (BasicBlock* predecessor : header->predecessors) {
+      if (!loop->contains(predecessor)) {
+          outside.push_back(predecessor);
+      }
+  }
+
+  // Placed right before the header, so code entering the loop falls through
+  BasicBlock* preheader = function->createBlock("preheader");
+  function->moveBefore(preheader, header);
+
+  // Values entering the loop now flow in from the preheader; several
+  // different ones are merged there first
+  for (Instruction* phi : header->phis()) {
+      Value* same = phi->incomingFor(outside.front());
+      for (BasicBlock* predecessor : outside) {
+          if (phi->incomingFor(predecessor) != same) {
+              same = nullptr;
+              break;
+          }
+      }
+
+      Value* entering = same;
+      if (!entering) {
+          Instruction* merge = preheader->insertPhi(function->create(Opcode::PHI, phi->type));
+          for (BasicBlock* predecessor : outside) {
+              merge->addIncoming(phi->incomingFor(predecessor), predecessor);
+          }
+          entering = merge;
+      }
+      for (BasicBlock* predecessor : outside) {
+          phi->removeIncoming(predecessor);
+      }
+      phi->addIncoming(entering, preheader);
+  }
+
+  // Redirect the entering edges
+  for (BasicBlock* predecessor : outside) {
+      for (BasicBlock*& target : predecessor->getTerminator()->blocks) {
+          if (target == header) target = preheader;
+      }
+      std::replace(header->predecessors.begin(), header->predecessors.end(), predecessor, static_cast<BasicBlock*>(nullptr));
+  }
+  header->predecessors.erase(std::remove(header->predecessors.begin(), header->predecessors.end(), nullptr),
+                             header->predecessors.end());
+  header->predecessors.push_back(preheader);
+  preheader->predecessors = outside;
+
+  std::unique_ptr<Instruction> branch = function->create(Opcode::BR, Type::VOID);
+  branch->blocks.push_back(header);
+  preheader->append(std::move(branch));
+
+  // The preheader belongs to every loop enclosing this one
+  addBlock(preheader, loop->parent);
+  return preheader;
+}
+
+void LoopInfo::addBlock(BasicBlock* block, Loop* loop) {
+  if (!loop) return;
+  for (Loop* enclosing = loop; enclosing; enclosing = enclosing->parent) {
+      enclosing->members.insert(block);
+      enclosing->blocks.push_back(block);
+  }
+  innermost[block] = loop;
+}
+
+// Counted loops
+
+namespace {
+
+// The comparison of b and a equivalent to a <opcode> b
+Opcode swapComparison(Opcode opcode) {
+  switch (opcode) {
+      case Opcode::CMP_LT: return Opcode::CMP_GT;
+      case Opcode::CMP_LE: return Opcode::CMP_GE;
+      case Opcode::CMP_GT: return Opcode::CMP_LT;
+      case Opcode::CMP_GE: return Opcode::CMP_LE;
+      default: return opcode;
+  }
+}
+
+// The comparison true exactly when a <opcode> b is false
+Opcode invertComparison(Opcode opcode) {
+  switch (opcode) {
+      case Opcode::CMP_EQ: return Opcode::CMP_NE;
+      case Opcode::CMP_NE: return Opcode::CMP_EQ;
+      case Opcode::CMP_LT: return Opcode::CMP_GE;
+      case Opcode::CMP_LE: return Opcode::CMP_GT;
+      case Opcode::CMP_GT: return Opcode::CMP_LE;
+      default: return Opcode::CMP_LT;
+  }
+}
+
+// Step of a header phi that is an induction variable, or 0
+int64_t inductionStep(const Loop& loop, const Instruction* phi) {
+  if (!phi->isPhi() || phi->parent != loop.header || phi->type != Type::I32) return 0;
+  const Value* next = phi->incomingFor(loop.latches.front());
+  if (!next || !next->isInstruction()) return 0;
+  const Instruction* update = static_cast<const Instruction*>(next);
+  if (update->opcode != Opcode::ADD && update->opcode != Opcode::SUB) return 0;
+
+  const Value* left = update->getOperand(0);
+  const Value* right = update->getOperand(1);
+  if (update->opcode == Opcode::ADD && left->isConstant()) std::swap(left, right);
+  if (left != phi || !right->isConstant()) return 0;
+  int64_t step = static_cast<const Constant*>(right)->integer;
+  return update->opcode == Opcode::ADD ? step : -step;
+}
+
+// Iterations of a loop from start while counter <predicate> bound, stepping
+// by step; -1 when the test would never fail without the counter wrapping
+int64_t computeTripCount(Opcode predicate, int64_t start, int64_t bound, int64_t step) {
+  switch (predicate) {
+      case Opcode::CMP_LT:
+          if (start >= bound) return 0;
+          return step > 0 ? (bound - start + step - 1) / step : -1;
+      case Opcode::CMP_LE:
+          if (start > bound) return 0;
+          return step > 0 ? (bound - start) / step + 1 : -1;
+      case Opcode::CMP_GT:
+          if (start <= bound) return 0;
+          return step < 0 ? (start - bound - step - 1) / -step : -1;
+      case Opcode::CMP_GE:
+          if (start < bound) return 0;
+          return step < 0 ? (start - bound) / -step + 1 : -1;
+      case Opcode::CMP_NE:
+          if (start == bound) return 0;
+          if ((bound - start) % step != 0 || (bound - start) / step < 0) return -1;
+          return (bound - start) / step;
+      case Opcode::CMP_EQ:
+          return start == bound ? 1 : 0;
+      default:
+          return -1;
+  }
+}
+
+} // namespace
+
+bool analyzeCountedLoop(const Loop& loop, CountedLoop& counted) {
+  BasicBlock* header = loop.header;
+  std::vector<BasicBlock*> exiting = loop.exitingBlocks();
+  Instruction* branch = header->getTerminator();
+  if (loop.latches.size() != 1 || exiting.size() != 1 || exiting.front() != header ||
+      branch->opcode != Opcode::CONDBR) {
+      return false;
+  }
+
+  BasicBlock* entering = nullptr;
+  for (BasicBlock* predecessor : header->predecessors) {
+      if (loop.contains(predecessor)) continue;
+      if (entering) return false;
+      entering = predecessor;
+  }
+  if (!entering) return false;
+
+  // The test as left <predicate> right, true while the loop continues
+  Value* condition = branch->getOperand(0);
+  if (!condition->isInstruction()) return false;
+  Instruction* test = static_cast<Instruction*>(condition);
+  Opcode predicate = Opcode::CMP_NE;
+  Value* left = test;
+  Value* right = header->parent->getInteger(test->type, 0);
+  if (test->isComparison()) {
+      predicate = test->opcode;
+      left = test->getOperand(0);
+      right = test->getOperand(1);
+  } else if (test->opcode == Opcode::SUB && isIntegerType(test->type)) {
+      // a - b is nonzero exactly when a != b
+      left = test->getOperand(0);
+      right = test->getOperand(1);
+  }
+  if (!loop.contains(branch->blocks[0])) predicate = invertComparison(predicate);
+
+  if (!left->isInstruction() || inductionStep(loop, static_cast<Instruction*>(left)) == 0) {
+      std::swap(left, right);
+      predicate = swapComparison(predicate);
+  }
+  if (!left->isInstruction()) return false;
+  Instruction* counter = static_cast<Instruction*>(left);
+  int64_t step = inductionStep(loop, counter);
+  if (step == 0) return false;
+  if (right->isInstruction() && loop.contains(static_cast<Instruction*>(right)->parent)) return false;
+
+  counted.counter = counter;
+  counted.entering = entering;
+  counted.start = counter->incomingFor(entering);
+  counted.step = step;
+  counted.predicate = predicate;
+  counted.bound = right;
+  counted.tripCount = -1;
+  if (counted.start->isConstant() && right->isConstant() && right->type == Type::I32) {
+      counted.tripCount = computeTripCount(predicate, static_cast<const Constant*>(counted.start)->integer,
+                                           static_cast<const Constant*>(right)->integer, step);
+  }
+  return true;
+}
+
+// Induction variables
+
+namespace {
+
+int64_t wrap32(uint64_t value) {
+  return static_cast<int32_t>(value);
+}
+
+// a + factor * b, with equal terms merged and zero terms dropped
+LinearValue addLinear(const LinearValue& a, const LinearValue& b, int64_t factor) {
+  LinearValue result = a;
+  result.constant = wrap32(static_cast<uint64_t>(a.constant) + static_cast<uint64_t>(factor) * b.constant);
+  for (const auto& term : b.terms) {
+      int64_t added = wrap32(static_cast<uint64_t>(factor) * term.second);
+      auto it = std::find_if(result.terms.begin(), result.terms.end(), [&](const std::pair<Value*, int64_t>& existing) {
+          return existing.first == term.first;
+      });
+      if (it == result.terms.end()) {
+          result.terms.emplace_back(term.first, added);
+      } else {
+          it->second = wrap32(static_cast<uint64_t>(it->second) + added);
+      }
+  }
+  result.terms.erase(std::remove_if(result.terms.begin(), result.terms.end(), [](const std::pair<Value*, int64_t>& term) {
+      return term.second == 0;
+  }), result.terms.end());
+  std::sort(result.terms.begin(), result.terms.end(), [](const std::pair<Value*, int64_t>& x, const std::pair<Value*, int64_t>& y) {
+      return x.first->id < y.first->id;
+  });
+  return result;
+}
+
+// a * b, when one of them is a constant (otherwise the product is not linear)
+bool multiplyLinear(const LinearValue& a, const LinearValue& b, LinearValue& result) {
+  if (!a.isConstant() && !b.isConstant()) return false;
+  const LinearValue& factor = a.isConstant() ? a : b;
+  const LinearValue& other = a.isConstant() ? b : a;
+  result = addLinear(LinearValue(), other, factor.constant);
+  return true;
+}
+
+} // namespace
+
+InductionVariables::InductionVariables(const Loop& loop) : loop(loop) {
+  if (loop.latches.size() != 1) return;
+
+  for (Instruction* phi : loop.header->phis()) {
+      int64_t step = inductionStep(loop, phi);
+      if (step == 0) continue;
+      basicVariables.emplace_back(phi, step);
+      InductionValue& value = values[phi];
+      value.iv = phi;
+      value.scale.constant = 1;
+  }
+
+  // Blocks are in reverse postorder, so operands other than phis are
+  // described before their users
+  for (const BasicBlock* block : loop.blocks) {
+      for (const auto& instruction : block->instructions) {
+          if (instruction->type != Type::I32 || instruction->isPhi()) continue;
+          InductionValue value;
+          if (describeInstruction(instruction.get(), value)) {
+              values[instruction.get()] = value;
+          }
+      }
+  }
+}
+
+const InductionValue* InductionVariables::find(const Value* value) const {
+  auto it = values.find(value);
+  return it != values.end() ? &it->second : nullptr;
+}
+
+bool InductionVariables::describe(Value* operand, InductionValue& result) const {
+  result = InductionValue();
+  if (operand->isConstant()) {
+      if (operand->type != Type::I32) return false;
+      result.offset.constant = static_cast<const Constant*>(operand)->integer;
+      return true;
+  }
+  if (!operand->isInstruction() || operand->type != Type::I32) return false;
+  if (loop.contains(static_cast<const Instruction*>(operand)->parent)) {
+      const InductionValue* known = find(operand);
+      if (!known) return false;
+      result = *known;
+      return true;
+  }
+  result.offset.terms.emplace_back(operand, 1);
+  return true;
+}
+
+bool InductionVariables::describeInstruction(const Instruction* instruction, InductionValue& result) const {
+  InductionValue left;
+  InductionValue right;
+  switch (instruction->opcode) {
+      case Opcode::ADD:
+      case Opcode::SUB: {
+          if (!describe(instruction->getOperand(0), left) || !describe(instruction->getOperand(1), right)) return false;
+          if (left.iv && right.iv && left.iv != right.iv) return false;
+          int64_t factor = instruction->opcode == Opcode::ADD ? 1 : -1;
+          result.iv = left.iv ? left.iv : right.iv;
+          result.scale = addLinear(left.scale, right.scale, factor);
+          result.offset = addLinear(left.offset, right.offset, factor);
+          result.multiplies = left.multiplies || right.multiplies;
+          break;
+      }
+      case Opcode::NEG:
+          if (!describe(instruction->getOperand(0), left)) return false;
+          result.iv = left.iv;
+          result.scale = addLinear(LinearValue(), left.scale, -1);
+          result.offset = addLinear(LinearValue(), left.offset, -1);
+          result.multiplies = left.multiplies;
+          break;
+      case Opcode::MUL:
+      case Opcode::SHL: {
+          if (!describe(instruction->getOperand(0), left) || !describe(instruction->getOperand(1), right)) return false;
+          if (instruction->opcode == Opcode::SHL) {
+              if (right.iv || !right.offset.isConstant()) return false;
+              int64_t amount = right.offset.constant;
+              if (amount < 0 || amount > 31) return false;
+              right.offset.constant = wrap32(uint64_t(1) << amount);
+          }
+          if (left.iv && right.iv) return false;
+          if (!left.iv) std::swap(left, right);
+          result.iv = left.iv;
+          if (!multiplyLinear(left.scale, right.offset, result.scale) ||
+              !multiplyLinear(left.offset, right.offset, result.offset)) {
+              return false;
+          }
+          result.multiplies = left.multiplies || right.multiplies || left.iv != nullptr;
+          break;
+      }
+      default:
+          return false;
+  }
+
+  // What the variable contributes may cancel out
+  if (result.iv && result.scale.isConstant() && result.scale.constant == 0) result.iv = nullptr;
+  return true;
+}
+
+// Reductions
+
+namespace {
+
+// update = select(compare(l, r), t, f), where l, r and t, f are phi and
+// one other value, either way round
+bool analyzeMinMax(const Loop& loop, Instruction* phi, Instruction* update, Reduction& reduction) {
+  Value* condition = update->getOperand(0);
+  Value* t = update->getOperand(1);
+  Value* f = update->getOperand(2);
+  if (!condition->isInstruction() || (t == phi) == (f == phi)) return false;
+  Instruction* compare = static_cast<Instruction*>(condition);
+  switch (compare->opcode) {
+      case Opcode::CMP_LT:
+      case Opcode::CMP_LE:
+      case Opcode::CMP_GT:
+      case Opcode::CMP_GE:
+          break;
+      default:
+          return false;
+  }
+  Value* l = compare->getOperand(0);
+  Value* r = compare->getOperand(1);
+  if (!(l == t && r == f) && !(l == f && r == t)) return false;
+  if (!loop.contains(compare->parent) || compare->getUsers().size() != 1) return false;
+  for (Instruction* user : phi->getUsers()) {
+      if (user != update && user != compare && loop.contains(user->parent)) return false;
+  }
+  for (Instruction* user : update->getUsers()) {
+      if (user != phi) return false;
+  }
+
+  // select(l > r, l, r) keeps the larger, select(l > r, r, l) the smaller
+  bool greater = compare->opcode == Opcode::CMP_GT || compare->opcode == Opcode::CMP_GE;
+  reduction.phi = phi;
+  reduction.update = update;
+  reduction.combine = Opcode::SELECT;
+  reduction.predicate = greater == (t == l) ? Opcode::CMP_GT : Opcode::CMP_LT;
+  reduction.identity = 0;
+  return true;
+}
+
+} // namespace
+
+bool analyzeReduction(const Loop& loop, Instruction* phi, bool relaxedMath, Reduction& reduction) {
+  if (loop.latches.size() != 1 || !phi->isPhi() || phi->parent != loop.header) return false;
+  if (inductionStep(loop, phi) != 0) return false;
+
+  Value* next = phi->incomingFor(loop.latches.front());
+  if (!next || !next->isInstruction()) return false;
+  Instruction* update = static_cast<Instruction*>(next);
+  if (!loop.contains(update->parent) || update->type != phi->type) return false;
+
+  bool floating = isFloatType(laneType(phi->type));
+  if (!floating && !isIntegerType(laneType(phi->type))) return false;
+  if (floating && !relaxedMath) return false;
+  if (update->opcode == Opcode::SELECT) return analyzeMinMax(loop, phi, update, reduction);
+
+  if (update->numOperands() != 2) return false;
+  Value* a = update->getOperand(0);
+  Value* b = update->getOperand(1);
+  if ((a == phi) == (b == phi)) return false;
+  for (Instruction* user : phi->getUsers()) {
+      if (user != update && loop.contains(user->parent)) return false;
+  }
+  for (Instruction* user : update->getUsers()) {
+      if (user != phi) return false;
+  }
+
+  reduction.phi = phi;
+  reduction.update = update;
+  reduction.combine = update->opcode;
+  reduction.identity = 0;
+  switch (update->opcode) {
+      case Opcode::ADD:
+          return true;
+      case Opcode::SUB:
+          if (a != phi) return false;
+          reduction.combine = Opcode::ADD;
+          return true;
+      case Opcode::MUL:
+          reduction.identity = 1;
+          return true;
+      case Opcode::AND:
+          reduction.identity = -1;
+          return !floating;
+      case Opcode::OR:
+      case Opcode::XOR:
+          return !floating;
+      default:
+          return false;
+  }
+}
+
+} // namespace ir
+} // namespace ccc
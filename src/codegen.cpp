@@ -1,11 +1,41 @@
 #include "codegen.h"
+#include "allocation.h"
+#include "ir_builder.h"
+#include "pass.h"
 #include <sstream>
 
 namespace ccc {
 
+namespace {
+
+// COIL branch condition that holds after CMP a, b when a <comparison> b
+uint8_t branchCondition(ir::Opcode comparison) {
+    switch (comparison) {
+        case ir::Opcode::CMP_EQ: return coil::BranchCondition::EQ;
+        case ir::Opcode::CMP_NE: return coil::BranchCondition::NE;
+        case ir::Opcode::CMP_LT: return coil::BranchCondition::LT;
+        case ir::Opcode::CMP_LE: return coil::BranchCondition::LE;
+        case ir::Opcode::CMP_GT: return coil::BranchCondition::GT;
+        default:                 return coil::BranchCondition::GE;
+    }
+}
+
+uint8_t invertCondition(uint8_t condition) {
+    switch (condition) {
+        case coil::BranchCondition::EQ: return coil::BranchCondition::NE;
+        case coil::BranchCondition::NE: return coil::BranchCondition::EQ;
+        case coil::BranchCondition::LT: return coil::BranchCondition::GE;
+        case coil::BranchCondition::LE: return coil::BranchCondition::GT;
+        case coil::BranchCondition::GT: return coil::BranchCondition::LE;
+        default:                        return coil::BranchCondition::LT;
+    }
+}
+
+} // namespace
+
 CodeGenerator::CodeGenerator(int optimizationLevel, ErrorHandler& errorHandler)
     : optimizationLevel(optimizationLevel), errorHandler(errorHandler), 
-      nextVarId(1), labelCounter(0) {
+      irDump(nullptr), remarks(nullptr), relaxedMath(false), nextVarId(1), outOfVariables(false), labelCounter(0) {
 }
 
 coil::CoilObject CodeGenerator::generate(ASTNode* root) {
@@ -17,11 +47,34 @@ coil::CoilObject CodeGenerator::generate(ASTNode* root) {
     // Initialize COIL object
     initialize();
     
-    // Generate code based on the AST
-    if (root->getNodeType() == "ProgramNode") {
-        generateProgram(static_cast<ProgramNode*>(root));
-    } else {
+    if (root->kind != NodeKind::PROGRAM) {
         errorHandler.error(0, 0, "Expected program node as root");
+        return coilObject;
+    }
+    ProgramNode* program = static_cast<ProgramNode*>(root);
+    
+    // Global variables only need their symbols
+    for (const auto& declaration : program->declarations) {
+        if (declaration->kind == NodeKind::VARIABLE_DECLARATION) {
+            generateGlobalVariable(static_cast<VariableDeclarationNode*>(declaration.get()));
+        }
+    }
+    
+    // Functions go through the IR
+    IRBuilder builder(errorHandler);
+    std::unique_ptr<ir::Module> module = builder.build(program);
+    if (errorHandler.hasErrors()) {
+        return coilObject;
+    }
+    
+    // Optimize at the requested level
+    ir::PassManager passes;
+    passes.setRemarks(remarks);
+    ir::addStandardPasses(passes, optimizationLevel, relaxedMath);
+    passes.run(*module);
+    
+    for (const auto& function : module->functions) {
+        lowerFunction(*function);
     }
     
     return coilObject;
@@ -98,912 +151,653 @@ void CodeGenerator::initialize() {
     bssSectionIndex = coilObject.addSection(bssSection);
     
     // Initialize variable tracking
-    variables.clear();
+    valueVariables.clear();
+    blockLabels.clear();
     nextVarId = 1;
     
-    // Initialize scope stack
-    while (!scopeStack.empty()) {
-        scopeStack.pop();
-    }
-    
     // Initialize label counter
     labelCounter = 0;
     
     // Set up processor directive
-    std::vector<coil::Operand> procOperands = {
-        coil::Operand::createImmediate<uint8_t>(0x01) // CPU
+    std::vector<MachineOperand> procOperands = {
+        MachineOperand::immediate<uint8_t>(0x01) // CPU
     };
     emitInstruction(coil::Opcode::PROC, procOperands);
+    flushInstructions();
 }
 
-void CodeGenerator::generateProgram(ProgramNode* node) {
-    // Process all declarations in the program
-    for (const auto& declaration : node->declarations) {
-        if (declaration->getNodeType() == "FunctionDeclarationNode") {
-            generateFunctionDeclaration(static_cast<FunctionDeclarationNode*>(declaration.get()));
-        } else if (declaration->getNodeType() == "VariableDeclarationNode") {
-            generateVariableDeclaration(static_cast<VariableDeclarationNode*>(declaration.get()), true);
-        }
-        // Add other top-level declarations as needed
-    }
+void CodeGenerator::generateGlobalVariable(VariableDeclarationNode* node) {
+    // Global variable - add to data or bss section
+    uint16_t sectionIndex = node->initializer ? dataSectionIndex : bssSectionIndex;
+    
+    // Add variable symbol
+    addSymbol(node->name.lexeme, coil::SymbolFlags::GLOBAL | coil::SymbolFlags::DATA, sectionIndex);
+    
+    // Global variables will be set up by the linker, so we're done for now
+    // In a more complete implementation, we would add data directives for global variables
 }
 
-void CodeGenerator::generateFunctionDeclaration(FunctionDeclarationNode* node) {
-    // Set current function context
-    currentFunction = node->name.lexeme;
+void CodeGenerator::lowerFunction(ir::Function& function) {
+    // Phi copies are placed at the end of predecessors, which needs every
+    // edge into a block with phis to come from a block with one successor
+    function.splitCriticalEdges();
     
-    // Add function symbol
-    uint16_t functionSymbol = addSymbol(node->name.lexeme, coil::SymbolFlags::GLOBAL | coil::SymbolFlags::FUNCTION, textSectionIndex);
+    if (irDump) {
+        ir::print(*irDump, function);
+    }
     
-    // Start defining the function
-    emitLabel(node->name.lexeme);
+    valueVariables.clear();
+    blockLabels.clear();
+    scratchVariables.clear();
+    outOfVariables = false;
+    
+    // Values that are never live at the same time share a variable
+    ir::CFG cfg(function);
+    ir::Liveness liveness(cfg);
+    ir::VariableAllocation allocation(cfg, liveness);
+    if (allocation.size() >= UINT16_MAX) {
+        errorHandler.error(0, 0, "Function '" + function.name + "' needs " + std::to_string(allocation.size()) +
+                           " COIL variables (" + std::to_string(allocation.maxLive()) +
+                           " values live at once), more than the " + std::to_string(UINT16_MAX - 1) + " available");
+        return;
+    }
     
     // Define function symbol with SYM instruction
-    std::vector<coil::Operand> symOperands = {
-        coil::Operand::createSymbol(functionSymbol)
+    uint16_t functionSymbol = addSymbol(function.name, coil::SymbolFlags::GLOBAL | coil::SymbolFlags::FUNCTION, textSectionIndex);
+    std::vector<MachineOperand> symOperands = {
+        MachineOperand::symbol(functionSymbol)
     };
     emitInstruction(coil::Opcode::SYM, symOperands);
     
-    // Generate function body if it exists
-    if (node->body) {
-        // Begin function scope
-        enterScope();
-        
-        // Add parameters to the current scope
-        for (size_t i = 0; i < node->parameters.size(); i++) {
-            const auto& param = node->parameters[i];
-            if (!param->name.lexeme.empty()) {
-                uint16_t paramType = translateType(param->type.get());
-                uint16_t paramVarId = getNextVarId();
-                
-                // Add parameter to variables map
-                variables[param->name.lexeme] = Variable(param->name.lexeme, paramVarId, paramType);
-                
-                // Add to current scope for cleanup
-                scopeStack.top().push_back(param->name.lexeme);
-                
-                // Emit variable declaration
-                emitVarDeclaration(paramVarId, paramType);
-                
-                // Load parameter value from ABI
-                std::vector<coil::Operand> movOperands = {
-                    coil::Operand::createVariable(paramVarId),
-                    coil::Operand::createImmediate<uint16_t>(coil::Type::ABICTL | coil::Type::PARAM),
-                    coil::Operand::createImmediate<uint16_t>(static_cast<uint16_t>(i)) // Parameter index
-                };
-                emitInstruction(coil::Opcode::MOV, movOperands);
+    emitScopeEnter();
+    
+    // Variables are scoped to the function, so ids start over in each one
+    nextVarId = 1;
+    std::vector<uint16_t> varIds;
+    for (unsigned variable = 0; variable < allocation.size(); variable++) {
+        uint16_t varId = getNextVarId();
+        varIds.push_back(varId);
+        emitVarDeclaration(varId, allocation.type(variable));
+    }
+    size_t declarationsEnd = pendingInstructions.size();
+    for (const auto& block : function.blocks) {
+        blockLabels[block.get()] = generateLabel(block->name);
+        for (const auto& instruction : block->instructions) {
+            if (instruction->producesValue()) {
+                valueVariables[instruction.get()] = varIds[allocation.variable(instruction.get())];
             }
         }
-        
-        // Generate code for the function body
-        generateBlock(node->body.get());
-        
-        // If no explicit return statement in a non-void function, add one
-        // In a real compiler, we'd check the function return type
-        if (currentFunction == "main") {
-            std::vector<coil::Operand> retOperands = {
-                coil::Operand::createImmediate<uint16_t>(coil::Type::ABICTL | coil::Type::RET),
-                coil::Operand::createImmediate<int32_t>(0)
-            };
-            emitInstruction(coil::Opcode::RET, retOperands);
-        } else {
-            // For non-main functions, just add a simple return
-            std::vector<coil::Operand> retOperands;
-            emitInstruction(coil::Opcode::RET, retOperands);
-        }
-        
-        // End function scope
-        leaveScope();
     }
     
-    // Clear function context
-    currentFunction = "";
-}
-
-void CodeGenerator::generateVariableDeclaration(VariableDeclarationNode* node, bool isGlobal) {
-    // Get variable type
-    uint16_t varType = translateType(node->type.get());
-    
-    if (isGlobal) {
-        // Global variable - add to data or bss section
-        uint16_t sectionIndex = node->initializer ? dataSectionIndex : bssSectionIndex;
+    // Blocks in layout order; a branch to the next block falls through
+    for (size_t i = 0; i < function.blocks.size(); i++) {
+        const ir::BasicBlock* block = function.blocks[i].get();
+        const ir::BasicBlock* next = i + 1 < function.blocks.size() ? function.blocks[i + 1].get() : nullptr;
         
-        // Add variable symbol
-        uint16_t symbolIndex = addSymbol(node->name.lexeme, coil::SymbolFlags::GLOBAL | coil::SymbolFlags::DATA, sectionIndex);
-        
-        // Global variables will be set up by the linker, so we're done for now
-        // In a more complete implementation, we would add data directives for global variables
-    } else {
-        // Local variable - add to current scope
-        uint16_t varId = getNextVarId();
-        
-        // Add variable to variables map
-        variables[node->name.lexeme] = Variable(node->name.lexeme, varId, varType);
-        
-        // Add to current scope for cleanup
-        scopeStack.top().push_back(node->name.lexeme);
+        // Nothing branches to the entry block unless it is part of a loop
+        if (i > 0 || !block->predecessors.empty()) {
+            emitLabel(blockLabels[block]);
+        }
         
-        // Emit variable declaration
-        if (node->initializer) {
-            // Generate initializer expression
-            uint16_t initVarId = generateExpression(node->initializer.get());
-            
-            // Emit variable declaration with initializer
-            emitVarDeclaration(varId, varType, initVarId);
-        } else {
-            // Emit variable declaration without initializer
-            emitVarDeclaration(varId, varType);
+        for (const auto& instruction : block->instructions) {
+            if (instruction->isPhi() || isFusedComparison(*instruction)) {
+                continue;
+            }
+            if (instruction->isTerminator()) {
+                for (const ir::BasicBlock* successor : block->successors()) {
+                    lowerPhiCopies(block, successor);
+                }
+                lowerTerminator(*instruction, next);
+            } else {
+                lowerInstruction(*instruction);
+            }
+            releaseTempVars();
         }
     }
-}
-
-void CodeGenerator::generateBlock(BlockNode* node) {
-    // Enter a new scope for the block
-    emitScopeEnter();
-    enterScope();
     
-    // Generate code for each statement in the block
-    for (const auto& stmt : node->statements) {
-        generateStatement(stmt.get());
-    }
-    
-    // Leave the block scope
-    leaveScope();
     emitScopeLeave();
-}
-
-void CodeGenerator::generateStatement(StatementNode* node) {
-    if (!node) return;
     
-    if (node->getNodeType() == "BlockNode") {
-        generateBlock(static_cast<BlockNode*>(node));
-    } else if (node->getNodeType() == "ExpressionStatementNode") {
-        generateExpressionStatement(static_cast<ExpressionStatementNode*>(node));
-    } else if (node->getNodeType() == "VariableDeclarationNode") {
-        generateVariableDeclaration(static_cast<VariableDeclarationNode*>(node));
-    } else if (node->getNodeType() == "IfNode") {
-        generateIfStatement(static_cast<IfNode*>(node));
-    } else if (node->getNodeType() == "WhileNode") {
-        generateWhileStatement(static_cast<WhileNode*>(node));
-    } else if (node->getNodeType() == "DoWhileNode") {
-        generateDoWhileStatement(static_cast<DoWhileNode*>(node));
-    } else if (node->getNodeType() == "ForNode") {
-        generateForStatement(static_cast<ForNode*>(node));
-    } else if (node->getNodeType() == "ReturnNode") {
-        generateReturnStatement(static_cast<ReturnNode*>(node));
-    } else if (node->getNodeType() == "BreakNode") {
-        generateBreakStatement(static_cast<BreakNode*>(node));
-    } else if (node->getNodeType() == "ContinueNode") {
-        generateContinueStatement(static_cast<ContinueNode*>(node));
-    } else {
-        errorHandler.error(0, 0, "Unknown statement type: " + node->getNodeType());
+    if (outOfVariables) {
+        errorHandler.error(0, 0, "Function '" + function.name + "' needs more than the " +
+                           std::to_string(UINT16_MAX - 1) + " COIL variables available (" +
+                           std::to_string(allocation.size()) + " for its values, the rest scratch variables)");
+        pendingInstructions.clear();
+        return;
     }
-}
-
-void CodeGenerator::generateExpressionStatement(ExpressionStatementNode* node) {
-    // Generate the expression - result is discarded in an expression statement
-    generateExpression(node->expression.get());
-}
-
-void CodeGenerator::generateIfStatement(IfNode* node) {
-    // Generate labels for branches
-    std::string elseLabel = generateLabel("else");
-    std::string endIfLabel = generateLabel("endif");
-    
-    // Generate condition expression
-    uint16_t condVarId = generateExpression(node->condition.get());
-    
-    // Compare condition with 0 (false)
-    std::vector<coil::Operand> cmpOperands = {
-        coil::Operand::createVariable(condVarId),
-        coil::Operand::createImmediate<int32_t>(0)
-    };
-    emitInstruction(coil::Opcode::CMP, cmpOperands);
-    
-    // Branch to else if condition is false
-    std::vector<coil::Operand> branchOperands = {
-        coil::Operand::createSymbol(addSymbol(elseLabel))
-    };
-    emitInstruction(coil::Opcode::BR, branchOperands);
-    
-    // Generate then branch
-    generateStatement(node->thenBranch.get());
     
-    // Jump to end (skip else branch)
-    std::vector<coil::Operand> endBranchOperands = {
-        coil::Operand::createSymbol(addSymbol(endIfLabel))
-    };
-    emitInstruction(coil::Opcode::BR, endBranchOperands);
-    
-    // Else branch
-    emitLabel(elseLabel);
-    if (node->elseBranch) {
-        generateStatement(node->elseBranch.get());
-    }
-    
-    // End of if statement
-    emitLabel(endIfLabel);
-}
-
-void CodeGenerator::generateWhileStatement(WhileNode* node) {
-    // Generate labels for loop control
-    std::string startLabel = generateLabel("while_start");
-    std::string endLabel = generateLabel("while_end");
-    
-    // Start of loop
-    emitLabel(startLabel);
-    
-    // Generate condition expression
-    uint16_t condVarId = generateExpression(node->condition.get());
-    
-    // Compare condition with 0 (false)
-    std::vector<coil::Operand> cmpOperands = {
-        coil::Operand::createVariable(condVarId),
-        coil::Operand::createImmediate<int32_t>(0)
-    };
-    emitInstruction(coil::Opcode::CMP, cmpOperands);
-    
-    // Branch to end if condition is false
-    std::vector<coil::Operand> branchOperands = {
-        coil::Operand::createSymbol(addSymbol(endLabel))
-    };
-    emitInstruction(coil::Opcode::BR, branchOperands);
-    
-    // Generate loop body
-    generateStatement(node->body.get());
-    
-    // Jump back to start
-    std::vector<coil::Operand> loopBranchOperands = {
-        coil::Operand::createSymbol(addSymbol(startLabel))
-    };
-    emitInstruction(coil::Opcode::BR, loopBranchOperands);
-    
-    // End of loop
-    emitLabel(endLabel);
-}
-
-void CodeGenerator::generateDoWhileStatement(DoWhileNode* node) {
-    // Generate labels for loop control
-    std::string startLabel = generateLabel("dowhile_start");
-    std::string conditionLabel = generateLabel("dowhile_condition");
-    std::string endLabel = generateLabel("dowhile_end");
-    
-    // Start of loop
-    emitLabel(startLabel);
-    
-    // Generate loop body
-    generateStatement(node->body.get());
-    
-    // Condition check
-    emitLabel(conditionLabel);
-    uint16_t condVarId = generateExpression(node->condition.get());
-    
-    // Compare condition with 0 (false)
-    std::vector<coil::Operand> cmpOperands = {
-        coil::Operand::createVariable(condVarId),
-        coil::Operand::createImmediate<int32_t>(0)
-    };
-    emitInstruction(coil::Opcode::CMP, cmpOperands);
-    
-    // Branch to end if condition is false
-    std::vector<coil::Operand> branchOperands = {
-        coil::Operand::createSymbol(addSymbol(endLabel))
-    };
-    emitInstruction(coil::Opcode::BR, branchOperands);
-    
-    // Jump back to start
-    std::vector<coil::Operand> loopBranchOperands = {
-        coil::Operand::createSymbol(addSymbol(startLabel))
-    };
-    emitInstruction(coil::Opcode::BR, loopBranchOperands);
-    
-    // End of loop
-    emitLabel(endLabel);
-}
-
-void CodeGenerator::generateForStatement(ForNode* node) {
-    // Generate labels for loop control
-    std::string startLabel = generateLabel("for_start");
-    std::string incrementLabel = generateLabel("for_increment");
-    std::string endLabel = generateLabel("for_end");
-    
-    // Enter loop scope (for initializer variables)
-    emitScopeEnter();
-    enterScope();
-    
-    // Generate initializer
-    if (node->initializer) {
-        generateStatement(node->initializer.get());
-    }
-    
-    // Start of loop
-    emitLabel(startLabel);
-    
-    // Generate condition if present
-    if (node->condition) {
-        uint16_t condVarId = generateExpression(node->condition.get());
-        
-        // Compare condition with 0 (false)
-        std::vector<coil::Operand> cmpOperands = {
-            coil::Operand::createVariable(condVarId),
-            coil::Operand::createImmediate<int32_t>(0)
-        };
-        emitInstruction(coil::Opcode::CMP, cmpOperands);
-        
-        // Branch to end if condition is false
-        std::vector<coil::Operand> branchOperands = {
-            coil::Operand::createSymbol(addSymbol(endLabel))
-        };
-        emitInstruction(coil::Opcode::BR, branchOperands);
+    // Scratch variables join the declarations at the top of the scope
+    std::vector<MachineInstruction> body(pendingInstructions.begin() + declarationsEnd, pendingInstructions.end());
+    pendingInstructions.resize(declarationsEnd);
+    for (const ScratchVariable& scratch : scratchVariables) {
+        emitVarDeclaration(scratch.varId, scratch.type);
     }
+    pendingInstructions.insert(pendingInstructions.end(), body.begin(), body.end());
     
-    // Generate loop body
-    generateStatement(node->body.get());
-    
-    // Increment step
-    emitLabel(incrementLabel);
-    if (node->increment) {
-        generateExpression(node->increment.get());
+    // Clean up what lowering one instruction at a time left behind
+    if (optimizationLevel >= 1) {
+        unsigned removed = PeepholeOptimizer().run(pendingInstructions);
+        if (remarks && removed > 0) {
+            *remarks << "remark: " << function.name << ": peephole: removed " << removed << " instructions\n";
+        }
     }
-    
-    // Jump back to start
-    std::vector<coil::Operand> loopBranchOperands = {
-        coil::Operand::createSymbol(addSymbol(startLabel))
-    };
-    emitInstruction(coil::Opcode::BR, loopBranchOperands);
-    
-    // End of loop
-    emitLabel(endLabel);
-    
-    // Leave loop scope
-    leaveScope();
-    emitScopeLeave();
+    flushInstructions();
 }
 
-void CodeGenerator::generateReturnStatement(ReturnNode* node) {
-    // Generate return value if present
-    if (node->value) {
-        uint16_t returnVarId = generateExpression(node->value.get());
-        
-        // Return with value
-        std::vector<coil::Operand> retOperands = {
-            coil::Operand::createImmediate<uint16_t>(coil::Type::ABICTL | coil::Type::RET),
-            coil::Operand::createVariable(returnVarId)
-        };
-        emitInstruction(coil::Opcode::RET, retOperands);
-    } else {
-        // Return without value
-        std::vector<coil::Operand> retOperands = {
-            coil::Operand::createImmediate<uint16_t>(coil::Type::ABICTL | coil::Type::RET)
-        };
-        emitInstruction(coil::Opcode::RET, retOperands);
+bool CodeGenerator::isSiblingTailCall(const ir::Instruction& instruction) const {
+    if (optimizationLevel < 1 || !instruction.isTailCall()) {
+        return false;
     }
+    for (size_t i = 0; i < instruction.numOperands(); i++) {
+        const ir::Value* argument = instruction.getOperand(i);
+        if (!argument->isInstruction() || static_cast<const ir::Instruction*>(argument)->opcode != ir::Opcode::PARAM ||
+            static_cast<const ir::Instruction*>(argument)->index != i) {
+            return false;
+        }
+    }
+    return true;
 }
 
-void CodeGenerator::generateBreakStatement(BreakNode* node) {
-    // In a real compiler, we would keep track of loop/switch contexts
-    // and jump to the appropriate end label
-    errorHandler.warning(0, 0, "Break statement not fully implemented");
-}
-
-void CodeGenerator::generateContinueStatement(ContinueNode* node) {
-    // In a real compiler, we would keep track of loop contexts
-    // and jump to the appropriate continuation point
-    errorHandler.warning(0, 0, "Continue statement not fully implemented");
-}
-
-uint16_t CodeGenerator::generateExpression(ExpressionNode* node) {
-    if (!node) {
-        errorHandler.error(0, 0, "Null expression");
-        return 0;
+bool CodeGenerator::isFusedComparison(const ir::Instruction& instruction) const {
+    if (!instruction.isComparison() || instruction.getUsers().size() != 1) {
+        return false;
     }
-    
-    if (node->getNodeType() == "LiteralNode") {
-        return generateLiteral(static_cast<LiteralNode*>(node));
-    } else if (node->getNodeType() == "VariableNode") {
-        return generateVariable(static_cast<VariableNode*>(node));
-    } else if (node->getNodeType() == "UnaryNode") {
-        return generateUnary(static_cast<UnaryNode*>(node));
-    } else if (node->getNodeType() == "BinaryNode") {
-        return generateBinary(static_cast<BinaryNode*>(node));
-    } else if (node->getNodeType() == "CallNode") {
-        return generateCall(static_cast<CallNode*>(node));
-    } else if (node->getNodeType() == "ArrayAccessNode") {
-        return generateArrayAccess(static_cast<ArrayAccessNode*>(node));
-    } else if (node->getNodeType() == "MemberAccessNode") {
-        return generateMemberAccess(static_cast<MemberAccessNode*>(node));
-    } else if (node->getNodeType() == "ConditionalNode") {
-        return generateConditional(static_cast<ConditionalNode*>(node));
-    } else {
-        errorHandler.error(0, 0, "Unknown expression type: " + node->getNodeType());
-        return 0;
+    const ir::Instruction* user = instruction.getUsers().front();
+    if ((user->opcode != ir::Opcode::CONDBR && user->opcode != ir::Opcode::SELECT) ||
+        user->getOperand(0) != &instruction || ir::isVectorType(user->type) != ir::isVectorType(instruction.type)) {
+        return false;
     }
-}
-
-uint16_t CodeGenerator::generateLiteral(LiteralNode* node) {
-    // Create a temporary variable for the literal
-    uint16_t resultVarId = getNextVarId();
     
-    switch (node->token.type) {
-        case TokenType::INTEGER_LITERAL: {
-            // Parse integer value
-            int value = std::stoi(node->token.lexeme);
-            
-            // Declare a temporary variable
-            emitVarDeclaration(resultVarId, coil::Type::INT32);
+    // Right before the branch or select, so its operands' variables still
+    // hold them
+    auto position = instruction.parent->find(&instruction);
+    return std::next(position)->get() == user;
+}
+
+void CodeGenerator::lowerInstruction(const ir::Instruction& instruction) {
+    switch (instruction.opcode) {
+        case ir::Opcode::ADD:
+        case ir::Opcode::SUB:
+        case ir::Opcode::MUL:
+        case ir::Opcode::DIV:
+        case ir::Opcode::MOD:
+        case ir::Opcode::AND:
+        case ir::Opcode::OR:
+        case ir::Opcode::XOR:
+        case ir::Opcode::SHL:
+        case ir::Opcode::SHR: {
+            uint8_t opcode = coil::Opcode::ADD;
+            switch (instruction.opcode) {
+                case ir::Opcode::SUB: opcode = coil::Opcode::SUB; break;
+                case ir::Opcode::MUL: opcode = coil::Opcode::MUL; break;
+                case ir::Opcode::DIV: opcode = coil::Opcode::DIV; break;
+                case ir::Opcode::MOD: opcode = coil::Opcode::MOD; break;
+                case ir::Opcode::AND: opcode = coil::Opcode::AND; break;
+                case ir::Opcode::OR:  opcode = coil::Opcode::OR; break;
+                case ir::Opcode::XOR: opcode = coil::Opcode::XOR; break;
+                case ir::Opcode::SHL: opcode = coil::Opcode::SHL; break;
+                // All integer types are signed, so right shifts are arithmetic
+                case ir::Opcode::SHR: opcode = coil::Opcode::SAR; break;
+                default: break;
+            }
             
-            // Move literal value to variable
-            std::vector<coil::Operand> movOperands = {
-                coil::Operand::createVariable(resultVarId),
-                coil::Operand::createImmediate<int32_t>(value)
+            std::vector<MachineOperand> operands = {
+                MachineOperand::variable(valueVariables.at(&instruction)),
+                valueOperand(instruction.getOperand(0)),
+                valueOperand(instruction.getOperand(1))
             };
-            emitInstruction(coil::Opcode::MOV, movOperands);
+            emitInstruction(opcode, operands);
             break;
         }
-        case TokenType::FLOAT_LITERAL: {
-            // Parse float value
-            float value = std::stof(node->token.lexeme);
-            
-            // Declare a temporary variable
-            emitVarDeclaration(resultVarId, coil::Type::FP32);
-            
-            // Move literal value to variable
-            std::vector<coil::Operand> movOperands = {
-                coil::Operand::createVariable(resultVarId),
-                coil::Operand::createImmediate<float>(value)
+        case ir::Opcode::SEXT:
+        case ir::Opcode::TRUNC:
+        case ir::Opcode::SITOFP:
+        case ir::Opcode::FPTOSI:
+        case ir::Opcode::FPEXT:
+        case ir::Opcode::FPTRUNC: {
+            // COIL variables are typed, and a MOV converts its source to
+            // the type of its destination
+            std::vector<MachineOperand> operands = {
+                MachineOperand::variable(valueVariables.at(&instruction)),
+                valueOperand(instruction.getOperand(0))
             };
-            emitInstruction(coil::Opcode::MOV, movOperands);
+            emitInstruction(coil::Opcode::MOV, operands);
             break;
         }
-        case TokenType::CHAR_LITERAL: {
-            // Parse character value (handling escape sequences)
-            char value = node->token.lexeme[1]; // Skip the opening quote
-            if (value == '\\' && node->token.lexeme.length() > 2) {
-                // Handle escape sequence
-                char escape = node->token.lexeme[2];
-                switch (escape) {
-                    case 'n': value = '\n'; break;
-                    case 't': value = '\t'; break;
-                    case 'r': value = '\r'; break;
-                    case '0': value = '\0'; break;
-                    case '\\': value = '\\'; break;
-                    case '\'': value = '\''; break;
-                    case '\"': value = '\"'; break;
-                    default: value = escape;
-                }
-            }
-            
-            // Declare a temporary variable
-            emitVarDeclaration(resultVarId, coil::Type::INT8);
-            
-            // Move literal value to variable
-            std::vector<coil::Operand> movOperands = {
-                coil::Operand::createVariable(resultVarId),
-                coil::Operand::createImmediate<int8_t>(value)
+        case ir::Opcode::NEG:
+        case ir::Opcode::NOT: {
+            std::vector<MachineOperand> operands = {
+                MachineOperand::variable(valueVariables.at(&instruction)),
+                valueOperand(instruction.getOperand(0))
             };
-            emitInstruction(coil::Opcode::MOV, movOperands);
+            emitInstruction(instruction.opcode == ir::Opcode::NEG ? coil::Opcode::NEG : coil::Opcode::NOT, operands);
+            break;
+        }
+        case ir::Opcode::CMP_EQ:
+        case ir::Opcode::CMP_NE:
+        case ir::Opcode::CMP_LT:
+        case ir::Opcode::CMP_LE:
+        case ir::Opcode::CMP_GT:
+        case ir::Opcode::CMP_GE: {
+            // Only branches read the flags: set 1, and skip setting 0 when
+            // the comparison holds. Vectors compare lane by lane.
+            uint16_t leftLaneVarId = 0;
+            uint16_t rightLaneVarId = 0;
+            uint16_t resultLaneVarId = 0;
+            for (unsigned lane = 0; lane < ir::laneCount(instruction.type); lane++) {
+                MachineOperand result = laneOperand(&instruction, lane, resultLaneVarId);
+                std::vector<MachineOperand> cmpOperands = {
+                    laneOperand(instruction.getOperand(0), lane, leftLaneVarId),
+                    laneOperand(instruction.getOperand(1), lane, rightLaneVarId)
+                };
+                emitInstruction(coil::Opcode::CMP, cmpOperands);
+                emitInstruction(coil::Opcode::MOV, {result, MachineOperand::immediate<int32_t>(1)});
+                std::string holds = generateLabel("cmp_true");
+                emitConditionalJump(holds, branchCondition(instruction.opcode));
+                emitInstruction(coil::Opcode::MOV, {result, MachineOperand::immediate<int32_t>(0)});
+                emitLabel(holds);
+            }
             break;
         }
-        case TokenType::STRING_LITERAL: {
-            // Handle string literals (would be implemented with static data section)
-            errorHandler.warning(0, 0, "String literals not fully implemented");
+        case ir::Opcode::SELECT: {
+            // COIL has no select: compare, move in one operand and skip
+            // moving in the other unless the flags pick it. A comparison
+            // only the select uses, right before it, is compared here
+            // instead of being lowered by itself. Vectors go lane by lane.
+            const ir::Value* condition = instruction.getOperand(0);
+            const ir::Instruction* comparison = nullptr;
+            if (condition->isInstruction() && isFusedComparison(*static_cast<const ir::Instruction*>(condition))) {
+                comparison = static_cast<const ir::Instruction*>(condition);
+            }
+            uint8_t whenTrue = comparison ? branchCondition(comparison->opcode) : coil::BranchCondition::NE;
             
-            // For now, just create a placeholder char pointer
-            emitVarDeclaration(resultVarId, coil::Type::PTR);
+            // When the result shares a variable with one of the operands,
+            // only the other one has to move
+            const ir::Value* chosen = instruction.getOperand(1);
+            const ir::Value* other = instruction.getOperand(2);
+            uint16_t resultVarId = valueVariables.at(&instruction);
+            bool holdsChosen = chosen->isInstruction() && valueVariables.at(chosen) == resultVarId;
+            bool holdsOther = other->isInstruction() && valueVariables.at(other) == resultVarId;
             
-            // Set to null for now
-            std::vector<coil::Operand> movOperands = {
-                coil::Operand::createVariable(resultVarId),
-                coil::Operand::createImmediate<int32_t>(0)
-            };
-            emitInstruction(coil::Opcode::MOV, movOperands);
+            uint16_t leftLaneVarId = 0;
+            uint16_t rightLaneVarId = 0;
+            uint16_t chosenLaneVarId = 0;
+            uint16_t otherLaneVarId = 0;
+            uint16_t resultLaneVarId = 0;
+            for (unsigned lane = 0; lane < ir::laneCount(instruction.type); lane++) {
+                // Lanes are addressed before the CMP, so only moves follow
+                // it; the operands compared are often the ones chosen
+                MachineOperand result = laneOperand(&instruction, lane, resultLaneVarId);
+                MachineOperand whenChosen = holdsChosen ? result : laneOperand(chosen, lane, chosenLaneVarId);
+                MachineOperand whenOther = holdsOther ? result : laneOperand(other, lane, otherLaneVarId);
+                auto compared = [&](const ir::Value* value, uint16_t& laneVarId) {
+                    if (value == chosen) return whenChosen;
+                    if (value == other) return whenOther;
+                    return laneOperand(value, lane, laneVarId);
+                };
+                std::vector<MachineOperand> cmpOperands;
+                if (comparison) {
+                    cmpOperands = {compared(comparison->getOperand(0), leftLaneVarId),
+                                   compared(comparison->getOperand(1), rightLaneVarId)};
+                } else {
+                    cmpOperands = {laneOperand(condition, lane, leftLaneVarId), MachineOperand::immediate<int32_t>(0)};
+                }
+                emitInstruction(coil::Opcode::CMP, cmpOperands);
+                
+                std::string skip = generateLabel("select_done");
+                if (holdsChosen) {
+                    emitConditionalJump(skip, whenTrue);
+                    emitInstruction(coil::Opcode::MOV, {result, whenOther});
+                } else if (holdsOther) {
+                    emitConditionalJump(skip, invertCondition(whenTrue));
+                    emitInstruction(coil::Opcode::MOV, {result, whenChosen});
+                } else {
+                    emitInstruction(coil::Opcode::MOV, {result, whenOther});
+                    emitConditionalJump(skip, invertCondition(whenTrue));
+                    emitInstruction(coil::Opcode::MOV, {result, whenChosen});
+                }
+                emitLabel(skip);
+            }
             break;
         }
-        default:
-            errorHandler.error(0, 0, "Unknown literal type");
-            return 0;
-    }
-    
-    return resultVarId;
-}
-
-uint16_t CodeGenerator::generateVariable(VariableNode* node) {
-    // Look up the variable in our map
-    const std::string& name = node->name.lexeme;
-    auto it = variables.find(name);
-    
-    if (it == variables.end()) {
-        errorHandler.error(node->name.line, node->name.column, "Undefined variable: " + name);
-        return 0;
-    }
-    
-    // For variable access, we just return the variable ID
-    return it->second.varId;
-}
-
-uint16_t CodeGenerator::generateUnary(UnaryNode* node) {
-    // Generate the operand
-    uint16_t operandVarId = generateExpression(node->operand.get());
-    
-    // Create a temporary variable for the result
-    uint16_t resultVarId = getNextVarId();
-    
-    // The type of the result depends on the operation
-    uint16_t resultType = coil::Type::INT32; // Default
-    
-    // Determine the operation based on the operator
-    switch (node->op.type) {
-        case TokenType::OP_MINUS: {
-            // Unary minus (negation)
-            emitVarDeclaration(resultVarId, resultType);
-            
-            std::vector<coil::Operand> negOperands = {
-                coil::Operand::createVariable(resultVarId),
-                coil::Operand::createVariable(operandVarId)
+        case ir::Opcode::LOAD: {
+            // Address the element, then copy it out, so the value's
+            // variable stays free for the values that share it. A vector
+            // variable takes as many elements as it has lanes.
+            uint16_t elementVarId = createElementVar(instruction.type);
+            std::vector<MachineOperand> indexOperands = {
+                MachineOperand::variable(elementVarId),
+                valueOperand(instruction.getOperand(0)),
+                valueOperand(instruction.getOperand(1))
             };
-            emitInstruction(coil::Opcode::NEG, negOperands);
+            emitInstruction(coil::Opcode::INDEX, indexOperands);
+            emitInstruction(coil::Opcode::MOV, {MachineOperand::variable(valueVariables.at(&instruction)),
+                                                MachineOperand::variable(elementVarId)});
             break;
         }
-        case TokenType::OP_PLUS: {
-            // Unary plus (no-op)
-            emitVarDeclaration(resultVarId, resultType);
+        case ir::Opcode::STORE: {
+            // Address the element, then move the value into it
+            const ir::Value* value = instruction.getOperand(2);
+            uint16_t elementVarId = createElementVar(value->type);
+            std::vector<MachineOperand> indexOperands = {
+                MachineOperand::variable(elementVarId),
+                valueOperand(instruction.getOperand(0)),
+                valueOperand(instruction.getOperand(1))
+            };
+            emitInstruction(coil::Opcode::INDEX, indexOperands);
             
-            std::vector<coil::Operand> movOperands = {
-                coil::Operand::createVariable(resultVarId),
-                coil::Operand::createVariable(operandVarId)
+            std::vector<MachineOperand> movOperands = {
+                MachineOperand::variable(elementVarId),
+                valueOperand(value)
             };
             emitInstruction(coil::Opcode::MOV, movOperands);
             break;
         }
-        case TokenType::OP_EXCLAMATION: {
-            // Logical NOT
-            emitVarDeclaration(resultVarId, resultType);
-            
-            // COIL doesn't have a direct NOT instruction for booleans, so we do it with comparison
-            std::vector<coil::Operand> cmpOperands = {
-                coil::Operand::createVariable(operandVarId),
-                coil::Operand::createImmediate<int32_t>(0)
+        case ir::Opcode::ADDR: {
+            // base + index * size
+            uint16_t offsetVarId = createTempVar(ir::Type::I32);
+            std::vector<MachineOperand> mulOperands = {
+                MachineOperand::variable(offsetVarId),
+                valueOperand(instruction.getOperand(1)),
+                valueOperand(instruction.getOperand(2))
             };
-            emitInstruction(coil::Opcode::CMP, cmpOperands);
+            emitInstruction(coil::Opcode::MUL, mulOperands);
             
-            // Move 1 to result if operand was 0 (opposite of boolean value)
-            std::vector<coil::Operand> movOperands = {
-                coil::Operand::createVariable(resultVarId),
-                coil::Operand::createImmediate<int32_t>(1)
+            std::vector<MachineOperand> addOperands = {
+                MachineOperand::variable(valueVariables.at(&instruction)),
+                valueOperand(instruction.getOperand(0)),
+                MachineOperand::variable(offsetVarId)
             };
-            emitInstruction(coil::Opcode::MOV, movOperands);
-            
-            // TODO: This actually needs to be conditional using BR instruction
+            emitInstruction(coil::Opcode::ADD, addOperands);
             break;
         }
-        case TokenType::OP_TILDE: {
-            // Bitwise NOT
-            emitVarDeclaration(resultVarId, resultType);
-            
-            std::vector<coil::Operand> notOperands = {
-                coil::Operand::createVariable(resultVarId),
-                coil::Operand::createVariable(operandVarId)
+        case ir::Opcode::SPLAT: {
+            // Address each lane like a store addresses its element
+            const ir::Value* value = instruction.getOperand(0);
+            uint16_t laneVarId = createElementVar(value->type);
+            for (unsigned lane = 0; lane < ir::laneCount(instruction.type); lane++) {
+                std::vector<MachineOperand> indexOperands = {
+                    MachineOperand::variable(laneVarId),
+                    MachineOperand::variable(valueVariables.at(&instruction)),
+                    MachineOperand::immediate<int32_t>(static_cast<int32_t>(lane))
+                };
+                emitInstruction(coil::Opcode::INDEX, indexOperands);
+                
+                std::vector<MachineOperand> movOperands = {
+                    MachineOperand::variable(laneVarId),
+                    valueOperand(value)
+                };
+                emitInstruction(coil::Opcode::MOV, movOperands);
+            }
+            break;
+        }
+        case ir::Opcode::EXTRACT: {
+            // Like a load from the vector's lanes
+            uint16_t laneVarId = createElementVar(instruction.type);
+            std::vector<MachineOperand> indexOperands = {
+                MachineOperand::variable(laneVarId),
+                valueOperand(instruction.getOperand(0)),
+                valueOperand(instruction.getOperand(1))
             };
-            emitInstruction(coil::Opcode::NOT, notOperands);
+            emitInstruction(coil::Opcode::INDEX, indexOperands);
+            emitInstruction(coil::Opcode::MOV, {MachineOperand::variable(valueVariables.at(&instruction)),
+                                                MachineOperand::variable(laneVarId)});
             break;
         }
-        case TokenType::OP_PLUS_PLUS: {
-            // Increment
-            // Create a copy of the operand
-            emitVarDeclaration(resultVarId, resultType);
-            
-            std::vector<coil::Operand> movOperands = {
-                coil::Operand::createVariable(resultVarId),
-                coil::Operand::createVariable(operandVarId)
+        case ir::Opcode::PARAM: {
+            // Load parameter value from ABI
+            std::vector<MachineOperand> movOperands = {
+                MachineOperand::variable(valueVariables.at(&instruction)),
+                MachineOperand::immediate<uint16_t>(coil::Type::ABICTL | coil::Type::PARAM),
+                MachineOperand::immediate<uint16_t>(static_cast<uint16_t>(instruction.index))
             };
             emitInstruction(coil::Opcode::MOV, movOperands);
-            
-            // Increment the operand
-            std::vector<coil::Operand> incOperands = {
-                coil::Operand::createVariable(operandVarId)
-            };
-            emitInstruction(coil::Opcode::INC, incOperands);
             break;
         }
-        case TokenType::OP_MINUS_MINUS: {
-            // Decrement
-            // Create a copy of the operand
-            emitVarDeclaration(resultVarId, resultType);
-            
-            std::vector<coil::Operand> movOperands = {
-                coil::Operand::createVariable(resultVarId),
-                coil::Operand::createVariable(operandVarId)
+        case ir::Opcode::CALL: {
+            if (isSiblingTailCall(instruction)) {
+                emitJump(instruction.callee);
+                break;
+            }
+            std::vector<MachineOperand> callOperands = {
+                MachineOperand::symbol(addSymbol(instruction.callee)),
+                MachineOperand::immediate<uint16_t>(coil::Type::ABICTL | coil::Type::PARAM)
             };
-            emitInstruction(coil::Opcode::MOV, movOperands);
+            for (const ir::Value* argument : instruction.getOperands()) {
+                callOperands.push_back(valueOperand(argument));
+            }
+            emitInstruction(coil::Opcode::CALL, callOperands);
             
-            // Decrement the operand
-            std::vector<coil::Operand> decOperands = {
-                coil::Operand::createVariable(operandVarId)
-            };
-            emitInstruction(coil::Opcode::DEC, decOperands);
+            // Get the return value
+            if (instruction.producesValue()) {
+                std::vector<MachineOperand> movOperands = {
+                    MachineOperand::variable(valueVariables.at(&instruction)),
+                    MachineOperand::immediate<uint16_t>(coil::Type::ABICTL | coil::Type::RET)
+                };
+                emitInstruction(coil::Opcode::MOV, movOperands);
+            }
             break;
         }
-        case TokenType::OP_STAR: {
-            // Dereference operator (*)
-            // For now, just return the operand (which should be a pointer)
-            // In a real compiler, we would generate a load instruction
-            errorHandler.warning(0, 0, "Dereference operator not fully implemented");
-            return operandVarId;
-        }
-        case TokenType::OP_AMPERSAND: {
-            // Address-of operator (&)
-            // For now, just return the operand
-            // In a real compiler, we would generate an address computation
-            errorHandler.warning(0, 0, "Address-of operator not fully implemented");
-            return operandVarId;
-        }
         default:
-            errorHandler.error(node->op.line, node->op.column, 
-                              "Unknown unary operator: " + node->op.lexeme);
-            return 0;
+            errorHandler.error(0, 0, std::string("Cannot lower IR instruction: ") + ir::opcodeName(instruction.opcode));
+            break;
     }
-    
-    return resultVarId;
 }
 
-uint16_t CodeGenerator::generateBinary(BinaryNode* node) {
-    // Generate left and right operands
-    uint16_t leftVarId = generateExpression(node->left.get());
-    uint16_t rightVarId = generateExpression(node->right.get());
-    
-    // Create a temporary variable for the result
-    uint16_t resultVarId = getNextVarId();
-    
-    // The type of the result depends on the operation
-    uint16_t resultType = coil::Type::INT32; // Default
-    
-    // Determine the operation based on the operator
-    switch (node->op.type) {
-        case TokenType::OP_PLUS: {
-            // Addition
-            emitVarDeclaration(resultVarId, resultType);
-            
-            std::vector<coil::Operand> addOperands = {
-                coil::Operand::createVariable(resultVarId),
-                coil::Operand::createVariable(leftVarId),
-                coil::Operand::createVariable(rightVarId)
-            };
-            emitInstruction(coil::Opcode::ADD, addOperands);
-            break;
-        }
-        case TokenType::OP_MINUS: {
-            // Subtraction
-            emitVarDeclaration(resultVarId, resultType);
-            
-            std::vector<coil::Operand> subOperands = {
-                coil::Operand::createVariable(resultVarId),
-                coil::Operand::createVariable(leftVarId),
-                coil::Operand::createVariable(rightVarId)
-            };
-            emitInstruction(coil::Opcode::SUB, subOperands);
+void CodeGenerator::lowerTerminator(const ir::Instruction& terminator, const ir::BasicBlock* next) {
+    switch (terminator.opcode) {
+        case ir::Opcode::BR:
+            if (terminator.blocks[0] != next) {
+                emitJump(blockLabels.at(terminator.blocks[0]));
+            }
             break;
-        }
-        case TokenType::OP_STAR: {
-            // Multiplication
-            emitVarDeclaration(resultVarId, resultType);
+        case ir::Opcode::CONDBR: {
+            // A constant condition (left at -O0) always goes one way
+            const ir::Value* condition = terminator.getOperand(0);
+            if (condition->isConstant()) {
+                const ir::BasicBlock* taken = terminator.blocks[static_cast<const ir::Constant*>(condition)->isZero() ? 1 : 0];
+                if (taken != next) {
+                    emitJump(blockLabels.at(taken));
+                }
+                break;
+            }
             
-            std::vector<coil::Operand> mulOperands = {
-                coil::Operand::createVariable(resultVarId),
-                coil::Operand::createVariable(leftVarId),
-                coil::Operand::createVariable(rightVarId)
-            };
-            emitInstruction(coil::Opcode::MUL, mulOperands);
-            break;
-        }
-        case TokenType::OP_SLASH: {
-            // Division
-            emitVarDeclaration(resultVarId, resultType);
+            // Branch on the comparison that computes the condition, or
+            // compare the condition with 0 (false)
+            std::vector<MachineOperand> cmpOperands;
+            uint8_t whenTrue;
+            if (condition->isInstruction() && isFusedComparison(*static_cast<const ir::Instruction*>(condition))) {
+                const ir::Instruction* comparison = static_cast<const ir::Instruction*>(condition);
+                cmpOperands = {valueOperand(comparison->getOperand(0)), valueOperand(comparison->getOperand(1))};
+                whenTrue = branchCondition(comparison->opcode);
+            } else {
+                cmpOperands = {valueOperand(condition), MachineOperand::immediate<int32_t>(0)};
+                whenTrue = coil::BranchCondition::NE;
+            }
+            emitInstruction(coil::Opcode::CMP, cmpOperands);
             
-            std::vector<coil::Operand> divOperands = {
-                coil::Operand::createVariable(resultVarId),
-                coil::Operand::createVariable(leftVarId),
-                coil::Operand::createVariable(rightVarId)
-            };
-            emitInstruction(coil::Opcode::DIV, divOperands);
+            // Branch conditionally to the target that does not follow, and
+            // jump to the other one unless it follows
+            const ir::BasicBlock* taken = terminator.blocks[0];
+            const ir::BasicBlock* other = terminator.blocks[1];
+            uint8_t flags = whenTrue;
+            if (taken == next) {
+                std::swap(taken, other);
+                flags = invertCondition(whenTrue);
+            }
+            emitConditionalJump(blockLabels.at(taken), flags);
+            if (other != next) {
+                emitJump(blockLabels.at(other));
+            }
             break;
         }
-        case TokenType::OP_PERCENT: {
-            // Modulo
-            emitVarDeclaration(resultVarId, resultType);
-            
-            std::vector<coil::Operand> modOperands = {
-                coil::Operand::createVariable(resultVarId),
-                coil::Operand::createVariable(leftVarId),
-                coil::Operand::createVariable(rightVarId)
+        case ir::Opcode::RET: {
+            // The callee of a sibling tail call returns for us
+            if (terminator.parent->instructions.size() > 1 &&
+                isSiblingTailCall(*std::prev(terminator.parent->find(&terminator))->get())) {
+                break;
+            }
+            std::vector<MachineOperand> retOperands = {
+                MachineOperand::immediate<uint16_t>(coil::Type::ABICTL | coil::Type::RET)
             };
-            emitInstruction(coil::Opcode::MOD, modOperands);
+            if (terminator.numOperands() > 0) {
+                retOperands.push_back(valueOperand(terminator.getOperand(0)));
+            }
+            emitInstruction(coil::Opcode::RET, retOperands);
             break;
         }
-        case TokenType::OP_EQUALS: {
-            // Assignment
-            // For assignment, we just copy the right value to the left variable
-            std::vector<coil::Operand> movOperands = {
-                coil::Operand::createVariable(leftVarId),
-                coil::Operand::createVariable(rightVarId)
-            };
-            emitInstruction(coil::Opcode::MOV, movOperands);
-            
-            // Assignment expressions return the assigned value
-            return leftVarId;
-        }
-        // Add other binary operators as needed (comparison, bitwise, logical, etc.)
         default:
-            errorHandler.error(node->op.line, node->op.column, 
-                              "Binary operator not implemented: " + node->op.lexeme);
-            return 0;
+            break;
     }
-    
-    return resultVarId;
 }
 
-uint16_t CodeGenerator::generateCall(CallNode* node) {
-    // Generate the callee
-    // For simplicity, assume callee is a variable (function name)
-    std::string funcName;
-    if (node->callee->getNodeType() == "VariableNode") {
-        funcName = static_cast<VariableNode*>(node->callee.get())->name.lexeme;
-    } else {
-        errorHandler.error(0, 0, "Only simple function calls supported");
-        return 0;
+void CodeGenerator::lowerPhiCopies(const ir::BasicBlock* from, const ir::BasicBlock* to) {
+    std::vector<ir::Instruction*> phis = to->phis();
+    if (phis.empty()) {
+        return;
     }
     
-    // Generate arguments
-    std::vector<uint16_t> argVarIds;
-    for (const auto& arg : node->arguments) {
-        argVarIds.push_back(generateExpression(arg.get()));
+    // The copies happen in parallel: a phi reading another phi of the same
+    // block (a loop-carried swap) must see the old value, so those sources
+    // are saved into temporaries first
+    std::vector<MachineOperand> sources;
+    for (const ir::Instruction* phi : phis) {
+        const ir::Value* value = phi->incomingFor(from);
+        if (!value || value->isUndef()) {
+            // No copy is made for these
+            sources.push_back(MachineOperand::immediate<int32_t>(0));
+            continue;
+        }
+        if (value->isConstant()) {
+            sources.push_back(immediateOperand(static_cast<const ir::Constant*>(value)));
+            continue;
+        }
+        
+        const ir::Instruction* source = static_cast<const ir::Instruction*>(value);
+        if (source->isPhi() && source->parent == to && source != phi) {
+            uint16_t tempVarId = createTempVar(source->type);
+            std::vector<MachineOperand> saveOperands = {
+                MachineOperand::variable(tempVarId),
+                MachineOperand::variable(valueVariables.at(source))
+            };
+            emitInstruction(coil::Opcode::MOV, saveOperands);
+            sources.push_back(MachineOperand::variable(tempVarId));
+        } else {
+            sources.push_back(MachineOperand::variable(valueVariables.at(source)));
+        }
     }
     
-    // Create a variable for the return value
-    uint16_t returnVarId = getNextVarId();
-    emitVarDeclaration(returnVarId, coil::Type::INT32); // Assume int return type
-    
-    // Create the CALL instruction operands
-    std::vector<coil::Operand> callOperands;
-    
-    // First operand is the function symbol
-    uint16_t funcSymbol = addSymbol(funcName);
-    callOperands.push_back(coil::Operand::createSymbol(funcSymbol));
-    
-    // ABI control parameter
-    callOperands.push_back(coil::Operand::createImmediate<uint16_t>(coil::Type::ABICTL | coil::Type::PARAM));
-    
-    // Add all arguments
-    for (uint16_t argId : argVarIds) {
-        callOperands.push_back(coil::Operand::createVariable(argId));
+    for (size_t i = 0; i < phis.size(); i++) {
+        const ir::Value* value = phis[i]->incomingFor(from);
+        if (!value || value->isUndef() || value == phis[i]) {
+            continue;
+        }
+        // The allocation gives a phi its incoming value's variable when it can
+        if (value->isInstruction() && valueVariables.at(value) == valueVariables.at(phis[i])) {
+            continue;
+        }
+        std::vector<MachineOperand> movOperands = {
+            MachineOperand::variable(valueVariables.at(phis[i])),
+            sources[i]
+        };
+        emitInstruction(coil::Opcode::MOV, movOperands);
     }
-    
-    // Emit the call instruction
-    emitInstruction(coil::Opcode::CALL, callOperands);
-    
-    // Get the return value
-    std::vector<coil::Operand> movOperands = {
-        coil::Operand::createVariable(returnVarId),
-        coil::Operand::createImmediate<uint16_t>(coil::Type::ABICTL | coil::Type::RET)
-    };
-    emitInstruction(coil::Opcode::MOV, movOperands);
-    
-    return returnVarId;
+    releaseTempVars();
 }
 
-uint16_t CodeGenerator::generateArrayAccess(ArrayAccessNode* node) {
-    // Generate array and index expressions
-    uint16_t arrayVarId = generateExpression(node->array.get());
-    uint16_t indexVarId = generateExpression(node->index.get());
-    
-    // Create a result variable
-    uint16_t resultVarId = getNextVarId();
-    emitVarDeclaration(resultVarId, coil::Type::INT32); // Assume int array elements
-    
-    // Emit the array access instruction
-    std::vector<coil::Operand> indexOperands = {
-        coil::Operand::createVariable(resultVarId),
-        coil::Operand::createVariable(arrayVarId),
-        coil::Operand::createVariable(indexVarId)
-    };
-    emitInstruction(coil::Opcode::INDEX, indexOperands);
+MachineOperand CodeGenerator::valueOperand(const ir::Value* value) {
+    if (value->isInstruction()) {
+        return MachineOperand::variable(valueVariables.at(value));
+    }
+    if (value->isConstant()) {
+        return immediateOperand(static_cast<const ir::Constant*>(value));
+    }
     
-    return resultVarId;
+    // Undefined: any variable will do, so use a fresh one
+    return MachineOperand::variable(createTempVar(value->type));
 }
 
-uint16_t CodeGenerator::generateMemberAccess(MemberAccessNode* node) {
-    // Not implemented in this simple version
-    errorHandler.warning(0, 0, "Member access not implemented");
-    return 0;
-}
-
-uint16_t CodeGenerator::generateConditional(ConditionalNode* node) {
-    // Generate condition
-    uint16_t condVarId = generateExpression(node->condition.get());
-    
-    // Generate labels for the branches
-    std::string falseLabel = generateLabel("cond_false");
-    std::string endLabel = generateLabel("cond_end");
-    
-    // Create a result variable
-    uint16_t resultVarId = getNextVarId();
-    emitVarDeclaration(resultVarId, coil::Type::INT32); // Assume int result
-    
-    // Compare condition with zero
-    std::vector<coil::Operand> cmpOperands = {
-        coil::Operand::createVariable(condVarId),
-        coil::Operand::createImmediate<int32_t>(0)
-    };
-    emitInstruction(coil::Opcode::CMP, cmpOperands);
-    
-    // Branch to false part if condition is false
-    std::vector<coil::Operand> branchOperands = {
-        coil::Operand::createSymbol(addSymbol(falseLabel))
-    };
-    emitInstruction(coil::Opcode::BR, branchOperands);
-    
-    // True part
-    uint16_t trueVarId = generateExpression(node->trueExpr.get());
-    std::vector<coil::Operand> trueMovOperands = {
-        coil::Operand::createVariable(resultVarId),
-        coil::Operand::createVariable(trueVarId)
-    };
-    emitInstruction(coil::Opcode::MOV, trueMovOperands);
-    
-    // Jump to end
-    std::vector<coil::Operand> endBranchOperands = {
-        coil::Operand::createSymbol(addSymbol(endLabel))
-    };
-    emitInstruction(coil::Opcode::BR, endBranchOperands);
+MachineOperand CodeGenerator::laneOperand(const ir::Value* value, unsigned lane, uint16_t& laneVarId) {
+    if (!ir::isVectorType(value->type)) {
+        return valueOperand(value);
+    }
     
-    // False part
-    emitLabel(falseLabel);
-    uint16_t falseVarId = generateExpression(node->falseExpr.get());
-    std::vector<coil::Operand> falseMovOperands = {
-        coil::Operand::createVariable(resultVarId),
-        coil::Operand::createVariable(falseVarId)
+    // Address the lane like EXTRACT does, through one element variable
+    // for all of the value's lanes
+    if (laneVarId == 0) {
+        laneVarId = createElementVar(ir::laneType(value->type));
+    }
+    std::vector<MachineOperand> indexOperands = {
+        MachineOperand::variable(laneVarId),
+        valueOperand(value),
+        MachineOperand::immediate<int32_t>(static_cast<int32_t>(lane))
     };
-    emitInstruction(coil::Opcode::MOV, falseMovOperands);
-    
-    // End of conditional
-    emitLabel(endLabel);
-    
-    return resultVarId;
+    emitInstruction(coil::Opcode::INDEX, indexOperands);
+    return MachineOperand::variable(laneVarId);
+}
+
+MachineOperand CodeGenerator::immediateOperand(const ir::Constant* constant) {
+    // An immediate of the constant's width
+    switch (constant->type) {
+        case ir::Type::I8:
+            return MachineOperand::immediate<int8_t>(static_cast<int8_t>(constant->integer));
+        case ir::Type::F32:
+            return MachineOperand::immediate<float>(static_cast<float>(constant->floating));
+        case ir::Type::F64:
+            return MachineOperand::immediate<double>(constant->floating);
+        default:
+            return MachineOperand::immediate<int32_t>(static_cast<int32_t>(constant->integer));
+    }
 }
 
 // Helper methods
 
-uint16_t CodeGenerator::createTempVar(uint16_t type) {
+uint16_t CodeGenerator::createTempVar(ir::Type type, bool element) {
+    // Reuse a scratch variable of the same type and kind that is free again
+    for (ScratchVariable& scratch : scratchVariables) {
+        if (!scratch.busy && scratch.type == type && scratch.element == element) {
+            scratch.busy = true;
+            return scratch.varId;
+        }
+    }
+    
+    // Out of ids: lowerFunction reports it and drops the code, so any
+    // variable will do until then
+    if (nextVarId >= UINT16_MAX) {
+        outOfVariables = true;
+        return UINT16_MAX - 1;
+    }
     uint16_t varId = getNextVarId();
-    emitVarDeclaration(varId, type);
+    scratchVariables.push_back({varId, type, element, true});
     return varId;
 }
 
-uint16_t CodeGenerator::translateType(TypeNode* typeNode) {
-    // Map AST type to COIL type
-    if (typeNode->name.type == TokenType::KW_INT) {
-        if (typeNode->isPointer) {
-            return coil::Type::PTR;
-        }
-        return coil::Type::INT32;
-    } else if (typeNode->name.type == TokenType::KW_CHAR) {
-        if (typeNode->isPointer) {
-            return coil::Type::PTR;
-        }
-        return coil::Type::INT8;
-    } else if (typeNode->name.type == TokenType::KW_FLOAT) {
-        return coil::Type::FP32;
-    } else if (typeNode->name.type == TokenType::KW_DOUBLE) {
-        return coil::Type::FP64;
-    } else if (typeNode->name.type == TokenType::KW_VOID) {
-        if (typeNode->isPointer) {
+void CodeGenerator::releaseTempVars() {
+    for (ScratchVariable& scratch : scratchVariables) {
+        scratch.busy = false;
+    }
+}
+
+uint16_t CodeGenerator::translateType(ir::Type type) {
+    // Map IR type to COIL type
+    switch (type) {
+        case ir::Type::VOID:
+            return coil::Type::VOID;
+        case ir::Type::I8:
+            return coil::Type::INT8;
+        case ir::Type::I32:
+            return coil::Type::INT32;
+        case ir::Type::F32:
+            return coil::Type::FP32;
+        case ir::Type::F64:
+            return coil::Type::FP64;
+        case ir::Type::PTR:
             return coil::Type::PTR;
-        }
-        return coil::Type::VOID;
+        case ir::Type::V4I32:
+        case ir::Type::V4F32:
+            return coil::Type::V128;
     }
     
     // Default to int
-    errorHandler.warning(typeNode->name.line, typeNode->name.column, 
-                       "Unknown type '" + typeNode->name.lexeme + "', defaulting to int");
     return coil::Type::INT32;
 }
 
@@ -1032,53 +826,54 @@ uint16_t CodeGenerator::addSymbol(const std::string& name, uint32_t attributes,
     return coilObject.addSymbol(symbol);
 }
 
-void CodeGenerator::enterScope() {
-    // Push a new scope onto the stack
-    scopeStack.push({});
+// Instruction emission methods
+
+void CodeGenerator::emitInstruction(uint8_t opcode, const std::vector<MachineOperand>& operands) {
+    // Held back until the function is complete
+    pendingInstructions.push_back({opcode, operands});
 }
 
-void CodeGenerator::leaveScope() {
-    // Clean up variables in the current scope
-    if (!scopeStack.empty()) {
-        for (const std::string& varName : scopeStack.top()) {
-            variables.erase(varName);
+void CodeGenerator::flushInstructions() {
+    for (const MachineInstruction& pending : pendingInstructions) {
+        std::vector<coil::Operand> operands;
+        for (const MachineOperand& operand : pending.operands) {
+            operands.push_back(operand.lower());
         }
-        scopeStack.pop();
+        
+        // Add it to the text section
+        coil::Instruction instruction(pending.opcode, operands);
+        coilObject.addInstruction(textSectionIndex, instruction);
     }
-}
-
-// Instruction emission methods
-
-void CodeGenerator::emitInstruction(uint8_t opcode, const std::vector<coil::Operand>& operands) {
-    // Create an instruction
-    coil::Instruction instruction(opcode, operands);
-    
-    // Add it to the text section
-    coilObject.addInstruction(textSectionIndex, instruction);
+    pendingInstructions.clear();
 }
 
 void CodeGenerator::emitScopeEnter() {
     // Emit SCOPEE instruction
-    std::vector<coil::Operand> operands;
+    std::vector<MachineOperand> operands;
     emitInstruction(coil::Opcode::SCOPEE, operands);
 }
 
 void CodeGenerator::emitScopeLeave() {
     // Emit SCOPEL instruction
-    std::vector<coil::Operand> operands;
+    std::vector<MachineOperand> operands;
     emitInstruction(coil::Opcode::SCOPEL, operands);
 }
 
-void CodeGenerator::emitVarDeclaration(uint16_t varId, uint16_t type, uint16_t initializer) {
+void CodeGenerator::emitVarDeclaration(uint16_t varId, ir::Type type, uint16_t initializer) {
     // Create VAR instruction operands
-    std::vector<coil::Operand> varOperands = {
-        coil::Operand::createVariable(varId),
-        coil::Operand::createImmediate<uint16_t>(type)
+    std::vector<MachineOperand> varOperands = {
+        MachineOperand::variable(varId),
+        MachineOperand::immediate<uint16_t>(translateType(type))
     };
     
+    // Vector variables also give the type of their lanes
+    if (ir::isVectorType(type)) {
+        varOperands.push_back(MachineOperand::immediate<uint16_t>(translateType(ir::laneType(type))));
+    }
+    
     // Add initializer if provided
     if (initializer != 0) {
-        varOperands.push_back(coil::Operand::createVariable(initializer));
+        varOperands.push_back(MachineOperand::variable(initializer));
     }
     
     // Emit the VAR instruction
@@ -1090,8 +885,8 @@ void CodeGenerator::emitLabel(const std::string& label) {
     uint16_t symbolIndex = addSymbol(label, 0, textSectionIndex);
     
     // Create the SYM instruction
-    std::vector<coil::Operand> symOperands = {
-        coil::Operand::createSymbol(symbolIndex)
+    std::vector<MachineOperand> symOperands = {
+        MachineOperand::symbol(symbolIndex)
     };
     
     // Emit the SYM instruction
@@ -1103,22 +898,22 @@ void CodeGenerator::emitJump(const std::string& label) {
     uint16_t symbolIndex = addSymbol(label);
     
     // Create the BR instruction
-    std::vector<coil::Operand> brOperands = {
-        coil::Operand::createSymbol(symbolIndex)
+    std::vector<MachineOperand> brOperands = {
+        MachineOperand::symbol(symbolIndex)
     };
     
     // Emit the BR instruction
     emitInstruction(coil::Opcode::BR, brOperands);
 }
 
-void CodeGenerator::emitConditionalJump(const std::string& label, const std::string& condition) {
+void CodeGenerator::emitConditionalJump(const std::string& label, uint8_t condition) {
     // Find or create the symbol for the target label
     uint16_t symbolIndex = addSymbol(label);
     
-    // Create the BR instruction with condition
-    std::vector<coil::Operand> brOperands = {
-        coil::Operand::createSymbol(symbolIndex)
-        // We'd add condition operands here in a full implementation
+    // Create the BR instruction with the flags it tests
+    std::vector<MachineOperand> brOperands = {
+        MachineOperand::symbol(symbolIndex),
+        MachineOperand::immediate<uint8_t>(condition)
     };
     
     // Emit the BR instruction
@@ -0,0 +1,332 @@
+#include "constant.h"
+#include "ast.h"
+#include "error.h"
+#include "types.h"
+#include <cmath>
+#include <cstdlib>
+
+namespace ccc {
+
+namespace {
+
+// Decode the value of a character literal such as 'a' or '\n'
+int64_t decodeCharacter(const std::string& lexeme) {
+  if (lexeme.length() < 3) return 0;
+
+  char value = lexeme[1];
+  if (value == '\\' && lexeme.length() > 3) {
+      switch (lexeme[2]) {
+          case 'a': value = '\a'; break;
+          case 'b': value = '\b'; break;
+          case 'f': value = '\f'; break;
+          case 'n': value = '\n'; break;
+          case 'r': value = '\r'; break;
+          case 't': value = '\t'; break;
+          case 'v': value = '\v'; break;
+          case '0': value = '\0'; break;
+          default:  value = lexeme[2]; break;
+      }
+  }
+  return static_cast<signed char>(value);
+}
+
+} // namespace
+
+ConstantEvaluator::ConstantEvaluator(ErrorHandler& errorHandler)
+  : errorHandler(errorHandler) {
+}
+
+ConstantValue ConstantEvaluator::evaluate(ExpressionNode* node) {
+  if (!node || !node->type) return ConstantValue();
+
+  switch (node->kind) {
+      case NodeKind::LITERAL:
+          return evaluateLiteral(static_cast<LiteralNode*>(node));
+      case NodeKind::UNARY:
+          return evaluateUnary(static_cast<UnaryNode*>(node));
+      case NodeKind::BINARY:
+          return evaluateBinary(static_cast<BinaryNode*>(node));
+      case NodeKind::CONDITIONAL:
+          return evaluateConditional(static_cast<ConditionalNode*>(node));
+      default:
+          // Variables, calls and memory accesses are never constant expressions
+          return ConstantValue();
+  }
+}
+
+ConstantValue ConstantEvaluator::convert(const ConstantValue& value, const TypeInfo* type,
+                                         int line, int column) {
+  if (!value.isConstant() || !type || !type->isNumeric()) {
+      return ConstantValue();
+  }
+
+  if (type->isFloatingPoint()) {
+      double result = value.isInteger() ? static_cast<double>(value.integer) : value.floating;
+      if (type->kind == TypeInfo::Kind::FLOAT) {
+          result = static_cast<float>(result);
+      }
+      return ConstantValue::makeFloating(result);
+  }
+
+  if (value.isInteger()) {
+      // Integer to integer conversions wrap silently (implementation-defined in C)
+      int bits = type->size * 8;
+      uint64_t mask = (uint64_t(1) << bits) - 1;
+      uint64_t raw = static_cast<uint64_t>(value.integer) & mask;
+      uint64_t sign = uint64_t(1) << (bits - 1);
+      return ConstantValue::makeInteger(static_cast<int64_t>((raw ^ sign) - sign));
+  }
+
+  // Floating to integer truncates toward zero; out of range is undefined
+  double truncated = std::trunc(value.floating);
+  double limit = std::ldexp(1.0, type->size * 8 - 1);
+  if (std::isnan(truncated) || truncated < -limit || truncated >= limit) {
+      errorHandler.warning(line, column, "Constant " + std::to_string(value.floating) +
+                           " is out of range for type '" + type->toString() + "'");
+      return ConstantValue();
+  }
+  return ConstantValue::makeInteger(static_cast<int64_t>(truncated));
+}
+
+ConstantValue ConstantEvaluator::wrapInteger(int64_t value, const TypeInfo* type, int line, int column) {
+  ConstantValue result = convert(ConstantValue::makeInteger(value), type);
+  if (result.isInteger() && result.integer != value) {
+      errorHandler.warning(line, column, "Integer overflow in constant expression");
+  }
+  return result;
+}
+
+ConstantValue ConstantEvaluator::evaluateLiteral(LiteralNode* node) {
+  const Token& token = node->token;
+
+  switch (token.type) {
+      case TokenType::INTEGER_LITERAL: {
+          // Decimal digits, possibly followed by u/l suffixes
+          int64_t value = 0;
+          bool tooLarge = false;
+          for (char c : token.lexeme) {
+              if (c < '0' || c > '9') break;
+              if (value > (INT64_MAX - (c - '0')) / 10) {
+                  tooLarge = true;
+                  break;
+              }
+              value = value * 10 + (c - '0');
+          }
+
+          ConstantValue result = convert(ConstantValue::makeInteger(value), node->type);
+          if (tooLarge || (result.isInteger() && result.integer != value)) {
+              errorHandler.warning(token.line, token.column, "Integer constant " + token.lexeme +
+                                   " is too large for type '" + node->type->toString() + "'");
+          }
+          return result;
+      }
+      case TokenType::FLOAT_LITERAL:
+          return convert(ConstantValue::makeFloating(std::strtod(token.lexeme.c_str(), nullptr)), node->type);
+      case TokenType::CHAR_LITERAL:
+          return convert(ConstantValue::makeInteger(decodeCharacter(token.lexeme)), node->type);
+      default:
+          // String literals are arrays, not arithmetic constants
+          return ConstantValue();
+  }
+}
+
+ConstantValue ConstantEvaluator::evaluateUnary(UnaryNode* node) {
+  if (!node->operand) return ConstantValue();
+
+  const ConstantValue& operand = node->operand->constant;
+  if (!operand.isConstant()) return ConstantValue();
+
+  int line = node->op.line;
+  int column = node->op.column;
+
+  switch (node->op.type) {
+      case TokenType::OP_PLUS:
+          return convert(operand, node->type, line, column);
+
+      case TokenType::OP_MINUS: {
+          ConstantValue value = convert(operand, node->type, line, column);
+          if (value.isInteger()) {
+              return wrapInteger(-value.integer, node->type, line, column);
+          }
+          if (value.isFloating()) {
+              return ConstantValue::makeFloating(-value.floating);
+          }
+          return ConstantValue();
+      }
+
+      case TokenType::OP_TILDE: {
+          ConstantValue value = convert(operand, node->type, line, column);
+          if (!value.isInteger()) return ConstantValue();
+          return wrapInteger(~value.integer, node->type, line, column);
+      }
+
+      case TokenType::OP_EXCLAMATION:
+          return ConstantValue::makeInteger(operand.isTrue() ? 0 : 1);
+
+      default:
+          // ++, --, * and & need an object
+          return ConstantValue();
+  }
+}
+
+ConstantValue ConstantEvaluator::evaluateBinary(BinaryNode* node) {
+  if (!node->left || !node->right) return ConstantValue();
+
+  const ConstantValue& left = node->left->constant;
+  const ConstantValue& right = node->right->constant;
+  int line = node->op.line;
+  int column = node->op.column;
+
+  // Logical operators fold as soon as the left operand decides the result
+  if (node->op.type == TokenType::OP_LOGICAL_AND || node->op.type == TokenType::OP_LOGICAL_OR) {
+      bool isAnd = node->op.type == TokenType::OP_LOGICAL_AND;
+      if (left.isConstant() && left.isTrue() != isAnd) {
+          return ConstantValue::makeInteger(isAnd ? 0 : 1);
+      }
+      if (left.isConstant() && right.isConstant()) {
+          return ConstantValue::makeInteger(right.isTrue() ? 1 : 0);
+      }
+      return ConstantValue();
+  }
+
+  if (!left.isConstant() || !right.isConstant()) return ConstantValue();
+
+  switch (node->op.type) {
+      case TokenType::OP_LESS:
+      case TokenType::OP_LESS_EQUALS:
+      case TokenType::OP_GREATER:
+      case TokenType::OP_GREATER_EQUALS:
+      case TokenType::OP_EQUALS_EQUALS:
+      case TokenType::OP_NOT_EQUALS: {
+          // Compare in the common type of the operands; double holds every
+          // int and float value exactly
+          const TypeInfo* leftType = node->left->type;
+          const TypeInfo* rightType = node->right->type;
+          if (!leftType || !rightType || !leftType->isNumeric() || !rightType->isNumeric()) {
+              return ConstantValue();
+          }
+
+          int order;
+          if (left.isFloating() || right.isFloating()) {
+              double a = left.isInteger() ? static_cast<double>(left.integer) : left.floating;
+              double b = right.isInteger() ? static_cast<double>(right.integer) : right.floating;
+              if (std::isnan(a) || std::isnan(b)) {
+                  // Unordered: only != holds
+                  return ConstantValue::makeInteger(node->op.type == TokenType::OP_NOT_EQUALS ? 1 : 0);
+              }
+              order = a < b ? -1 : (a > b ? 1 : 0);
+          } else {
+              order = left.integer < right.integer ? -1 : (left.integer > right.integer ? 1 : 0);
+          }
+
+          bool result = false;
+          switch (node->op.type) {
+              case TokenType::OP_LESS:           result = order < 0; break;
+              case TokenType::OP_LESS_EQUALS:    result = order <= 0; break;
+              case TokenType::OP_GREATER:        result = order > 0; break;
+              case TokenType::OP_GREATER_EQUALS: result = order >= 0; break;
+              case TokenType::OP_EQUALS_EQUALS:  result = order == 0; break;
+              default:                           result = order != 0; break;
+          }
+          return ConstantValue::makeInteger(result ? 1 : 0);
+      }
+
+      case TokenType::OP_SHL:
+      case TokenType::OP_SHR: {
+          // The result has the promoted type of the left operand
+          ConstantValue value = convert(left, node->type, line, column);
+          if (!value.isInteger() || !right.isInteger()) return ConstantValue();
+
+          int bits = node->type->size * 8;
+          if (right.integer < 0 || right.integer >= bits) {
+              errorHandler.warning(line, column, "Shift count " + std::to_string(right.integer) +
+                                   " is out of range for type '" + node->type->toString() + "'");
+              return ConstantValue();
+          }
+
+          if (node->op.type == TokenType::OP_SHR) {
+              return ConstantValue::makeInteger(value.integer >> right.integer);
+          }
+          if (value.integer < 0) {
+              errorHandler.warning(line, column, "Left shift of negative value");
+          }
+          // Exact in 64 bits since the value is at most 32 bits wide
+          return wrapInteger(value.integer * (int64_t(1) << right.integer), node->type, line, column);
+      }
+
+      case TokenType::OP_PLUS:
+      case TokenType::OP_MINUS:
+      case TokenType::OP_STAR:
+      case TokenType::OP_SLASH:
+      case TokenType::OP_PERCENT:
+      case TokenType::OP_AMPERSAND:
+      case TokenType::OP_PIPE:
+      case TokenType::OP_CARET:
+          break;
+
+      default:
+          // Assignment has a side effect; anything else is not arithmetic
+          return ConstantValue();
+  }
+
+  // Arithmetic: both operands are converted to the common (node) type
+  ConstantValue a = convert(left, node->type, line, column);
+  ConstantValue b = convert(right, node->type, line, column);
+  if (!a.isConstant() || !b.isConstant()) return ConstantValue();
+
+  if (a.isFloating()) {
+      double result;
+      switch (node->op.type) {
+          case TokenType::OP_PLUS:  result = a.floating + b.floating; break;
+          case TokenType::OP_MINUS: result = a.floating - b.floating; break;
+          case TokenType::OP_STAR:  result = a.floating * b.floating; break;
+          case TokenType::OP_SLASH: result = a.floating / b.floating; break;
+          default:
+              // %, &, | and ^ are not defined on floating operands
+              return ConstantValue();
+      }
+      return convert(ConstantValue::makeFloating(result), node->type, line, column);
+  }
+
+  // Integer operands fit in 32 bits, so the exact result fits in 64
+  int64_t x = a.integer;
+  int64_t y = b.integer;
+  switch (node->op.type) {
+      case TokenType::OP_PLUS:      return wrapInteger(x + y, node->type, line, column);
+      case TokenType::OP_MINUS:     return wrapInteger(x - y, node->type, line, column);
+      case TokenType::OP_STAR:      return wrapInteger(x * y, node->type, line, column);
+      case TokenType::OP_AMPERSAND: return ConstantValue::makeInteger(x & y);
+      case TokenType::OP_PIPE:      return ConstantValue::makeInteger(x | y);
+      case TokenType::OP_CARET:     return ConstantValue::makeInteger(x ^ y);
+      default:
+          break;
+  }
+
+  // Division and remainder
+  if (y == 0) {
+      errorHandler.warning(line, column, "Division by zero in constant expression");
+      return ConstantValue();
+  }
+  if (node->op.type == TokenType::OP_SLASH) {
+      return wrapInteger(x / y, node->type, line, column);
+  }
+
+  // x % y is undefined when x / y overflows (INT_MIN % -1)
+  if (wrapInteger(x / y, node->type, line, column).integer != x / y) {
+      return ConstantValue::makeInteger(0);
+  }
+  return ConstantValue::makeInteger(x % y);
+}
+
+ConstantValue ConstantEvaluator::evaluateConditional(ConditionalNode* node) {
+  if (!node->condition || !node->trueExpr || !node->falseExpr) return ConstantValue();
+
+  const ConstantValue& condition = node->condition->constant;
+  if (!condition.isConstant()) return ConstantValue();
+
+  // Only the selected operand has to be constant
+  ExpressionNode* selected = condition.isTrue() ? node->trueExpr.get() : node->falseExpr.get();
+  return convert(selected->constant, node->type);
+}
+
+} // namespace ccc
@@ -0,0 +1,474 @@
+#include "dataflow.h"
+#include <algorithm>
+#include <cstdint>
+#include <map>
+
+namespace ccc {
+namespace ir {
+
+// Bit vectors
+
+BitVector::BitVector(size_t size, bool value)
+  : bits(size), words((size + 63) / 64, value ? ~uint64_t(0) : 0) {
+  clearUnusedBits();
+}
+
+void BitVector::clearUnusedBits() {
+  if (bits % 64 != 0) {
+      words.back() &= (uint64_t(1) << (bits % 64)) - 1;
+  }
+}
+
+void BitVector::setAll() {
+  std::fill(words.begin(), words.end(), ~uint64_t(0));
+  clearUnusedBits();
+}
+
+void BitVector::clear() {
+  std::fill(words.begin(), words.end(), 0);
+}
+
+bool BitVector::any() const {
+  for (uint64_t word : words) {
+      if (word) return true;
+  }
+  return false;
+}
+
+size_t BitVector::count() const {
+  size_t total = 0;
+  for (uint64_t word : words) {
+      total += __builtin_popcountll(word);
+  }
+  return total;
+}
+
+bool BitVector::unionWith(const BitVector& other) {
+  uint64_t changed = 0;
+  for (size_t w = 0; w < words.size(); w++) {
+      uint64_t merged = words[w] | other.words[w];
+      changed |= merged ^ words[w];
+      words[w] = merged;
+  }
+  return changed != 0;
+}
+
+bool BitVector::intersectWith(const BitVector& other) {
+  uint64_t changed = 0;
+  for (size_t w = 0; w < words.size(); w++) {
+      uint64_t merged = words[w] & other.words[w];
+      changed |= merged ^ words[w];
+      words[w] = merged;
+  }
+  return changed != 0;
+}
+
+bool BitVector::subtract(const BitVector& other) {
+  uint64_t changed = 0;
+  for (size_t w = 0; w < words.size(); w++) {
+      uint64_t merged = words[w] & ~other.words[w];
+      changed |= merged ^ words[w];
+      words[w] = merged;
+  }
+  return changed != 0;
+}
+
+bool BitVector::assignTransfer(const BitVector& gen, const BitVector& in, const BitVector& kill) {
+  uint64_t changed = 0;
+  for (size_t w = 0; w < words.size(); w++) {
+      uint64_t merged = gen.words[w] | (in.words[w] & ~kill.words[w]);
+      changed |= merged ^ words[w];
+      words[w] = merged;
+  }
+  return changed != 0;
+}
+
+size_t BitVector::findNext(size_t from) const {
+  if (from >= bits) return NPOS;
+  size_t w = from / 64;
+  uint64_t word = words[w] & (~uint64_t(0) << (from % 64));
+  while (true) {
+      if (word) return w * 64 + __builtin_ctzll(word);
+      if (++w == words.size()) return NPOS;
+      word = words[w];
+  }
+}
+
+// Solver
+
+DataflowResult solve(const CFG& cfg, const DataflowProblem& problem) {
+  size_t blockCount = cfg.size();
+  bool forward = problem.direction == DataflowProblem::Direction::FORWARD;
+  bool intersection = problem.meet == DataflowProblem::Meet::INTERSECTION;
+
+  // Must problems start from "everything" and shrink, may problems grow
+  DataflowResult result;
+  result.in.assign(blockCount, BitVector(problem.facts, intersection));
+  result.out.assign(blockCount, BitVector(problem.facts, intersection));
+
+  // Work positions follow reverse postorder forward and postorder backward;
+  // the CFG numbering is reverse postorder
+  auto blockAt = [&](size_t position) {
+      return static_cast<unsigned>(forward ? position : blockCount - 1 - position);
+  };
+  BitVector pending(blockCount, true);
+  size_t cursor = 0;
+
+  BitVector merged(problem.facts);
+  while (true) {
+      size_t position = pending.findNext(cursor);
+      if (position == BitVector::NPOS) {
+          position = pending.findNext(0);
+          if (position == BitVector::NPOS) break;
+      }
+      pending.reset(position);
+      cursor = position + 1;
+      unsigned block = blockAt(position);
+
+      // Meet over the neighbours facts flow in from
+      const std::vector<unsigned>& sources = forward ? cfg.predecessors(block) : cfg.successors(block);
+      bool atBoundary = forward ? block == 0 : sources.empty();
+      if (atBoundary) {
+          merged = problem.boundary;
+      } else if (intersection) {
+          merged.setAll();
+      } else {
+          merged.clear();
+      }
+      for (unsigned source : sources) {
+          const BitVector& facts = forward ? result.out[source] : result.in[source];
+          if (intersection) {
+              merged.intersectWith(facts);
+          } else {
+              merged.unionWith(facts);
+          }
+      }
+
+      BitVector& incoming = forward ? result.in[block] : result.out[block];
+      BitVector& outgoing = forward ? result.out[block] : result.in[block];
+      incoming = merged;
+      if (!outgoing.assignTransfer(problem.gen[block], incoming, problem.kill[block])) continue;
+
+      // Facts changed: revisit the blocks they flow to
+      const std::vector<unsigned>& targets = forward ? cfg.successors(block) : cfg.predecessors(block);
+      for (unsigned target : targets) {
+          pending.set(forward ? target : blockCount - 1 - target);
+      }
+  }
+
+  return result;
+}
+
+// Memory locations
+
+namespace {
+
+// Elements a load or store accesses
+int64_t accessWidth(const Instruction* access) {
+  Type type = access->opcode == Opcode::STORE ? access->getOperand(2)->type : access->type;
+  return laneCount(type);
+}
+
+} // namespace
+
+bool mustAlias(const Instruction* a, const Instruction* b) {
+  return a->getOperand(0) == b->getOperand(0) && a->getOperand(1) == b->getOperand(1) &&
+         accessWidth(a) == accessWidth(b);
+}
+
+bool mayAlias(const Instruction* a, const Instruction* b) {
+  if (a->getOperand(0) != b->getOperand(0)) return true;
+  const Value* indexA = a->getOperand(1);
+  const Value* indexB = b->getOperand(1);
+  if (indexA->isConstant() && indexB->isConstant()) {
+      int64_t startA = static_cast<const Constant*>(indexA)->integer;
+      int64_t startB = static_cast<const Constant*>(indexB)->integer;
+      return startA < startB + accessWidth(b) && startB < startA + accessWidth(a);
+  }
+  return true;
+}
+
+// Liveness
+
+Liveness::Liveness(const CFG& cfg) : cfg(cfg) {
+  for (BasicBlock* block : cfg.reversePostOrder()) {
+      for (const auto& instruction : block->instructions) {
+          if (instruction->producesValue()) {
+              numbers[instruction.get()] = static_cast<unsigned>(values.size());
+              values.push_back(instruction.get());
+          }
+      }
+  }
+
+  DataflowProblem problem;
+  problem.direction = DataflowProblem::Direction::BACKWARD;
+  problem.meet = DataflowProblem::Meet::UNION;
+  problem.facts = values.size();
+  problem.boundary = BitVector(values.size());
+  problem.gen.assign(cfg.size(), BitVector(values.size()));
+  problem.kill.assign(cfg.size(), BitVector(values.size()));
+
+  // Uses on the edges to phis, per predecessor
+  std::vector<BitVector> edgeUses(cfg.size(), BitVector(values.size()));
+
+  for (unsigned b = 0; b < cfg.size(); b++) {
+      BitVector& gen = problem.gen[b];
+      BitVector& kill = problem.kill[b];
+      const BasicBlock* block = cfg.block(b);
+
+      // Upward-exposed uses: walk backwards, a definition hides later uses
+      for (auto it = block->instructions.rbegin(); it != block->instructions.rend(); ++it) {
+          const Instruction* instruction = it->get();
+          if (instruction->producesValue()) {
+              unsigned defined = numbers.at(instruction);
+              gen.reset(defined);
+              kill.set(defined);
+          }
+          if (instruction->isPhi()) continue;
+          for (const Value* operand : instruction->getOperands()) {
+              unsigned used = index(operand);
+              if (used != CFG::NONE) gen.set(used);
+          }
+      }
+
+      // A phi operand is read at the end of its incoming block
+      for (const BasicBlock* successor : block->successors()) {
+          for (const Instruction* phi : successor->phis()) {
+              unsigned used = index(phi->incomingFor(block));
+              if (used == CFG::NONE) continue;
+              edgeUses[b].set(used);
+              if (!kill.test(used)) gen.set(used);
+          }
+      }
+  }
+
+  result = solve(cfg, problem);
+  for (unsigned b = 0; b < cfg.size(); b++) {
+      result.out[b].unionWith(edgeUses[b]);
+  }
+}
+
+unsigned Liveness::index(const Value* value) const {
+  if (!value) return CFG::NONE;
+  auto it = numbers.find(value);
+  return it != numbers.end() ? it->second : CFG::NONE;
+}
+
+bool Liveness::isLiveIn(const Value* value, const BasicBlock* block) const {
+  unsigned i = index(value);
+  return i != CFG::NONE && cfg.isReachable(block) && liveIn(block).test(i);
+}
+
+bool Liveness::isLiveOut(const Value* value, const BasicBlock* block) const {
+  unsigned i = index(value);
+  return i != CFG::NONE && cfg.isReachable(block) && liveOut(block).test(i);
+}
+
+// Reaching definitions
+
+ReachingDefinitions::ReachingDefinitions(const CFG& cfg) : cfg(cfg) {
+  std::map<std::pair<const Value*, const Value*>, std::vector<unsigned>> byLocation;
+  for (BasicBlock* block : cfg.reversePostOrder()) {
+      for (const auto& instruction : block->instructions) {
+          if (!instruction->writesMemory()) continue;
+          unsigned number = static_cast<unsigned>(definitions.size());
+          numbers[instruction.get()] = number;
+          definitions.push_back(instruction.get());
+          if (instruction->opcode == Opcode::STORE) {
+              byLocation[{instruction->getOperand(0), instruction->getOperand(1)}].push_back(number);
+          }
+      }
+  }
+
+  overwrites.assign(definitions.size(), BitVector(definitions.size()));
+  for (const auto& location : byLocation) {
+      for (unsigned store : location.second) {
+          for (unsigned other : location.second) {
+              if (other != store) overwrites[store].set(other);
+          }
+      }
+  }
+
+  DataflowProblem problem;
+  problem.direction = DataflowProblem::Direction::FORWARD;
+  problem.meet = DataflowProblem::Meet::UNION;
+  problem.facts = definitions.size();
+  problem.boundary = BitVector(definitions.size());
+  problem.gen.assign(cfg.size(), BitVector(definitions.size()));
+  problem.kill.assign(cfg.size(), BitVector(definitions.size()));
+
+  for (unsigned b = 0; b < cfg.size(); b++) {
+      for (const auto& instruction : cfg.block(b)->instructions) {
+          auto it = numbers.find(instruction.get());
+          if (it == numbers.end()) continue;
+          problem.gen[b].subtract(overwrites[it->second]);
+          problem.gen[b].set(it->second);
+          problem.kill[b].unionWith(overwrites[it->second]);
+      }
+      problem.kill[b].subtract(problem.gen[b]);
+  }
+
+  result = solve(cfg, problem);
+}
+
+unsigned ReachingDefinitions::index(const Instruction* definition) const {
+  auto it = numbers.find(definition);
+  return it != numbers.end() ? it->second : CFG::NONE;
+}
+
+void ReachingDefinitions::step(BitVector& facts, const Instruction* instruction) const {
+  auto it = numbers.find(instruction);
+  if (it == numbers.end()) return;
+  facts.subtract(overwrites[it->second]);
+  facts.set(it->second);
+}
+
+BitVector ReachingDefinitions::reachingBefore(const Instruction* position) const {
+  BitVector facts = reachingIn(position->parent);
+  for (const auto& instruction : position->parent->instructions) {
+      if (instruction.get() == position) break;
+      step(facts, instruction.get());
+  }
+  return facts;
+}
+
+// Available expressions
+
+namespace {
+
+bool isExpression(const Instruction* instruction) {
+  switch (instruction->opcode) {
+      case Opcode::ADD:
+      case Opcode::SUB:
+      case Opcode::MUL:
+      case Opcode::DIV:
+      case Opcode::MOD:
+      case Opcode::NEG:
+      case Opcode::NOT:
+      case Opcode::AND:
+      case Opcode::OR:
+      case Opcode::XOR:
+      case Opcode::SHL:
+      case Opcode::SHR:
+      case Opcode::SEXT:
+      case Opcode::TRUNC:
+      case Opcode::SITOFP:
+      case Opcode::FPTOSI:
+      case Opcode::FPEXT:
+      case Opcode::FPTRUNC:
+      case Opcode::CMP_EQ:
+      case Opcode::CMP_NE:
+      case Opcode::CMP_LT:
+      case Opcode::CMP_LE:
+      case Opcode::CMP_GT:
+      case Opcode::CMP_GE:
+      case Opcode::SELECT:
+      case Opcode::LOAD:
+          return true;
+      default:
+          return false;
+  }
+}
+
+bool isCommutative(Opcode opcode) {
+  switch (opcode) {
+      case Opcode::ADD:
+      case Opcode::MUL:
+      case Opcode::AND:
+      case Opcode::OR:
+      case Opcode::XOR:
+      case Opcode::CMP_EQ:
+      case Opcode::CMP_NE:
+          return true;
+      default:
+          return false;
+  }
+}
+
+} // namespace
+
+AvailableExpressions::AvailableExpressions(const CFG& cfg) : cfg(cfg) {
+  // Same opcode, type and operands: same expression
+  std::map<std::vector<uintptr_t>, unsigned> keys;
+  for (BasicBlock* block : cfg.reversePostOrder()) {
+      for (const auto& instruction : block->instructions) {
+          if (!isExpression(instruction.get())) continue;
+
+          std::vector<uintptr_t> key = {static_cast<uintptr_t>(instruction->opcode),
+                                        static_cast<uintptr_t>(instruction->type)};
+          for (const Value* operand : instruction->getOperands()) {
+              key.push_back(reinterpret_cast<uintptr_t>(operand));
+          }
+          if (isCommutative(instruction->opcode) && key[2] > key[3]) {
+              std::swap(key[2], key[3]);
+          }
+
+          auto inserted = keys.emplace(key, static_cast<unsigned>(expressions.size()));
+          if (inserted.second) {
+              expressions.push_back(instruction.get());
+              if (instruction->opcode == Opcode::LOAD) {
+                  loads.push_back(inserted.first->second);
+              }
+          }
+          numbers[instruction.get()] = inserted.first->second;
+      }
+  }
+
+  DataflowProblem problem;
+  problem.direction = DataflowProblem::Direction::FORWARD;
+  problem.meet = DataflowProblem::Meet::INTERSECTION;
+  problem.facts = expressions.size();
+  problem.boundary = BitVector(expressions.size());
+  problem.gen.assign(cfg.size(), BitVector(expressions.size()));
+  problem.kill.assign(cfg.size(), BitVector(expressions.size()));
+
+  // Kill: every load a write in the block may clobber; gen: what is still
+  // available at the end of the block
+  for (unsigned b = 0; b < cfg.size(); b++) {
+      for (const auto& instruction : cfg.block(b)->instructions) {
+          if (instruction->writesMemory()) {
+              for (unsigned load : loads) {
+                  if (clobbers(instruction.get(), load)) problem.kill[b].set(load);
+              }
+          }
+          step(problem.gen[b], instruction.get());
+      }
+  }
+
+  result = solve(cfg, problem);
+}
+
+unsigned AvailableExpressions::expressionOf(const Instruction* instruction) const {
+  auto it = numbers.find(instruction);
+  return it != numbers.end() ? it->second : NONE;
+}
+
+bool AvailableExpressions::clobbers(const Instruction* write, unsigned load) const {
+  return write->opcode != Opcode::STORE || mayAlias(write, expressions[load]);
+}
+
+void AvailableExpressions::step(BitVector& facts, const Instruction* instruction) const {
+  if (instruction->writesMemory()) {
+      for (unsigned load : loads) {
+          if (clobbers(instruction, load)) facts.reset(load);
+      }
+      return;
+  }
+
+  unsigned expression = expressionOf(instruction);
+  if (expression != NONE) {
+      facts.set(expression);
+  }
+}
+
+bool AvailableExpressions::isAvailable(unsigned expression, const Instruction* position) const {
+  BitVector facts = availableIn(position->parent);
+  for (const auto& instruction : position->parent->instructions) {
+      if (instruction.get() == position) break;
+      step(facts, instruction.get());
+  }
+  return facts.test(expression);
+}
+
+} // namespace ir
+} // namespace ccc
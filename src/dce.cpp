@@ -0,0 +1,131 @@
+#include "passes.h"
+#include <unordered_set>
+
+namespace ccc {
+namespace ir {
+
+namespace {
+
+class DeadCodeEliminator {
+public:
+  DeadCodeEliminator(Function& function, AnalysisManager& analyses)
+      : function(function), cfg(analyses.getCFG()), postDominators(analyses.getPostDominators()) {}
+
+  void mark() {
+      for (BasicBlock* block : cfg.reversePostOrder()) {
+          for (const auto& instruction : block->instructions) {
+              Instruction* current = instruction.get();
+              if (current->opcode == Opcode::CONDBR) {
+                  // A branch whose block has no post-dominator (one that
+                  // never reaches a RET) has nowhere else to go
+                  if (!postDominators.idom(block)) markLive(current);
+              } else if (current->opcode != Opcode::BR && current->hasSideEffects()) {
+                  markLive(current);
+              }
+          }
+      }
+
+      while (!worklist.empty()) {
+          Instruction* current = worklist.back();
+          worklist.pop_back();
+
+          for (Value* operand : current->getOperands()) {
+              if (operand->isInstruction()) markLive(static_cast<Instruction*>(operand));
+          }
+
+          // A phi needs control to arrive from each of its incoming blocks
+          if (current->isPhi()) {
+              for (BasicBlock* incoming : current->blocks) {
+                  if (cfg.isReachable(incoming)) markLive(incoming->getTerminator());
+              }
+          }
+
+          markBlockLive(current->parent);
+      }
+  }
+
+  bool sweep() {
+      bool changed = false;
+
+      // A dead branch decides nothing that matters: go straight to where
+      // both ways meet again. The arms between become unreachable.
+      for (BasicBlock* block : cfg.reversePostOrder()) {
+          Instruction* terminator = block->getTerminator();
+          if (terminator->opcode != Opcode::CONDBR || live.count(terminator)) continue;
+
+          terminator->dropOperands();
+          terminator->opcode = Opcode::BR;
+          terminator->blocks = {postDominators.idom(block)};
+          changed = true;
+      }
+
+      // Dead values may use each other, so unlink all before deleting any
+      std::vector<Instruction*> dead;
+      for (BasicBlock* block : cfg.reversePostOrder()) {
+          for (const auto& instruction : block->instructions) {
+              if (!instruction->isTerminator() && !live.count(instruction.get())) {
+                  dead.push_back(instruction.get());
+              }
+          }
+      }
+      for (Instruction* instruction : dead) {
+          instruction->dropOperands();
+      }
+      for (Instruction* instruction : dead) {
+          if (instruction->hasUsers()) {
+              // Only dead phis of the arms just cut off still refer to it
+              instruction->replaceAllUsesWith(function.getUndef(instruction->type));
+          }
+          instruction->parent->erase(instruction);
+      }
+      changed |= !dead.empty();
+
+      if (changed) {
+          function.recomputePredecessors();
+          function.removeUnreachableBlocks();
+      }
+      return changed;
+  }
+
+private:
+  Function& function;
+  const CFG& cfg;
+  const DominatorTree& postDominators;
+  std::unordered_set<const Instruction*> live;
+  std::unordered_set<const BasicBlock*> liveBlocks;
+  std::vector<Instruction*> worklist;
+
+  void markLive(Instruction* instruction) {
+      if (instruction && live.insert(instruction).second) {
+          worklist.push_back(instruction);
+      }
+  }
+
+  // Code in a live block runs only if the branches it is control dependent
+  // on go its way, so those branches are live too. Unconditional jumps are
+  // always kept but only make their block live through a phi.
+  void markBlockLive(BasicBlock* block) {
+      if (!liveBlocks.insert(block).second) return;
+
+      for (BasicBlock* controlling : postDominators.frontier(block)) {
+          markLive(controlling->getTerminator());
+      }
+  }
+};
+
+} // namespace
+
+bool DCEPass::run(Function& function, AnalysisManager& analyses) {
+  if (!function.entry()) return false;
+
+  DeadCodeEliminator eliminator(function, analyses);
+  eliminator.mark();
+  bool changed = eliminator.sweep();
+
+  // Blocks a pass before us cut off without cleaning up
+  changed |= function.removeUnreachableBlocks();
+  return changed;
+}
+
+} // namespace ir
+} // namespace ccc
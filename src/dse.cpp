@@ -0,0 +1,130 @@
+#include "passes.h"
+#include <unordered_map>
+
+namespace ccc {
+namespace ir {
+
+namespace {
+
+// Backward must problem over the stores of a function: a store's fact holds
+// at a point when, on every path from there, its location is written again
+// before anything may read it. RET ends every path with nothing overwritten,
+// since the caller can see all memory we address.
+class DeadStores {
+public:
+  explicit DeadStores(const CFG& cfg) : cfg(cfg) {
+      for (BasicBlock* block : cfg.reversePostOrder()) {
+          for (const auto& instruction : block->instructions) {
+              if (instruction->opcode != Opcode::STORE) continue;
+              unsigned number = static_cast<unsigned>(stores.size());
+              numbers[instruction.get()] = number;
+              stores.push_back(instruction.get());
+              addressedBy[instruction->getOperand(0)].push_back(number);
+              if (instruction->getOperand(1) != instruction->getOperand(0)) {
+                  addressedBy[instruction->getOperand(1)].push_back(number);
+              }
+          }
+      }
+
+      DataflowProblem problem;
+      problem.direction = DataflowProblem::Direction::BACKWARD;
+      problem.meet = DataflowProblem::Meet::INTERSECTION;
+      problem.facts = stores.size();
+      problem.boundary = BitVector(stores.size());
+      problem.gen.assign(cfg.size(), BitVector(stores.size()));
+      problem.kill.assign(cfg.size(), BitVector(stores.size()));
+
+      BitVector gen(stores.size());
+      BitVector kill(stores.size());
+      for (unsigned b = 0; b < cfg.size(); b++) {
+          const BasicBlock* block = cfg.block(b);
+          BitVector& blockGen = problem.gen[b];
+          BitVector& blockKill = problem.kill[b];
+          for (auto it = block->instructions.rbegin(); it != block->instructions.rend(); ++it) {
+              effect(it->get(), gen, kill);
+              blockGen.subtract(kill);
+              blockGen.unionWith(gen);
+              blockKill.unionWith(kill);
+          }
+      }
+
+      result = solve(cfg, problem);
+  }
+
+  // Stores whose value is never read
+  std::vector<Instruction*> dead() const {
+      std::vector<Instruction*> found;
+      BitVector facts(stores.size());
+      BitVector gen(stores.size());
+      BitVector kill(stores.size());
+      for (unsigned b = 0; b < cfg.size(); b++) {
+          const BasicBlock* block = cfg.block(b);
+          facts = result.out[b];
+          for (auto it = block->instructions.rbegin(); it != block->instructions.rend(); ++it) {
+              Instruction* instruction = it->get();
+              if (instruction->opcode == Opcode::STORE && facts.test(numbers.at(instruction))) {
+                  found.push_back(instruction);
+              }
+              effect(instruction, gen, kill);
+              facts.subtract(kill);
+              facts.unionWith(gen);
+          }
+      }
+      return found;
+  }
+
+private:
+  const CFG& cfg;
+  std::vector<Instruction*> stores;
+  std::unordered_map<const Instruction*, unsigned> numbers;
+
+  // Stores by the values their base and index are
+  std::unordered_map<const Value*, std::vector<unsigned>> addressedBy;
+  DataflowResult result;
+
+  // Facts an instruction makes true (gen) and false (kill) going backwards
+  void effect(const Instruction* instruction, BitVector& gen, BitVector& kill) const {
+      gen.clear();
+      kill.clear();
+
+      switch (instruction->opcode) {
+          case Opcode::STORE:
+              for (unsigned i = 0; i < stores.size(); i++) {
+                  if (mustAlias(stores[i], instruction)) gen.set(i);
+              }
+              break;
+          case Opcode::LOAD:
+              for (unsigned i = 0; i < stores.size(); i++) {
+                  if (mayAlias(stores[i], instruction)) kill.set(i);
+              }
+              break;
+          case Opcode::CALL:
+              kill.setAll();
+              break;
+          default:
+              break;
+      }
+
+      // Above the definition of an address, the same SSA value names a
+      // different location (the previous loop iteration's)
+      auto it = addressedBy.find(instruction);
+      if (it != addressedBy.end()) {
+          for (unsigned i : it->second) kill.set(i);
+      }
+  }
+};
+
+} // namespace
+
+bool DSEPass::run(Function& function, AnalysisManager& analyses) {
+  if (!function.entry()) return false;
+
+  std::vector<Instruction*> dead = DeadStores(analyses.getCFG()).dead();
+  for (Instruction* store : dead) {
+      store->parent->erase(store);
+  }
+  return !dead.empty();
+}
+
+} // namespace ir
+} // namespace ccc
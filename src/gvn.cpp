@@ -0,0 +1,185 @@
+#include "passes.h"
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <unordered_set>
+
+namespace ccc {
+namespace ir {
+
+namespace {
+
+// A value known to be in memory: what a load read or a store wrote at the
+// address of access
+struct MemoryValue {
+  const Instruction* access;
+  Value* value;
+};
+
+class ValueNumbering {
+public:
+  explicit ValueNumbering(AnalysisManager& analyses)
+      : cfg(analyses.getCFG()), dominators(analyses.getDominators()) {}
+
+  bool run() {
+      // Blocks in dominator-tree preorder; each keeps the expressions and
+      // memory contents of the blocks dominating it
+      std::vector<Scope> scopes;
+      for (BasicBlock* block : dominators.preorder()) {
+          BasicBlock* parent = dominators.idom(block);
+          while (!scopes.empty() && scopes.back().block != parent) {
+              for (const Key& key : scopes.back().keys) leaders.erase(key);
+              scopes.pop_back();
+          }
+
+          Scope scope;
+          scope.block = block;
+          if (!scopes.empty()) {
+              scope.memory = scopes.back().memory;
+              if (cfg.predecessors(cfg.index(block)).size() > 1) {
+                  forgetClobbered(scope.memory, block, parent);
+              }
+          }
+          scopes.push_back(std::move(scope));
+          visit(block, scopes.back());
+      }
+
+      for (Instruction* instruction : redundant) {
+          instruction->parent->erase(instruction);
+      }
+      return !redundant.empty();
+  }
+
+private:
+  // Opcode, type and operands (for phis, also the block and incoming edges)
+  using Key = std::tuple<Opcode, Type, std::vector<const void*>>;
+
+  struct Scope {
+      BasicBlock* block = nullptr;
+      std::vector<Key> keys;
+      std::vector<MemoryValue> memory;
+  };
+
+  const CFG& cfg;
+  const DominatorTree& dominators;
+  std::map<Key, Instruction*> leaders;
+  std::vector<Instruction*> redundant;
+
+  void visit(BasicBlock* block, Scope& scope) {
+      for (const auto& instruction : block->instructions) {
+          Instruction* current = instruction.get();
+          switch (current->opcode) {
+              case Opcode::LOAD:
+                  visitLoad(current, scope);
+                  continue;
+              case Opcode::STORE:
+                  forget(scope.memory, current);
+                  scope.memory.push_back({current, current->getOperand(2)});
+                  continue;
+              case Opcode::CALL:
+                  scope.memory.clear();
+                  continue;
+              case Opcode::PARAM:
+                  continue;
+              default:
+                  if (current->isTerminator()) continue;
+                  break;
+          }
+
+          Key key = keyOf(current);
+          auto found = leaders.find(key);
+          if (found != leaders.end()) {
+              replace(current, found->second);
+          } else {
+              leaders.emplace(key, current);
+              scope.keys.push_back(std::move(key));
+          }
+      }
+  }
+
+  // A load of an address whose contents are known since the last write
+  // that may alias it reuses them
+  void visitLoad(Instruction* load, Scope& scope) {
+      for (auto it = scope.memory.rbegin(); it != scope.memory.rend(); ++it) {
+          if (mustAlias(it->access, load) && it->value->type == load->type) {
+              replace(load, it->value);
+              return;
+          }
+      }
+      scope.memory.push_back({load, load});
+  }
+
+  void replace(Instruction* instruction, Value* leader) {
+      instruction->replaceAllUsesWith(leader);
+      redundant.push_back(instruction);
+  }
+
+  // Drop the memory contents a write may change
+  static void forget(std::vector<MemoryValue>& memory, const Instruction* write) {
+      memory.erase(std::remove_if(memory.begin(), memory.end(), [&](const MemoryValue& known) {
+          return mayAlias(known.access, write);
+      }), memory.end());
+  }
+
+  // At a join, contents known at the end of the immediate dominator hold
+  // unless some path from there writes them: look at every block between
+  // (including the join itself, which a loop reaches again)
+  void forgetClobbered(std::vector<MemoryValue>& memory, BasicBlock* join, BasicBlock* dominator) {
+      unsigned stop = cfg.index(dominator);
+      std::vector<unsigned> worklist = cfg.predecessors(cfg.index(join));
+      std::unordered_set<unsigned> visited;
+      while (!worklist.empty() && !memory.empty()) {
+          unsigned b = worklist.back();
+          worklist.pop_back();
+          if (b == stop || !visited.insert(b).second) continue;
+
+          for (const auto& instruction : cfg.block(b)->instructions) {
+              if (instruction->opcode == Opcode::CALL) {
+                  memory.clear();
+              } else if (instruction->opcode == Opcode::STORE) {
+                  forget(memory, instruction.get());
+              }
+          }
+          const std::vector<unsigned>& predecessors = cfg.predecessors(b);
+          worklist.insert(worklist.end(), predecessors.begin(), predecessors.end());
+      }
+  }
+
+  // Instructions with equal keys compute the same value
+  static Key keyOf(const Instruction* instruction) {
+      std::vector<const void*> operands(instruction->getOperands().begin(), instruction->getOperands().end());
+      std::vector<const void*> edges;
+      switch (instruction->opcode) {
+          case Opcode::ADD:
+          case Opcode::MUL:
+          case Opcode::AND:
+          case Opcode::OR:
+          case Opcode::XOR:
+          case Opcode::CMP_EQ:
+          case Opcode::CMP_NE:
+              std::sort(operands.begin(), operands.end());
+              break;
+          case Opcode::PHI:
+              // Phis only match in the same block, on the same edges
+              edges.push_back(instruction->parent);
+              edges.insert(edges.end(), instruction->blocks.begin(), instruction->blocks.end());
+              break;
+          default:
+              break;
+      }
+      operands.insert(operands.end(), edges.begin(), edges.end());
+      return Key(instruction->opcode, instruction->type, std::move(operands));
+  }
+};
+
+} // namespace
+
+bool GVNPass::run(Function& function, AnalysisManager& analyses) {
+  if (!function.entry()) return false;
+
+  ValueNumbering numbering(analyses);
+  return numbering.run();
+}
+
+} // namespace ir
+} // namespace ccc
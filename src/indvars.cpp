@@ -0,0 +1,253 @@
+#include "passes.h"
+#include <algorithm>
+
+namespace ccc {
+namespace ir {
+
+namespace {
+
+bool isConstant(const Value* value, int64_t expected) {
+  return value->isConstant() && static_cast<const Constant*>(value)->integer == expected;
+}
+
+} // namespace
+
+Value* PreheaderBuilder::constant(int64_t value) {
+  return function.getInteger(Type::I32, static_cast<int32_t>(value));
+}
+
+Value* PreheaderBuilder::add(Value* a, Value* b) {
+  if (isConstant(a, 0)) return b;
+  if (isConstant(b, 0)) return a;
+  return emit(Opcode::ADD, Type::I32, {a, b});
+}
+
+Value* PreheaderBuilder::sub(Value* a, Value* b) {
+  if (a == b) return constant(0);
+  if (isConstant(b, 0)) return a;
+  return emit(Opcode::SUB, Type::I32, {a, b});
+}
+
+Value* PreheaderBuilder::mul(Value* a, Value* b) {
+  if (isConstant(a, 0) || isConstant(b, 0)) return constant(0);
+  if (isConstant(a, 1)) return b;
+  if (isConstant(b, 1)) return a;
+  return emit(Opcode::MUL, Type::I32, {a, b});
+}
+
+Value* PreheaderBuilder::linear(const LinearValue& value) {
+  Value* result = constant(value.constant);
+  for (const auto& term : value.terms) {
+      result = add(result, mul(term.first, constant(term.second)));
+  }
+  return result;
+}
+
+Value* PreheaderBuilder::emit(Opcode opcode, Type type, const std::vector<Value*>& operands) {
+  std::vector<const Constant*> constants;
+  for (Value* operand : operands) {
+      if (operand->isConstant()) constants.push_back(static_cast<const Constant*>(operand));
+  }
+  if (constants.size() == operands.size()) {
+      if (Constant* folded = foldInstruction(function, opcode, type, constants)) return folded;
+  }
+  return preheader->insertBeforeTerminator(function.create(opcode, type, operands));
+}
+
+Value* PreheaderBuilder::identity(const Reduction& reduction, Type type) {
+  Type lane = laneType(type);
+  Value* scalar;
+  if (reduction.combine == Opcode::SELECT) {
+      scalar = reduction.phi->incomingFor(preheader);
+  } else if (isFloatType(lane)) {
+      scalar = function.getFloating(lane, static_cast<double>(reduction.identity));
+  } else {
+      scalar = function.getInteger(lane, reduction.identity);
+  }
+  return scalar->type != type ? emit(Opcode::SPLAT, type, {scalar}) : scalar;
+}
+
+Value* combinePartials(Function& function, BasicBlock* block, const Reduction& reduction, Value* a, Value* b) {
+  if (reduction.combine != Opcode::SELECT) {
+      return block->append(function.create(reduction.combine, a->type, {a, b}));
+  }
+  Type condition = isVectorType(a->type) ? Type::V4I32 : Type::I32;
+  Instruction* kept = block->append(function.create(reduction.predicate, condition, {a, b}));
+  return block->append(function.create(Opcode::SELECT, a->type, {kept, a, b}));
+}
+
+namespace {
+
+class InductionSimplifier {
+public:
+  InductionSimplifier(Function& function, Loop* loop) : function(function), loop(loop) {}
+
+  unsigned removed = 0;
+  unsigned reduced = 0;
+
+  // Whether there is anything to do, before the loop gets a preheader
+  bool hasCandidates() const {
+      InductionVariables variables(*loop);
+      const auto& basic = variables.basic();
+      for (size_t i = 0; i < basic.size(); i++) {
+          for (size_t j = 0; j < i; j++) {
+              if (basic[j].second == basic[i].second || basic[j].second == -basic[i].second) return true;
+          }
+      }
+      return !roots(variables).empty();
+  }
+
+  void run(BasicBlock* preheader) {
+      PreheaderBuilder builder(function, preheader);
+      removeRedundant(builder, preheader);
+      reduceStrength(builder, preheader);
+  }
+
+private:
+  Function& function;
+  Loop* loop;
+
+  // Basic variables stepping by the same amount, or by opposite amounts,
+  // differ by a constant (or a sum) fixed on entry: keep one and compute
+  // the others from it. The loop's counter is kept, so its test stays.
+  void removeRedundant(PreheaderBuilder& builder, BasicBlock* preheader) {
+      InductionVariables variables(*loop);
+      std::vector<std::pair<Instruction*, int64_t>> basic = variables.basic();
+      CountedLoop counted;
+      if (analyzeCountedLoop(*loop, counted)) {
+          std::stable_partition(basic.begin(), basic.end(), [&](const std::pair<Instruction*, int64_t>& variable) {
+              return variable.first == counted.counter;
+          });
+      }
+
+      std::vector<std::pair<Instruction*, int64_t>> kept;
+      for (const auto& variable : basic) {
+          auto same = std::find_if(kept.begin(), kept.end(), [&](const std::pair<Instruction*, int64_t>& other) {
+              return other.second == variable.second || other.second == -variable.second;
+          });
+          if (same == kept.end()) {
+              kept.push_back(variable);
+              continue;
+          }
+
+          Instruction* phi = variable.first;
+          Instruction* base = same->first;
+          Value* start = phi->incomingFor(preheader);
+          Value* baseStart = base->incomingFor(preheader);
+          Value* replacement;
+          if (same->second == variable.second) {
+              Value* difference = builder.sub(start, baseStart);
+              replacement = afterPhis(Opcode::ADD, base, difference);
+          } else {
+              Value* sum = builder.add(start, baseStart);
+              replacement = afterPhis(Opcode::SUB, sum, base);
+          }
+          Value* update = phi->incomingFor(loop->latches.front());
+          phi->replaceAllUsesWith(replacement);
+          phi->parent->erase(phi);
+          if (!update->hasUsers()) {
+              Instruction* dead = static_cast<Instruction*>(update);
+              dead->parent->erase(dead);
+          }
+          removed++;
+      }
+  }
+
+  // Values computed from a basic variable with a multiplication that
+  // something other than another such value uses
+  std::vector<Instruction*> roots(const InductionVariables& variables) const {
+      std::vector<Instruction*> found;
+      for (BasicBlock* block : loop->blocks) {
+          for (const auto& instruction : block->instructions) {
+              const InductionValue* value = variables.find(instruction.get());
+              if (!value || !value->iv || !value->multiplies || instruction->isPhi()) continue;
+              for (Instruction* user : instruction->getUsers()) {
+                  const InductionValue* used = variables.find(user);
+                  if (!used || used->iv != value->iv || !loop->contains(user->parent)) {
+                      found.push_back(instruction.get());
+                      break;
+                  }
+              }
+          }
+      }
+      return found;
+  }
+
+  // Give each root its own variable: a header phi starting at the root's
+  // value on entry and stepping by scale * step on the back edge
+  void reduceStrength(PreheaderBuilder& builder, BasicBlock* preheader) {
+      InductionVariables variables(*loop);
+      BasicBlock* latch = loop->latches.front();
+      std::vector<std::pair<InductionValue, Instruction*>> created;
+      for (Instruction* root : roots(variables)) {
+          const InductionValue& value = *variables.find(root);
+          auto existing = std::find_if(created.begin(), created.end(), [&](const std::pair<InductionValue, Instruction*>& other) {
+              return other.first.iv == value.iv && other.first.scale == value.scale && other.first.offset == value.offset;
+          });
+          if (existing != created.end()) {
+              root->replaceAllUsesWith(existing->second);
+              reduced++;
+              continue;
+          }
+
+          int64_t step = 0;
+          for (const auto& basic : variables.basic()) {
+              if (basic.first == value.iv) step = basic.second;
+          }
+          Value* scale = builder.linear(value.scale);
+          Value* start = builder.add(builder.mul(scale, value.iv->incomingFor(preheader)), builder.linear(value.offset));
+          Value* increment = builder.mul(scale, builder.constant(step));
+
+          Instruction* phi = loop->header->insertPhi(function.create(Opcode::PHI, Type::I32));
+          Instruction* next = latch->insertBeforeTerminator(function.create(Opcode::ADD, Type::I32, {phi, increment}));
+          phi->addIncoming(start, preheader);
+          phi->addIncoming(next, latch);
+          root->replaceAllUsesWith(phi);
+          created.emplace_back(value, phi);
+          reduced++;
+      }
+  }
+
+  // Place a computation at the top of the header, after its phis
+  Instruction* afterPhis(Opcode opcode, Value* a, Value* b) {
+      BasicBlock* header = loop->header;
+      Instruction* position = nullptr;
+      for (const auto& instruction : header->instructions) {
+          if (!instruction->isPhi()) {
+              position = instruction.get();
+              break;
+          }
+      }
+      return header->insertBefore(function.create(opcode, Type::I32, {a, b}), position);
+  }
+};
+
+} // namespace
+
+bool IndVarsPass::run(Function& function, AnalysisManager& analyses) {
+  if (!function.entry()) return false;
+
+  LoopInfo& loops = analyses.getLoops();
+  bool changed = false;
+  for (Loop* loop : loops.loopsInnermostFirst()) {
+      InductionSimplifier simplifier(function, loop);
+      if (!simplifier.hasCandidates()) continue;
+
+      simplifier.run(loops.insertPreheader(loop));
+      changed = true;
+
+      std::string message = "loop at bb" + std::to_string(loop->header->id) + ": ";
+      if (simplifier.reduced > 0) {
+          message += "replaced " + std::to_string(simplifier.reduced) + " multiplications by additions";
+      }
+      if (simplifier.removed > 0) {
+          if (simplifier.reduced > 0) message += ", ";
+          message += "removed " + std::to_string(simplifier.removed) + " redundant induction variables";
+      }
+      remark(function, message);
+  }
+  return changed;
+}
+
+} // namespace ir
+} // namespace ccc
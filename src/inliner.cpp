@@ -0,0 +1,304 @@
+#include "passes.h"
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+
+namespace ccc {
+namespace ir {
+
+namespace {
+
+// A call waiting for a decision, with the callees whose bodies it was
+// copied out of (innermost last)
+struct CallSite {
+  Instruction* call;
+  std::vector<const Function*> history;
+};
+
+// Instructions a function's body costs once lowered; parameters and jumps
+// mostly disappear into the surrounding code
+unsigned bodySize(const Function& function) {
+  unsigned size = 0;
+  for (const auto& block : function.blocks) {
+      for (const auto& instruction : block->instructions) {
+          switch (instruction->opcode) {
+              case Opcode::PHI:
+              case Opcode::PARAM:
+              case Opcode::BR:
+                  break;
+              default:
+                  size++;
+                  break;
+          }
+      }
+  }
+  return size;
+}
+
+// Functions ordered callees first (Tarjan's strongly connected components
+// come out in reverse topological order of the call graph)
+std::vector<Function*> bottomUpOrder(Module& module) {
+  std::unordered_map<const Function*, std::vector<Function*>> callees;
+  for (const auto& function : module.functions) {
+      for (const auto& block : function->blocks) {
+          for (const auto& instruction : block->instructions) {
+              if (instruction->opcode != Opcode::CALL) continue;
+              if (Function* callee = module.findFunction(instruction->callee)) {
+                  callees[function.get()].push_back(callee);
+              }
+          }
+      }
+  }
+
+  std::vector<Function*> order;
+  std::unordered_map<const Function*, unsigned> number;
+  std::unordered_map<const Function*, unsigned> low;
+  std::vector<Function*> stack;
+  std::unordered_map<const Function*, bool> onStack;
+  std::function<void(Function*)> visit = [&](Function* function) {
+      unsigned index = static_cast<unsigned>(number.size());
+      number[function] = index;
+      low[function] = index;
+      stack.push_back(function);
+      onStack[function] = true;
+      for (Function* callee : callees[function]) {
+          if (!number.count(callee)) {
+              visit(callee);
+              low[function] = std::min(low[function], low[callee]);
+          } else if (onStack[callee]) {
+              low[function] = std::min(low[function], number[callee]);
+          }
+      }
+      if (low[function] == number[function]) {
+          Function* member;
+          do {
+              member = stack.back();
+              stack.pop_back();
+              onStack[member] = false;
+              order.push_back(member);
+          } while (member != function);
+      }
+  };
+  for (const auto& function : module.functions) {
+      if (!number.count(function.get())) visit(function.get());
+  }
+  return order;
+}
+
+} // namespace
+
+InlinerPass::InlinerPass(int optimizationLevel) {
+  // -O1 only inlines calls that cost more than the body they run
+  switch (optimizationLevel) {
+      case 0:
+      case 1:
+          threshold = 0;
+          loopBonus = 0;
+          recursionLimit = 0;
+          maxCallerSize = 1000;
+          break;
+      case 2:
+          threshold = 40;
+          loopBonus = 40;
+          recursionLimit = 0;
+          maxCallerSize = 2000;
+          break;
+      default:
+          threshold = 100;
+          loopBonus = 100;
+          recursionLimit = 1;
+          maxCallerSize = 4000;
+          break;
+  }
+}
+
+bool InlinerPass::run(Module& module) {
+  bool changed = false;
+  for (Function* function : bottomUpOrder(module)) {
+      if (function->entry()) {
+          changed |= inlineCalls(module, *function);
+      }
+  }
+  return changed;
+}
+
+bool InlinerPass::inlineCalls(Module& module, Function& caller) {
+  std::vector<CallSite> sites;
+  for (const auto& block : caller.blocks) {
+      for (const auto& instruction : block->instructions) {
+          if (instruction->opcode == Opcode::CALL) {
+              sites.push_back({instruction.get(), {}});
+          }
+      }
+  }
+
+  std::unique_ptr<AnalysisManager> analyses(new AnalysisManager(caller));
+  unsigned callerSize = bodySize(caller);
+  bool changed = false;
+
+  while (!sites.empty()) {
+      // Calls that shrink the code go first, so the budget is spent on the
+      // ones that need it
+      auto next = std::find_if(sites.begin(), sites.end(), [&](const CallSite& site) {
+          const Function* callee = module.findFunction(site.call->callee);
+          return callee && callee->entry() && cost(*site.call, *callee) <= 0;
+      });
+      if (next == sites.end()) next = sites.begin();
+      CallSite site = *next;
+      sites.erase(next);
+
+      Instruction* call = site.call;
+      Function* callee = module.findFunction(call->callee);
+      if (!callee || !callee->entry()) {
+          remark(caller, "'" + call->callee + "' not inlined: no definition");
+          continue;
+      }
+      if (call->numOperands() != callee->paramTypes.size() || call->type != callee->returnType) {
+          remark(caller, "'" + callee->name + "' not inlined: call does not match its definition");
+          continue;
+      }
+
+      // A tail call to the caller itself becomes a jump back to its start
+      if (callee == &caller && call->isTailCall()) {
+          remark(caller, "'" + callee->name + "' not inlined: tail call to itself, turned into a loop instead");
+          continue;
+      }
+
+      // Each copy of a recursive function's body contains the recursive
+      // call again; only unroll the recursion a bounded number of times
+      unsigned depth = static_cast<unsigned>(std::count(site.history.begin(), site.history.end(), callee));
+      if (callee == &caller) depth++;
+      if (depth > recursionLimit) {
+          remark(caller, "'" + callee->name + "' not inlined: recursive (limit " + std::to_string(recursionLimit) + ")");
+          continue;
+      }
+
+      int siteCost = cost(*call, *callee);
+      int siteThreshold = threshold;
+      if (analyses->getLoops().depth(call->parent) > 0) {
+          siteThreshold += loopBonus;
+      }
+      std::string decision = "(cost " + std::to_string(siteCost) + ", threshold " + std::to_string(siteThreshold) + ")";
+      if (siteCost > siteThreshold) {
+          remark(caller, "'" + callee->name + "' not inlined: too costly " + decision);
+          continue;
+      }
+      unsigned size = bodySize(*callee);
+      if (siteCost > 0 && callerSize + size > maxCallerSize) {
+          remark(caller, "'" + callee->name + "' not inlined: '" + caller.name + "' would exceed " +
+                 std::to_string(maxCallerSize) + " instructions " + decision);
+          continue;
+      }
+
+      remark(caller, "'" + callee->name + "' inlined " + decision);
+      std::vector<const Function*> history = site.history;
+      history.push_back(callee);
+      for (Instruction* copied : inlineCall(caller, call, *callee)) {
+          sites.push_back({copied, history});
+      }
+      callerSize += size;
+      analyses.reset(new AnalysisManager(caller));
+      changed = true;
+  }
+  return changed;
+}
+
+int InlinerPass::cost(const Instruction& call, const Function& callee) const {
+  // Saved: the CALL, the result move, and a parameter move per argument.
+  // Constant arguments usually fold away in the copy.
+  int saved = 2 + static_cast<int>(call.numOperands());
+  for (const Value* argument : call.getOperands()) {
+      if (argument->isConstant()) saved += 2;
+  }
+  return static_cast<int>(bodySize(callee)) - saved;
+}
+
+std::vector<Instruction*> InlinerPass::inlineCall(Function& caller, Instruction* call, Function& callee) {
+  std::unordered_map<const Value*, Value*> values;
+  std::unordered_map<const BasicBlock*, BasicBlock*> copies;
+
+  // Snapshot first: a function inlined into itself grows as we copy
+  std::vector<BasicBlock*> sources;
+  for (const auto& block : callee.blocks) {
+      sources.push_back(block.get());
+  }
+
+  // Copy the blocks and instructions; parameters are the arguments
+  std::vector<std::pair<const Instruction*, Instruction*>> instructions;
+  std::vector<Instruction*> calls;
+  for (BasicBlock* source : sources) {
+      BasicBlock* copy = caller.createBlock(callee.name + "_" + source->name);
+      copies[source] = copy;
+      for (const auto& instruction : source->instructions) {
+          if (instruction->opcode == Opcode::PARAM) {
+              values[instruction.get()] = call->getOperand(instruction->index);
+              continue;
+          }
+          std::unique_ptr<Instruction> created = caller.create(instruction->opcode, instruction->type);
+          created->callee = instruction->callee;
+          created->index = instruction->index;
+          Instruction* placed = copy->append(std::move(created));
+          values[instruction.get()] = placed;
+          instructions.emplace_back(instruction.get(), placed);
+          if (placed->opcode == Opcode::CALL) calls.push_back(placed);
+      }
+  }
+
+  auto map = [&](Value* value) -> Value* {
+      if (value->isConstant()) {
+          const Constant* constant = static_cast<const Constant*>(value);
+          return isFloatType(constant->type) ? caller.getFloating(constant->type, constant->floating)
+                                             : caller.getInteger(constant->type, constant->integer);
+      }
+      if (value->isUndef()) return caller.getUndef(value->type);
+      return values.at(value);
+  };
+  for (const auto& pair : instructions) {
+      for (Value* operand : pair.first->getOperands()) {
+          pair.second->addOperand(map(operand));
+      }
+      for (BasicBlock* block : pair.first->blocks) {
+          pair.second->blocks.push_back(copies.at(block));
+      }
+  }
+
+  // The call's block continues after the body; returns jump there
+  BasicBlock* tail = caller.splitBlock(std::next(call->parent->find(call))->get(), callee.name + "_return");
+  std::vector<std::pair<Value*, BasicBlock*>> results;
+  for (BasicBlock* source : sources) {
+      BasicBlock* copy = copies.at(source);
+      caller.moveBefore(copy, tail);
+      Instruction* terminator = copy->getTerminator();
+      if (terminator->opcode != Opcode::RET) continue;
+      Value* result = terminator->numOperands() > 0 ? terminator->getOperand(0) : nullptr;
+      results.emplace_back(result, copy);
+      terminator->dropOperands();
+      terminator->opcode = Opcode::BR;
+      terminator->blocks = {tail};
+  }
+
+  BasicBlock* block = call->parent;
+  Instruction* jump = block->getTerminator();
+  jump->blocks = {copies.at(sources.front())};
+
+  if (call->producesValue()) {
+      Value* result = caller.getUndef(call->type);
+      if (results.size() == 1 && results.front().first) {
+          result = results.front().first;
+      } else if (results.size() > 1) {
+          Instruction* phi = tail->insertPhi(caller.create(Opcode::PHI, call->type));
+          for (const auto& returned : results) {
+              phi->addIncoming(returned.first ? returned.first : caller.getUndef(call->type), returned.second);
+          }
+          result = phi;
+      }
+      call->replaceAllUsesWith(result);
+  }
+  block->erase(call);
+
+  caller.recomputePredecessors();
+  return calls;
+}
+
+} // namespace ir
+} // namespace ccc
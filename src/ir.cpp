@@ -0,0 +1,641 @@
+#include "ir.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace ccc {
+namespace ir {
+
+namespace {
+
+// Remove one occurrence of user from a user list (order is not significant)
+void removeUser(std::vector<Instruction*>& users, Instruction* user) {
+  auto it = std::find(users.begin(), users.end(), user);
+  if (it != users.end()) {
+      *it = users.back();
+      users.pop_back();
+  }
+}
+
+} // namespace
+
+const char* typeName(Type type) {
+  switch (type) {
+      case Type::VOID: return "void";
+      case Type::I8:   return "i8";
+      case Type::I32:  return "i32";
+      case Type::F32:  return "f32";
+      case Type::F64:  return "f64";
+      case Type::PTR:  return "ptr";
+      case Type::V4I32: return "v4i32";
+      case Type::V4F32: return "v4f32";
+  }
+  return "?";
+}
+
+const char* opcodeName(Opcode opcode) {
+  switch (opcode) {
+      case Opcode::ADD:    return "add";
+      case Opcode::SUB:    return "sub";
+      case Opcode::MUL:    return "mul";
+      case Opcode::DIV:    return "div";
+      case Opcode::MOD:    return "mod";
+      case Opcode::NEG:    return "neg";
+      case Opcode::NOT:    return "not";
+      case Opcode::AND:    return "and";
+      case Opcode::OR:     return "or";
+      case Opcode::XOR:    return "xor";
+      case Opcode::SHL:    return "shl";
+      case Opcode::SHR:    return "shr";
+      case Opcode::SEXT:   return "sext";
+      case Opcode::TRUNC:  return "trunc";
+      case Opcode::SITOFP: return "sitofp";
+      case Opcode::FPTOSI: return "fptosi";
+      case Opcode::FPEXT:  return "fpext";
+      case Opcode::FPTRUNC: return "fptrunc";
+      case Opcode::CMP_EQ: return "cmp.eq";
+      case Opcode::CMP_NE: return "cmp.ne";
+      case Opcode::CMP_LT: return "cmp.lt";
+      case Opcode::CMP_LE: return "cmp.le";
+      case Opcode::CMP_GT: return "cmp.gt";
+      case Opcode::CMP_GE: return "cmp.ge";
+      case Opcode::SELECT: return "select";
+      case Opcode::LOAD:   return "load";
+      case Opcode::STORE:  return "store";
+      case Opcode::ADDR:   return "addr";
+      case Opcode::SPLAT:  return "splat";
+      case Opcode::EXTRACT: return "extract";
+      case Opcode::PARAM:  return "param";
+      case Opcode::CALL:   return "call";
+      case Opcode::PHI:    return "phi";
+      case Opcode::BR:     return "br";
+      case Opcode::CONDBR: return "condbr";
+      case Opcode::RET:    return "ret";
+  }
+  return "?";
+}
+
+Opcode conversionOpcode(Type from, Type to) {
+  if (isFloatType(from) && isFloatType(to)) {
+      return to == Type::F64 ? Opcode::FPEXT : Opcode::FPTRUNC;
+  }
+  if (isFloatType(from)) return Opcode::FPTOSI;
+  if (isFloatType(to)) return Opcode::SITOFP;
+  return to == Type::I32 ? Opcode::SEXT : Opcode::TRUNC;
+}
+
+// Value implementation
+void Value::replaceAllUsesWith(Value* replacement) {
+  if (replacement == this) return;
+
+  while (!users.empty()) {
+      Instruction* user = users.back();
+      for (size_t i = 0; i < user->numOperands(); i++) {
+          if (user->getOperand(i) == this) {
+              user->setOperand(i, replacement);
+          }
+      }
+  }
+}
+
+// Instruction implementation
+Instruction::~Instruction() {
+  dropOperands();
+}
+
+void Instruction::setOperand(size_t i, Value* value) {
+  removeUser(operands[i]->users, this);
+  operands[i] = value;
+  value->users.push_back(this);
+}
+
+void Instruction::addOperand(Value* value) {
+  operands.push_back(value);
+  value->users.push_back(this);
+}
+
+void Instruction::removeOperand(size_t i) {
+  removeUser(operands[i]->users, this);
+  operands.erase(operands.begin() + i);
+}
+
+void Instruction::dropOperands() {
+  for (Value* operand : operands) {
+      removeUser(operand->users, this);
+  }
+  operands.clear();
+}
+
+void Instruction::addIncoming(Value* value, BasicBlock* block) {
+  addOperand(value);
+  blocks.push_back(block);
+}
+
+void Instruction::removeIncoming(BasicBlock* block) {
+  for (size_t i = blocks.size(); i-- > 0;) {
+      if (blocks[i] == block) {
+          removeOperand(i);
+          blocks.erase(blocks.begin() + i);
+      }
+  }
+}
+
+Value* Instruction::incomingFor(const BasicBlock* block) const {
+  for (size_t i = 0; i < blocks.size(); i++) {
+      if (blocks[i] == block) {
+          return operands[i];
+      }
+  }
+  return nullptr;
+}
+
+bool Instruction::isTerminator() const {
+  return opcode == Opcode::BR || opcode == Opcode::CONDBR || opcode == Opcode::RET;
+}
+
+bool Instruction::isComparison() const {
+  return opcode >= Opcode::CMP_EQ && opcode <= Opcode::CMP_GE;
+}
+
+bool Instruction::isConversion() const {
+  return opcode >= Opcode::SEXT && opcode <= Opcode::FPTRUNC;
+}
+
+bool Instruction::isTailCall() const {
+  if (opcode != Opcode::CALL || !parent) return false;
+  const Instruction* terminator = parent->getTerminator();
+  if (!terminator || terminator->opcode != Opcode::RET || std::next(parent->find(this))->get() != terminator) {
+      return false;
+  }
+  if (!producesValue()) return terminator->numOperands() == 0;
+  return terminator->numOperands() == 1 && terminator->getOperand(0) == this && getUsers().size() == 1;
+}
+
+bool Instruction::hasSideEffects() const {
+  return opcode == Opcode::STORE || opcode == Opcode::CALL || isTerminator();
+}
+
+bool Instruction::readsMemory() const {
+  return opcode == Opcode::LOAD || opcode == Opcode::CALL;
+}
+
+bool Instruction::writesMemory() const {
+  return opcode == Opcode::STORE || opcode == Opcode::CALL;
+}
+
+// BasicBlock implementation
+Instruction* BasicBlock::getTerminator() const {
+  if (instructions.empty() || !instructions.back()->isTerminator()) {
+      return nullptr;
+  }
+  return instructions.back().get();
+}
+
+std::vector<BasicBlock*> BasicBlock::successors() const {
+  Instruction* terminator = getTerminator();
+  if (!terminator) return {};
+
+  std::vector<BasicBlock*> result;
+  for (BasicBlock* block : terminator->blocks) {
+      if (std::find(result.begin(), result.end(), block) == result.end()) {
+          result.push_back(block);
+      }
+  }
+  return result;
+}
+
+std::vector<Instruction*> BasicBlock::phis() const {
+  std::vector<Instruction*> result;
+  for (const auto& instruction : instructions) {
+      if (!instruction->isPhi()) break;
+      result.push_back(instruction.get());
+  }
+  return result;
+}
+
+Instruction* BasicBlock::append(std::unique_ptr<Instruction> instruction) {
+  instruction->parent = this;
+  instructions.push_back(std::move(instruction));
+  return instructions.back().get();
+}
+
+Instruction* BasicBlock::insertBefore(std::unique_ptr<Instruction> instruction, Instruction* position) {
+  instruction->parent = this;
+  auto it = instructions.insert(find(position), std::move(instruction));
+  return it->get();
+}
+
+Instruction* BasicBlock::insertBeforeTerminator(std::unique_ptr<Instruction> instruction) {
+  Instruction* terminator = getTerminator();
+  if (!terminator) {
+      return append(std::move(instruction));
+  }
+  return insertBefore(std::move(instruction), terminator);
+}
+
+Instruction* BasicBlock::insertPhi(std::unique_ptr<Instruction> instruction) {
+  instruction->parent = this;
+  auto it = instructions.begin();
+  while (it != instructions.end() && (*it)->isPhi()) {
+      ++it;
+  }
+  return instructions.insert(it, std::move(instruction))->get();
+}
+
+void BasicBlock::moveHere(Instruction* instruction, Instruction* position) {
+  BasicBlock* from = instruction->parent;
+  auto source = from->find(instruction);
+  auto target = position ? find(position) : find(getTerminator());
+  instructions.splice(target, from->instructions, source);
+  instruction->parent = this;
+}
+
+void BasicBlock::erase(Instruction* instruction) {
+  if (instruction->hasUsers()) {
+      throw std::logic_error("Erasing IR instruction that still has users");
+  }
+  instructions.erase(find(instruction));
+}
+
+BasicBlock::InstructionList::iterator BasicBlock::find(const Instruction* instruction) {
+  if (!instruction) return instructions.end();
+  return std::find_if(instructions.begin(), instructions.end(),
+                      [instruction](const std::unique_ptr<Instruction>& candidate) {
+                          return candidate.get() == instruction;
+                      });
+}
+
+// Function implementation
+BasicBlock* Function::createBlock(const std::string& name) {
+  blocks.push_back(std::unique_ptr<BasicBlock>(new BasicBlock(this, blockCounter++, name)));
+  return blocks.back().get();
+}
+
+void Function::removeBlock(BasicBlock* block) {
+  // Operands first, so values defined and used within the block can go
+  for (auto& instruction : block->instructions) {
+      instruction->dropOperands();
+  }
+  block->instructions.clear();
+
+  blocks.erase(std::remove_if(blocks.begin(), blocks.end(),
+                              [block](const std::unique_ptr<BasicBlock>& candidate) {
+                                  return candidate.get() == block;
+                              }),
+               blocks.end());
+}
+
+void Function::moveBefore(BasicBlock* block, BasicBlock* position) {
+  auto find = [this](const BasicBlock* target) {
+      return std::find_if(blocks.begin(), blocks.end(),
+                          [target](const std::unique_ptr<BasicBlock>& candidate) {
+                              return candidate.get() == target;
+                          });
+  };
+  std::unique_ptr<BasicBlock> moved = std::move(*find(block));
+  blocks.erase(find(nullptr));
+  blocks.insert(find(position), std::move(moved));
+}
+
+void Function::arrangeBlocks(const std::vector<BasicBlock*>& order) {
+  std::unordered_map<const BasicBlock*, size_t> position;
+  for (size_t i = 0; i < order.size(); i++) {
+      position.emplace(order[i], i);
+  }
+  auto rank = [&position, &order](const std::unique_ptr<BasicBlock>& block) {
+      auto it = position.find(block.get());
+      return it == position.end() ? order.size() : it->second;
+  };
+  std::stable_sort(blocks.begin(), blocks.end(),
+                   [&rank](const std::unique_ptr<BasicBlock>& a, const std::unique_ptr<BasicBlock>& b) {
+                       return rank(a) < rank(b);
+                   });
+}
+
+std::unique_ptr<Instruction> Function::create(Opcode opcode, Type type, const std::vector<Value*>& operands) {
+  std::unique_ptr<Instruction> instruction(new Instruction(opcode, type));
+  instruction->id = nextValueId();
+  for (Value* operand : operands) {
+      instruction->addOperand(operand);
+  }
+  return instruction;
+}
+
+size_t Function::ConstantKeyHash::operator()(const ConstantKey& key) const {
+  size_t hash = std::hash<uint64_t>()(key.bits);
+  hash ^= (static_cast<size_t>(key.type) * 2 + (key.floating ? 1 : 0)) + 0x9e3779b97f4a7c15ULL + (hash << 6) +
+          (hash >> 2);
+  return hash;
+}
+
+Constant* Function::intern(const ConstantKey& key, int64_t integer, double floating) {
+  Constant*& constant = constantTable[key];
+  if (!constant) {
+      constants.push_back(std::unique_ptr<Constant>(new Constant(key.type, integer, floating)));
+      constants.back()->id = nextValueId();
+      constant = constants.back().get();
+  }
+  return constant;
+}
+
+Constant* Function::getInteger(Type type, int64_t value) {
+  return intern({type, false, static_cast<uint64_t>(value)}, value, 0.0);
+}
+
+Constant* Function::getFloating(Type type, double value) {
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof bits);
+  return intern({type, true, bits}, 0, value);
+}
+
+Undef* Function::getUndef(Type type) {
+  for (const auto& undef : undefs) {
+      if (undef->type == type) {
+          return undef.get();
+      }
+  }
+  undefs.push_back(std::unique_ptr<Undef>(new Undef(type)));
+  undefs.back()->id = nextValueId();
+  return undefs.back().get();
+}
+
+void Function::recomputePredecessors() {
+  for (auto& block : blocks) {
+      block->predecessors.clear();
+  }
+  for (auto& block : blocks) {
+      for (BasicBlock* successor : block->successors()) {
+          successor->predecessors.push_back(block.get());
+      }
+  }
+}
+
+BasicBlock* Function::splitBlock(Instruction* position, const std::string& name) {
+  BasicBlock* block = position->parent;
+  auto at = std::find_if(blocks.begin(), blocks.end(),
+                         [block](const std::unique_ptr<BasicBlock>& candidate) { return candidate.get() == block; });
+  BasicBlock* tail = blocks.insert(at + 1, std::unique_ptr<BasicBlock>(new BasicBlock(this, blockCounter++, name)))->get();
+
+  tail->instructions.splice(tail->instructions.end(), block->instructions, block->find(position), block->instructions.end());
+  for (auto& instruction : tail->instructions) {
+      instruction->parent = tail;
+  }
+  for (BasicBlock* successor : tail->successors()) {
+      for (Instruction* phi : successor->phis()) {
+          for (BasicBlock*& incoming : phi->blocks) {
+              if (incoming == block) incoming = tail;
+          }
+      }
+  }
+
+  std::unique_ptr<Instruction> branch = create(Opcode::BR, Type::VOID);
+  branch->blocks.push_back(tail);
+  block->append(std::move(branch));
+
+  recomputePredecessors();
+  return tail;
+}
+
+void Function::splitCriticalEdges() {
+  recomputePredecessors();
+
+  for (size_t b = 0; b < blocks.size(); b++) {
+      BasicBlock* block = blocks[b].get();
+      Instruction* terminator = block->getTerminator();
+      if (!terminator || terminator->opcode != Opcode::CONDBR) continue;
+
+      // Both edges to the same block: the condition does not matter
+      if (terminator->blocks[0] == terminator->blocks[1]) {
+          terminator->opcode = Opcode::BR;
+          terminator->dropOperands();
+          terminator->blocks.pop_back();
+          continue;
+      }
+
+      for (size_t s = 0; s < terminator->blocks.size(); s++) {
+          BasicBlock* successor = terminator->blocks[s];
+          if (successor->predecessors.size() < 2 || successor->phis().empty()) continue;
+
+          // Keep a fall-through from the source into the successor; other
+          // split blocks go at the end so no existing fall-through breaks
+          std::unique_ptr<BasicBlock> created(new BasicBlock(this, blockCounter++, "split"));
+          BasicBlock* split = created.get();
+          if (b + 1 < blocks.size() && blocks[b + 1].get() == successor) {
+              blocks.insert(blocks.begin() + b + 1, std::move(created));
+          } else {
+              blocks.push_back(std::move(created));
+          }
+          std::unique_ptr<Instruction> branch = create(Opcode::BR, Type::VOID);
+          branch->blocks.push_back(successor);
+          split->append(std::move(branch));
+
+          terminator->blocks[s] = split;
+          for (Instruction* phi : successor->phis()) {
+              for (BasicBlock*& incoming : phi->blocks) {
+                  if (incoming == block) incoming = split;
+              }
+          }
+
+          split->predecessors.push_back(block);
+          std::replace(successor->predecessors.begin(), successor->predecessors.end(), block, split);
+      }
+  }
+
+  recomputePredecessors();
+}
+
+bool Function::removeUnreachableBlocks() {
+  BasicBlock* start = entry();
+  if (!start) return false;
+
+  std::unordered_set<const BasicBlock*> reachable = {start};
+  std::vector<BasicBlock*> worklist = {start};
+  while (!worklist.empty()) {
+      BasicBlock* block = worklist.back();
+      worklist.pop_back();
+      for (BasicBlock* successor : block->successors()) {
+          if (reachable.insert(successor).second) {
+              worklist.push_back(successor);
+          }
+      }
+  }
+  if (reachable.size() == blocks.size()) return false;
+
+  std::vector<BasicBlock*> dead;
+  for (const auto& block : blocks) {
+      if (!reachable.count(block.get())) {
+          dead.push_back(block.get());
+      }
+  }
+
+  // Live phis forget the dead edges; dead values are unlinked before any
+  // is freed, since dead blocks may use each other's values
+  for (BasicBlock* block : dead) {
+      for (BasicBlock* successor : block->successors()) {
+          if (!reachable.count(successor)) continue;
+          for (Instruction* phi : successor->phis()) {
+              phi->removeIncoming(block);
+          }
+      }
+  }
+  for (BasicBlock* block : dead) {
+      for (auto& instruction : block->instructions) {
+          instruction->dropOperands();
+      }
+  }
+  for (BasicBlock* block : dead) {
+      for (auto& instruction : block->instructions) {
+          if (instruction->hasUsers()) {
+              instruction->replaceAllUsesWith(getUndef(instruction->type));
+          }
+      }
+      block->instructions.clear();
+  }
+  blocks.erase(std::remove_if(blocks.begin(), blocks.end(),
+                              [&reachable](const std::unique_ptr<BasicBlock>& block) {
+                                  return !reachable.count(block.get());
+                              }),
+               blocks.end());
+  recomputePredecessors();
+
+  // Phis that now merge one value are that value
+  bool changed = true;
+  while (changed) {
+      changed = false;
+      for (auto& block : blocks) {
+          for (Instruction* phi : block->phis()) {
+              Value* same = nullptr;
+              bool trivial = true;
+              for (Value* operand : phi->getOperands()) {
+                  if (operand == phi || operand == same) continue;
+                  if (same) {
+                      trivial = false;
+                      break;
+                  }
+                  same = operand;
+              }
+              if (!trivial) continue;
+              phi->replaceAllUsesWith(same ? same : getUndef(phi->type));
+              block->erase(phi);
+              changed = true;
+          }
+      }
+  }
+  return true;
+}
+
+Function::~Function() {
+  // Unlink all uses before anything is freed
+  for (auto& block : blocks) {
+      for (auto& instruction : block->instructions) {
+          instruction->dropOperands();
+      }
+  }
+}
+
+// Module implementation
+Function* Module::findFunction(const std::string& name) const {
+  for (const auto& function : functions) {
+      if (function->name == name) {
+          return function.get();
+      }
+  }
+  return nullptr;
+}
+
+// Printing
+namespace {
+
+void printValue(std::ostream& out, const Value* value) {
+  if (value->isConstant()) {
+      const Constant* constant = static_cast<const Constant*>(value);
+      if (isFloatType(constant->type)) {
+          out << constant->floating;
+      } else {
+          out << constant->integer;
+      }
+  } else if (value->isUndef()) {
+      out << "undef";
+  } else {
+      out << "%" << value->id;
+  }
+}
+
+void printBlockName(std::ostream& out, const BasicBlock* block) {
+  out << "bb" << block->id;
+}
+
+} // namespace
+
+void print(std::ostream& out, const Function& function) {
+  out << "function " << function.name << "(";
+  for (size_t i = 0; i < function.paramTypes.size(); i++) {
+      if (i > 0) out << ", ";
+      out << typeName(function.paramTypes[i]);
+  }
+  out << ") -> " << typeName(function.returnType) << " {\n";
+
+  for (const auto& block : function.blocks) {
+      printBlockName(out, block.get());
+      out << " (" << block->name << "):";
+      if (!block->predecessors.empty()) {
+          out << "  ; preds";
+          for (const BasicBlock* predecessor : block->predecessors) {
+              out << " ";
+              printBlockName(out, predecessor);
+          }
+      }
+      out << "\n";
+
+      for (const auto& instruction : block->instructions) {
+          out << "  ";
+          if (instruction->producesValue()) {
+              out << "%" << instruction->id << " = ";
+          }
+          out << opcodeName(instruction->opcode);
+          if (instruction->producesValue()) {
+              out << " " << typeName(instruction->type);
+          }
+          if (instruction->opcode == Opcode::CALL) {
+              out << " @" << instruction->callee;
+          }
+          if (instruction->opcode == Opcode::PARAM) {
+              out << " " << instruction->index;
+          }
+
+          for (size_t i = 0; i < instruction->numOperands(); i++) {
+              out << (i == 0 && instruction->opcode != Opcode::CALL ? " " : ", ");
+              if (instruction->isPhi()) {
+                  out << "[";
+                  printValue(out, instruction->getOperand(i));
+                  out << ", ";
+                  printBlockName(out, instruction->blocks[i]);
+                  out << "]";
+              } else {
+                  printValue(out, instruction->getOperand(i));
+              }
+          }
+
+          if (!instruction->isPhi()) {
+              for (size_t i = 0; i < instruction->blocks.size(); i++) {
+                  out << (i == 0 && instruction->numOperands() == 0 ? " " : ", ");
+                  printBlockName(out, instruction->blocks[i]);
+              }
+          }
+          out << "\n";
+      }
+  }
+  out << "}\n";
+}
+
+void print(std::ostream& out, const Module& module) {
+  for (const auto& function : module.functions) {
+      print(out, *function);
+  }
+}
+
+} // namespace ir
+} // namespace ccc
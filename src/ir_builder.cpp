@@ -0,0 +1,856 @@
+#include "ir_builder.h"
+#include "passes.h"
+#include "semantic.h"
+
+namespace ccc {
+
+namespace {
+
+// Whether a value is known to be 0 or 1: a comparison, or && and || of such
+bool isTruthValue(const ir::Value* value) {
+  if (value->isConstant()) {
+      const ir::Constant* constant = static_cast<const ir::Constant*>(value);
+      return constant->type == ir::Type::I32 && (constant->integer == 0 || constant->integer == 1);
+  }
+  if (!value->isInstruction()) {
+      return false;
+  }
+  const ir::Instruction* instruction = static_cast<const ir::Instruction*>(value);
+  if (instruction->isComparison()) {
+      return true;
+  }
+  return (instruction->opcode == ir::Opcode::AND || instruction->opcode == ir::Opcode::OR) &&
+         isTruthValue(instruction->getOperand(0)) && isTruthValue(instruction->getOperand(1));
+}
+
+bool isArithmeticType(ir::Type type) {
+  return ir::isIntegerType(type) || ir::isFloatType(type);
+}
+
+// Type the operands of a comparison or a compound assignment are brought
+// to: the usual arithmetic conversions after the integer promotions
+ir::Type comparisonType(ir::Type a, ir::Type b) {
+  if (!isArithmeticType(a) || !isArithmeticType(b)) return a;
+  if (a == ir::Type::F64 || b == ir::Type::F64) return ir::Type::F64;
+  if (a == ir::Type::F32 || b == ir::Type::F32) return ir::Type::F32;
+  return ir::Type::I32;
+}
+
+// Opcode of an arithmetic or comparison operator; false for any other token
+bool binaryOpcode(TokenType type, ir::Opcode& opcode) {
+  switch (type) {
+      case TokenType::OP_PLUS:            opcode = ir::Opcode::ADD; return true;
+      case TokenType::OP_MINUS:           opcode = ir::Opcode::SUB; return true;
+      case TokenType::OP_STAR:            opcode = ir::Opcode::MUL; return true;
+      case TokenType::OP_SLASH:           opcode = ir::Opcode::DIV; return true;
+      case TokenType::OP_PERCENT:         opcode = ir::Opcode::MOD; return true;
+      case TokenType::OP_AMPERSAND:       opcode = ir::Opcode::AND; return true;
+      case TokenType::OP_PIPE:            opcode = ir::Opcode::OR; return true;
+      case TokenType::OP_CARET:           opcode = ir::Opcode::XOR; return true;
+      case TokenType::OP_SHL:             opcode = ir::Opcode::SHL; return true;
+      case TokenType::OP_SHR:             opcode = ir::Opcode::SHR; return true;
+      case TokenType::OP_EQUALS_EQUALS:   opcode = ir::Opcode::CMP_EQ; return true;
+      case TokenType::OP_NOT_EQUALS:      opcode = ir::Opcode::CMP_NE; return true;
+      case TokenType::OP_LESS:            opcode = ir::Opcode::CMP_LT; return true;
+      case TokenType::OP_LESS_EQUALS:     opcode = ir::Opcode::CMP_LE; return true;
+      case TokenType::OP_GREATER:         opcode = ir::Opcode::CMP_GT; return true;
+      case TokenType::OP_GREATER_EQUALS:  opcode = ir::Opcode::CMP_GE; return true;
+      default:                            return false;
+  }
+}
+
+} // namespace
+
+IRBuilder::IRBuilder(ErrorHandler& errorHandler)
+  : errorHandler(errorHandler), module(nullptr), function(nullptr), block(nullptr) {
+}
+
+std::unique_ptr<ir::Module> IRBuilder::build(ProgramNode* program) {
+  std::unique_ptr<ir::Module> result(new ir::Module());
+  module = result.get();
+  resetTraversal();
+
+  // Global variables have no code of their own; CodeGenerator emits them
+  for (const auto& declaration : program->declarations) {
+      if (declaration->kind == NodeKind::FUNCTION_DECLARATION) {
+          visitFunctionDeclaration(static_cast<FunctionDeclarationNode*>(declaration.get()));
+      }
+  }
+
+  module = nullptr;
+  return result;
+}
+
+ir::Type IRBuilder::translateType(const TypeInfo* type) {
+  if (!type) return ir::Type::I32;
+
+  switch (type->kind) {
+      case TypeInfo::Kind::VOID:     return ir::Type::VOID;
+      case TypeInfo::Kind::CHAR:     return ir::Type::I8;
+      case TypeInfo::Kind::INT:      return ir::Type::I32;
+      case TypeInfo::Kind::FLOAT:    return ir::Type::F32;
+      case TypeInfo::Kind::DOUBLE:   return ir::Type::F64;
+      case TypeInfo::Kind::POINTER:
+      case TypeInfo::Kind::ARRAY:
+      case TypeInfo::Kind::FUNCTION: return ir::Type::PTR;
+      default:                       return ir::Type::I32;
+  }
+}
+
+bool IRBuilder::isLocal(const SymbolInfo* symbol) {
+  return symbol->kind == SymbolInfo::Kind::PARAMETER ||
+         (symbol->kind == SymbolInfo::Kind::VARIABLE && symbol->scopeLevel > 0);
+}
+
+// SSA construction
+
+void IRBuilder::writeVariable(const SymbolInfo* variable, ir::BasicBlock* target, ir::Value* value) {
+  currentDef[target][variable] = value;
+}
+
+ir::Value* IRBuilder::resolve(ir::Value* value) const {
+  auto it = replacedPhis.find(value);
+  while (it != replacedPhis.end()) {
+      value = it->second;
+      it = replacedPhis.find(value);
+  }
+  return value;
+}
+
+ir::Value* IRBuilder::readVariable(const SymbolInfo* variable, ir::BasicBlock* target) {
+  auto& definitions = currentDef[target];
+  auto it = definitions.find(variable);
+  if (it != definitions.end()) {
+      return resolve(it->second);
+  }
+  return readVariableRecursive(variable, target);
+}
+
+ir::Value* IRBuilder::readVariableRecursive(const SymbolInfo* variable, ir::BasicBlock* target) {
+  ir::Type type = translateType(variable->type);
+  ir::Value* value;
+
+  if (!sealedBlocks.count(target)) {
+      // Not all predecessors known yet: placeholder phi, completed on sealing
+      ir::Instruction* phi = target->insertPhi(function->create(ir::Opcode::PHI, type));
+      incompletePhis[target].emplace_back(variable, phi);
+      value = phi;
+  } else if (target->predecessors.size() == 1) {
+      // No phi needed
+      value = readVariable(variable, target->predecessors[0]);
+  } else if (target->predecessors.empty()) {
+      // Entry or unreachable block: the variable was never assigned
+      value = function->getUndef(type);
+  } else {
+      // Break cycles with an operandless phi before asking the predecessors
+      ir::Instruction* phi = target->insertPhi(function->create(ir::Opcode::PHI, type));
+      writeVariable(variable, target, phi);
+      value = addPhiOperands(variable, phi);
+  }
+
+  writeVariable(variable, target, value);
+  return value;
+}
+
+ir::Value* IRBuilder::addPhiOperands(const SymbolInfo* variable, ir::Instruction* phi) {
+  for (ir::BasicBlock* predecessor : phi->parent->predecessors) {
+      phi->addIncoming(readVariable(variable, predecessor), predecessor);
+  }
+  return tryRemoveTrivialPhi(phi);
+}
+
+ir::Value* IRBuilder::tryRemoveTrivialPhi(ir::Instruction* phi) {
+  ir::Value* same = nullptr;
+  for (ir::Value* operand : phi->getOperands()) {
+      if (operand == same || operand == phi) continue;
+      if (same) return phi; // Merges at least two values: not trivial
+      same = operand;
+  }
+  if (!same) {
+      // Unreachable or only references itself
+      same = function->getUndef(phi->type);
+  }
+
+  // Remember the phis that used this one; they may become trivial too
+  std::vector<ir::Instruction*> phiUsers;
+  for (ir::Instruction* user : phi->getUsers()) {
+      if (user != phi && user->isPhi()) {
+          phiUsers.push_back(user);
+      }
+  }
+
+  phi->dropOperands();
+  phi->replaceAllUsesWith(same);
+  replacedPhis[phi] = same;
+  removedPhis.push_back(phi);
+
+  for (ir::Instruction* user : phiUsers) {
+      if (!replacedPhis.count(user)) {
+          tryRemoveTrivialPhi(user);
+      }
+  }
+  return resolve(same);
+}
+
+void IRBuilder::sealBlock(ir::BasicBlock* target) {
+  // Copy first: completing a phi can read variables in this block again
+  auto pending = std::move(incompletePhis[target]);
+  incompletePhis.erase(target);
+  sealedBlocks.insert(target);
+
+  for (const auto& entry : pending) {
+      addPhiOperands(entry.first, entry.second);
+  }
+}
+
+// Instruction creation
+
+ir::Instruction* IRBuilder::emit(ir::Opcode opcode, ir::Type type, const std::vector<ir::Value*>& operands) {
+  return block->append(function->create(opcode, type, operands));
+}
+
+void IRBuilder::emitBranch(ir::BasicBlock* target) {
+  ir::Instruction* branch = emit(ir::Opcode::BR, ir::Type::VOID);
+  branch->blocks.push_back(target);
+  target->predecessors.push_back(block);
+}
+
+void IRBuilder::emitCondBranch(ir::Value* condition, ir::BasicBlock* ifTrue, ir::BasicBlock* ifFalse) {
+  ir::Instruction* branch = emit(ir::Opcode::CONDBR, ir::Type::VOID, {condition});
+  branch->blocks.push_back(ifTrue);
+  branch->blocks.push_back(ifFalse);
+  ifTrue->predecessors.push_back(block);
+  if (ifFalse != ifTrue) {
+      ifFalse->predecessors.push_back(block);
+  }
+}
+
+void IRBuilder::emitCondition(ExpressionNode* condition, ir::BasicBlock* ifTrue, ir::BasicBlock* ifFalse) {
+  if (condition && !condition->constant.isConstant()) {
+      if (condition->kind == NodeKind::BINARY) {
+          auto* binary = static_cast<BinaryNode*>(condition);
+          bool isAnd = binary->op.type == TokenType::OP_LOGICAL_AND;
+          if (isAnd || binary->op.type == TokenType::OP_LOGICAL_OR) {
+              // The right operand runs only when the left one does not decide
+              ir::BasicBlock* right = function->createBlock(isAnd ? "and_rhs" : "or_rhs");
+              emitCondition(binary->left.get(), isAnd ? right : ifTrue, isAnd ? ifFalse : right);
+              sealBlock(right);
+              startBlock(right);
+              emitCondition(binary->right.get(), ifTrue, ifFalse);
+              return;
+          }
+      } else if (condition->kind == NodeKind::UNARY) {
+          auto* unary = static_cast<UnaryNode*>(condition);
+          if (unary->op.type == TokenType::OP_EXCLAMATION) {
+              emitCondition(unary->operand.get(), ifFalse, ifTrue);
+              return;
+          }
+      }
+  }
+  emitCondBranch(visitExpression(condition), ifTrue, ifFalse);
+}
+
+void IRBuilder::startBlock(ir::BasicBlock* target) {
+  layout.push_back(target);
+  block = target;
+}
+
+void IRBuilder::startUnreachableBlock() {
+  // Code after return, break or continue; it has no predecessors
+  ir::BasicBlock* unreachable = function->createBlock("unreachable");
+  sealBlock(unreachable);
+  startBlock(unreachable);
+}
+
+ir::Value* IRBuilder::zero(ir::Type type) {
+  if (isFloatType(type)) {
+      return function->getFloating(type, 0.0);
+  }
+  return function->getInteger(type, 0);
+}
+
+ir::Value* IRBuilder::convert(ir::Value* value, ir::Type type) {
+  if (value->type == type || !isArithmeticType(value->type) || !isArithmeticType(type)) {
+      return value;
+  }
+  if (value->isUndef()) {
+      return function->getUndef(type);
+  }
+  ir::Opcode opcode = ir::conversionOpcode(value->type, type);
+  if (value->isConstant()) {
+      if (ir::Constant* folded = ir::foldInstruction(*function, opcode, type, {static_cast<ir::Constant*>(value)})) {
+          return folded;
+      }
+  }
+  return emit(opcode, type, {value});
+}
+
+ir::Value* IRBuilder::constant(const ConstantValue& value, ir::Type type) {
+  if (value.isFloating()) {
+      return function->getFloating(type, value.floating);
+  }
+  return function->getInteger(type, value.integer);
+}
+
+// Declarations and statements
+
+void IRBuilder::visitFunctionDeclaration(FunctionDeclarationNode* node) {
+  if (!node->body || !node->symbol) return;
+
+  const TypeInfo* functionType = node->symbol->type;
+  std::vector<ir::Type> paramTypes;
+  for (const TypeInfo* paramType : functionType->parameters) {
+      paramTypes.push_back(translateType(paramType));
+  }
+
+  module->functions.emplace_back(new ir::Function(node->name.lexeme, translateType(functionType->base), paramTypes));
+  function = module->functions.back().get();
+
+  // Fresh construction state
+  currentDef.clear();
+  incompletePhis.clear();
+  sealedBlocks.clear();
+  replacedPhis.clear();
+  removedPhis.clear();
+  loops.clear();
+  layout.clear();
+
+  ir::BasicBlock* entry = function->createBlock("entry");
+  sealBlock(entry);
+  startBlock(entry);
+
+  // Parameters are read from the ABI once, at entry
+  for (size_t i = 0; i < node->parameters.size(); i++) {
+      ir::Instruction* param = emit(ir::Opcode::PARAM, paramTypes[i]);
+      param->index = static_cast<uint32_t>(i);
+      if (node->parameters[i]->symbol) {
+          writeVariable(node->parameters[i]->symbol, entry, param);
+      }
+  }
+
+  visitBlock(node->body.get());
+
+  // Falling off the end: main returns 0, other functions return nothing
+  if (!isTerminated()) {
+      if (function->name == "main") {
+          emit(ir::Opcode::RET, ir::Type::VOID, {function->getInteger(ir::Type::I32, 0)});
+      } else {
+          emit(ir::Opcode::RET, ir::Type::VOID);
+      }
+  }
+
+  // Blocks are laid out in the order they were started. Replaced phis go
+  // before unreachable blocks are dropped: they are no longer part of the
+  // SSA form, while the phis that lose inputs from dead blocks are merged
+  // away like any other.
+  function->arrangeBlocks(layout);
+  for (ir::Instruction* phi : removedPhis) {
+      phi->parent->erase(phi);
+  }
+  removedPhis.clear();
+  function->removeUnreachableBlocks();
+
+  function->recomputePredecessors();
+  function = nullptr;
+  block = nullptr;
+}
+
+void IRBuilder::visitVariableDeclaration(VariableDeclarationNode* node) {
+  if (!node->symbol) return;
+
+  ir::Type type = translateType(node->symbol->type);
+  ir::Value* value = node->initializer
+      ? convert(visitExpression(node->initializer.get()), type)
+      : function->getUndef(type);
+  writeVariable(node->symbol, block, value);
+}
+
+void IRBuilder::visitBlock(BlockNode* node) {
+  for (const auto& statement : node->statements) {
+      visitStatement(statement.get());
+  }
+}
+
+void IRBuilder::visitExpressionStatement(ExpressionStatementNode* node) {
+  visitExpression(node->expression.get());
+}
+
+void IRBuilder::visitIfStatement(IfNode* node) {
+  ir::BasicBlock* thenBlock = function->createBlock("then");
+  ir::BasicBlock* elseBlock = node->elseBranch ? function->createBlock("else") : nullptr;
+  ir::BasicBlock* endBlock = function->createBlock("endif");
+
+  emitCondition(node->condition.get(), thenBlock, elseBlock ? elseBlock : endBlock);
+  sealBlock(thenBlock);
+
+  startBlock(thenBlock);
+  visitStatement(node->thenBranch.get());
+  if (!isTerminated()) {
+      emitBranch(endBlock);
+  }
+
+  if (elseBlock) {
+      sealBlock(elseBlock);
+      startBlock(elseBlock);
+      visitStatement(node->elseBranch.get());
+      if (!isTerminated()) {
+          emitBranch(endBlock);
+      }
+  }
+
+  sealBlock(endBlock);
+  startBlock(endBlock);
+}
+
+void IRBuilder::visitWhileStatement(WhileNode* node) {
+  ir::BasicBlock* header = function->createBlock("while_cond");
+  ir::BasicBlock* body = function->createBlock("while_body");
+  ir::BasicBlock* exit = function->createBlock("while_end");
+
+  // The header is sealed once the back edge exists
+  emitBranch(header);
+  startBlock(header);
+  emitCondition(node->condition.get(), body, exit);
+
+  sealBlock(body);
+  startBlock(body);
+  loops.push_back({exit, header});
+  visitStatement(node->body.get());
+  loops.pop_back();
+  if (!isTerminated()) {
+      emitBranch(header);
+  }
+
+  sealBlock(header);
+  sealBlock(exit);
+  startBlock(exit);
+}
+
+void IRBuilder::visitDoWhileStatement(DoWhileNode* node) {
+  ir::BasicBlock* body = function->createBlock("do_body");
+  ir::BasicBlock* condition = function->createBlock("do_cond");
+  ir::BasicBlock* exit = function->createBlock("do_end");
+
+  // The body is sealed once the back edge exists
+  emitBranch(body);
+  startBlock(body);
+  loops.push_back({exit, condition});
+  visitStatement(node->body.get());
+  loops.pop_back();
+  if (!isTerminated()) {
+      emitBranch(condition);
+  }
+
+  sealBlock(condition);
+  startBlock(condition);
+  emitCondition(node->condition.get(), body, exit);
+
+  sealBlock(body);
+  sealBlock(exit);
+  startBlock(exit);
+}
+
+void IRBuilder::visitForStatement(ForNode* node) {
+  if (node->initializer) {
+      visitStatement(node->initializer.get());
+  }
+
+  ir::BasicBlock* header = function->createBlock("for_cond");
+  ir::BasicBlock* body = function->createBlock("for_body");
+  ir::BasicBlock* latch = function->createBlock("for_inc");
+  ir::BasicBlock* exit = function->createBlock("for_end");
+
+  // The header is sealed once the back edge exists
+  emitBranch(header);
+  startBlock(header);
+  if (node->condition) {
+      emitCondition(node->condition.get(), body, exit);
+  } else {
+      emitBranch(body);
+  }
+
+  sealBlock(body);
+  startBlock(body);
+  loops.push_back({exit, latch});
+  visitStatement(node->body.get());
+  loops.pop_back();
+  if (!isTerminated()) {
+      emitBranch(latch);
+  }
+
+  sealBlock(latch);
+  startBlock(latch);
+  if (node->increment) {
+      visitExpression(node->increment.get());
+  }
+  emitBranch(header);
+
+  sealBlock(header);
+  sealBlock(exit);
+  startBlock(exit);
+}
+
+void IRBuilder::visitReturnStatement(ReturnNode* node) {
+  if (node->value) {
+      emit(ir::Opcode::RET, ir::Type::VOID, {convert(visitExpression(node->value.get()), function->returnType)});
+  } else {
+      emit(ir::Opcode::RET, ir::Type::VOID);
+  }
+  startUnreachableBlock();
+}
+
+void IRBuilder::visitBreakStatement(BreakNode*) {
+  if (loops.empty()) {
+      errorHandler.error(0, 0, "Break statement not within a loop");
+      return;
+  }
+  emitBranch(loops.back().breakTarget);
+  startUnreachableBlock();
+}
+
+void IRBuilder::visitContinueStatement(ContinueNode*) {
+  if (loops.empty()) {
+      errorHandler.error(0, 0, "Continue statement not within a loop");
+      return;
+  }
+  emitBranch(loops.back().continueTarget);
+  startUnreachableBlock();
+}
+
+void IRBuilder::visitInvalidStatement(StatementNode* node) {
+  errorHandler.error(0, 0, "Unknown statement type: " + node->getNodeType());
+}
+
+// Expressions
+
+ir::Value* IRBuilder::visitExpression(ExpressionNode* node) {
+  // Folded by semantic analysis
+  if (node && node->constant.isConstant()) {
+      return constant(node->constant, translateType(node->type));
+  }
+  return ASTVisitor::visitExpression(node);
+}
+
+ir::Value* IRBuilder::visitInvalidExpression(ExpressionNode* node) {
+  if (!node) {
+      errorHandler.error(0, 0, "Null expression");
+  } else {
+      errorHandler.error(0, 0, "Unknown expression type: " + node->getNodeType());
+  }
+  return function->getUndef(ir::Type::I32);
+}
+
+ir::Value* IRBuilder::visitLiteral(LiteralNode* node) {
+  // Numeric and character literals are folded constants and never get here
+  if (node->token.type != TokenType::STRING_LITERAL) {
+      errorHandler.error(node->token.line, node->token.column, "Unknown literal type");
+      return function->getUndef(translateType(node->type));
+  }
+
+  // String literals would live in the data section; null for now
+  errorHandler.warning(0, 0, "String literals not fully implemented");
+  return function->getInteger(ir::Type::PTR, 0);
+}
+
+ir::Value* IRBuilder::visitVariable(VariableNode* node) {
+  if (!node->symbol || !isLocal(node->symbol)) {
+      errorHandler.error(node->name.line, node->name.column,
+                        "Global variable access not implemented: " + node->name.lexeme);
+      return function->getUndef(translateType(node->type));
+  }
+  return readVariable(node->symbol, block);
+}
+
+ir::Value* IRBuilder::visitUnary(UnaryNode* node) {
+  ir::Type type = translateType(node->type);
+
+  switch (node->op.type) {
+      case TokenType::OP_MINUS:
+          return emit(ir::Opcode::NEG, type, {convert(visitExpression(node->operand.get()), type)});
+
+      case TokenType::OP_PLUS:
+          // Unary plus only promotes
+          return convert(visitExpression(node->operand.get()), type);
+
+      case TokenType::OP_EXCLAMATION: {
+          // Logical NOT: compare with zero
+          ir::Value* operand = visitExpression(node->operand.get());
+          return emit(ir::Opcode::CMP_EQ, ir::Type::I32, {operand, zero(operand->type)});
+      }
+
+      case TokenType::OP_TILDE:
+          return emit(ir::Opcode::NOT, type, {convert(visitExpression(node->operand.get()), type)});
+
+      case TokenType::OP_PLUS_PLUS:
+      case TokenType::OP_MINUS_MINUS: {
+          // Increment or decrement the operand, yielding its old value
+          ir::Opcode opcode = node->op.type == TokenType::OP_PLUS_PLUS ? ir::Opcode::ADD : ir::Opcode::SUB;
+          ir::Value* one = isFloatType(type) ? static_cast<ir::Value*>(function->getFloating(type, 1.0))
+                                             : function->getInteger(type == ir::Type::PTR ? ir::Type::I32 : type, 1);
+          ExpressionNode* operand = node->operand.get();
+
+          if (operand->kind == NodeKind::VARIABLE) {
+              auto* variable = static_cast<VariableNode*>(operand);
+              if (variable->symbol && isLocal(variable->symbol)) {
+                  ir::Value* old = readVariable(variable->symbol, block);
+                  writeVariable(variable->symbol, block, emit(opcode, type, {old, one}));
+                  return old;
+              }
+          } else if (operand->kind == NodeKind::ARRAY_ACCESS) {
+              auto* access = static_cast<ArrayAccessNode*>(operand);
+              ir::Value* base = visitExpression(access->array.get());
+              ir::Value* index = visitExpression(access->index.get());
+              ir::Value* old = emit(ir::Opcode::LOAD, type, {base, index});
+              emit(ir::Opcode::STORE, ir::Type::VOID, {base, index, emit(opcode, type, {old, one})});
+              return old;
+          }
+
+          errorHandler.error(node->op.line, node->op.column,
+                            "Operand of " + node->op.lexeme + " must be a local variable or array element");
+          return function->getUndef(type);
+      }
+
+      case TokenType::OP_STAR:
+          // Dereference needs address-taken locals; pass the operand through
+          errorHandler.warning(0, 0, "Dereference operator not fully implemented");
+          return visitExpression(node->operand.get());
+
+      case TokenType::OP_AMPERSAND:
+          errorHandler.warning(0, 0, "Address-of operator not fully implemented");
+          return visitExpression(node->operand.get());
+
+      default:
+          errorHandler.error(node->op.line, node->op.column,
+                            "Unknown unary operator: " + node->op.lexeme);
+          return function->getUndef(type);
+  }
+}
+
+ir::Value* IRBuilder::visitBinary(BinaryNode* node) {
+  if (node->op.type == TokenType::OP_EQUALS || compoundOperator(node->op.type) != TokenType::UNKNOWN) {
+      return assign(node);
+  }
+  if (node->op.type == TokenType::OP_LOGICAL_AND || node->op.type == TokenType::OP_LOGICAL_OR) {
+      return logical(node);
+  }
+
+  ir::Opcode opcode;
+  if (!binaryOpcode(node->op.type, opcode)) {
+      errorHandler.error(node->op.line, node->op.column,
+                        "Binary operator not implemented: " + node->op.lexeme);
+      return function->getUndef(translateType(node->type));
+  }
+  ir::Value* left = visitExpression(node->left.get());
+  ir::Value* right = visitExpression(node->right.get());
+  return operate(opcode, translateType(node->type), left, right);
+}
+
+ir::Value* IRBuilder::operate(ir::Opcode opcode, ir::Type type, ir::Value* left, ir::Value* right) {
+  // Operands are converted to a common type (the result's, except for
+  // comparisons, which yield an int, 0 or 1), a shift count only promoted
+  ir::Type operandType = type;
+  if (opcode >= ir::Opcode::CMP_EQ && opcode <= ir::Opcode::CMP_GE) {
+      operandType = comparisonType(left->type, right->type);
+  }
+  left = convert(left, operandType);
+  right = convert(right, opcode == ir::Opcode::SHL || opcode == ir::Opcode::SHR ? ir::Type::I32 : operandType);
+  return emit(opcode, type, {left, right});
+}
+
+ir::Value* IRBuilder::logical(BinaryNode* node) {
+  bool isAnd = node->op.type == TokenType::OP_LOGICAL_AND;
+  ir::Opcode opcode = isAnd ? ir::Opcode::AND : ir::Opcode::OR;
+  if (isSpeculatable(node->right.get())) {
+      ir::Value* left = truthValue(visitExpression(node->left.get()));
+      ir::Value* right = truthValue(visitExpression(node->right.get()));
+      return emit(opcode, ir::Type::I32, {left, right});
+  }
+
+  // Every way around the right operand already knows the result
+  ir::BasicBlock* right = function->createBlock(isAnd ? "and_rhs" : "or_rhs");
+  ir::BasicBlock* end = function->createBlock(isAnd ? "and_end" : "or_end");
+  emitCondition(node->left.get(), isAnd ? right : end, isAnd ? end : right);
+  sealBlock(right);
+  startBlock(right);
+  ir::Value* rightValue = truthValue(visitExpression(node->right.get()));
+  ir::BasicBlock* rightEnd = block;
+  emitBranch(end);
+
+  sealBlock(end);
+  startBlock(end);
+  ir::Instruction* phi = end->insertPhi(function->create(ir::Opcode::PHI, ir::Type::I32));
+  for (ir::BasicBlock* predecessor : end->predecessors) {
+      phi->addIncoming(predecessor == rightEnd ? rightValue : function->getInteger(ir::Type::I32, isAnd ? 0 : 1),
+                       predecessor);
+  }
+  return tryRemoveTrivialPhi(phi);
+}
+
+bool IRBuilder::isSpeculatable(const ExpressionNode* node) {
+  if (!node || node->constant.isConstant()) {
+      return true;
+  }
+  switch (node->kind) {
+      case NodeKind::VARIABLE:
+          return true;
+      case NodeKind::UNARY: {
+          const auto* unary = static_cast<const UnaryNode*>(node);
+          switch (unary->op.type) {
+              case TokenType::OP_MINUS:
+              case TokenType::OP_PLUS:
+              case TokenType::OP_TILDE:
+              case TokenType::OP_EXCLAMATION:
+                  return isSpeculatable(unary->operand.get());
+              default:
+                  return false;
+          }
+      }
+      case NodeKind::BINARY: {
+          const auto* binary = static_cast<const BinaryNode*>(node);
+          if (binary->op.type == TokenType::OP_EQUALS || compoundOperator(binary->op.type) != TokenType::UNKNOWN) {
+              return false;
+          }
+          // Integer division traps on a zero divisor and on INT_MIN / -1
+          if (binary->op.type == TokenType::OP_SLASH || binary->op.type == TokenType::OP_PERCENT) {
+              const ConstantValue& divisor = binary->right->constant;
+              if (!divisor.isFloating() && (!divisor.isConstant() || divisor.integer == 0 || divisor.integer == -1)) {
+                  return false;
+              }
+          }
+          return isSpeculatable(binary->left.get()) && isSpeculatable(binary->right.get());
+      }
+      default:
+          // Calls and assignments have side effects; loads may fault
+          return false;
+  }
+}
+
+ir::Value* IRBuilder::truthValue(ir::Value* value) {
+  if (isTruthValue(value)) {
+      return value;
+  }
+  if (value->isConstant()) {
+      return function->getInteger(ir::Type::I32, static_cast<ir::Constant*>(value)->isZero() ? 0 : 1);
+  }
+  return emit(ir::Opcode::CMP_NE, ir::Type::I32, {value, zero(value->type)});
+}
+
+ir::Value* IRBuilder::assign(BinaryNode* node) {
+  ExpressionNode* target = node->left.get();
+  ExpressionNode* source = node->right.get();
+  ir::Opcode opcode;
+  bool compound = binaryOpcode(compoundOperator(node->op.type), opcode);
+
+  if (target->kind == NodeKind::VARIABLE) {
+      auto* variable = static_cast<VariableNode*>(target);
+      if (variable->symbol && isLocal(variable->symbol)) {
+          ir::Type type = translateType(variable->symbol->type);
+          ir::Value* old = compound ? readVariable(variable->symbol, block) : nullptr;
+          ir::Value* value = visitExpression(source);
+          if (compound) {
+              value = combine(opcode, old, value);
+          }
+          value = convert(value, type);
+          writeVariable(variable->symbol, block, value);
+          return value;
+      }
+      errorHandler.error(variable->name.line, variable->name.column,
+                        "Global variable access not implemented: " + variable->name.lexeme);
+      return visitExpression(source);
+  }
+
+  if (target->kind == NodeKind::ARRAY_ACCESS) {
+      // Element address first, then the value, left to right; a compound
+      // assignment loads the element from and stores it back to that one
+      // address
+      auto* access = static_cast<ArrayAccessNode*>(target);
+      ir::Type type = translateType(access->type);
+      ir::Value* base = visitExpression(access->array.get());
+      ir::Value* index = visitExpression(access->index.get());
+      ir::Value* old = compound ? emit(ir::Opcode::LOAD, type, {base, index}) : nullptr;
+      ir::Value* value = visitExpression(source);
+      if (compound) {
+          value = combine(opcode, old, value);
+      }
+      value = convert(value, type);
+      emit(ir::Opcode::STORE, ir::Type::VOID, {base, index, value});
+      return value;
+  }
+
+  errorHandler.error(0, 0, "Invalid assignment target");
+  return visitExpression(source);
+}
+
+ir::Value* IRBuilder::combine(ir::Opcode opcode, ir::Value* old, ir::Value* value) {
+  // Computed in the type a op b would have, the promoted left type for a shift
+  bool shift = opcode == ir::Opcode::SHL || opcode == ir::Opcode::SHR;
+  return operate(opcode, comparisonType(old->type, shift ? old->type : value->type), old, value);
+}
+
+ir::Value* IRBuilder::visitCall(CallNode* node) {
+  // For simplicity, assume callee is a variable (function name)
+  if (node->callee->kind != NodeKind::VARIABLE) {
+      errorHandler.error(0, 0, "Only simple function calls supported");
+      return function->getUndef(translateType(node->type));
+  }
+
+  // Arguments are converted to the parameters' types when they are known
+  const SymbolInfo* callee = static_cast<VariableNode*>(node->callee.get())->symbol;
+  const TypeInfo* calleeType = callee ? callee->type : nullptr;
+  std::vector<ir::Value*> arguments;
+  for (size_t i = 0; i < node->arguments.size(); i++) {
+      ir::Value* argument = visitExpression(node->arguments[i].get());
+      if (calleeType && calleeType->kind == TypeInfo::Kind::FUNCTION && i < calleeType->parameters.size()) {
+          argument = convert(argument, translateType(calleeType->parameters[i]));
+      }
+      arguments.push_back(argument);
+  }
+
+  ir::Instruction* call = emit(ir::Opcode::CALL, translateType(node->type), arguments);
+  call->callee = static_cast<VariableNode*>(node->callee.get())->name.lexeme;
+  return call;
+}
+
+ir::Value* IRBuilder::visitArrayAccess(ArrayAccessNode* node) {
+  ir::Value* base = visitExpression(node->array.get());
+  ir::Value* index = visitExpression(node->index.get());
+  return emit(ir::Opcode::LOAD, translateType(node->type), {base, index});
+}
+
+ir::Value* IRBuilder::visitMemberAccess(MemberAccessNode* node) {
+  // Not implemented in this simple version
+  errorHandler.warning(0, 0, "Member access not implemented");
+  return function->getUndef(translateType(node->type));
+}
+
+ir::Value* IRBuilder::visitConditional(ConditionalNode* node) {
+  ir::BasicBlock* trueBlock = function->createBlock("cond_true");
+  ir::BasicBlock* falseBlock = function->createBlock("cond_false");
+  ir::BasicBlock* endBlock = function->createBlock("cond_end");
+
+  emitCondition(node->condition.get(), trueBlock, falseBlock);
+  sealBlock(trueBlock);
+  sealBlock(falseBlock);
+
+  // Each arm may itself branch, so remember where it ends
+  ir::Type type = translateType(node->type);
+  startBlock(trueBlock);
+  ir::Value* trueValue = convert(visitExpression(node->trueExpr.get()), type);
+  ir::BasicBlock* trueEnd = block;
+  emitBranch(endBlock);
+
+  startBlock(falseBlock);
+  ir::Value* falseValue = convert(visitExpression(node->falseExpr.get()), type);
+  ir::BasicBlock* falseEnd = block;
+  emitBranch(endBlock);
+
+  sealBlock(endBlock);
+  startBlock(endBlock);
+
+  ir::Instruction* phi = endBlock->insertPhi(function->create(ir::Opcode::PHI, type));
+  phi->addIncoming(trueValue, trueEnd);
+  phi->addIncoming(falseValue, falseEnd);
+  return tryRemoveTrivialPhi(phi);
+}
+
+} // namespace ccc
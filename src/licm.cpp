@@ -0,0 +1,291 @@
+#include "passes.h"
+#include <unordered_map>
+#include <unordered_set>
+
+namespace ccc {
+namespace ir {
+
+namespace {
+
+// Instructions that compute a value from their operands alone (loads also
+// depend on memory)
+bool isMovable(const Instruction* instruction) {
+  switch (instruction->opcode) {
+      case Opcode::PHI:
+      case Opcode::PARAM:
+      case Opcode::STORE:
+      case Opcode::CALL:
+          return false;
+      default:
+          return !instruction->isTerminator();
+  }
+}
+
+// Whether executing the instruction where the program would not can fault:
+// loads, and integer division unless the divisor is a constant other than
+// 0 and -1
+bool mayTrap(const Instruction* instruction) {
+  switch (instruction->opcode) {
+      case Opcode::LOAD:
+          return true;
+      case Opcode::DIV:
+      case Opcode::MOD: {
+          if (isFloatType(instruction->type)) return false;
+          const Value* divisor = instruction->getOperand(1);
+          if (!divisor->isConstant()) return true;
+          int64_t value = static_cast<const Constant*>(divisor)->integer;
+          return value == 0 || value == -1;
+      }
+      default:
+          return false;
+  }
+}
+
+class Hoister {
+public:
+  struct Summary {
+      const BasicBlock* header;
+      unsigned hoisted;
+      unsigned guarded;
+  };
+
+  Hoister(Function& function, const DominatorTree& dominators, LoopInfo& loops)
+      : function(function), dominators(dominators), loops(loops) {}
+
+  std::vector<Summary> run() {
+      std::vector<Summary> summaries;
+      for (Loop* loop : loops.loopsInnermostFirst()) {
+          Summary summary = {loop->header, 0, 0};
+          if (hasCandidates(loop)) {
+              findWrites(loop);
+              if (!loop->preheader()) insertedBlocks = true;
+              BasicBlock* preheader = loops.insertPreheader(loop);
+              summary.hoisted = hoistSpeculatable(loop, preheader);
+              summary.guarded = hoistGuarded(loop, preheader);
+              if (summary.guarded > 0) insertedBlocks = true;
+          }
+          if (summary.hoisted + summary.guarded > 0) {
+              summaries.push_back(summary);
+          }
+      }
+      return summaries;
+  }
+
+  // Whether preheaders or guards were added, even if nothing moved
+  bool changedCFG() const { return insertedBlocks; }
+
+private:
+  Function& function;
+  const DominatorTree& dominators;
+  LoopInfo& loops;
+
+  bool insertedBlocks = false;
+
+  // Memory writes of the loop being processed
+  std::vector<const Instruction*> stores;
+  bool hasCall = false;
+
+  bool isInvariant(const Loop* loop, const Instruction* instruction,
+                   const std::unordered_set<const Instruction*>& alsoHoisted = {}) const {
+      for (const Value* operand : instruction->getOperands()) {
+          if (!operand->isInstruction()) continue;
+          const Instruction* definition = static_cast<const Instruction*>(operand);
+          if (loop->contains(definition->parent) && !alsoHoisted.count(definition)) return false;
+      }
+      return true;
+  }
+
+  bool hasCandidates(const Loop* loop) const {
+      for (BasicBlock* block : loop->blocks) {
+          for (const auto& instruction : block->instructions) {
+              if (isMovable(instruction.get()) && isInvariant(loop, instruction.get())) return true;
+          }
+      }
+      return false;
+  }
+
+  void findWrites(const Loop* loop) {
+      stores.clear();
+      hasCall = false;
+      for (BasicBlock* block : loop->blocks) {
+          for (const auto& instruction : block->instructions) {
+              if (instruction->opcode == Opcode::STORE) stores.push_back(instruction.get());
+              if (instruction->opcode == Opcode::CALL) hasCall = true;
+          }
+      }
+  }
+
+  // A load can move out when nothing in the loop may write what it reads
+  bool isMemoryInvariant(const Instruction* instruction) const {
+      if (instruction->opcode != Opcode::LOAD) return true;
+      if (hasCall) return false;
+      for (const Instruction* store : stores) {
+          if (mayAlias(store, instruction)) return false;
+      }
+      return true;
+  }
+
+  // Blocks that run whenever the loop is left run at least once per entry
+  bool isGuaranteedToExecute(const Loop* loop, const BasicBlock* block) const {
+      std::vector<BasicBlock*> exiting = loop->exitingBlocks();
+      if (exiting.empty()) return false;
+      for (const BasicBlock* source : exiting) {
+          if (!dominators.dominates(block, source)) return false;
+      }
+      return true;
+  }
+
+  // Move invariant code that is safe to run even when the loop would not
+  // have run it into the preheader
+  unsigned hoistSpeculatable(const Loop* loop, BasicBlock* preheader) {
+      unsigned count = 0;
+      bool changed = true;
+      while (changed) {
+          changed = false;
+          for (BasicBlock* block : loop->blocks) {
+              std::vector<Instruction*> candidates;
+              for (const auto& instruction : block->instructions) {
+                  candidates.push_back(instruction.get());
+              }
+              for (Instruction* instruction : candidates) {
+                  if (!isMovable(instruction) || !isInvariant(loop, instruction)) continue;
+                  if (mayTrap(instruction) &&
+                      !(isMemoryInvariant(instruction) && isGuaranteedToExecute(loop, block))) {
+                      continue;
+                  }
+                  preheader->moveHere(instruction);
+                  count++;
+                  changed = true;
+              }
+          }
+      }
+      return count;
+  }
+
+  // A loop tested at the top may run zero times, so loads and divisions in
+  // its body cannot simply move to the preheader. Instead the preheader
+  // repeats the header's test and the code moves to a block only entered
+  // when the body will run; the header merges it with undef for the
+  // zero-trip path, which goes straight to the exit test.
+  unsigned hoistGuarded(const Loop* loop, BasicBlock* preheader) {
+      BasicBlock* header = loop->header;
+      std::vector<BasicBlock*> exiting = loop->exitingBlocks();
+      Instruction* test = header->getTerminator();
+      if (exiting.size() != 1 || exiting.front() != header || test->opcode != Opcode::CONDBR) return 0;
+      for (const auto& instruction : header->instructions) {
+          if (instruction->hasSideEffects() && !instruction->isTerminator()) return 0;
+      }
+
+      // Code that runs on every iteration that reaches a latch, and what
+      // depends only on it
+      std::vector<Instruction*> selected;
+      std::unordered_set<const Instruction*> chosen;
+      bool changed = true;
+      while (changed) {
+          changed = false;
+          for (BasicBlock* block : loop->blocks) {
+              bool everyIteration = true;
+              for (const BasicBlock* latch : loop->latches) {
+                  if (!dominators.dominates(block, latch)) everyIteration = false;
+              }
+              for (const auto& instruction : block->instructions) {
+                  Instruction* current = instruction.get();
+                  if (chosen.count(current) || !isMovable(current) || !isInvariant(loop, current, chosen)) continue;
+                  if (mayTrap(current) && !(isMemoryInvariant(current) && everyIteration)) continue;
+                  selected.push_back(current);
+                  chosen.insert(current);
+                  changed = true;
+              }
+          }
+      }
+      if (selected.empty()) return 0;
+
+      // The preheader evaluates the header's test on the entering values
+      std::unordered_map<const Value*, Value*> entering;
+      for (Instruction* phi : header->phis()) {
+          entering[phi] = phi->incomingFor(preheader);
+      }
+      auto map = [&](Value* value) {
+          auto it = entering.find(value);
+          return it != entering.end() ? it->second : value;
+      };
+      for (const auto& instruction : header->instructions) {
+          if (instruction->isPhi() || instruction->isTerminator()) continue;
+          std::unique_ptr<Instruction> copy = function.create(instruction->opcode, instruction->type);
+          for (Value* operand : instruction->getOperands()) {
+              copy->addOperand(map(operand));
+          }
+          entering[instruction.get()] = preheader->insertBeforeTerminator(std::move(copy));
+      }
+
+      BasicBlock* guarded = function.createBlock("hoisted");
+      function.moveBefore(guarded, header);
+      loops.addBlock(guarded, loop->parent);
+      std::unique_ptr<Instruction> jump = function.create(Opcode::BR, Type::VOID);
+      jump->blocks.push_back(header);
+      guarded->append(std::move(jump));
+
+      Instruction* branch = preheader->getTerminator();
+      branch->opcode = Opcode::CONDBR;
+      branch->addOperand(map(test->getOperand(0)));
+      if (loop->contains(test->blocks[0])) {
+          branch->blocks = {guarded, header};
+      } else {
+          branch->blocks = {header, guarded};
+      }
+      for (Instruction* phi : header->phis()) {
+          phi->addIncoming(phi->incomingFor(preheader), guarded);
+      }
+      function.recomputePredecessors();
+
+      // Move the code; uses in the loop see it through a header phi
+      for (Instruction* instruction : selected) {
+          guarded->moveHere(instruction);
+      }
+      for (Instruction* instruction : selected) {
+          std::vector<Instruction*> users;
+          for (Instruction* user : instruction->getUsers()) {
+              if (loop->contains(user->parent) && (users.empty() || users.back() != user)) users.push_back(user);
+          }
+          if (users.empty()) continue;
+
+          Instruction* phi = header->insertPhi(function.create(Opcode::PHI, instruction->type));
+          for (BasicBlock* predecessor : header->predecessors) {
+              Value* incoming = phi;
+              if (predecessor == guarded) incoming = instruction;
+              if (predecessor == preheader) incoming = function.getUndef(instruction->type);
+              phi->addIncoming(incoming, predecessor);
+          }
+          for (Instruction* user : users) {
+              for (size_t i = 0; i < user->numOperands(); i++) {
+                  if (user->getOperand(i) == instruction) user->setOperand(i, phi);
+              }
+          }
+      }
+      return static_cast<unsigned>(selected.size());
+  }
+};
+
+} // namespace
+
+bool LICMPass::run(Function& function, AnalysisManager& analyses) {
+  if (!function.entry()) return false;
+
+  LoopInfo& loops = analyses.getLoops();
+  if (loops.empty()) return false;
+
+  Hoister hoister(function, analyses.getDominators(), loops);
+  std::vector<Hoister::Summary> summaries = hoister.run();
+  for (const Hoister::Summary& summary : summaries) {
+      std::string message = "hoisted " + std::to_string(summary.hoisted + summary.guarded) +
+                            " instructions out of the loop at bb" + std::to_string(summary.header->id);
+      if (summary.guarded > 0) {
+          message += " (" + std::to_string(summary.guarded) + " behind a zero-trip guard)";
+      }
+      remark(function, message);
+  }
+  return !summaries.empty() || hoister.changedCFG();
+}
+
+} // namespace ir
+} // namespace ccc
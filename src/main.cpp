@@ -23,6 +23,9 @@ void printUsage(const char* programName) {
             << "  -O<level>     Optimization level (0-3)\n"
             << "  -I <dir>      Add include directory\n"
             << "  -D <name>[=value] Define macro\n"
+            << "  --dump-ir     Print the IR of each function to stdout\n"
+            << "  --remarks     Report optimization decisions to stderr\n"
+            << "  --relaxed-math Allow reordering floating-point arithmetic\n"
             << "  -v            Verbose output\n"
             << "  -h, --help    Display help\n";
 }
@@ -35,6 +38,9 @@ int main(int argc, char* argv[]) {
   std::vector<std::string> defines;
   int optimizationLevel = 0;
   bool verbose = false;
+  bool dumpIR = false;
+  bool remarks = false;
+  bool relaxedMath = false;
 
   // Parse command line arguments
   for (int i = 1; i < argc; ++i) {
@@ -45,6 +51,12 @@ int main(int argc, char* argv[]) {
           return 0;
       } else if (arg == "-v") {
           verbose = true;
+      } else if (arg == "--dump-ir") {
+          dumpIR = true;
+      } else if (arg == "--remarks") {
+          remarks = true;
+      } else if (arg == "--relaxed-math") {
+          relaxedMath = true;
       } else if (arg == "-o" && i + 1 < argc) {
           outputFile = argv[++i];
       } else if (arg.substr(0, 2) == "-O") {
@@ -117,7 +129,8 @@ int main(int argc, char* argv[]) {
           std::cout << "Performing semantic analysis...\n";
       }
       
-      ccc::SemanticAnalyzer semanticAnalyzer(errorHandler);
+      ccc::TypeContext typeContext;
+      ccc::SemanticAnalyzer semanticAnalyzer(errorHandler, typeContext);
       semanticAnalyzer.analyze(ast.get());
       
       if (errorHandler.hasErrors()) {
@@ -131,6 +144,13 @@ int main(int argc, char* argv[]) {
       }
       
       ccc::CodeGenerator codeGen(optimizationLevel, errorHandler);
+      if (dumpIR) {
+          codeGen.setIRDump(&std::cout);
+      }
+      if (remarks) {
+          codeGen.setRemarks(&std::cerr);
+      }
+      codeGen.setRelaxedMath(relaxedMath);
       coil::CoilObject coilObject = codeGen.generate(ast.get());
       
       if (errorHandler.hasErrors()) {
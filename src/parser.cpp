@@ -464,41 +464,8 @@ std::unique_ptr<ExpressionNode> Parser::assignment() {
       Token op = previous();
       auto value = assignment();
       
-      // Convert += to +, etc.
-      TokenType binaryOp;
-      switch (op.type) {
-          case TokenType::OP_PLUS_EQUALS: binaryOp = TokenType::OP_PLUS; break;
-          case TokenType::OP_MINUS_EQUALS: binaryOp = TokenType::OP_MINUS; break;
-          case TokenType::OP_STAR_EQUALS: binaryOp = TokenType::OP_STAR; break;
-          case TokenType::OP_SLASH_EQUALS: binaryOp = TokenType::OP_SLASH; break;
-          case TokenType::OP_PERCENT_EQUALS: binaryOp = TokenType::OP_PERCENT; break;
-          case TokenType::OP_AND_EQUALS: binaryOp = TokenType::OP_AMPERSAND; break;
-          case TokenType::OP_OR_EQUALS: binaryOp = TokenType::OP_PIPE; break;
-          case TokenType::OP_XOR_EQUALS: binaryOp = TokenType::OP_CARET; break;
-          case TokenType::OP_SHL_EQUALS: binaryOp = TokenType::OP_SHL; break;
-          case TokenType::OP_SHR_EQUALS: binaryOp = TokenType::OP_SHR; break;
-          default: binaryOp = TokenType::UNKNOWN; break;
-      }
-      
-      // Create a combined assignment (a += b becomes a = a + b)
-      if (binaryOp != TokenType::UNKNOWN) {
-          Token binaryToken(binaryOp, op.lexeme.substr(0, op.lexeme.size() - 1), op.filename, op.line, op.column);
-          
-          auto right = std::make_unique<BinaryNode>(
-              std::move(expr),
-              binaryToken,
-              std::move(value)
-          );
-          
-          // Create a = (a + b)
-          Token equalsToken(TokenType::OP_EQUALS, "=", op.filename, op.line, op.column);
-          return std::make_unique<BinaryNode>(
-              std::move(expr), // Will be cloned in codegen since it's used twice
-              equalsToken,
-              std::move(right)
-          );
-      }
-      
+      // Compound assignments keep their operator: the target is evaluated
+      // once, so it cannot be duplicated into a = a op b
       return std::make_unique<BinaryNode>(
           std::move(expr),
           op,
@@ -0,0 +1,151 @@
+#include "pass.h"
+#include "passes.h"
+
+namespace ccc {
+namespace ir {
+
+// Analyses
+
+const CFG& AnalysisManager::getCFG() {
+  if (!cfg) {
+      cfg.reset(new CFG(function));
+  }
+  return *cfg;
+}
+
+const DominatorTree& AnalysisManager::getDominators() {
+  if (!dominators) {
+      dominators.reset(new DominatorTree(getCFG()));
+  }
+  return *dominators;
+}
+
+const DominatorTree& AnalysisManager::getPostDominators() {
+  if (!postDominators) {
+      postDominators.reset(new DominatorTree(getCFG(), true));
+  }
+  return *postDominators;
+}
+
+LoopInfo& AnalysisManager::getLoops() {
+  if (!loops) {
+      loops.reset(new LoopInfo(getCFG(), getDominators()));
+  }
+  return *loops;
+}
+
+const Liveness& AnalysisManager::getLiveness() {
+  if (!liveness) {
+      liveness.reset(new Liveness(getCFG()));
+  }
+  return *liveness;
+}
+
+const ReachingDefinitions& AnalysisManager::getReachingDefinitions() {
+  if (!reachingDefinitions) {
+      reachingDefinitions.reset(new ReachingDefinitions(getCFG()));
+  }
+  return *reachingDefinitions;
+}
+
+const AvailableExpressions& AnalysisManager::getAvailableExpressions() {
+  if (!availableExpressions) {
+      availableExpressions.reset(new AvailableExpressions(getCFG()));
+  }
+  return *availableExpressions;
+}
+
+void AnalysisManager::invalidate(Preserved preserved) {
+  if (preserved == Preserved::ALL) return;
+
+  // Dataflow results depend on the instructions
+  availableExpressions.reset();
+  reachingDefinitions.reset();
+  liveness.reset();
+
+  if (preserved == Preserved::NOTHING) {
+      // Dependents first: they refer to the CFG
+      loops.reset();
+      postDominators.reset();
+      dominators.reset();
+      cfg.reset();
+  }
+}
+
+// Passes
+
+void PassBase::remark(const Function& function, const std::string& message) const {
+  if (remarks) {
+      *remarks << "remark: " << function.name << ": " << name() << ": " << message << "\n";
+  }
+}
+
+// Pipeline
+
+void PassManager::add(std::unique_ptr<Pass> pass) {
+  pass->setRemarks(remarks);
+  passes.push_back(std::move(pass));
+}
+
+void PassManager::add(std::unique_ptr<ModulePass> pass) {
+  pass->setRemarks(remarks);
+  modulePasses.push_back(std::move(pass));
+}
+
+void PassManager::setRemarks(std::ostream* out) {
+  remarks = out;
+  for (const auto& pass : modulePasses) pass->setRemarks(out);
+  for (const auto& pass : passes) pass->setRemarks(out);
+}
+
+bool PassManager::run(Module& module) {
+  bool changed = false;
+  for (const auto& pass : modulePasses) {
+      changed |= pass->run(module);
+  }
+  for (const auto& function : module.functions) {
+      changed |= run(*function);
+  }
+  return changed;
+}
+
+bool PassManager::run(Function& function) {
+  AnalysisManager analyses(function);
+  bool changed = false;
+  for (const auto& pass : passes) {
+      if (pass->run(function, analyses)) {
+          analyses.invalidate(pass->preserved());
+          changed = true;
+      }
+  }
+  return changed;
+}
+
+void addStandardPasses(PassManager& passes, int optimizationLevel, bool relaxedMath) {
+  // -O0 runs no passes
+  if (optimizationLevel < 1) return;
+
+  passes.add(std::unique_ptr<ModulePass>(new InlinerPass(optimizationLevel)));
+  passes.add(std::unique_ptr<Pass>(new TailRecursionPass()));
+  passes.add(std::unique_ptr<Pass>(new SCCPPass()));
+  passes.add(std::unique_ptr<Pass>(new GVNPass()));
+  passes.add(std::unique_ptr<Pass>(new LICMPass()));
+  if (optimizationLevel >= 2) {
+      // Invariant parts of induction values are outside the loop by now,
+      // and conditional updates turned into selects (if (a[i] > s) s =
+      // a[i];) leave loop bodies straight for the vectorizer. Vector
+      // loops are unrolled like any other. Unrolled copies start from
+      // known counter values; fold them.
+      passes.add(std::unique_ptr<Pass>(new SimplifyCFGPass()));
+      passes.add(std::unique_ptr<Pass>(new IndVarsPass()));
+      passes.add(std::unique_ptr<Pass>(new VectorizePass(relaxedMath)));
+      passes.add(std::unique_ptr<Pass>(new UnrollPass(optimizationLevel, relaxedMath)));
+      passes.add(std::unique_ptr<Pass>(new SCCPPass()));
+  }
+  passes.add(std::unique_ptr<Pass>(new DSEPass()));
+  passes.add(std::unique_ptr<Pass>(new DCEPass()));
+  passes.add(std::unique_ptr<Pass>(new SimplifyCFGPass()));
+}
+
+} // namespace ir
+} // namespace ccc
@@ -0,0 +1,378 @@
+#include "peephole.h"
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace ccc {
+
+bool MachineOperand::isInteger(int64_t value) const {
+  if (operandKind != Kind::IMMEDIATE) return false;
+  switch (format) {
+      case Format::I8:  return static_cast<int8_t>(bits) == value;
+      case Format::U8:  return static_cast<uint8_t>(bits) == value;
+      case Format::U16: return static_cast<uint16_t>(bits) == value;
+      case Format::I32: return static_cast<int32_t>(bits) == value;
+      default:          return false;
+  }
+}
+
+coil::Operand MachineOperand::lower() const {
+  switch (operandKind) {
+      case Kind::VARIABLE:
+          return coil::Operand::createVariable(id());
+      case Kind::SYMBOL:
+          return coil::Operand::createSymbol(id());
+      case Kind::IMMEDIATE:
+          break;
+  }
+  switch (format) {
+      case Format::I8:
+          return coil::Operand::createImmediate<int8_t>(static_cast<int8_t>(bits));
+      case Format::U8:
+          return coil::Operand::createImmediate<uint8_t>(static_cast<uint8_t>(bits));
+      case Format::U16:
+          return coil::Operand::createImmediate<uint16_t>(static_cast<uint16_t>(bits));
+      case Format::F32: {
+          float value;
+          std::memcpy(&value, &bits, sizeof(value));
+          return coil::Operand::createImmediate<float>(value);
+      }
+      case Format::F64: {
+          double value;
+          std::memcpy(&value, &bits, sizeof(value));
+          return coil::Operand::createImmediate<double>(value);
+      }
+      default:
+          return coil::Operand::createImmediate<int32_t>(static_cast<int32_t>(bits));
+  }
+}
+
+namespace {
+
+using Code = std::vector<MachineInstruction>;
+
+// Position of the first instruction after position that is not a NOP
+size_t following(const Code& code, size_t position) {
+  size_t next = position + 1;
+  while (next < code.size() && code[next].opcode == coil::Opcode::NOP) next++;
+  return next;
+}
+
+// What the rewrites ask about the function as a whole, gathered in one
+// pass over the code at the start of each sweep and kept up to date by
+// remove and retarget as the rewrites change it
+class Facts {
+public:
+  explicit Facts(const Code& code) {
+      for (size_t i = 0; i < code.size(); i++) {
+          const MachineInstruction& instruction = code[i];
+          switch (instruction.opcode) {
+              case coil::Opcode::SYM:
+                  labels[instruction.operands[0].id()] = i;
+                  break;
+              case coil::Opcode::INDEX:
+                  elements.insert(instruction.operands[0].id());
+                  break;
+              case coil::Opcode::VAR:
+                  types.emplace(instruction.operands[0].id(), instruction.operands[1]);
+                  break;
+              default:
+                  break;
+          }
+          count(instruction, 1);
+      }
+  }
+
+  // Position of SYM label, or code.size() when it is not in this code
+  size_t labelPosition(const Code& code, const MachineOperand& label) const {
+      auto it = labels.find(label.id());
+      return it != labels.end() ? it->second : code.size();
+  }
+
+  // Whether a BR or CALL refers to label
+  bool isReferenced(const MachineOperand& label) const {
+      auto it = references.find(label.id());
+      return it != references.end() && it->second > 0;
+  }
+
+  // Whether an INDEX binds x to an element. A MOV into such a variable
+  // stores to memory, and one out of it loads. An INDEX that is removed
+  // still counts.
+  bool isElement(const MachineOperand& x) const { return elements.count(x.id()) > 0; }
+
+  // Type operand of the VAR declaring x, which has none when x is not
+  // declared in this code
+  MachineOperand declaredType(const MachineOperand& x) const {
+      auto it = types.find(x.id());
+      return it != types.end() ? it->second : MachineOperand::immediate<uint16_t>(0);
+  }
+
+  void remove(MachineInstruction& instruction) {
+      count(instruction, -1);
+      if (instruction.opcode == coil::Opcode::SYM) labels.erase(instruction.operands[0].id());
+      if (instruction.opcode == coil::Opcode::VAR) types.erase(instruction.operands[0].id());
+      instruction.opcode = coil::Opcode::NOP;
+      instruction.operands.clear();
+  }
+
+  // Point a BR at another label
+  void retarget(MachineInstruction& branch, const MachineOperand& label) {
+      references[branch.operands[0].id()]--;
+      references[label.id()]++;
+      branch.operands[0] = label;
+  }
+
+private:
+  std::unordered_map<uint16_t, size_t> labels;               // SYM by symbol index
+  std::unordered_map<uint16_t, int> references;              // Symbol operands of BRs and CALLs
+  std::unordered_set<uint16_t> elements;                     // Variables an INDEX binds
+  std::unordered_map<uint16_t, MachineOperand> types;        // VAR type operand by variable
+
+  void count(const MachineInstruction& instruction, int delta) {
+      if (instruction.opcode != coil::Opcode::BR && instruction.opcode != coil::Opcode::CALL) return;
+      for (const MachineOperand& operand : instruction.operands) {
+          if (operand.isSymbol()) references[operand.id()] += delta;
+      }
+  }
+};
+
+// MOV x, a: a plain copy between variables or from an immediate (three
+// operands move a parameter or a return value, moves to or from an
+// element are loads and stores, and moves between variables of different
+// types convert; all are left alone)
+bool isCopy(const Facts& facts, const MachineInstruction& instruction) {
+  if (instruction.opcode != coil::Opcode::MOV || instruction.operands.size() != 2 ||
+      !instruction.operands[0].isVariable()) {
+      return false;
+  }
+  for (const MachineOperand& operand : instruction.operands) {
+      if (operand.isVariable() && facts.isElement(operand)) return false;
+  }
+  const MachineOperand& source = instruction.operands[1];
+  return !source.isVariable() || facts.declaredType(source) == facts.declaredType(instruction.operands[0]);
+}
+
+// Whether instruction computes x from operands that do not include x
+bool overwrites(const MachineInstruction& instruction, const MachineOperand& x) {
+  switch (instruction.opcode) {
+      case coil::Opcode::MOV:
+          if (instruction.operands.size() != 2) return false;
+          break;
+      case coil::Opcode::ADD:
+      case coil::Opcode::SUB:
+      case coil::Opcode::MUL:
+      case coil::Opcode::DIV:
+      case coil::Opcode::MOD:
+      case coil::Opcode::AND:
+      case coil::Opcode::OR:
+      case coil::Opcode::XOR:
+      case coil::Opcode::SHL:
+      case coil::Opcode::SHR:
+      case coil::Opcode::SAR:
+      case coil::Opcode::NEG:
+      case coil::Opcode::NOT:
+          break;
+      default:
+          return false;
+  }
+  if (instruction.operands.empty() || instruction.operands[0] != x) return false;
+  return std::find(instruction.operands.begin() + 1, instruction.operands.end(), x) == instruction.operands.end();
+}
+
+// MOV x, x
+bool removeSelfCopy(Code& code, Facts& facts, size_t position) {
+  MachineInstruction& move = code[position];
+  if (!isCopy(facts, move) || move.operands[0] != move.operands[1]) return false;
+  facts.remove(move);
+  return true;
+}
+
+// MOV x, y followed by MOV y, x: the second copies what y already holds
+bool removeCopyBack(Code& code, Facts& facts, size_t position) {
+  const MachineInstruction& move = code[position];
+  size_t next = following(code, position);
+  if (!isCopy(facts, move) || next == code.size() || !isCopy(facts, code[next])) return false;
+  if (code[next].operands[0] != move.operands[1] || code[next].operands[1] != move.operands[0]) return false;
+  facts.remove(code[next]);
+  return true;
+}
+
+// MOV x, a followed by an instruction that sets x again without reading it
+bool removeOverwrittenCopy(Code& code, Facts& facts, size_t position) {
+  MachineInstruction& move = code[position];
+  size_t next = following(code, position);
+  if (!isCopy(facts, move) || next == code.size() || !overwrites(code[next], move.operands[0])) return false;
+  facts.remove(move);
+  return true;
+}
+
+// op x, a, identity (or op x, identity, a when op commutes) is a copy of
+// a, or nothing when a is x
+template <int64_t identity, bool commutes>
+bool removeIdentity(Code& code, Facts& facts, size_t position) {
+  MachineInstruction& instruction = code[position];
+  if (instruction.operands.size() != 3) return false;
+  size_t kept;
+  if (instruction.operands[2].isInteger(identity)) {
+      kept = 1;
+  } else if (commutes && instruction.operands[1].isInteger(identity)) {
+      kept = 2;
+  } else {
+      return false;
+  }
+  if (instruction.operands[kept] == instruction.operands[0]) {
+      facts.remove(instruction);
+  } else {
+      instruction = {coil::Opcode::MOV, {instruction.operands[0], instruction.operands[kept]}};
+  }
+  return true;
+}
+
+// SCOPEE followed by its SCOPEL with at most variable declarations between
+bool removeEmptyScope(Code& code, Facts& facts, size_t position) {
+  size_t next = following(code, position);
+  while (next < code.size() && code[next].opcode == coil::Opcode::VAR) next = following(code, next);
+  if (next == code.size() || code[next].opcode != coil::Opcode::SCOPEL) return false;
+  for (size_t i = position; i <= next; i++) facts.remove(code[i]);
+  return true;
+}
+
+// BR to one of the labels right after it goes where control would go
+// anyway, whatever its condition
+bool removeBranchToNext(Code& code, Facts& facts, size_t position) {
+  MachineInstruction& branch = code[position];
+  if (branch.operands.empty() || !branch.operands[0].isSymbol()) return false;
+  for (size_t next = following(code, position); next < code.size() && code[next].opcode == coil::Opcode::SYM;
+       next = following(code, next)) {
+      if (code[next].operands[0] == branch.operands[0]) {
+          facts.remove(branch);
+          return true;
+      }
+  }
+  return false;
+}
+
+// BR with no condition: control never falls through it
+bool isJump(const MachineInstruction& instruction) {
+  return instruction.opcode == coil::Opcode::BR && instruction.operands.size() == 1 &&
+         instruction.operands[0].isSymbol();
+}
+
+// Where a jump to label ends up: the target of the jump that starts its
+// code, if one does, or the label itself
+MachineOperand jumpTarget(const Code& code, const Facts& facts, const MachineOperand& label) {
+  size_t next = facts.labelPosition(code, label);
+  while (next < code.size() && code[next].opcode == coil::Opcode::SYM) next = following(code, next);
+  return next < code.size() && isJump(code[next]) ? code[next].operands[0] : label;
+}
+
+// BR to a label whose code only jumps on goes to the end of the chain of
+// jumps instead, unless the chain leads back to where it started
+bool threadJump(Code& code, Facts& facts, size_t position) {
+  MachineInstruction& branch = code[position];
+  if (branch.operands.empty() || !branch.operands[0].isSymbol()) return false;
+
+  MachineOperand target = branch.operands[0];
+  for (size_t hops = 0; hops < code.size(); hops++) {
+      MachineOperand next = jumpTarget(code, facts, target);
+      if (next == target) break;
+      if (next == branch.operands[0]) return false;
+      target = next;
+  }
+  if (target == branch.operands[0]) return false;
+  facts.retarget(branch, target);
+  return true;
+}
+
+// Code after a jump or RET that no branch reaches: up to the next label
+// something branches to, or the declarations closing the scope
+bool removeUnreachable(Code& code, Facts& facts, size_t position) {
+  if (code[position].opcode == coil::Opcode::BR && !isJump(code[position])) return false;
+
+  bool changed = false;
+  for (size_t next = following(code, position); next < code.size(); next = following(code, next)) {
+      const MachineInstruction& instruction = code[next];
+      if (instruction.opcode == coil::Opcode::SCOPEE || instruction.opcode == coil::Opcode::SCOPEL ||
+          instruction.opcode == coil::Opcode::VAR) {
+          break;
+      }
+      if (instruction.opcode == coil::Opcode::SYM && facts.isReferenced(instruction.operands[0])) break;
+      facts.remove(code[next]);
+      changed = true;
+  }
+  return changed;
+}
+
+// CMP whose flags are set again, or go out of scope, before a BR could
+// read them. Labels and calls end the search: flags may be read after a
+// label reached from elsewhere, and are not tracked across calls.
+bool removeDeadCompare(Code& code, Facts& facts, size_t position) {
+  for (size_t next = following(code, position); next < code.size(); next = following(code, next)) {
+      switch (code[next].opcode) {
+          case coil::Opcode::CMP:
+          case coil::Opcode::TEST:
+          case coil::Opcode::RET:
+          case coil::Opcode::SCOPEL:
+              facts.remove(code[position]);
+              return true;
+          case coil::Opcode::BR:
+          case coil::Opcode::SYM:
+          case coil::Opcode::CALL:
+              return false;
+          default:
+              break;
+      }
+  }
+  facts.remove(code[position]);
+  return true;
+}
+
+// A rewrite tried at every instruction with the given opcode; apply
+// returns whether it changed anything
+struct Pattern {
+  uint8_t opcode;
+  bool (*apply)(Code& code, Facts& facts, size_t position);
+};
+
+const Pattern patterns[] = {
+  {coil::Opcode::MOV, removeSelfCopy},
+  {coil::Opcode::MOV, removeCopyBack},
+  {coil::Opcode::MOV, removeOverwrittenCopy},
+  {coil::Opcode::ADD, removeIdentity<0, true>},
+  {coil::Opcode::SUB, removeIdentity<0, false>},
+  {coil::Opcode::MUL, removeIdentity<1, true>},
+  {coil::Opcode::OR, removeIdentity<0, true>},
+  {coil::Opcode::XOR, removeIdentity<0, true>},
+  {coil::Opcode::SHL, removeIdentity<0, false>},
+  {coil::Opcode::SAR, removeIdentity<0, false>},
+  {coil::Opcode::SCOPEE, removeEmptyScope},
+  {coil::Opcode::BR, threadJump},
+  {coil::Opcode::BR, removeUnreachable},
+  {coil::Opcode::RET, removeUnreachable},
+  {coil::Opcode::BR, removeBranchToNext},
+  {coil::Opcode::CMP, removeDeadCompare},
+  {coil::Opcode::TEST, removeDeadCompare},
+};
+
+} // namespace
+
+unsigned PeepholeOptimizer::run(std::vector<MachineInstruction>& instructions) {
+  bool changed = true;
+  while (changed) {
+      changed = false;
+      Facts facts(instructions);
+      for (size_t i = 0; i < instructions.size(); i++) {
+          for (const Pattern& pattern : patterns) {
+              if (instructions[i].opcode == pattern.opcode && pattern.apply(instructions, facts, i)) changed = true;
+          }
+      }
+  }
+
+  size_t before = instructions.size();
+  instructions.erase(std::remove_if(instructions.begin(), instructions.end(), [](const MachineInstruction& instruction) {
+      return instruction.opcode == coil::Opcode::NOP;
+  }), instructions.end());
+  return static_cast<unsigned>(before - instructions.size());
+}
+
+} // namespace ccc
@@ -0,0 +1,393 @@
+#include "passes.h"
+#include <cstdint>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace ccc {
+namespace ir {
+
+namespace {
+
+// Wrap a result to the width of an integer type
+int64_t wrap(Type type, uint64_t value) {
+  if (type == Type::I8) return static_cast<int8_t>(value);
+  if (type == Type::I32) return static_cast<int32_t>(value);
+  return static_cast<int64_t>(value);
+}
+
+unsigned bitWidth(Type type) {
+  return type == Type::I8 ? 8 : 32;
+}
+
+} // namespace
+
+Constant* foldInstruction(Function& function, Opcode opcode, Type type,
+                          const std::vector<const Constant*>& operands) {
+  const Constant* left = operands.empty() ? nullptr : operands[0];
+  const Constant* right = operands.size() > 1 ? operands[1] : nullptr;
+  if (!left) return nullptr;
+
+  // Comparisons produce an int from operands of any type
+  switch (opcode) {
+      case Opcode::CMP_EQ:
+      case Opcode::CMP_NE:
+      case Opcode::CMP_LT:
+      case Opcode::CMP_LE:
+      case Opcode::CMP_GT:
+      case Opcode::CMP_GE: {
+          // An int against a float would compare integer fields with
+          // floating ones; only values of one type compare directly
+          if (!right || right->type != left->type) return nullptr;
+          bool floating = isFloatType(left->type);
+          double a = floating ? left->floating : static_cast<double>(left->integer);
+          double b = floating ? right->floating : static_cast<double>(right->integer);
+          int64_t x = left->integer;
+          int64_t y = right->integer;
+          bool result = false;
+          switch (opcode) {
+              case Opcode::CMP_EQ: result = floating ? a == b : x == y; break;
+              case Opcode::CMP_NE: result = floating ? a != b : x != y; break;
+              case Opcode::CMP_LT: result = floating ? a < b : x < y; break;
+              case Opcode::CMP_LE: result = floating ? a <= b : x <= y; break;
+              case Opcode::CMP_GT: result = floating ? a > b : x > y; break;
+              default:             result = floating ? a >= b : x >= y; break;
+          }
+          return function.getInteger(type, result ? 1 : 0);
+      }
+      default:
+          break;
+  }
+
+  // Conversions read the field of their operand's type and write the
+  // one of theirs; FPTOSI of a value out of range is left for run time
+  switch (opcode) {
+      case Opcode::SEXT:
+      case Opcode::TRUNC:
+          return function.getInteger(type, wrap(type, uint64_t(left->integer)));
+      case Opcode::SITOFP:
+          return function.getFloating(type, type == Type::F32 ? double(float(left->integer)) : double(left->integer));
+      case Opcode::FPTOSI: {
+          double limit = type == Type::I8 ? 128.0 : 2147483648.0;
+          if (!(left->floating > -limit - 1.0 && left->floating < limit)) return nullptr;
+          return function.getInteger(type, static_cast<int64_t>(left->floating));
+      }
+      case Opcode::FPEXT:
+          return function.getFloating(type, left->floating);
+      case Opcode::FPTRUNC:
+          return function.getFloating(type, static_cast<float>(left->floating));
+      default:
+          break;
+  }
+
+  // Arithmetic reads the field of its result's type, so the operands must
+  // be of that type (a shift count may be of another)
+  if (left->type != type) return nullptr;
+  if (right && right->type != type && opcode != Opcode::SHL && opcode != Opcode::SHR) return nullptr;
+
+  if (isFloatType(type)) {
+      double a = left->floating;
+      double b = right ? right->floating : 0.0;
+      double result;
+      switch (opcode) {
+          case Opcode::ADD: result = a + b; break;
+          case Opcode::SUB: result = a - b; break;
+          case Opcode::MUL: result = a * b; break;
+          case Opcode::DIV: result = a / b; break;
+          case Opcode::NEG: result = -a; break;
+          default: return nullptr;
+      }
+      if (type == Type::F32) {
+          result = static_cast<float>(result);
+      }
+      return function.getFloating(type, result);
+  }
+
+  if (!isIntegerType(type)) return nullptr;
+
+  // Integers are stored sign-extended; compute unsigned so overflow wraps
+  int64_t a = left->integer;
+  int64_t b = right ? right->integer : 0;
+  uint64_t result;
+  switch (opcode) {
+      case Opcode::ADD: result = uint64_t(a) + uint64_t(b); break;
+      case Opcode::SUB: result = uint64_t(a) - uint64_t(b); break;
+      case Opcode::MUL: result = uint64_t(a) * uint64_t(b); break;
+      case Opcode::DIV:
+      case Opcode::MOD:
+          // Trapping or overflowing divisions are left for run time
+          if (b == 0 || (b == -1 && a == wrap(type, uint64_t(1) << (bitWidth(type) - 1)))) return nullptr;
+          result = opcode == Opcode::DIV ? uint64_t(a / b) : uint64_t(a % b);
+          break;
+      case Opcode::NEG: result = uint64_t(0) - uint64_t(a); break;
+      case Opcode::NOT: result = ~uint64_t(a); break;
+      case Opcode::AND: result = uint64_t(a) & uint64_t(b); break;
+      case Opcode::OR:  result = uint64_t(a) | uint64_t(b); break;
+      case Opcode::XOR: result = uint64_t(a) ^ uint64_t(b); break;
+      case Opcode::SHL:
+      case Opcode::SHR:
+          if (b < 0 || b >= bitWidth(type)) return nullptr;
+          result = opcode == Opcode::SHL ? uint64_t(a) << b : uint64_t(a >> b);
+          break;
+      default:
+          return nullptr;
+  }
+  return function.getInteger(type, wrap(type, result));
+}
+
+namespace {
+
+// Lattice: unknown yet (TOP), one constant, or several values (BOTTOM)
+struct LatticeValue {
+  enum class State {
+      TOP,
+      CONSTANT,
+      BOTTOM
+  };
+
+  State state = State::TOP;
+  Constant* constant = nullptr;
+};
+
+class SCCPSolver {
+public:
+  explicit SCCPSolver(Function& function) : function(function) {}
+
+  void solve();
+  bool rewrite();
+
+private:
+  Function& function;
+  std::unordered_map<const Value*, LatticeValue> values;
+  std::unordered_set<const BasicBlock*> executableBlocks;
+  std::set<std::pair<const BasicBlock*, const BasicBlock*>> executableEdges;
+  std::vector<std::pair<BasicBlock*, BasicBlock*>> edgeWorklist;
+  std::vector<Instruction*> valueWorklist;
+
+  LatticeValue get(const Value* value) const;
+  void set(Instruction* instruction, LatticeValue value);
+  void markEdge(BasicBlock* from, BasicBlock* to);
+  void visit(Instruction* instruction);
+  void visitPhi(Instruction* phi);
+};
+
+LatticeValue SCCPSolver::get(const Value* value) const {
+  LatticeValue result;
+  if (value->isConstant()) {
+      result.state = LatticeValue::State::CONSTANT;
+      result.constant = const_cast<Constant*>(static_cast<const Constant*>(value));
+  } else if (value->isUndef()) {
+      // Could be anything; do not fold around it
+      result.state = LatticeValue::State::BOTTOM;
+  } else {
+      auto it = values.find(value);
+      if (it != values.end()) result = it->second;
+  }
+  return result;
+}
+
+void SCCPSolver::set(Instruction* instruction, LatticeValue value) {
+  LatticeValue& current = values[instruction];
+
+  // Values only move down the lattice
+  if (current.state == LatticeValue::State::BOTTOM) return;
+  if (current.state == LatticeValue::State::CONSTANT && value.state == LatticeValue::State::CONSTANT &&
+      current.constant != value.constant) {
+      value.state = LatticeValue::State::BOTTOM;
+  }
+  if (current.state == value.state && current.constant == value.constant) return;
+  if (value.state == LatticeValue::State::TOP) return;
+
+  current = value;
+  for (Instruction* user : instruction->getUsers()) {
+      valueWorklist.push_back(user);
+  }
+}
+
+void SCCPSolver::markEdge(BasicBlock* from, BasicBlock* to) {
+  if (executableEdges.insert({from, to}).second) {
+      edgeWorklist.emplace_back(from, to);
+  }
+}
+
+void SCCPSolver::solve() {
+  BasicBlock* entry = function.entry();
+  executableBlocks.insert(entry);
+  for (const auto& instruction : entry->instructions) {
+      visit(instruction.get());
+  }
+
+  while (!edgeWorklist.empty() || !valueWorklist.empty()) {
+      while (!valueWorklist.empty()) {
+          Instruction* instruction = valueWorklist.back();
+          valueWorklist.pop_back();
+          if (executableBlocks.count(instruction->parent)) {
+              visit(instruction);
+          }
+      }
+
+      while (!edgeWorklist.empty()) {
+          BasicBlock* target = edgeWorklist.back().second;
+          edgeWorklist.pop_back();
+
+          if (executableBlocks.insert(target).second) {
+              // First time reached: everything in it runs
+              for (const auto& instruction : target->instructions) {
+                  visit(instruction.get());
+              }
+          } else {
+              // Another way in: only the phis can change
+              for (Instruction* phi : target->phis()) {
+                  visitPhi(phi);
+              }
+          }
+      }
+  }
+}
+
+void SCCPSolver::visitPhi(Instruction* phi) {
+  LatticeValue merged;
+  for (size_t i = 0; i < phi->numOperands(); i++) {
+      if (!executableEdges.count({phi->blocks[i], phi->parent})) continue;
+
+      LatticeValue incoming = get(phi->getOperand(i));
+      if (incoming.state == LatticeValue::State::TOP) continue;
+      if (incoming.state == LatticeValue::State::BOTTOM ||
+          (merged.state == LatticeValue::State::CONSTANT && merged.constant != incoming.constant)) {
+          merged.state = LatticeValue::State::BOTTOM;
+          break;
+      }
+      merged = incoming;
+  }
+  set(phi, merged);
+}
+
+void SCCPSolver::visit(Instruction* instruction) {
+  switch (instruction->opcode) {
+      case Opcode::PHI:
+          visitPhi(instruction);
+          return;
+      case Opcode::BR:
+          markEdge(instruction->parent, instruction->blocks[0]);
+          return;
+      case Opcode::CONDBR: {
+          LatticeValue condition = get(instruction->getOperand(0));
+          if (condition.state == LatticeValue::State::CONSTANT) {
+              markEdge(instruction->parent, instruction->blocks[condition.constant->isZero() ? 1 : 0]);
+          } else if (condition.state == LatticeValue::State::BOTTOM) {
+              markEdge(instruction->parent, instruction->blocks[0]);
+              markEdge(instruction->parent, instruction->blocks[1]);
+          }
+          return;
+      }
+      case Opcode::RET:
+      case Opcode::STORE:
+          return;
+      case Opcode::SELECT: {
+          // The operand a constant condition picks, or either when both
+          // are the same constant
+          LatticeValue condition = get(instruction->getOperand(0));
+          if (condition.state == LatticeValue::State::TOP) return;
+          if (condition.state == LatticeValue::State::CONSTANT) {
+              set(instruction, get(instruction->getOperand(condition.constant->isZero() ? 2 : 1)));
+              return;
+          }
+          LatticeValue a = get(instruction->getOperand(1));
+          LatticeValue b = get(instruction->getOperand(2));
+          if (a.state == LatticeValue::State::TOP || b.state == LatticeValue::State::TOP) return;
+          if (a.state == LatticeValue::State::CONSTANT && b.state == LatticeValue::State::CONSTANT &&
+              a.constant == b.constant) {
+              set(instruction, a);
+          } else {
+              LatticeValue unknown;
+              unknown.state = LatticeValue::State::BOTTOM;
+              set(instruction, unknown);
+          }
+          return;
+      }
+      case Opcode::PARAM:
+      case Opcode::CALL:
+      case Opcode::LOAD: {
+          LatticeValue unknown;
+          unknown.state = LatticeValue::State::BOTTOM;
+          set(instruction, unknown);
+          return;
+      }
+      default:
+          break;
+  }
+
+  // Arithmetic and comparisons
+  std::vector<const Constant*> operands;
+  for (const Value* operand : instruction->getOperands()) {
+      LatticeValue value = get(operand);
+      if (value.state == LatticeValue::State::TOP) return;
+      if (value.state == LatticeValue::State::BOTTOM) {
+          set(instruction, value);
+          return;
+      }
+      operands.push_back(value.constant);
+  }
+
+  LatticeValue result;
+  result.constant = foldInstruction(function, instruction->opcode, instruction->type, operands);
+  result.state = result.constant ? LatticeValue::State::CONSTANT : LatticeValue::State::BOTTOM;
+  set(instruction, result);
+}
+
+bool SCCPSolver::rewrite() {
+  bool changed = false;
+
+  for (const auto& block : function.blocks) {
+      if (!executableBlocks.count(block.get())) continue;
+
+      std::vector<Instruction*> folded;
+      for (const auto& instruction : block->instructions) {
+          LatticeValue value = get(instruction.get());
+          if (instruction->producesValue() && value.state == LatticeValue::State::CONSTANT) {
+              instruction->replaceAllUsesWith(value.constant);
+              folded.push_back(instruction.get());
+          }
+      }
+      for (Instruction* instruction : folded) {
+          block->erase(instruction);
+          changed = true;
+      }
+
+      // A branch on a constant only takes one way
+      Instruction* terminator = block->getTerminator();
+      if (terminator && terminator->opcode == Opcode::CONDBR && terminator->getOperand(0)->isConstant()) {
+          BasicBlock* taken = terminator->blocks[static_cast<Constant*>(terminator->getOperand(0))->isZero() ? 1 : 0];
+          BasicBlock* skipped = terminator->blocks[0] == taken ? terminator->blocks[1] : terminator->blocks[0];
+          if (skipped != taken) {
+              for (Instruction* phi : skipped->phis()) {
+                  phi->removeIncoming(block.get());
+              }
+          }
+          terminator->dropOperands();
+          terminator->opcode = Opcode::BR;
+          terminator->blocks = {taken};
+          changed = true;
+      }
+  }
+
+  if (changed) {
+      function.recomputePredecessors();
+  }
+  changed |= function.removeUnreachableBlocks();
+  return changed;
+}
+
+} // namespace
+
+bool SCCPPass::run(Function& function, AnalysisManager& analyses) {
+  (void)analyses;
+  if (!function.entry()) return false;
+
+  SCCPSolver solver(function);
+  solver.solve();
+  return solver.rewrite();
+}
+
+} // namespace ir
+} // namespace ccc
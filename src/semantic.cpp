@@ -1,24 +1,109 @@
 #include "semantic.h"
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <thread>
 
 namespace ccc {
 
+// IdentifierTable implementation
+IdentifierTable::IdentifierTable() : slots(64, INVALID_ID) {
+}
+
+uint32_t IdentifierTable::hashName(const std::string& name) {
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  for (unsigned char c : name) {
+      hash ^= c;
+      hash *= 16777619u;
+  }
+  return hash;
+}
+
+size_t IdentifierTable::findSlot(const std::string& name, uint32_t hash) const {
+  size_t mask = slots.size() - 1;
+  size_t slot = hash & mask;
+  
+  // Linear probing; stops at the matching id or the first empty slot
+  while (slots[slot] != INVALID_ID) {
+      uint32_t id = slots[slot];
+      if (hashes[id] == hash && names[id] == name) {
+          break;
+      }
+      slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+uint32_t IdentifierTable::intern(const std::string& name) {
+  uint32_t hash = hashName(name);
+  size_t slot = findSlot(name, hash);
+  if (slots[slot] != INVALID_ID) {
+      return slots[slot];
+  }
+  
+  uint32_t id = static_cast<uint32_t>(names.size());
+  names.push_back(name);
+  hashes.push_back(hash);
+  slots[slot] = id;
+  
+  // Keep the load factor under 3/4
+  if (names.size() * 4 >= slots.size() * 3) {
+      grow();
+  }
+  return id;
+}
+
+uint32_t IdentifierTable::find(const std::string& name) const {
+  return slots[findSlot(name, hashName(name))];
+}
+
+void IdentifierTable::grow() {
+  std::vector<uint32_t> newSlots(slots.size() * 2, INVALID_ID);
+  size_t mask = newSlots.size() - 1;
+  
+  for (uint32_t id = 0; id < names.size(); id++) {
+      size_t slot = hashes[id] & mask;
+      while (newSlots[slot] != INVALID_ID) {
+          slot = (slot + 1) & mask;
+      }
+      newSlots[slot] = id;
+  }
+  slots.swap(newSlots);
+}
+
+void IdentifierTable::clear() {
+  names.clear();
+  hashes.clear();
+  slots.assign(64, INVALID_ID);
+}
+
 // SymbolTable implementation
-SymbolTable::SymbolTable() : currentScope(0) {
-  // Create the global scope
-  scopes.push_back({});
+SymbolTable::SymbolTable(IdentifierTable& identifiers, const SymbolTable* enclosing,
+                         size_t enclosingMark)
+  : identifiers(identifiers), enclosing(enclosing), enclosingMark(enclosingMark),
+    currentScope(0) {
 }
 
 void SymbolTable::enterScope() {
   currentScope++;
-  if (currentScope >= scopes.size()) {
-      scopes.push_back({});
-  }
+  scopeMarks.push_back(undoLog.size());
 }
 
 void SymbolTable::leaveScope() {
   if (currentScope == 0) {
       throw std::runtime_error("Cannot leave global scope");
   }
+  
+  // Unbind everything declared in this scope, innermost first
+  size_t mark = scopeMarks.back();
+  scopeMarks.pop_back();
+  while (undoLog.size() > mark) {
+      uint32_t id = undoLog.back();
+      undoLog.pop_back();
+      innermost[id] = innermost[id]->shadowed;
+  }
+  
   currentScope--;
 }
 
@@ -26,67 +111,209 @@ int SymbolTable::currentScopeLevel() const {
   return currentScope;
 }
 
-void SymbolTable::addVariable(const std::string& name, const TypeInfo& type) {
-  scopes[currentScope][name] = SymbolInfo(SymbolInfo::Kind::VARIABLE, type, name, currentScope);
+const SymbolInfo* SymbolTable::bind(SymbolInfo::Kind kind, const std::string& name,
+                                    const TypeInfo* type, int scopeLevel) {
+  uint32_t id = identifiers.intern(name);
+  if (id >= innermost.size()) {
+      innermost.resize(identifiers.size(), nullptr);
+  }
+  
+  if (scopeLevel == currentScope) {
+      // Shadow the current binding and remember to undo it on leaveScope()
+      bindings.emplace_back(SymbolInfo(kind, type, name, scopeLevel), innermost[id], bindings.size());
+      innermost[id] = &bindings.back();
+      if (scopeLevel > 0) {
+          undoLog.push_back(id);
+      }
+  } else {
+      // Global binding made from a nested scope: link it in below any locals
+      Binding** link = &innermost[id];
+      while (*link && (*link)->symbol.scopeLevel > scopeLevel) {
+          link = &(*link)->shadowed;
+      }
+      bindings.emplace_back(SymbolInfo(kind, type, name, scopeLevel), *link, bindings.size());
+      *link = &bindings.back();
+  }
+  
+  return &bindings.back().symbol;
+}
+
+const SymbolInfo* SymbolTable::addVariable(const std::string& name, const TypeInfo* type) {
+  return bind(SymbolInfo::Kind::VARIABLE, name, type, currentScope);
 }
 
-void SymbolTable::addFunction(const std::string& name, const TypeInfo& type) {
-  scopes[0][name] = SymbolInfo(SymbolInfo::Kind::FUNCTION, type, name, 0);
+const SymbolInfo* SymbolTable::addFunction(const std::string& name, const TypeInfo* type) {
+  return bind(SymbolInfo::Kind::FUNCTION, name, type, 0);
 }
 
-void SymbolTable::addParameter(const std::string& name, const TypeInfo& type) {
-  scopes[currentScope][name] = SymbolInfo(SymbolInfo::Kind::PARAMETER, type, name, currentScope);
+const SymbolInfo* SymbolTable::addParameter(const std::string& name, const TypeInfo* type) {
+  return bind(SymbolInfo::Kind::PARAMETER, name, type, currentScope);
 }
 
-void SymbolTable::addTypedef(const std::string& name, const TypeInfo& type) {
-  scopes[currentScope][name] = SymbolInfo(SymbolInfo::Kind::TYPEDEF, type, name, currentScope);
+const SymbolInfo* SymbolTable::addTypedef(const std::string& name, const TypeInfo* type) {
+  return bind(SymbolInfo::Kind::TYPEDEF, name, type, currentScope);
 }
 
 bool SymbolTable::exists(const std::string& name) const {
-  for (int i = currentScope; i >= 0; i--) {
-      if (scopes[i].find(name) != scopes[i].end()) {
-          return true;
-      }
-  }
-  return false;
+  return lookup(name) != nullptr;
 }
 
 bool SymbolTable::existsInCurrentScope(const std::string& name) const {
-  return scopes[currentScope].find(name) != scopes[currentScope].end();
+  // Only this table's own scopes count; the enclosing table is never current
+  const SymbolInfo* symbol = lookupBefore(identifiers.find(name), bindings.size());
+  return symbol && symbol->scopeLevel == currentScope;
 }
 
 const SymbolInfo* SymbolTable::lookup(const std::string& name) const {
-  for (int i = currentScope; i >= 0; i--) {
-      auto it = scopes[i].find(name);
-      if (it != scopes[i].end()) {
-          return &it->second;
-      }
+  return lookup(identifiers.find(name));
+}
+
+const SymbolInfo* SymbolTable::lookup(uint32_t id) const {
+  const SymbolInfo* symbol = lookupBefore(id, bindings.size());
+  if (!symbol && enclosing) {
+      symbol = enclosing->lookupBefore(id, enclosingMark);
+  }
+  return symbol;
+}
+
+const SymbolInfo* SymbolTable::lookupBefore(uint32_t id, size_t limit) const {
+  if (id == IdentifierTable::INVALID_ID || id >= innermost.size()) {
+      return nullptr;
+  }
+  
+  // Skip bindings made after the limit
+  Binding* binding = innermost[id];
+  while (binding && binding->sequence >= limit) {
+      binding = binding->shadowed;
   }
-  return nullptr;
+  return binding ? &binding->symbol : nullptr;
 }
 
 void SymbolTable::clear() {
-  scopes.clear();
-  scopes.push_back({});
+  bindings.clear();
+  innermost.clear();
+  undoLog.clear();
+  scopeMarks.clear();
   currentScope = 0;
 }
 
+namespace {
+
+// Interns the names of all parameters and locals so that the parallel
+// phase only ever reads the identifier table
+class IdentifierCollector : public ASTVisitor<IdentifierCollector> {
+public:
+  explicit IdentifierCollector(IdentifierTable& identifiers) : identifiers(identifiers) {}
+  
+  void visitParameter(ParameterNode* node) {
+      identifiers.intern(node->name.lexeme);
+  }
+  
+  void visitVariableDeclaration(VariableDeclarationNode* node) {
+      identifiers.intern(node->name.lexeme);
+  }
+  
+  // Expressions declare nothing
+  void visitExpression(ExpressionNode*) {}
+  
+private:
+  IdentifierTable& identifiers;
+};
+
+} // namespace
+
 // SemanticAnalyzer implementation
-SemanticAnalyzer::SemanticAnalyzer(ErrorHandler& errorHandler)
-  : errorHandler(errorHandler), currentFunctionReturnType(nullptr), hasReturn(false) {
+SemanticAnalyzer::SemanticAnalyzer(ErrorHandler& errorHandler, TypeContext& types, unsigned threadCount)
+  : errorHandler(errorHandler), types(types), constants(errorHandler), identifiers(ownIdentifiers),
+    symbolTable(nullptr), threadCount(threadCount),
+    currentFunctionReturnType(nullptr), hasReturn(false) {
+}
+
+SemanticAnalyzer::SemanticAnalyzer(SemanticAnalyzer& parent, ErrorHandler& diagnostics, SymbolTable& scope)
+  : errorHandler(diagnostics), types(parent.types), constants(diagnostics), identifiers(parent.identifiers),
+    symbolTable(&scope), threadCount(1),
+    currentFunctionReturnType(nullptr), hasReturn(false) {
 }
 
 void SemanticAnalyzer::analyze(ASTNode* root) {
   if (!root) return;
   
-  // Clear the symbol table for a fresh analysis
-  symbolTable.clear();
+  if (root->kind != NodeKind::PROGRAM) {
+      errorHandler.error(0, 0, "Expected program node as root");
+      return;
+  }
+  
+  // Start from fresh tables
+  functionScopes.clear();
+  identifiers.clear();
+  globals.reset(new SymbolTable(identifiers));
+  symbolTable = globals.get();
+  resetTraversal();
   
-  // Visit the root node
-  if (root->getNodeType() == "ProgramNode") {
-      visitProgram(static_cast<ProgramNode*>(root));
+  const auto& declarations = static_cast<ProgramNode*>(root)->declarations;
+  std::vector<ErrorHandler> diagnostics(declarations.size());
+  
+  // A function body to check, with the number of global bindings it may see
+  struct FunctionJob {
+      FunctionDeclarationNode* node;
+      size_t index;
+      size_t globalsMark;
+  };
+  std::vector<FunctionJob> jobs;
+  
+  // Phase 1 (serial): globals and signatures, in source order
+  IdentifierCollector collector(identifiers);
+  for (size_t i = 0; i < declarations.size(); i++) {
+      ASTNode* declaration = declarations[i].get();
+      SemanticAnalyzer worker(*this, diagnostics[i], *globals);
+      worker.visit(declaration);
+      
+      if (declaration && declaration->kind == NodeKind::FUNCTION_DECLARATION) {
+          auto* function = static_cast<FunctionDeclarationNode*>(declaration);
+          if (function->symbol && function->body) {
+              // Taken after binding the function so it can call itself
+              jobs.push_back({function, i, globals->mark()});
+              collector.visit(function);
+          }
+      }
+  }
+  
+  // Phase 2 (parallel): function bodies against the now immutable globals
+  functionScopes.resize(jobs.size());
+  std::atomic<size_t> nextJob(0);
+  auto runJobs = [&]() {
+      for (size_t j = nextJob++; j < jobs.size(); j = nextJob++) {
+          const FunctionJob& job = jobs[j];
+          ErrorHandler& buffer = diagnostics[job.index];
+          try {
+              functionScopes[j].reset(new SymbolTable(identifiers, globals.get(), job.globalsMark));
+              SemanticAnalyzer worker(*this, buffer, *functionScopes[j]);
+              worker.checkFunctionBody(job.node);
+          } catch (const std::exception& e) {
+              buffer.error(job.node->name.line, job.node->name.column,
+                           "Internal error while analyzing '" + job.node->name.lexeme + "': " + e.what());
+          }
+      }
+  };
+  
+  unsigned workers = threadCount ? threadCount : std::max(1u, std::thread::hardware_concurrency());
+  workers = static_cast<unsigned>(std::min<size_t>(workers, jobs.size()));
+  if (workers <= 1) {
+      runJobs();
   } else {
-      errorHandler.error(0, 0, "Expected program node as root");
+      std::vector<std::thread> pool;
+      for (unsigned t = 1; t < workers; t++) {
+          pool.emplace_back(runJobs);
+      }
+      runJobs();
+      for (auto& thread : pool) {
+          thread.join();
+      }
+  }
+  
+  // Merge diagnostics in source order
+  for (const auto& buffer : diagnostics) {
+      errorHandler.append(buffer);
   }
 }
 
@@ -94,80 +321,71 @@ bool SemanticAnalyzer::hasErrors() const {
   return errorHandler.hasErrors();
 }
 
-void SemanticAnalyzer::visitProgram(ProgramNode* node) {
-  for (const auto& declaration : node->declarations) {
-      if (declaration->getNodeType() == "FunctionDeclarationNode") {
-          visitFunctionDeclaration(static_cast<FunctionDeclarationNode*>(declaration.get()));
-      } else if (declaration->getNodeType() == "VariableDeclarationNode") {
-          visitVariableDeclaration(static_cast<VariableDeclarationNode*>(declaration.get()));
-      }
-      // Add other top-level declarations as needed
-  }
-}
-
 void SemanticAnalyzer::visitFunctionDeclaration(FunctionDeclarationNode* node) {
   // Get the return type
-  TypeInfo returnType = getTypeFromTypeNode(node->returnType.get());
+  const TypeInfo* returnType = getTypeFromTypeNode(node->returnType.get());
   
   // Process parameters
-  std::vector<TypeInfo> paramTypes;
+  std::vector<const TypeInfo*> paramTypes;
   for (const auto& param : node->parameters) {
-      TypeInfo paramType = getTypeFromTypeNode(param->type.get());
+      const TypeInfo* paramType = getTypeFromTypeNode(param->type.get());
       paramTypes.push_back(paramType);
   }
   
   // Create function type
-  TypeInfo functionType = TypeInfo::createFunction(returnType, paramTypes);
+  const TypeInfo* functionType = types.getFunction(returnType, paramTypes);
   
   // Check if function already exists
   const std::string& name = node->name.lexeme;
-  if (symbolTable.existsInCurrentScope(name)) {
+  if (symbolTable->existsInCurrentScope(name)) {
       errorHandler.error(node->name.line, node->name.column, 
                         "Function '" + name + "' already declared in this scope");
       return;
   }
   
-  // Add function to symbol table
-  symbolTable.addFunction(name, functionType);
+  // Add function to symbol table; the body is checked by checkFunctionBody()
+  node->symbol = symbolTable->addFunction(name, functionType);
+}
+
+void SemanticAnalyzer::checkFunctionBody(FunctionDeclarationNode* node) {
+  const TypeInfo* functionType = node->symbol->type;
+  const TypeInfo* returnType = functionType->base;
   
-  // Process function body if it exists
-  if (node->body) {
-      // Enter function scope
-      symbolTable.enterScope();
-      
-      // Set current function return type for checking return statements
-      currentFunctionReturnType = &returnType;
-      hasReturn = returnType.kind == TypeInfo::Kind::VOID; // void functions implicitly return
-      
-      // Add parameters to symbol table
-      for (const auto& param : node->parameters) {
-          visitParameter(param.get());
-      }
-      
-      // Process the function body
-      visitBlock(node->body.get());
-      
-      // Check if function has a return statement (if needed)
-      if (!hasReturn && returnType.kind != TypeInfo::Kind::VOID) {
-          errorHandler.error(node->name.line, node->name.column, 
-                            "Function '" + name + "' may not return a value");
-      }
-      
-      // Reset function context
-      currentFunctionReturnType = nullptr;
-      
-      // Leave function scope
-      symbolTable.leaveScope();
+  // Enter function scope
+  symbolTable->enterScope();
+  
+  // Set current function return type for checking return statements
+  currentFunctionReturnType = returnType;
+  hasReturn = returnType->kind == TypeInfo::Kind::VOID; // void functions implicitly return
+  
+  // Add parameters to symbol table, reusing the types from the signature
+  for (size_t i = 0; i < node->parameters.size(); i++) {
+      declareParameter(node->parameters[i].get(), functionType->parameters[i]);
   }
+  
+  // Process the function body
+  visitBlock(node->body.get());
+  
+  // Check if function has a return statement (if needed)
+  if (!hasReturn && returnType->kind != TypeInfo::Kind::VOID) {
+      errorHandler.error(node->name.line, node->name.column, 
+                        "Function '" + node->name.lexeme + "' may not return a value");
+  }
+  
+  // Reset function context
+  currentFunctionReturnType = nullptr;
+  
+  // Leave function scope
+  symbolTable->leaveScope();
 }
 
 void SemanticAnalyzer::visitVariableDeclaration(VariableDeclarationNode* node) {
   // Get the variable type
-  TypeInfo type = getTypeFromTypeNode(node->type.get());
+  const TypeInfo* type = getTypeFromTypeNode(node->type.get());
   
   // Check if variable already exists in current scope
   const std::string& name = node->name.lexeme;
-  if (symbolTable.existsInCurrentScope(name)) {
+  if (symbolTable->existsInCurrentScope(name)) {
       errorHandler.error(node->name.line, node->name.column, 
                         "Variable '" + name + "' already declared in this scope");
       return;
@@ -175,24 +393,31 @@ void SemanticAnalyzer::visitVariableDeclaration(VariableDeclarationNode* node) {
   
   // Check initializer if present
   if (node->initializer) {
-      TypeInfo initType = visitExpression(node->initializer.get());
+      const TypeInfo* initType = visitExpression(node->initializer.get());
       
       // Ensure initializer type is compatible with variable type
       if (!areTypesCompatible(initType, type)) {
           errorHandler.error(node->name.line, node->name.column, 
-                            "Cannot initialize variable of type '" + std::to_string(static_cast<int>(type.kind)) + 
-                            "' with expression of type '" + std::to_string(static_cast<int>(initType.kind)) + "'");
+                            "Cannot initialize variable of type '" + type->toString() + 
+                            "' with expression of type '" + initType->toString() + "'");
+      }
+      
+      // Static storage is initialized before the program runs
+      if (symbolTable->currentScopeLevel() == 0 && !node->initializer->constant.isConstant()) {
+          errorHandler.error(node->name.line, node->name.column, 
+                            "Initializer of global variable '" + name + "' is not a constant expression");
       }
   }
   
   // Add variable to symbol table
-  symbolTable.addVariable(name, type);
+  node->symbol = symbolTable->addVariable(name, type);
 }
 
 void SemanticAnalyzer::visitParameter(ParameterNode* node) {
-  // Get the parameter type
-  TypeInfo type = getTypeFromTypeNode(node->type.get());
-  
+  declareParameter(node, getTypeFromTypeNode(node->type.get()));
+}
+
+void SemanticAnalyzer::declareParameter(ParameterNode* node, const TypeInfo* type) {
   // Check if parameter name is empty (allowed in declarations)
   if (node->name.lexeme.empty()) {
       return;
@@ -200,48 +425,39 @@ void SemanticAnalyzer::visitParameter(ParameterNode* node) {
   
   // Check if parameter already exists in current scope
   const std::string& name = node->name.lexeme;
-  if (symbolTable.existsInCurrentScope(name)) {
+  if (symbolTable->existsInCurrentScope(name)) {
       errorHandler.error(node->name.line, node->name.column, 
                         "Parameter '" + name + "' already declared");
       return;
   }
   
   // Add parameter to symbol table
-  symbolTable.addParameter(name, type);
+  node->symbol = symbolTable->addParameter(name, type);
 }
 
 void SemanticAnalyzer::visitBlock(BlockNode* node) {
   // Enter a new scope
-  symbolTable.enterScope();
+  symbolTable->enterScope();
   
   // Process all statements in the block
   for (const auto& statement : node->statements) {
-      if (statement->getNodeType() == "ExpressionStatementNode") {
-          visitExpressionStatement(static_cast<ExpressionStatementNode*>(statement.get()));
-      } else if (statement->getNodeType() == "VariableDeclarationNode") {
-          visitVariableDeclaration(static_cast<VariableDeclarationNode*>(statement.get()));
-      } else if (statement->getNodeType() == "BlockNode") {
-          visitBlock(static_cast<BlockNode*>(statement.get()));
-      } else if (statement->getNodeType() == "IfNode") {
-          visitIfStatement(static_cast<IfNode*>(statement.get()));
-      } else if (statement->getNodeType() == "WhileNode") {
-          visitWhileStatement(static_cast<WhileNode*>(statement.get()));
-      } else if (statement->getNodeType() == "DoWhileNode") {
-          visitDoWhileStatement(static_cast<DoWhileNode*>(statement.get()));
-      } else if (statement->getNodeType() == "ForNode") {
-          visitForStatement(static_cast<ForNode*>(statement.get()));
-      } else if (statement->getNodeType() == "ReturnNode") {
-          visitReturnStatement(static_cast<ReturnNode*>(statement.get()));
-      } else if (statement->getNodeType() == "BreakNode") {
-          visitBreakStatement(static_cast<BreakNode*>(statement.get()));
-      } else if (statement->getNodeType() == "ContinueNode") {
-          visitContinueStatement(static_cast<ContinueNode*>(statement.get()));
-      }
-      // Add other statement types as needed
+      visitStatement(statement.get());
   }
   
   // Leave the scope
-  symbolTable.leaveScope();
+  symbolTable->leaveScope();
+}
+
+void SemanticAnalyzer::visitScopedStatement(StatementNode* node) {
+  if (node->kind == NodeKind::BLOCK) {
+      visitBlock(static_cast<BlockNode*>(node));
+      return;
+  }
+  
+  // For non-block statements, create an implicit scope
+  symbolTable->enterScope();
+  visitStatement(node);
+  symbolTable->leaveScope();
 }
 
 void SemanticAnalyzer::visitExpressionStatement(ExpressionStatementNode* node) {
@@ -250,177 +466,63 @@ void SemanticAnalyzer::visitExpressionStatement(ExpressionStatementNode* node) {
 
 void SemanticAnalyzer::visitIfStatement(IfNode* node) {
   // Check condition expression
-  TypeInfo condType = visitExpression(node->condition.get());
+  const TypeInfo* condType = visitExpression(node->condition.get());
   
   // Ensure condition is a scalar type (can be evaluated as boolean)
-  if (!condType.isScalar()) {
+  if (!condType->isScalar()) {
       errorHandler.error(0, 0, "If condition must be a scalar type");
   }
   
   // Process then branch
-  if (node->thenBranch->getNodeType() == "BlockNode") {
-      visitBlock(static_cast<BlockNode*>(node->thenBranch.get()));
-  } else {
-      // For non-block statements, create an implicit scope
-      symbolTable.enterScope();
-      
-      if (node->thenBranch->getNodeType() == "ExpressionStatementNode") {
-          visitExpressionStatement(static_cast<ExpressionStatementNode*>(node->thenBranch.get()));
-      } else if (node->thenBranch->getNodeType() == "VariableDeclarationNode") {
-          visitVariableDeclaration(static_cast<VariableDeclarationNode*>(node->thenBranch.get()));
-      } else if (node->thenBranch->getNodeType() == "IfNode") {
-          visitIfStatement(static_cast<IfNode*>(node->thenBranch.get()));
-      } else if (node->thenBranch->getNodeType() == "WhileNode") {
-          visitWhileStatement(static_cast<WhileNode*>(node->thenBranch.get()));
-      } else if (node->thenBranch->getNodeType() == "DoWhileNode") {
-          visitDoWhileStatement(static_cast<DoWhileNode*>(node->thenBranch.get()));
-      } else if (node->thenBranch->getNodeType() == "ForNode") {
-          visitForStatement(static_cast<ForNode*>(node->thenBranch.get()));
-      } else if (node->thenBranch->getNodeType() == "ReturnNode") {
-          visitReturnStatement(static_cast<ReturnNode*>(node->thenBranch.get()));
-      } else if (node->thenBranch->getNodeType() == "BreakNode") {
-          visitBreakStatement(static_cast<BreakNode*>(node->thenBranch.get()));
-      } else if (node->thenBranch->getNodeType() == "ContinueNode") {
-          visitContinueStatement(static_cast<ContinueNode*>(node->thenBranch.get()));
-      }
-      
-      symbolTable.leaveScope();
-  }
+  visitScopedStatement(node->thenBranch.get());
   
   // Process else branch if it exists
   if (node->elseBranch) {
-      if (node->elseBranch->getNodeType() == "BlockNode") {
-          visitBlock(static_cast<BlockNode*>(node->elseBranch.get()));
-      } else {
-          // For non-block statements, create an implicit scope
-          symbolTable.enterScope();
-          
-          if (node->elseBranch->getNodeType() == "ExpressionStatementNode") {
-              visitExpressionStatement(static_cast<ExpressionStatementNode*>(node->elseBranch.get()));
-          } else if (node->elseBranch->getNodeType() == "VariableDeclarationNode") {
-              visitVariableDeclaration(static_cast<VariableDeclarationNode*>(node->elseBranch.get()));
-          } else if (node->elseBranch->getNodeType() == "IfNode") {
-              visitIfStatement(static_cast<IfNode*>(node->elseBranch.get()));
-          } else if (node->elseBranch->getNodeType() == "WhileNode") {
-              visitWhileStatement(static_cast<WhileNode*>(node->elseBranch.get()));
-          } else if (node->elseBranch->getNodeType() == "DoWhileNode") {
-              visitDoWhileStatement(static_cast<DoWhileNode*>(node->elseBranch.get()));
-          } else if (node->elseBranch->getNodeType() == "ForNode") {
-              visitForStatement(static_cast<ForNode*>(node->elseBranch.get()));
-          } else if (node->elseBranch->getNodeType() == "ReturnNode") {
-              visitReturnStatement(static_cast<ReturnNode*>(node->elseBranch.get()));
-          } else if (node->elseBranch->getNodeType() == "BreakNode") {
-              visitBreakStatement(static_cast<BreakNode*>(node->elseBranch.get()));
-          } else if (node->elseBranch->getNodeType() == "ContinueNode") {
-              visitContinueStatement(static_cast<ContinueNode*>(node->elseBranch.get()));
-          }
-          
-          symbolTable.leaveScope();
-      }
+      visitScopedStatement(node->elseBranch.get());
   }
 }
 
 void SemanticAnalyzer::visitWhileStatement(WhileNode* node) {
   // Check condition expression
-  TypeInfo condType = visitExpression(node->condition.get());
+  const TypeInfo* condType = visitExpression(node->condition.get());
   
   // Ensure condition is a scalar type (can be evaluated as boolean)
-  if (!condType.isScalar()) {
+  if (!condType->isScalar()) {
       errorHandler.error(0, 0, "While condition must be a scalar type");
   }
   
   // Process the body
-  if (node->body->getNodeType() == "BlockNode") {
-      visitBlock(static_cast<BlockNode*>(node->body.get()));
-  } else {
-      // For non-block statements, create an implicit scope
-      symbolTable.enterScope();
-      
-      // Visit the appropriate statement type
-      if (node->body->getNodeType() == "ExpressionStatementNode") {
-          visitExpressionStatement(static_cast<ExpressionStatementNode*>(node->body.get()));
-      } else if (node->body->getNodeType() == "VariableDeclarationNode") {
-          visitVariableDeclaration(static_cast<VariableDeclarationNode*>(node->body.get()));
-      } else if (node->body->getNodeType() == "IfNode") {
-          visitIfStatement(static_cast<IfNode*>(node->body.get()));
-      } else if (node->body->getNodeType() == "WhileNode") {
-          visitWhileStatement(static_cast<WhileNode*>(node->body.get()));
-      } else if (node->body->getNodeType() == "DoWhileNode") {
-          visitDoWhileStatement(static_cast<DoWhileNode*>(node->body.get()));
-      } else if (node->body->getNodeType() == "ForNode") {
-          visitForStatement(static_cast<ForNode*>(node->body.get()));
-      } else if (node->body->getNodeType() == "ReturnNode") {
-          visitReturnStatement(static_cast<ReturnNode*>(node->body.get()));
-      } else if (node->body->getNodeType() == "BreakNode") {
-          visitBreakStatement(static_cast<BreakNode*>(node->body.get()));
-      } else if (node->body->getNodeType() == "ContinueNode") {
-          visitContinueStatement(static_cast<ContinueNode*>(node->body.get()));
-      }
-      
-      symbolTable.leaveScope();
-  }
+  visitScopedStatement(node->body.get());
 }
 
 void SemanticAnalyzer::visitDoWhileStatement(DoWhileNode* node) {
   // Process the body
-  if (node->body->getNodeType() == "BlockNode") {
-      visitBlock(static_cast<BlockNode*>(node->body.get()));
-  } else {
-      // For non-block statements, create an implicit scope
-      symbolTable.enterScope();
-      
-      // Visit the appropriate statement type
-      if (node->body->getNodeType() == "ExpressionStatementNode") {
-          visitExpressionStatement(static_cast<ExpressionStatementNode*>(node->body.get()));
-      } else if (node->body->getNodeType() == "VariableDeclarationNode") {
-          visitVariableDeclaration(static_cast<VariableDeclarationNode*>(node->body.get()));
-      } else if (node->body->getNodeType() == "IfNode") {
-          visitIfStatement(static_cast<IfNode*>(node->body.get()));
-      } else if (node->body->getNodeType() == "WhileNode") {
-          visitWhileStatement(static_cast<WhileNode*>(node->body.get()));
-      } else if (node->body->getNodeType() == "DoWhileNode") {
-          visitDoWhileStatement(static_cast<DoWhileNode*>(node->body.get()));
-      } else if (node->body->getNodeType() == "ForNode") {
-          visitForStatement(static_cast<ForNode*>(node->body.get()));
-      } else if (node->body->getNodeType() == "ReturnNode") {
-          visitReturnStatement(static_cast<ReturnNode*>(node->body.get()));
-      } else if (node->body->getNodeType() == "BreakNode") {
-          visitBreakStatement(static_cast<BreakNode*>(node->body.get()));
-      } else if (node->body->getNodeType() == "ContinueNode") {
-          visitContinueStatement(static_cast<ContinueNode*>(node->body.get()));
-      }
-      
-      symbolTable.leaveScope();
-  }
+  visitScopedStatement(node->body.get());
   
   // Check condition expression
-  TypeInfo condType = visitExpression(node->condition.get());
+  const TypeInfo* condType = visitExpression(node->condition.get());
   
   // Ensure condition is a scalar type (can be evaluated as boolean)
-  if (!condType.isScalar()) {
+  if (!condType->isScalar()) {
       errorHandler.error(0, 0, "Do-while condition must be a scalar type");
   }
 }
 
 void SemanticAnalyzer::visitForStatement(ForNode* node) {
   // Enter for loop scope
-  symbolTable.enterScope();
+  symbolTable->enterScope();
   
   // Process initializer
   if (node->initializer) {
-      if (node->initializer->getNodeType() == "ExpressionStatementNode") {
-          visitExpressionStatement(static_cast<ExpressionStatementNode*>(node->initializer.get()));
-      } else if (node->initializer->getNodeType() == "VariableDeclarationNode") {
-          visitVariableDeclaration(static_cast<VariableDeclarationNode*>(node->initializer.get()));
-      }
+      visitStatement(node->initializer.get());
   }
   
   // Check condition if present
   if (node->condition) {
-      TypeInfo condType = visitExpression(node->condition.get());
+      const TypeInfo* condType = visitExpression(node->condition.get());
       
       // Ensure condition is a scalar type (can be evaluated as boolean)
-      if (!condType.isScalar()) {
+      if (!condType->isScalar()) {
           errorHandler.error(0, 0, "For condition must be a scalar type");
       }
   }
@@ -431,38 +533,10 @@ void SemanticAnalyzer::visitForStatement(ForNode* node) {
   }
   
   // Process the body
-  if (node->body->getNodeType() == "BlockNode") {
-      visitBlock(static_cast<BlockNode*>(node->body.get()));
-  } else {
-      // For non-block statements, create an implicit scope
-      symbolTable.enterScope();
-      
-      // Visit the appropriate statement type
-      if (node->body->getNodeType() == "ExpressionStatementNode") {
-          visitExpressionStatement(static_cast<ExpressionStatementNode*>(node->body.get()));
-      } else if (node->body->getNodeType() == "VariableDeclarationNode") {
-          visitVariableDeclaration(static_cast<VariableDeclarationNode*>(node->body.get()));
-      } else if (node->body->getNodeType() == "IfNode") {
-          visitIfStatement(static_cast<IfNode*>(node->body.get()));
-      } else if (node->body->getNodeType() == "WhileNode") {
-          visitWhileStatement(static_cast<WhileNode*>(node->body.get()));
-      } else if (node->body->getNodeType() == "DoWhileNode") {
-          visitDoWhileStatement(static_cast<DoWhileNode*>(node->body.get()));
-      } else if (node->body->getNodeType() == "ForNode") {
-          visitForStatement(static_cast<ForNode*>(node->body.get()));
-      } else if (node->body->getNodeType() == "ReturnNode") {
-          visitReturnStatement(static_cast<ReturnNode*>(node->body.get()));
-      } else if (node->body->getNodeType() == "BreakNode") {
-          visitBreakStatement(static_cast<BreakNode*>(node->body.get()));
-      } else if (node->body->getNodeType() == "ContinueNode") {
-          visitContinueStatement(static_cast<ContinueNode*>(node->body.get()));
-      }
-      
-      symbolTable.leaveScope();
-  }
+  visitScopedStatement(node->body.get());
   
   // Leave for loop scope
-  symbolTable.leaveScope();
+  symbolTable->leaveScope();
 }
 
 void SemanticAnalyzer::visitReturnStatement(ReturnNode* node) {
@@ -477,10 +551,10 @@ void SemanticAnalyzer::visitReturnStatement(ReturnNode* node) {
   
   // Check return value
   if (node->value) {
-      TypeInfo valueType = visitExpression(node->value.get());
+      const TypeInfo* valueType = visitExpression(node->value.get());
       
       // Ensure return value type is compatible with function return type
-      if (!areTypesCompatible(valueType, *currentFunctionReturnType)) {
+      if (!areTypesCompatible(valueType, currentFunctionReturnType)) {
           errorHandler.error(0, 0, "Cannot return value of incompatible type");
       }
   } else {
@@ -499,178 +573,190 @@ void SemanticAnalyzer::visitContinueStatement(ContinueNode* node) {
   // Could check if we're inside a loop (not implemented)
 }
 
-TypeInfo SemanticAnalyzer::visitExpression(ExpressionNode* node) {
-  if (!node) {
-      return TypeInfo::createVoid();
+const TypeInfo* SemanticAnalyzer::visitExpression(ExpressionNode* node) {
+  // Dispatch, then record the computed type and folded value on the node
+  // for later phases; operands are annotated first, so folding is bottom-up
+  const TypeInfo* type = ASTVisitor::visitExpression(node);
+  if (node) {
+      node->type = type;
+      node->constant = constants.evaluate(node);
   }
-  
-  if (node->getNodeType() == "LiteralNode") {
-      return visitLiteral(static_cast<LiteralNode*>(node));
-  } else if (node->getNodeType() == "VariableNode") {
-      return visitVariable(static_cast<VariableNode*>(node));
-  } else if (node->getNodeType() == "UnaryNode") {
-      return visitUnary(static_cast<UnaryNode*>(node));
-  } else if (node->getNodeType() == "BinaryNode") {
-      return visitBinary(static_cast<BinaryNode*>(node));
-  } else if (node->getNodeType() == "CallNode") {
-      return visitCall(static_cast<CallNode*>(node));
-  } else if (node->getNodeType() == "ArrayAccessNode") {
-      return visitArrayAccess(static_cast<ArrayAccessNode*>(node));
-  } else if (node->getNodeType() == "MemberAccessNode") {
-      return visitMemberAccess(static_cast<MemberAccessNode*>(node));
-  } else if (node->getNodeType() == "ConditionalNode") {
-      return visitConditional(static_cast<ConditionalNode*>(node));
+  return type;
+}
+
+const TypeInfo* SemanticAnalyzer::visitInvalidExpression(ExpressionNode* node) {
+  if (node) {
+      errorHandler.error(0, 0, "Unknown expression type: " + node->getNodeType());
   }
-  
-  // Unknown expression type
-  errorHandler.error(0, 0, "Unknown expression type: " + node->getNodeType());
-  return TypeInfo::createVoid();
+  return types.getVoid();
 }
 
-TypeInfo SemanticAnalyzer::visitLiteral(LiteralNode* node) {
+const TypeInfo* SemanticAnalyzer::visitLiteral(LiteralNode* node) {
   switch (node->token.type) {
       case TokenType::INTEGER_LITERAL:
-          return TypeInfo::createInt();
+          return types.getInt();
       case TokenType::FLOAT_LITERAL:
-          return TypeInfo::createFloat();
+          return types.getFloat();
       case TokenType::CHAR_LITERAL:
-          return TypeInfo::createChar();
+          return types.getChar();
       case TokenType::STRING_LITERAL:
           // String literals are arrays of chars
-          return TypeInfo::createArray(TypeInfo::createChar(), node->token.lexeme.length() - 2 + 1); // -2 for quotes, +1 for null terminator
+          return types.getArray(types.getChar(), node->token.lexeme.length() - 2 + 1); // -2 for quotes, +1 for null terminator
       default:
           errorHandler.error(node->token.line, node->token.column, "Unknown literal type");
-          return TypeInfo::createVoid();
+          return types.getVoid();
   }
 }
 
-TypeInfo SemanticAnalyzer::visitVariable(VariableNode* node) {
+const TypeInfo* SemanticAnalyzer::visitVariable(VariableNode* node) {
   const std::string& name = node->name.lexeme;
   
   // Look up the variable in the symbol table
-  const SymbolInfo* symbol = symbolTable.lookup(name);
+  const SymbolInfo* symbol = symbolTable->lookup(name);
   if (!symbol) {
       errorHandler.error(node->name.line, node->name.column, "Undefined variable '" + name + "'");
-      return TypeInfo::createVoid();
+      return types.getVoid();
   }
   
+  node->symbol = symbol;
   return symbol->type;
 }
 
-TypeInfo SemanticAnalyzer::visitUnary(UnaryNode* node) {
-  TypeInfo operandType = visitExpression(node->operand.get());
+const TypeInfo* SemanticAnalyzer::visitUnary(UnaryNode* node) {
+  const TypeInfo* operandType = visitExpression(node->operand.get());
   
   switch (node->op.type) {
       case TokenType::OP_MINUS:
       case TokenType::OP_PLUS:
           // Unary plus and minus require numeric operand
-          if (!operandType.isNumeric()) {
+          if (!operandType->isNumeric()) {
               errorHandler.error(node->op.line, node->op.column, 
                                 "Unary operator " + node->op.lexeme + " requires numeric operand");
-              return TypeInfo::createVoid();
+              return types.getVoid();
           }
-          return operandType;
+          return promote(operandType);
           
       case TokenType::OP_EXCLAMATION:
           // Logical not requires scalar operand
-          if (!operandType.isScalar()) {
+          if (!operandType->isScalar()) {
               errorHandler.error(node->op.line, node->op.column, 
                                 "Unary operator ! requires scalar operand");
-              return TypeInfo::createVoid();
+              return types.getVoid();
           }
-          return TypeInfo::createInt(); // Boolean operations return int
+          return types.getInt(); // Boolean operations return int
           
       case TokenType::OP_TILDE:
           // Bitwise not requires integer operand
-          if (!operandType.isInteger()) {
+          if (!operandType->isInteger()) {
               errorHandler.error(node->op.line, node->op.column, 
                                 "Unary operator ~ requires integer operand");
-              return TypeInfo::createVoid();
+              return types.getVoid();
           }
-          return operandType;
+          return promote(operandType);
           
       case TokenType::OP_STAR:
           // Dereferencing requires pointer operand
-          if (operandType.kind != TypeInfo::Kind::POINTER) {
+          if (operandType->kind != TypeInfo::Kind::POINTER) {
               errorHandler.error(node->op.line, node->op.column, 
                                 "Cannot dereference non-pointer type");
-              return TypeInfo::createVoid();
+              return types.getVoid();
           }
-          return *operandType.base;
+          return operandType->base;
           
       case TokenType::OP_AMPERSAND:
           // Taking address creates a pointer to the operand type
-          return TypeInfo::createPointer(operandType);
+          return types.getPointer(operandType);
           
       case TokenType::OP_PLUS_PLUS:
       case TokenType::OP_MINUS_MINUS:
           // Increment/decrement requires numeric or pointer operand
-          if (!operandType.isNumeric() && operandType.kind != TypeInfo::Kind::POINTER) {
+          if (!operandType->isNumeric() && operandType->kind != TypeInfo::Kind::POINTER) {
               errorHandler.error(node->op.line, node->op.column, 
                                 "Unary operator " + node->op.lexeme + " requires numeric or pointer operand");
-              return TypeInfo::createVoid();
+              return types.getVoid();
           }
           return operandType;
           
       default:
           errorHandler.error(node->op.line, node->op.column, 
                             "Unknown unary operator: " + node->op.lexeme);
-          return TypeInfo::createVoid();
+          return types.getVoid();
   }
 }
 
-TypeInfo SemanticAnalyzer::visitBinary(BinaryNode* node) {
-  TypeInfo leftType = visitExpression(node->left.get());
-  TypeInfo rightType = visitExpression(node->right.get());
+const TypeInfo* SemanticAnalyzer::visitBinary(BinaryNode* node) {
+  const TypeInfo* leftType = visitExpression(node->left.get());
+  const TypeInfo* rightType = visitExpression(node->right.get());
   
-  switch (node->op.type) {
+  // a op= b checks op as a op b would, then assigns the result to a
+  TokenType compound = compoundOperator(node->op.type);
+  if (compound != TokenType::UNKNOWN) {
+      Token op(compound, node->op.lexeme.substr(0, node->op.lexeme.size() - 1),
+               node->op.filename, node->op.line, node->op.column);
+      const TypeInfo* resultType = binaryType(op, leftType, rightType);
+      if (resultType->kind == TypeInfo::Kind::VOID) {
+          return resultType;
+      }
+      if (!areTypesCompatible(resultType, leftType)) {
+          errorHandler.error(node->op.line, node->op.column, 
+                            "Cannot assign incompatible type");
+          return types.getVoid();
+      }
+      return leftType;
+  }
+  return binaryType(node->op, leftType, rightType);
+}
+
+const TypeInfo* SemanticAnalyzer::binaryType(const Token& op, const TypeInfo* leftType,
+                                             const TypeInfo* rightType) {
+  switch (op.type) {
       case TokenType::OP_PLUS:
           // Pointer arithmetic: pointer + integer
-          if (leftType.kind == TypeInfo::Kind::POINTER && rightType.isInteger()) {
+          if (leftType->kind == TypeInfo::Kind::POINTER && rightType->isInteger()) {
               return leftType;
           }
           // Integer + pointer
-          if (leftType.isInteger() && rightType.kind == TypeInfo::Kind::POINTER) {
+          if (leftType->isInteger() && rightType->kind == TypeInfo::Kind::POINTER) {
               return rightType;
           }
           // Numeric + numeric
-          if (leftType.isNumeric() && rightType.isNumeric()) {
+          if (leftType->isNumeric() && rightType->isNumeric()) {
               return getCommonType(leftType, rightType);
           }
           
-          errorHandler.error(node->op.line, node->op.column, 
+          errorHandler.error(op.line, op.column, 
                             "Invalid operands to binary +");
-          return TypeInfo::createVoid();
+          return types.getVoid();
           
       case TokenType::OP_MINUS:
           // Pointer arithmetic: pointer - integer
-          if (leftType.kind == TypeInfo::Kind::POINTER && rightType.isInteger()) {
+          if (leftType->kind == TypeInfo::Kind::POINTER && rightType->isInteger()) {
               return leftType;
           }
           // Pointer - pointer (gives an integer)
-          if (leftType.kind == TypeInfo::Kind::POINTER && rightType.kind == TypeInfo::Kind::POINTER) {
-              return TypeInfo::createInt();
+          if (leftType->kind == TypeInfo::Kind::POINTER && rightType->kind == TypeInfo::Kind::POINTER) {
+              return types.getInt();
           }
           // Numeric - numeric
-          if (leftType.isNumeric() && rightType.isNumeric()) {
+          if (leftType->isNumeric() && rightType->isNumeric()) {
               return getCommonType(leftType, rightType);
           }
           
-          errorHandler.error(node->op.line, node->op.column, 
+          errorHandler.error(op.line, op.column, 
                             "Invalid operands to binary -");
-          return TypeInfo::createVoid();
+          return types.getVoid();
           
       case TokenType::OP_STAR:
       case TokenType::OP_SLASH:
       case TokenType::OP_PERCENT:
           // Numeric operations
-          if (leftType.isNumeric() && rightType.isNumeric()) {
+          if (leftType->isNumeric() && rightType->isNumeric()) {
               return getCommonType(leftType, rightType);
           }
           
-          errorHandler.error(node->op.line, node->op.column, 
-                            "Invalid operands to binary " + node->op.lexeme);
-          return TypeInfo::createVoid();
+          errorHandler.error(op.line, op.column, 
+                            "Invalid operands to binary " + op.lexeme);
+          return types.getVoid();
           
       case TokenType::OP_LESS:
       case TokenType::OP_LESS_EQUALS:
@@ -680,11 +766,11 @@ TypeInfo SemanticAnalyzer::visitBinary(BinaryNode* node) {
       case TokenType::OP_NOT_EQUALS:
           // Comparison operators require compatible types
           if (!areTypesCompatible(leftType, rightType) && !areTypesCompatible(rightType, leftType)) {
-              errorHandler.error(node->op.line, node->op.column, 
+              errorHandler.error(op.line, op.column, 
                                 "Incompatible types for comparison");
-              return TypeInfo::createVoid();
+              return types.getVoid();
           }
-          return TypeInfo::createInt(); // Comparisons return int (0 or 1)
+          return types.getInt(); // Comparisons return int (0 or 1)
           
       case TokenType::OP_AMPERSAND:
       case TokenType::OP_PIPE:
@@ -692,104 +778,108 @@ TypeInfo SemanticAnalyzer::visitBinary(BinaryNode* node) {
       case TokenType::OP_SHL:
       case TokenType::OP_SHR:
           // Bitwise operators require integer operands
-          if (!leftType.isInteger() || !rightType.isInteger()) {
-              errorHandler.error(node->op.line, node->op.column, 
+          if (!leftType->isInteger() || !rightType->isInteger()) {
+              errorHandler.error(op.line, op.column, 
                                 "Bitwise operators require integer operands");
-              return TypeInfo::createVoid();
+              return types.getVoid();
+          }
+          // Shifts take the promoted type of the left operand alone
+          if (op.type == TokenType::OP_SHL || op.type == TokenType::OP_SHR) {
+              return promote(leftType);
           }
           return getCommonType(leftType, rightType);
           
       case TokenType::OP_LOGICAL_AND:
       case TokenType::OP_LOGICAL_OR:
           // Logical operators require scalar operands
-          if (!leftType.isScalar() || !rightType.isScalar()) {
-              errorHandler.error(node->op.line, node->op.column, 
+          if (!leftType->isScalar() || !rightType->isScalar()) {
+              errorHandler.error(op.line, op.column, 
                                 "Logical operators require scalar operands");
-              return TypeInfo::createVoid();
+              return types.getVoid();
           }
-          return TypeInfo::createInt(); // Logical operations return int
+          return types.getInt(); // Logical operations return int
           
       case TokenType::OP_EQUALS:
           // Assignment requires compatible types
           if (!areTypesCompatible(rightType, leftType)) {
-              errorHandler.error(node->op.line, node->op.column, 
+              errorHandler.error(op.line, op.column, 
                                 "Cannot assign incompatible type");
-              return TypeInfo::createVoid();
+              return types.getVoid();
           }
           return leftType;
           
       default:
-          errorHandler.error(node->op.line, node->op.column, 
-                            "Unknown binary operator: " + node->op.lexeme);
-          return TypeInfo::createVoid();
+          errorHandler.error(op.line, op.column, 
+                            "Unknown binary operator: " + op.lexeme);
+          return types.getVoid();
   }
 }
 
-TypeInfo SemanticAnalyzer::visitCall(CallNode* node) {
+const TypeInfo* SemanticAnalyzer::visitCall(CallNode* node) {
   // Check that the callee is a function
-  TypeInfo calleeType = visitExpression(node->callee.get());
+  const TypeInfo* calleeType = visitExpression(node->callee.get());
   
-  if (calleeType.kind != TypeInfo::Kind::FUNCTION) {
+  if (calleeType->kind != TypeInfo::Kind::FUNCTION) {
       errorHandler.error(0, 0, "Called object is not a function");
-      return TypeInfo::createVoid();
+      return types.getVoid();
   }
   
   // Check number of arguments
-  if (node->arguments.size() != calleeType.parameters.size()) {
+  if (node->arguments.size() != calleeType->parameters.size()) {
       errorHandler.error(0, 0, "Wrong number of arguments to function call");
-      return TypeInfo::createVoid();
+      return types.getVoid();
   }
   
   // Check argument types
   for (size_t i = 0; i < node->arguments.size(); i++) {
-      TypeInfo argType = visitExpression(node->arguments[i].get());
+      const TypeInfo* argType = visitExpression(node->arguments[i].get());
       
-      if (!areTypesCompatible(argType, calleeType.parameters[i])) {
+      if (!areTypesCompatible(argType, calleeType->parameters[i])) {
           errorHandler.error(0, 0, "Argument type mismatch in function call");
           // Continue checking other arguments
       }
   }
   
   // Return the function's return type
-  return *calleeType.base;
+  return calleeType->base;
 }
 
-TypeInfo SemanticAnalyzer::visitArrayAccess(ArrayAccessNode* node) {
-  TypeInfo arrayType = visitExpression(node->array.get());
-  TypeInfo indexType = visitExpression(node->index.get());
+const TypeInfo* SemanticAnalyzer::visitArrayAccess(ArrayAccessNode* node) {
+  const TypeInfo* arrayType = visitExpression(node->array.get());
+  const TypeInfo* indexType = visitExpression(node->index.get());
   
   // Array access requires array or pointer base
-  if (arrayType.kind != TypeInfo::Kind::ARRAY && arrayType.kind != TypeInfo::Kind::POINTER) {
+  if (arrayType->kind != TypeInfo::Kind::ARRAY && arrayType->kind != TypeInfo::Kind::POINTER) {
       errorHandler.error(0, 0, "Subscripted value is not an array or pointer");
-      return TypeInfo::createVoid();
+      return types.getVoid();
   }
   
   // Index must be integer
-  if (!indexType.isInteger()) {
+  if (!indexType->isInteger()) {
       errorHandler.error(0, 0, "Array index must be an integer");
-      return TypeInfo::createVoid();
+      return types.getVoid();
   }
   
   // Return the element type
-  return *arrayType.base;
+  return arrayType->base;
 }
 
-TypeInfo SemanticAnalyzer::visitMemberAccess(MemberAccessNode* node) {
-  TypeInfo objectType = visitExpression(node->object.get());
+const TypeInfo* SemanticAnalyzer::visitMemberAccess(MemberAccessNode* node) {
+  const TypeInfo* objectType = visitExpression(node->object.get());
   
   // Member access requires struct type (or pointer to struct with -> operator)
   if (node->op.type == TokenType::OP_DOT) {
-      if (objectType.kind != TypeInfo::Kind::STRUCT) {
+      if (objectType->kind != TypeInfo::Kind::STRUCT) {
           errorHandler.error(node->op.line, node->op.column, 
                             "Left operand of '.' must be a struct");
-          return TypeInfo::createVoid();
+          return types.getVoid();
       }
   } else if (node->op.type == TokenType::OP_ARROW) {
-      if (objectType.kind != TypeInfo::Kind::POINTER || 
-          (objectType.base && objectType.base->kind != TypeInfo::Kind::STRUCT)) {
+      if (objectType->kind != TypeInfo::Kind::POINTER || 
+          (objectType->base && objectType->base->kind != TypeInfo::Kind::STRUCT)) {
           errorHandler.error(node->op.line, node->op.column, 
                             "Left operand of '->' must be a pointer to a struct");
-          return TypeInfo::createVoid();
+          return types.getVoid();
       }
   }
   
@@ -797,20 +887,20 @@ TypeInfo SemanticAnalyzer::visitMemberAccess(MemberAccessNode* node) {
   // and return its type. For now, we'll just return int as a placeholder.
   errorHandler.warning(node->op.line, node->op.column, 
                      "Struct member access not fully implemented");
-  return TypeInfo::createInt();
+  return types.getInt();
 }
 
-TypeInfo SemanticAnalyzer::visitConditional(ConditionalNode* node) {
-  TypeInfo condType = visitExpression(node->condition.get());
+const TypeInfo* SemanticAnalyzer::visitConditional(ConditionalNode* node) {
+  const TypeInfo* condType = visitExpression(node->condition.get());
   
   // Condition must be scalar
-  if (!condType.isScalar()) {
+  if (!condType->isScalar()) {
       errorHandler.error(0, 0, "Conditional operator requires scalar condition");
-      return TypeInfo::createVoid();
+      return types.getVoid();
   }
   
-  TypeInfo trueType = visitExpression(node->trueExpr.get());
-  TypeInfo falseType = visitExpression(node->falseExpr.get());
+  const TypeInfo* trueType = visitExpression(node->trueExpr.get());
+  const TypeInfo* falseType = visitExpression(node->falseExpr.get());
   
   // Result types must be compatible
   if (areTypesCompatible(trueType, falseType)) {
@@ -819,105 +909,119 @@ TypeInfo SemanticAnalyzer::visitConditional(ConditionalNode* node) {
       return falseType;
   } else {
       errorHandler.error(0, 0, "Incompatible types in conditional expression");
-      return TypeInfo::createVoid();
+      return types.getVoid();
   }
 }
 
-TypeInfo SemanticAnalyzer::getTypeFromTypeNode(TypeNode* node) {
+const TypeInfo* SemanticAnalyzer::getTypeFromTypeNode(TypeNode* node) {
   TypeInfo::Kind kind;
-  int size = 0;
   
   // Determine base type
   if (node->name.type == TokenType::KW_VOID) {
       kind = TypeInfo::Kind::VOID;
-      size = 0;
   } else if (node->name.type == TokenType::KW_CHAR) {
       kind = TypeInfo::Kind::CHAR;
-      size = 1;
   } else if (node->name.type == TokenType::KW_INT) {
       kind = TypeInfo::Kind::INT;
-      size = 4;
   } else if (node->name.type == TokenType::KW_FLOAT) {
       kind = TypeInfo::Kind::FLOAT;
-      size = 4;
   } else if (node->name.type == TokenType::KW_DOUBLE) {
       kind = TypeInfo::Kind::DOUBLE;
-      size = 8;
   } else {
       // Unknown type, treat as void
       errorHandler.error(node->name.line, node->name.column, 
                        "Unknown type: " + node->name.lexeme);
       kind = TypeInfo::Kind::VOID;
-      size = 0;
   }
   
   // Create base type
-  TypeInfo result(kind, node->isConst, node->isVolatile, size);
+  const TypeInfo* result = types.getPrimitive(kind, node->isConst, node->isVolatile);
   
   // Handle pointers
   if (node->isPointer) {
       for (int i = 0; i < node->pointerLevel; i++) {
-          result = TypeInfo::createPointer(result);
+          result = types.getPointer(result);
       }
   }
   
   return result;
 }
 
-bool SemanticAnalyzer::areTypesCompatible(const TypeInfo& source, const TypeInfo& target) {
+bool SemanticAnalyzer::areTypesCompatible(const TypeInfo* source, const TypeInfo* target) {
+  // Interned types are identical exactly when their pointers are equal
+  if (source == target) {
+      return true;
+  }
+  
   // Identical types are compatible
-  if (source.kind == target.kind) {
-      if (source.kind == TypeInfo::Kind::ARRAY || 
-          source.kind == TypeInfo::Kind::POINTER || 
-          source.kind == TypeInfo::Kind::FUNCTION) {
+  if (source->kind == target->kind) {
+      if (source->kind == TypeInfo::Kind::ARRAY || 
+          source->kind == TypeInfo::Kind::POINTER || 
+          source->kind == TypeInfo::Kind::FUNCTION) {
           // For compound types, base types must be compatible
-          return areTypesCompatible(*source.base, *target.base);
+          return areTypesCompatible(source->base, target->base);
       }
       return true;
   }
   
   // Integer promotion
-  if (source.kind == TypeInfo::Kind::CHAR && target.kind == TypeInfo::Kind::INT) {
+  if (source->kind == TypeInfo::Kind::CHAR && target->kind == TypeInfo::Kind::INT) {
       return true;
   }
   
   // Float promotion
-  if (source.kind == TypeInfo::Kind::FLOAT && target.kind == TypeInfo::Kind::DOUBLE) {
+  if (source->kind == TypeInfo::Kind::FLOAT && target->kind == TypeInfo::Kind::DOUBLE) {
       return true;
   }
   
   // Integer to float
-  if (source.isInteger() && target.isFloatingPoint()) {
+  if (source->isInteger() && target->isFloatingPoint()) {
       return true;
   }
   
   // Array decays to pointer
-  if (source.kind == TypeInfo::Kind::ARRAY && target.kind == TypeInfo::Kind::POINTER) {
-      return areTypesCompatible(*source.base, *target.base);
+  if (source->kind == TypeInfo::Kind::ARRAY && target->kind == TypeInfo::Kind::POINTER) {
+      return areTypesCompatible(source->base, target->base);
   }
   
   return false;
 }
 
-TypeInfo SemanticAnalyzer::getCommonType(const TypeInfo& a, const TypeInfo& b) {
+const TypeInfo* SemanticAnalyzer::promote(const TypeInfo* type) {
+  // Integer promotions: anything narrower than int becomes int
+  if (type->isInteger() && type->size < types.getInt()->size) {
+      return types.getInt();
+  }
+  // Operators produce values, which are never qualified
+  if (type->isConst || type->isVolatile) {
+      return types.getPrimitive(type->kind);
+  }
+  return type;
+}
+
+const TypeInfo* SemanticAnalyzer::getCommonType(const TypeInfo* a, const TypeInfo* b) {
+  // Usual arithmetic conversions, applied after the integer promotions
+  a = promote(a);
+  b = promote(b);
+  
   // If types are identical, return either one
-  if (a.kind == b.kind) {
+  if (a->kind == b->kind) {
       return a;
   }
   
   // If one is double, result is double
-  if (a.kind == TypeInfo::Kind::DOUBLE || b.kind == TypeInfo::Kind::DOUBLE) {
-      return TypeInfo::createDouble();
+  if (a->kind == TypeInfo::Kind::DOUBLE || b->kind == TypeInfo::Kind::DOUBLE) {
+      return types.getDouble();
   }
   
   // If one is float, result is float
-  if (a.kind == TypeInfo::Kind::FLOAT || b.kind == TypeInfo::Kind::FLOAT) {
-      return TypeInfo::createFloat();
+  if (a->kind == TypeInfo::Kind::FLOAT || b->kind == TypeInfo::Kind::FLOAT) {
+      return types.getFloat();
   }
   
   // If both are integers, result is the larger one
-  if (a.isInteger() && b.isInteger()) {
-      return (a.size >= b.size) ? a : b;
+  if (a->isInteger() && b->isInteger()) {
+      return (a->size >= b->size) ? a : b;
   }
   
   // Default to a
@@ -0,0 +1,239 @@
+#include "passes.h"
+#include <algorithm>
+
+namespace ccc {
+namespace ir {
+
+namespace {
+
+class CFGSimplifier {
+public:
+  explicit CFGSimplifier(Function& function) : function(function) {}
+
+  // One sweep over the blocks; returns whether anything changed, after
+  // which the predecessor lists are current again
+  bool simplify() {
+      bool changed = false;
+      for (const auto& block : function.blocks) {
+          changed |= foldBranch(block.get());
+      }
+      if (changed) function.recomputePredecessors();
+
+      for (size_t b = 0; b < function.blocks.size(); b++) {
+          BasicBlock* block = function.blocks[b].get();
+          if (formSelect(block) || threadEmptyBlock(block) || threadConstantCondition(block) ||
+              mergeSuccessor(block)) {
+              function.recomputePredecessors();
+              changed = true;
+          }
+      }
+
+      changed |= function.removeUnreachableBlocks();
+      return changed;
+  }
+
+private:
+  Function& function;
+
+  // A CONDBR on a constant, or with both edges to the same block, is a jump
+  bool foldBranch(BasicBlock* block) {
+      Instruction* terminator = block->getTerminator();
+      if (!terminator || terminator->opcode != Opcode::CONDBR) return false;
+
+      BasicBlock* taken;
+      if (terminator->blocks[0] == terminator->blocks[1]) {
+          taken = terminator->blocks[0];
+      } else if (terminator->getOperand(0)->isConstant()) {
+          taken = terminator->blocks[static_cast<Constant*>(terminator->getOperand(0))->isZero() ? 1 : 0];
+          BasicBlock* skipped = terminator->blocks[0] == taken ? terminator->blocks[1] : terminator->blocks[0];
+          for (Instruction* phi : skipped->phis()) {
+              phi->removeIncoming(block);
+          }
+      } else {
+          return false;
+      }
+      terminator->dropOperands();
+      terminator->opcode = Opcode::BR;
+      terminator->blocks = {taken};
+      return true;
+  }
+
+  // Each predecessor once, however many edges it has into block
+  static std::vector<BasicBlock*> distinctPredecessors(const BasicBlock* block) {
+      std::vector<BasicBlock*> predecessors;
+      for (BasicBlock* predecessor : block->predecessors) {
+          if (std::find(predecessors.begin(), predecessors.end(), predecessor) == predecessors.end()) {
+              predecessors.push_back(predecessor);
+          }
+      }
+      return predecessors;
+  }
+
+  // Send the edges from predecessor to block straight to target instead.
+  // Target's phis take from predecessor what they took from block, which
+  // only works when predecessor does not already reach target some other
+  // way with a value of its own.
+  bool redirect(BasicBlock* predecessor, BasicBlock* block, BasicBlock* target) {
+      std::vector<Instruction*> phis = target->phis();
+      if (!phis.empty() &&
+          std::find(target->predecessors.begin(), target->predecessors.end(), predecessor) != target->predecessors.end()) {
+          return false;
+      }
+
+      for (Instruction* phi : phis) {
+          phi->addIncoming(phi->incomingFor(block), predecessor);
+      }
+      for (Instruction* phi : block->phis()) {
+          phi->removeIncoming(predecessor);
+      }
+      Instruction* terminator = predecessor->getTerminator();
+      std::replace(terminator->blocks.begin(), terminator->blocks.end(), block, target);
+      return true;
+  }
+
+  // Whether arm is a block of only a jump to join that block alone reaches
+  static bool isEmptyArm(const BasicBlock* arm, const BasicBlock* block, const BasicBlock* join) {
+      return arm != join && arm->instructions.size() == 1 && arm->predecessors.size() == 1 &&
+             arm->predecessors.front() == block && arm->getTerminator()->opcode == Opcode::BR &&
+             arm->getTerminator()->blocks[0] == join;
+  }
+
+  // A branch whose arms are empty blocks meeting again (or one empty arm
+  // and the join itself) only decides what the join's phis take: a SELECT
+  // on the condition says the same without the branch, and leaves a loop
+  // like if (a[i] > s) s = a[i]; straight enough to vectorize. Only when
+  // a single phi tells the arms apart, so one select replaces one branch.
+  bool formSelect(BasicBlock* block) {
+      Instruction* terminator = block->getTerminator();
+      if (!terminator || terminator->opcode != Opcode::CONDBR) return false;
+      BasicBlock* thenBlock = terminator->blocks[0];
+      BasicBlock* elseBlock = terminator->blocks[1];
+
+      // The join is where an empty arm jumps; the other arm is empty too
+      // or is the join
+      BasicBlock* join = nullptr;
+      for (BasicBlock* arm : {thenBlock, elseBlock}) {
+          Instruction* jump = arm->getTerminator();
+          if (arm->instructions.size() == 1 && jump->opcode == Opcode::BR) {
+              join = jump->blocks[0];
+              break;
+          }
+      }
+      if (!join || join == block) return false;
+      bool thenEmpty = isEmptyArm(thenBlock, block, join);
+      bool elseEmpty = isEmptyArm(elseBlock, block, join);
+      if (!(thenEmpty && elseEmpty) && !(thenEmpty && elseBlock == join) && !(elseEmpty && thenBlock == join)) {
+          return false;
+      }
+
+      BasicBlock* fromThen = thenBlock == join ? block : thenBlock;
+      BasicBlock* fromElse = elseBlock == join ? block : elseBlock;
+      Instruction* differing = nullptr;
+      for (Instruction* phi : join->phis()) {
+          if (phi->incomingFor(fromThen) == phi->incomingFor(fromElse)) continue;
+          if (differing) return false;
+          differing = phi;
+      }
+
+      for (Instruction* phi : join->phis()) {
+          Value* value = phi->incomingFor(fromThen);
+          if (phi == differing) {
+              value = block->insertBeforeTerminator(function.create(
+                  Opcode::SELECT, phi->type, {terminator->getOperand(0), value, phi->incomingFor(fromElse)}));
+          }
+          phi->removeIncoming(fromThen);
+          phi->removeIncoming(fromElse);
+          phi->addIncoming(value, block);
+      }
+      terminator->dropOperands();
+      terminator->opcode = Opcode::BR;
+      terminator->blocks = {join};
+      return true;
+  }
+
+  // A block that only jumps on: its predecessors jump to the target
+  // themselves. What reaches target's phis through block is defined above
+  // block, so it is available in each predecessor too.
+  bool threadEmptyBlock(BasicBlock* block) {
+      if (block == function.entry() || block->instructions.size() != 1) return false;
+      Instruction* terminator = block->getTerminator();
+      if (terminator->opcode != Opcode::BR || terminator->blocks[0] == block) return false;
+
+      BasicBlock* target = terminator->blocks[0];
+      bool changed = false;
+      for (BasicBlock* predecessor : distinctPredecessors(block)) {
+          changed |= redirect(predecessor, block, target);
+      }
+      return changed;
+  }
+
+  // A block that only branches on a phi of its own: a predecessor bringing
+  // a constant knows which way the branch goes and can go there directly
+  // (x = 0; ... if (!x) after a loop that may set it). The phi must have no
+  // other use, since the threaded paths no longer define it.
+  bool threadConstantCondition(BasicBlock* block) {
+      if (block == function.entry() || block->instructions.size() != 2) return false;
+      Instruction* phi = block->instructions.front().get();
+      Instruction* terminator = block->getTerminator();
+      if (!phi->isPhi() || terminator->opcode != Opcode::CONDBR || terminator->getOperand(0) != phi ||
+          phi->getUsers().size() != 1) {
+          return false;
+      }
+
+      bool changed = false;
+      for (BasicBlock* predecessor : distinctPredecessors(block)) {
+          Value* incoming = phi->incomingFor(predecessor);
+          if (!incoming || !incoming->isConstant()) continue;
+
+          BasicBlock* target = terminator->blocks[static_cast<Constant*>(incoming)->isZero() ? 1 : 0];
+          if (target == block) continue;
+          changed |= redirect(predecessor, block, target);
+      }
+      return changed;
+  }
+
+  // A block jumping to a successor that nothing else reaches: the two are
+  // one straight line of code, so the successor's instructions move up
+  bool mergeSuccessor(BasicBlock* block) {
+      Instruction* terminator = block->getTerminator();
+      if (!terminator || terminator->opcode != Opcode::BR) return false;
+      BasicBlock* successor = terminator->blocks[0];
+      if (successor == block || successor == function.entry() || successor->predecessors.size() != 1) return false;
+
+      for (Instruction* phi : successor->phis()) {
+          phi->replaceAllUsesWith(phi->getOperand(0));
+          successor->erase(phi);
+      }
+      block->erase(terminator);
+      for (auto& instruction : successor->instructions) {
+          instruction->parent = block;
+      }
+      block->instructions.splice(block->instructions.end(), successor->instructions);
+
+      for (BasicBlock* next : block->successors()) {
+          for (Instruction* phi : next->phis()) {
+              std::replace(phi->blocks.begin(), phi->blocks.end(), successor, block);
+          }
+      }
+      function.removeBlock(successor);
+      return true;
+  }
+};
+
+} // namespace
+
+bool SimplifyCFGPass::run(Function& function, AnalysisManager& analyses) {
+  (void)analyses;
+  if (!function.entry()) return false;
+
+  function.recomputePredecessors();
+  CFGSimplifier simplifier(function);
+  bool changed = false;
+  while (simplifier.simplify()) {
+      changed = true;
+  }
+  return changed;
+}
+
+} // namespace ir
+} // namespace ccc
@@ -0,0 +1,63 @@
+#include "passes.h"
+
+namespace ccc {
+namespace ir {
+
+bool TailRecursionPass::run(Function& function, AnalysisManager& analyses) {
+  (void)analyses;
+  BasicBlock* entry = function.entry();
+  if (!entry) return false;
+
+  std::vector<Instruction*> calls;
+  for (const auto& block : function.blocks) {
+      for (const auto& instruction : block->instructions) {
+          if (instruction->callee == function.name && instruction->isTailCall() &&
+              instruction->numOperands() == function.paramTypes.size()) {
+              calls.push_back(instruction.get());
+          }
+      }
+  }
+  if (calls.empty()) return false;
+
+  // The loop starts after the parameters are read; the entry block must
+  // not be part of a loop already for its parameters to run only once
+  function.recomputePredecessors();
+  if (!entry->predecessors.empty()) {
+      remark(function, "tail calls to itself not turned into a loop: the entry block is a loop header");
+      return false;
+  }
+  auto first = entry->instructions.begin();
+  while ((*first)->opcode == Opcode::PARAM) ++first;
+  BasicBlock* header = function.splitBlock(first->get(), "tailrecurse");
+
+  // Each parameter becomes a phi of the value it had on entry and the
+  // arguments of the calls, which jump back to the start instead
+  std::vector<std::pair<Instruction*, Instruction*>> parameters;
+  for (const auto& instruction : entry->instructions) {
+      if (instruction->opcode != Opcode::PARAM) continue;
+      Instruction* phi = header->insertPhi(function.create(Opcode::PHI, instruction->type));
+      instruction->replaceAllUsesWith(phi);
+      phi->addIncoming(instruction.get(), entry);
+      parameters.push_back({instruction.get(), phi});
+  }
+  for (Instruction* call : calls) {
+      BasicBlock* block = call->parent;
+      for (const auto& parameter : parameters) {
+          parameter.second->addIncoming(call->getOperand(parameter.first->index), block);
+      }
+      block->erase(block->getTerminator());
+      block->erase(call);
+
+      std::unique_ptr<Instruction> branch = function.create(Opcode::BR, Type::VOID);
+      branch->blocks.push_back(header);
+      block->append(std::move(branch));
+  }
+  function.recomputePredecessors();
+
+  remark(function, std::to_string(calls.size()) + (calls.size() == 1 ? " tail call" : " tail calls") +
+                   " to itself turned into a loop");
+  return true;
+}
+
+} // namespace ir
+} // namespace ccc
@@ -116,6 +116,22 @@ std::string Token::toString() const {
   return ss.str();
 }
 
+TokenType compoundOperator(TokenType type) {
+  switch (type) {
+      case TokenType::OP_PLUS_EQUALS: return TokenType::OP_PLUS;
+      case TokenType::OP_MINUS_EQUALS: return TokenType::OP_MINUS;
+      case TokenType::OP_STAR_EQUALS: return TokenType::OP_STAR;
+      case TokenType::OP_SLASH_EQUALS: return TokenType::OP_SLASH;
+      case TokenType::OP_PERCENT_EQUALS: return TokenType::OP_PERCENT;
+      case TokenType::OP_AND_EQUALS: return TokenType::OP_AMPERSAND;
+      case TokenType::OP_OR_EQUALS: return TokenType::OP_PIPE;
+      case TokenType::OP_XOR_EQUALS: return TokenType::OP_CARET;
+      case TokenType::OP_SHL_EQUALS: return TokenType::OP_SHL;
+      case TokenType::OP_SHR_EQUALS: return TokenType::OP_SHR;
+      default: return TokenType::UNKNOWN;
+  }
+}
+
 // Keyword mapping
 const std::unordered_map<std::string, TokenType> Keywords = {
   {"auto", TokenType::KW_AUTO},
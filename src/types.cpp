@@ -0,0 +1,116 @@
+#include "types.h"
+#include <functional>
+
+namespace ccc {
+
+// TypeInfo implementation
+std::string TypeInfo::toString() const {
+  std::string qualifiers;
+  if (isConst) qualifiers += "const ";
+  if (isVolatile) qualifiers += "volatile ";
+
+  switch (kind) {
+      case Kind::VOID:    return qualifiers + "void";
+      case Kind::CHAR:    return qualifiers + "char";
+      case Kind::INT:     return qualifiers + "int";
+      case Kind::FLOAT:   return qualifiers + "float";
+      case Kind::DOUBLE:  return qualifiers + "double";
+      case Kind::STRUCT:  return qualifiers + "struct";
+      case Kind::POINTER: return base->toString() + "*";
+      case Kind::ARRAY:   return base->toString() + "[" + std::to_string(length) + "]";
+      case Kind::FUNCTION: {
+          std::string result = base->toString() + "(";
+          for (size_t i = 0; i < parameters.size(); i++) {
+              if (i > 0) result += ", ";
+              result += parameters[i]->toString();
+          }
+          return result + ")";
+      }
+  }
+  return "<unknown>";
+}
+
+// TypeContext implementation
+TypeContext::TypeContext() {
+  voidType = getPrimitive(TypeInfo::Kind::VOID);
+  charType = getPrimitive(TypeInfo::Kind::CHAR);
+  intType = getPrimitive(TypeInfo::Kind::INT);
+  floatType = getPrimitive(TypeInfo::Kind::FLOAT);
+  doubleType = getPrimitive(TypeInfo::Kind::DOUBLE);
+}
+
+const TypeInfo* TypeContext::getPrimitive(TypeInfo::Kind kind, bool isConst, bool isVolatile) {
+  int size = 0;
+  switch (kind) {
+      case TypeInfo::Kind::CHAR:   size = 1; break;
+      case TypeInfo::Kind::INT:    size = 4; break;
+      case TypeInfo::Kind::FLOAT:  size = 4; break;
+      case TypeInfo::Kind::DOUBLE: size = 8; break;
+      default:                     size = 0; break;
+  }
+
+  return intern(TypeInfo(kind, isConst, isVolatile, size));
+}
+
+const TypeInfo* TypeContext::getPointer(const TypeInfo* baseType) {
+  TypeInfo info(TypeInfo::Kind::POINTER, false, false, 8);
+  info.base = baseType;
+  return intern(info);
+}
+
+const TypeInfo* TypeContext::getArray(const TypeInfo* elementType, int length) {
+  TypeInfo info(TypeInfo::Kind::ARRAY, false, false, elementType->size * length);
+  info.base = elementType;
+  info.length = length;
+  return intern(info);
+}
+
+const TypeInfo* TypeContext::getFunction(const TypeInfo* returnType,
+                                         const std::vector<const TypeInfo*>& paramTypes) {
+  TypeInfo info(TypeInfo::Kind::FUNCTION, false, false, 0);
+  info.base = returnType;
+  info.parameters = paramTypes;
+  return intern(info);
+}
+
+const TypeInfo* TypeContext::intern(const TypeInfo& candidate) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = table.find(&candidate);
+  if (it != table.end()) {
+      return *it;
+  }
+
+  storage.push_back(candidate);
+  TypeInfo* type = &storage.back();
+  type->id = static_cast<uint32_t>(ordered.size());
+  ordered.push_back(type);
+  table.insert(type);
+  return type;
+}
+
+size_t TypeContext::TypeHash::operator()(const TypeInfo* type) const {
+  // Component types are already interned, so hashing their addresses is enough
+  size_t hash = static_cast<size_t>(type->kind);
+  auto combine = [&hash](size_t value) {
+      hash ^= value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+  };
+
+  combine((type->isConst ? 1 : 0) | (type->isVolatile ? 2 : 0));
+  combine(static_cast<size_t>(type->length));
+  combine(std::hash<const TypeInfo*>()(type->base));
+  for (const TypeInfo* param : type->parameters) {
+      combine(std::hash<const TypeInfo*>()(param));
+  }
+  return hash;
+}
+
+bool TypeContext::TypeEqual::operator()(const TypeInfo* a, const TypeInfo* b) const {
+  return a->kind == b->kind &&
+         a->isConst == b->isConst &&
+         a->isVolatile == b->isVolatile &&
+         a->length == b->length &&
+         a->base == b->base &&
+         a->parameters == b->parameters;
+}
+
+} // namespace ccc
@@ -0,0 +1,417 @@
+#include "passes.h"
+#include <algorithm>
+#include <unordered_map>
+
+namespace ccc {
+namespace ir {
+
+namespace {
+
+// Instructions one iteration costs once lowered
+unsigned loopSize(const Loop* loop) {
+  unsigned size = 0;
+  for (const BasicBlock* block : loop->blocks) {
+      for (const auto& instruction : block->instructions) {
+          if (instruction->opcode != Opcode::PHI && instruction->opcode != Opcode::BR) size++;
+      }
+  }
+  return size;
+}
+
+// One copy of a loop's blocks
+struct Iteration {
+  std::unordered_map<const Value*, Value*> values;
+  std::unordered_map<const BasicBlock*, BasicBlock*> blocks;
+
+  Value* value(Value* original) const {
+      auto it = values.find(original);
+      return it != values.end() ? it->second : original;
+  }
+  BasicBlock* block(BasicBlock* original) const {
+      auto it = blocks.find(original);
+      return it != blocks.end() ? it->second : original;
+  }
+};
+
+class Unroller {
+public:
+  Unroller(Function& function, Loop* loop, const CountedLoop& counted)
+      : function(function), loop(loop), counted(counted),
+        header(loop->header), latch(loop->latches.front()),
+        body(loop->contains(header->getTerminator()->blocks[0]) ? header->getTerminator()->blocks[0]
+                                                                : header->getTerminator()->blocks[1]),
+        exit(loop->contains(header->getTerminator()->blocks[0]) ? header->getTerminator()->blocks[1]
+                                                                : header->getTerminator()->blocks[0]) {}
+
+  // Replace the loop by tripCount copies of its body and a last copy of
+  // the header that leaves; the copies start from the entering values
+  void unrollFully(unsigned tripCount) {
+      std::unordered_map<const Value*, Value*> entering;
+      for (Instruction* phi : header->phis()) {
+          entering[phi] = phi->incomingFor(counted.entering);
+      }
+
+      std::vector<Iteration> iterations;
+      for (unsigned k = 0; k <= tripCount; k++) {
+          std::unordered_map<const Value*, Value*> phis = entering;
+          if (k > 0) {
+              for (Instruction* phi : header->phis()) {
+                  phis[phi] = iterations.back().value(phi->incomingFor(latch));
+              }
+          }
+          iterations.push_back(copy(phis, k, k == tripCount));
+          Instruction* test = iterations.back().block(header)->getTerminator();
+          test->dropOperands();
+          test->opcode = Opcode::BR;
+          test->blocks = {k == tripCount ? exit : iterations.back().block(body)};
+          if (k > 0) {
+              connect(iterations[k - 1], iterations[k]);
+          }
+      }
+
+      // Code after the loop sees the header as it was when the test failed
+      const Iteration& last = iterations.back();
+      for (Instruction* phi : exit->phis()) {
+          std::replace(phi->blocks.begin(), phi->blocks.end(), header, last.block(header));
+      }
+      for (const auto& instruction : header->instructions) {
+          if (instruction->producesValue()) {
+              instruction->replaceAllUsesWith(last.value(instruction.get()));
+          }
+      }
+      enter(iterations.front().block(header));
+  }
+
+  // Repeat the body factor times behind one test that factor more
+  // iterations will run; the original loop, entered through a new block
+  // after the copies, runs the rest. With a constant trip count the copies
+  // run while the counter has not reached the value it has after the last
+  // whole round, and when factor divides the trip count nothing is left
+  // over: the copies leave to the exit and the original loop goes.
+  // Otherwise they compare the counter with the bound less the distance
+  // the counter covers in factor - 1 iterations, computed before the loop
+  // together with a check that computing it did not wrap. Each copy keeps
+  // its own partial result of every reduction; they merge in a block
+  // after the copies.
+  void unrollPartially(unsigned factor, BasicBlock* preheader, const std::vector<Reduction>& reductions) {
+      Value* limit;
+      Opcode predicate;
+      Instruction* fits = nullptr;
+      int64_t distance = static_cast<int64_t>(factor - 1) * counted.step;
+      if (counted.tripCount >= 0) {
+          int64_t rounds = counted.tripCount / factor;
+          int64_t start = static_cast<const Constant*>(counted.start)->integer;
+          limit = function.getInteger(Type::I32, start + rounds * factor * counted.step);
+          predicate = Opcode::CMP_NE;
+      } else {
+          limit = preheader->insertBeforeTerminator(function.create(
+              Opcode::SUB, Type::I32, {counted.bound, function.getInteger(Type::I32, distance)}));
+          fits = preheader->insertBeforeTerminator(function.create(
+              counted.step > 0 ? Opcode::CMP_LT : Opcode::CMP_GT, Type::I32, {limit, counted.bound}));
+          predicate = counted.predicate;
+      }
+
+      // Copy 0's header merges the entering values with the last copy's.
+      // Copies after the first start their partial results of a reduction
+      // from phis of their own.
+      std::unordered_map<const Value*, Value*> merged;
+      std::vector<std::unique_ptr<Instruction>> pending;
+      for (Instruction* phi : header->phis()) {
+          pending.push_back(function.create(Opcode::PHI, phi->type));
+          merged[phi] = pending.back().get();
+      }
+      std::vector<std::vector<Instruction*>> partials(reductions.size());
+      std::vector<std::unique_ptr<Instruction>> pendingPartials;
+      for (size_t r = 0; r < reductions.size(); r++) {
+          for (unsigned k = 1; k < factor; k++) {
+              pendingPartials.push_back(function.create(Opcode::PHI, reductions[r].phi->type));
+              partials[r].push_back(pendingPartials.back().get());
+          }
+      }
+      std::vector<Iteration> iterations;
+      for (unsigned k = 0; k < factor; k++) {
+          std::unordered_map<const Value*, Value*> phis = merged;
+          if (k > 0) {
+              for (Instruction* phi : header->phis()) {
+                  phis[phi] = iterations.back().value(phi->incomingFor(latch));
+              }
+              for (size_t r = 0; r < reductions.size(); r++) {
+                  phis[reductions[r].phi] = partials[r][k - 1];
+              }
+          }
+          iterations.push_back(copy(phis, k, false));
+          if (k > 0) {
+              Instruction* test = iterations.back().block(header)->getTerminator();
+              test->dropOperands();
+              test->opcode = Opcode::BR;
+              test->blocks = {iterations.back().block(body)};
+              connect(iterations[k - 1], iterations[k]);
+          }
+      }
+      connect(iterations.back(), iterations.front());
+      BasicBlock* top = iterations.front().block(header);
+      BasicBlock* bottom = iterations.back().block(latch);
+      std::unordered_map<const Value*, Value*> carried;
+      for (const Reduction& reduction : reductions) {
+          carried[reduction.phi] = iterations.front().value(reduction.update);
+      }
+      std::vector<Instruction*> phis = header->phis();
+      for (size_t i = 0; i < phis.size(); i++) {
+          Instruction* placed = top->insertPhi(std::move(pending[i]));
+          auto reduced = carried.find(phis[i]);
+          placed->addIncoming(phis[i]->incomingFor(preheader), preheader);
+          placed->addIncoming(reduced != carried.end() ? reduced->second
+                                                       : iterations.back().value(phis[i]->incomingFor(latch)), bottom);
+      }
+      PreheaderBuilder builder(function, preheader);
+      for (size_t r = 0; r < reductions.size(); r++) {
+          const Reduction& reduction = reductions[r];
+          for (unsigned k = 1; k < factor; k++) {
+              Instruction* partial = top->insertPhi(std::move(pendingPartials[r * (factor - 1) + k - 1]));
+              partial->addIncoming(builder.identity(reduction, reduction.phi->type), preheader);
+              partial->addIncoming(iterations[k].value(reduction.update), bottom);
+          }
+      }
+
+      Instruction* test = top->insertBeforeTerminator(function.create(
+          predicate, Type::I32, {merged.at(counted.counter), limit}));
+
+      // The partial results of each reduction merge once the copies stop
+      BasicBlock* done = top;
+      std::unordered_map<const Value*, Value*> results = merged;
+      if (!reductions.empty()) {
+          done = function.createBlock(header->name + "_reduce");
+          function.moveBefore(done, header);
+          for (size_t r = 0; r < reductions.size(); r++) {
+              const Reduction& reduction = reductions[r];
+              Value* result = merged.at(reduction.phi);
+              for (Instruction* partial : partials[r]) {
+                  result = combinePartials(function, done, reduction, result, partial);
+              }
+              results[reduction.phi] = result;
+          }
+      }
+
+      Instruction* branch = top->getTerminator();
+      BasicBlock* next = branch->blocks[0] == exit ? branch->blocks[1] : branch->blocks[0];
+      if (counted.tripCount >= 0 && counted.tripCount % factor == 0) {
+          // Code after the loop sees the header as it was when the copies'
+          // test failed
+          if (done != top) jump(done, exit);
+          for (Instruction* phi : exit->phis()) {
+              std::replace(phi->blocks.begin(), phi->blocks.end(), header, done);
+          }
+          for (const auto& instruction : header->instructions) {
+              if (!instruction->producesValue()) continue;
+              auto result = results.find(instruction.get());
+              instruction->replaceAllUsesWith(result != results.end() ? result->second
+                                                                      : iterations.front().value(instruction.get()));
+          }
+          branch->setOperand(0, test);
+          branch->blocks = {next, done != top ? done : exit};
+          preheader->getTerminator()->blocks = {top};
+          function.recomputePredecessors();
+          function.removeUnreachableBlocks();
+          return;
+      }
+
+      // The original loop is entered from the copies, and from the
+      // preheader when the limit wrapped
+      BasicBlock* remainder = function.createBlock(header->name + "_remainder");
+      function.moveBefore(remainder, header);
+      if (done != top) jump(done, remainder);
+      jump(remainder, header);
+      for (Instruction* phi : header->phis()) {
+          Value* value = results.at(phi);
+          if (fits) {
+              Instruction* merge = remainder->insertPhi(function.create(Opcode::PHI, phi->type));
+              merge->addIncoming(value, done);
+              merge->addIncoming(phi->incomingFor(preheader), preheader);
+              value = merge;
+          }
+          phi->removeIncoming(preheader);
+          phi->addIncoming(value, remainder);
+      }
+
+      branch->setOperand(0, test);
+      branch->blocks = {next, done != top ? done : remainder};
+
+      Instruction* entry = preheader->getTerminator();
+      if (fits) {
+          entry->opcode = Opcode::CONDBR;
+          entry->addOperand(fits);
+          entry->blocks = {top, remainder};
+      } else {
+          entry->blocks = {top};
+      }
+      function.recomputePredecessors();
+  }
+
+private:
+  Function& function;
+  Loop* loop;
+  const CountedLoop& counted;
+  BasicBlock* header;
+  BasicBlock* latch;
+  BasicBlock* body;    // Successor of the header in the loop
+  BasicBlock* exit;
+
+  // Copy the loop's blocks (only the header when headerOnly) with the
+  // header phis standing for the given values, placed before the header
+  Iteration copy(const std::unordered_map<const Value*, Value*>& phis, unsigned k, bool headerOnly) {
+      Iteration iteration;
+      iteration.values.insert(phis.begin(), phis.end());
+
+      std::vector<std::pair<const Instruction*, Instruction*>> instructions;
+      for (BasicBlock* source : loop->blocks) {
+          if (headerOnly && source != header) continue;
+          BasicBlock* copied = function.createBlock(source->name + "_u" + std::to_string(k));
+          function.moveBefore(copied, header);
+          iteration.blocks[source] = copied;
+          for (const auto& instruction : source->instructions) {
+              if (source == header && instruction->isPhi()) continue;
+              std::unique_ptr<Instruction> created = function.create(instruction->opcode, instruction->type);
+              created->callee = instruction->callee;
+              created->index = instruction->index;
+              Instruction* placed = copied->append(std::move(created));
+              iteration.values[instruction.get()] = placed;
+              instructions.emplace_back(instruction.get(), placed);
+          }
+      }
+      for (const auto& pair : instructions) {
+          for (Value* operand : pair.first->getOperands()) {
+              pair.second->addOperand(iteration.value(operand));
+          }
+          for (BasicBlock* block : pair.first->blocks) {
+              pair.second->blocks.push_back(iteration.block(block));
+          }
+      }
+      return iteration;
+  }
+
+  void jump(BasicBlock* from, BasicBlock* to) {
+      std::unique_ptr<Instruction> branch = function.create(Opcode::BR, Type::VOID);
+      branch->blocks.push_back(to);
+      from->append(std::move(branch));
+  }
+
+  // The back edge of one copy goes on to the next copy's header
+  void connect(const Iteration& from, const Iteration& to) {
+      Instruction* backEdge = from.block(latch)->getTerminator();
+      std::replace(backEdge->blocks.begin(), backEdge->blocks.end(), from.block(header), to.block(header));
+  }
+
+  // Enter the copies instead of the loop, which becomes unreachable
+  void enter(BasicBlock* first) {
+      for (BasicBlock*& target : counted.entering->getTerminator()->blocks) {
+          if (target == header) target = first;
+      }
+      function.recomputePredecessors();
+      function.removeUnreachableBlocks();
+  }
+};
+
+} // namespace
+
+UnrollPass::UnrollPass(int optimizationLevel, bool relaxedMath) : relaxedMath(relaxedMath) {
+  if (optimizationLevel >= 3) {
+      fullBudget = 256;
+      partialBudget = 128;
+      maxFactor = 8;
+  } else {
+      fullBudget = 64;
+      partialBudget = 48;
+      maxFactor = 4;
+  }
+}
+
+bool UnrollPass::run(Function& function, AnalysisManager& analyses) {
+  if (!function.entry()) return false;
+
+  LoopInfo& loops = analyses.getLoops();
+  std::vector<Loop*> candidates;
+  for (Loop* loop : loops.loopsInnermostFirst()) {
+      if (loop->isInnermost()) candidates.push_back(loop);
+  }
+
+  // Innermost loops share no blocks, so unrolling one leaves the others'
+  // descriptions intact
+  bool changed = false;
+  for (Loop* loop : candidates) {
+      std::string where = "loop at bb" + std::to_string(loop->header->id);
+      if (loop->header->noUnroll) {
+          remark(function, where + " not unrolled: it finishes a vectorized loop");
+          continue;
+      }
+
+      // A loop LICM guarded is entered both through the guard and around it
+      if (!loop->preheader()) {
+          loops.insertPreheader(loop);
+          changed = true;
+      }
+      CountedLoop counted;
+      if (!analyzeCountedLoop(*loop, counted)) {
+          remark(function, where + " not unrolled: not a counted loop");
+          continue;
+      }
+
+      unsigned size = loopSize(loop);
+      int64_t tripCount = counted.tripCount;
+      if (tripCount >= 0 && static_cast<uint64_t>(tripCount) * size <= fullBudget) {
+          if (tripCount == 0) continue;
+          Unroller(function, loop, counted).unrollFully(static_cast<unsigned>(tripCount));
+          remark(function, where + " unrolled completely (" + std::to_string(tripCount) + " iterations, " +
+                 std::to_string(tripCount * size) + " instructions)");
+          changed = true;
+          continue;
+      }
+
+      // The boundary iteration's header runs again in the remainder loop
+      bool sideEffects = false;
+      for (const auto& instruction : loop->header->instructions) {
+          if (instruction->hasSideEffects() && !instruction->isTerminator()) sideEffects = true;
+      }
+      if (sideEffects) {
+          remark(function, where + " not unrolled: the loop test has side effects");
+          continue;
+      }
+      if (tripCount < 0) {
+          bool ordered = (counted.step > 0 && (counted.predicate == Opcode::CMP_LT || counted.predicate == Opcode::CMP_LE)) ||
+                         (counted.step < 0 && (counted.predicate == Opcode::CMP_GT || counted.predicate == Opcode::CMP_GE));
+          if (!ordered) {
+              remark(function, where + " not unrolled: unknown trip count and the test is not an ordered comparison");
+              continue;
+          }
+      }
+
+      unsigned factor = maxFactor;
+      while (factor > 1 && (factor * size > partialBudget ||
+                            (tripCount >= 0 && static_cast<int64_t>(factor) > tripCount))) {
+          factor /= 2;
+      }
+      if (factor < 2) {
+          remark(function, where + " not unrolled: " + std::to_string(size) + " instructions exceed the budget of " +
+                 std::to_string(partialBudget));
+          continue;
+      }
+
+      std::vector<Reduction> reductions;
+      for (Instruction* phi : loop->header->phis()) {
+          Reduction reduction;
+          if (analyzeReduction(*loop, phi, relaxedMath, reduction)) reductions.push_back(reduction);
+      }
+      Unroller(function, loop, counted).unrollPartially(factor, counted.entering, reductions);
+      std::string message = where + " unrolled by " + std::to_string(factor);
+      if (tripCount < 0 || tripCount % factor != 0) message += " with a remainder loop";
+      if (!reductions.empty()) {
+          message += ", " + std::to_string(reductions.size()) + " reductions split into " +
+                     std::to_string(factor) + " partial results";
+      }
+      remark(function, message);
+      changed = true;
+  }
+  return changed;
+}
+
+} // namespace ir
+} // namespace ccc
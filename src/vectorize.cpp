@@ -0,0 +1,540 @@
+#include "passes.h"
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace ccc {
+namespace ir {
+
+namespace {
+
+// Iterations each pass through the vector loop runs
+const int64_t vectorLanes = 4;
+
+// Runtime overlap checks a loop may need before it is not worth it
+const unsigned maxAliasChecks = 8;
+
+// Whether vectors of type have a form of opcode
+bool hasVectorForm(Opcode opcode, Type type) {
+  switch (opcode) {
+      case Opcode::ADD:
+      case Opcode::SUB:
+      case Opcode::MUL:
+      case Opcode::NEG:
+          return true;
+      case Opcode::DIV:
+          return type == Type::V4F32;
+      case Opcode::CMP_EQ:
+      case Opcode::CMP_NE:
+      case Opcode::CMP_LT:
+      case Opcode::CMP_LE:
+      case Opcode::CMP_GT:
+      case Opcode::CMP_GE:
+      case Opcode::SELECT:
+          // Comparisons give a V4I32 of 0 and 1 lane by lane, which
+          // selects choose by
+          return true;
+      case Opcode::AND:
+      case Opcode::OR:
+      case Opcode::XOR:
+      case Opcode::NOT:
+      case Opcode::SHL:
+      case Opcode::SHR:
+          return type == Type::V4I32;
+      default:
+          return false;
+  }
+}
+
+// LOAD or STORE of base[counter + offset]
+struct Access {
+  Instruction* instruction;
+  Value* base;
+  LinearValue offset;
+};
+
+class Vectorizer {
+public:
+  Vectorizer(Function& function, Loop* loop, const CountedLoop& counted, bool relaxedMath)
+      : function(function), loop(loop), counted(counted), relaxedMath(relaxedMath), variables(*loop),
+        header(loop->header), latch(loop->latches.front()) {}
+
+  // Why the loop cannot be vectorized, or an empty string if it can
+  std::string analyze() {
+      if (counted.step != 1) return "the counter does not step by 1";
+      if (counted.tripCount >= 0 && counted.tripCount < vectorLanes) {
+          return "only " + std::to_string(counted.tripCount) + " iterations";
+      }
+      if (counted.tripCount < 0 && counted.predicate != Opcode::CMP_LT && counted.predicate != Opcode::CMP_LE &&
+          counted.predicate != Opcode::CMP_NE) {
+          return "the counter moves away from the bound";
+      }
+
+      // The body must run straight through from the header to the latch
+      Instruction* test = header->getTerminator();
+      BasicBlock* block = loop->contains(test->blocks[0]) ? test->blocks[0] : test->blocks[1];
+      std::vector<BasicBlock*> body;
+      while (block != header && body.size() < loop->blocks.size()) {
+          Instruction* terminator = block->getTerminator();
+          if (terminator->opcode != Opcode::BR) return "the loop body branches";
+          if (!block->phis().empty()) return "the loop body merges values";
+          body.push_back(block);
+          block = terminator->blocks[0];
+      }
+      if (body.empty() || body.size() + 1 != loop->blocks.size()) return "the loop body branches";
+
+      for (Instruction* phi : header->phis()) {
+          std::string reason = classifyPhi(phi);
+          if (!reason.empty()) return reason;
+      }
+
+      // Program order of one iteration; the loop test is left out
+      order.clear();
+      for (const auto& instruction : header->instructions) {
+          if (instruction->isPhi() || instruction->isTerminator()) continue;
+          bool testOnly = true;
+          for (Instruction* user : instruction->getUsers()) {
+              if (user != test) testOnly = false;
+          }
+          if (!testOnly) order.push_back(instruction.get());
+      }
+      for (BasicBlock* source : body) {
+          for (const auto& instruction : source->instructions) {
+              if (!instruction->isTerminator()) order.push_back(instruction.get());
+          }
+      }
+      for (Instruction* instruction : order) {
+          std::string reason = classify(instruction);
+          if (!reason.empty()) return reason;
+      }
+
+      return checkDependences();
+  }
+
+  unsigned aliasChecks() const { return static_cast<unsigned>(checks.size()); }
+  unsigned reductionCount() const { return static_cast<unsigned>(reductions.size()); }
+
+  // Put the vector loop in front of the original one, which becomes the
+  // epilogue. The preheader decides whether the vector loop may run: the
+  // bound less three must not wrap, and arrays reached through different
+  // pointers must not overlap. The vector loop runs while four more
+  // iterations remain; a block after it merges the lanes of each reduction
+  // and enters the epilogue, which picks up where it stopped.
+  void transform(BasicBlock* preheader) {
+      PreheaderBuilder builder(function, preheader);
+      Value* start = counted.start;
+      Value* limit;
+      Value* end;
+      Opcode predicate;
+      std::vector<Value*> conditions;
+      if (counted.tripCount >= 0) {
+          int64_t first = static_cast<const Constant*>(start)->integer;
+          int64_t rounds = counted.tripCount / vectorLanes;
+          limit = builder.constant(first + rounds * vectorLanes);
+          end = builder.constant(first + counted.tripCount);
+          predicate = Opcode::CMP_NE;
+      } else {
+          limit = builder.sub(counted.bound, builder.constant(vectorLanes - 1));
+          conditions.push_back(builder.emit(Opcode::CMP_LT, Type::I32, {limit, counted.bound}));
+          end = counted.predicate == Opcode::CMP_LE ? builder.add(counted.bound, builder.constant(1)) : counted.bound;
+          predicate = counted.predicate == Opcode::CMP_LE ? Opcode::CMP_LE : Opcode::CMP_LT;
+      }
+
+      // Elements [start + offset, end + offset) of each array, compared as
+      // addresses of 32-bit elements
+      std::vector<std::pair<const Access*, std::pair<Value*, Value*>>> ranges;
+      auto range = [&](const Access& access) {
+          for (const auto& known : ranges) {
+              if (known.first->base == access.base && known.first->offset == access.offset) return known.second;
+          }
+          Value* offset = builder.linear(access.offset);
+          auto address = [&](Value* index) {
+              if (index->isConstant() && static_cast<const Constant*>(index)->integer == 0) return access.base;
+              return builder.emit(Opcode::ADDR, Type::PTR, {access.base, index, builder.constant(4)});
+          };
+          ranges.emplace_back(&access, std::make_pair(address(builder.add(start, offset)), address(builder.add(end, offset))));
+          return ranges.back().second;
+      };
+      for (const auto& check : checks) {
+          std::pair<Value*, Value*> a = range(check.first);
+          std::pair<Value*, Value*> b = range(check.second);
+          Value* before = builder.emit(Opcode::CMP_LE, Type::I32, {a.second, b.first});
+          Value* after = builder.emit(Opcode::CMP_LE, Type::I32, {b.second, a.first});
+          conditions.push_back(builder.emit(Opcode::OR, Type::I32, {before, after}));
+      }
+      Value* enter = nullptr;
+      for (Value* condition : conditions) {
+          enter = enter ? builder.emit(Opcode::AND, Type::I32, {enter, condition}) : condition;
+      }
+
+      BasicBlock* vectorHeader = function.createBlock(header->name + "_vector");
+      BasicBlock* vectorBody = function.createBlock(header->name + "_vector_body");
+      BasicBlock* vectorEnd = function.createBlock(header->name + "_vector_end");
+      BasicBlock* remainder = function.createBlock(header->name + "_remainder");
+      for (BasicBlock* created : {vectorHeader, vectorBody, vectorEnd, remainder}) {
+          function.moveBefore(created, header);
+      }
+
+      Instruction* counter = vectorHeader->insertPhi(function.create(Opcode::PHI, Type::I32));
+      scalars[counted.counter] = counter;
+      for (const Reduction& reduction : reductions) {
+          Type type = vectorType(reduction.phi->type);
+          Instruction* accumulator = vectorHeader->insertPhi(function.create(Opcode::PHI, type));
+          accumulator->addIncoming(builder.identity(reduction, type), preheader);
+          vectors[reduction.phi] = accumulator;
+      }
+
+      for (Instruction* instruction : order) {
+          emitVector(instruction, vectorBody, builder);
+      }
+      Instruction* next = vectorBody->append(function.create(
+          Opcode::ADD, Type::I32, {counter, builder.constant(vectorLanes)}));
+      branch(vectorBody, vectorHeader);
+      counter->addIncoming(start, preheader);
+      counter->addIncoming(next, vectorBody);
+      for (const Reduction& reduction : reductions) {
+          static_cast<Instruction*>(vectors.at(reduction.phi))->addIncoming(vectors.at(reduction.update), vectorBody);
+      }
+
+      Instruction* more = vectorHeader->append(function.create(predicate, Type::I32, {counter, limit}));
+      std::unique_ptr<Instruction> loopTest = function.create(Opcode::CONDBR, Type::VOID, {more});
+      loopTest->blocks = {vectorBody, vectorEnd};
+      vectorHeader->append(std::move(loopTest));
+
+      // Each reduction's lanes fold into the value it entered with
+      std::unordered_map<const Value*, Value*> results;
+      results[counted.counter] = counter;
+      for (const Reduction& reduction : reductions) {
+          Type type = reduction.phi->type;
+          Value* result = nullptr;
+          for (int64_t lane = 0; lane < vectorLanes; lane++) {
+              Instruction* element = vectorEnd->append(function.create(
+                  Opcode::EXTRACT, type, {vectors.at(reduction.phi), builder.constant(lane)}));
+              result = result ? combinePartials(function, vectorEnd, reduction, result, element) : element;
+          }
+          Value* entering = reduction.phi->incomingFor(preheader);
+          if (entering != builder.identity(reduction, type)) {
+              result = combinePartials(function, vectorEnd, reduction, entering, result);
+          }
+          results[reduction.phi] = result;
+      }
+      branch(vectorEnd, remainder);
+
+      // The epilogue starts from the vector loop's results, or from the
+      // entering values when the preheader skipped the vector loop
+      branch(remainder, header);
+      for (Instruction* phi : header->phis()) {
+          Value* entering = phi->incomingFor(preheader);
+          auto result = results.find(phi);
+          Value* value = result != results.end() ? result->second : entering;
+          if (enter && value != entering) {
+              Instruction* merge = remainder->insertPhi(function.create(Opcode::PHI, phi->type));
+              merge->addIncoming(value, vectorEnd);
+              merge->addIncoming(entering, preheader);
+              value = merge;
+          }
+          phi->removeIncoming(preheader);
+          phi->addIncoming(value, remainder);
+      }
+      header->noUnroll = true;
+
+      Instruction* entry = preheader->getTerminator();
+      if (enter) {
+          entry->opcode = Opcode::CONDBR;
+          entry->addOperand(enter);
+          entry->blocks = {vectorHeader, remainder};
+      } else {
+          entry->blocks = {vectorHeader};
+      }
+      function.recomputePredecessors();
+  }
+
+private:
+  Function& function;
+  Loop* loop;
+  const CountedLoop& counted;
+  bool relaxedMath;
+  InductionVariables variables;
+  BasicBlock* header;
+  BasicBlock* latch;
+
+  std::vector<Instruction*> order;
+  std::vector<Reduction> reductions;
+  std::vector<Access> accesses;
+  std::vector<std::pair<Access, Access>> checks;
+
+  // Header phis that keep their entering value on every iteration
+  std::vector<const Instruction*> invariantPhis;
+
+  // Values of the loop that stay scalar (the counter and what is computed
+  // from it, to index the arrays) and that become vectors
+  std::unordered_set<const Value*> scalarValues;
+  std::unordered_set<const Value*> vectorValues;
+
+  // Their copies in the vector loop
+  std::unordered_map<const Value*, Value*> scalars;
+  std::unordered_map<const Value*, Value*> vectors;
+  std::unordered_map<const Value*, Value*> splats;
+
+  bool isUniform(const Value* value) const {
+      if (!value->isInstruction()) return true;
+      const Instruction* instruction = static_cast<const Instruction*>(value);
+      return !loop->contains(instruction->parent) ||
+             std::find(invariantPhis.begin(), invariantPhis.end(), instruction) != invariantPhis.end();
+  }
+
+  // Computed in the loop from the counter and invariant values; counter is
+  // set when it depends on the counter at all
+  bool isScalar(const Value* value, bool& counter) const {
+      const InductionValue* described = variables.find(value);
+      if (!described || value->type != Type::I32) return false;
+      if (described->iv && described->iv != counted.counter) return false;
+      counter = described->iv != nullptr;
+      return true;
+  }
+
+  std::string classifyPhi(Instruction* phi) {
+      if (phi == counted.counter) return "";
+      Value* update = phi->incomingFor(latch);
+      if (update == phi) {
+          invariantPhis.push_back(phi);
+          return "";
+      }
+      for (const auto& basic : variables.basic()) {
+          if (basic.first == phi) return "another induction variable steps by " + std::to_string(basic.second);
+      }
+
+      // Every lane keeps a partial result of a reduction
+      Reduction reduction;
+      if (analyzeReduction(*loop, phi, relaxedMath, reduction)) {
+          if (vectorType(phi->type) == Type::VOID) return std::string("reduces ") + typeName(phi->type) + " values";
+          reductions.push_back(reduction);
+          vectorValues.insert(phi);
+          return "";
+      }
+      if (!relaxedMath && analyzeReduction(*loop, phi, true, reduction)) {
+          return std::string("reducing ") + typeName(phi->type) +
+                 " values in another order would change the result (allowed by --relaxed-math)";
+      }
+      return "a value carried between iterations is not a reduction";
+  }
+
+  // An operand a vector instruction can use: a vector, or a value every
+  // lane shares
+  bool isVectorOperand(const Value* value) const {
+      bool counter = false;
+      if (vectorValues.count(value) || isUniform(value)) return true;
+      return isScalar(value, counter) && !counter;
+  }
+
+  std::string classify(Instruction* instruction) {
+      bool counter = false;
+      switch (instruction->opcode) {
+          case Opcode::LOAD:
+          case Opcode::STORE: {
+              Type type = instruction->opcode == Opcode::LOAD ? instruction->type : instruction->getOperand(2)->type;
+              if (vectorType(type) == Type::VOID) return std::string("accesses ") + typeName(type) + " elements";
+              if (!isUniform(instruction->getOperand(0))) return "the array accessed changes in the loop";
+              Value* index = instruction->getOperand(1);
+              const InductionValue* described = variables.find(index);
+              if (!described || described->iv != counted.counter) {
+                  return "accesses an element that does not follow the counter";
+              }
+              if (!described->scale.isConstant() || described->scale.constant != 1) {
+                  return "accesses elements that are not consecutive";
+              }
+              if (instruction->opcode == Opcode::STORE && !isVectorOperand(instruction->getOperand(2))) {
+                  return "stores the counter";
+              }
+              accesses.push_back({instruction, instruction->getOperand(0), described->offset});
+              if (instruction->opcode == Opcode::LOAD) vectorValues.insert(instruction);
+              return "";
+          }
+          case Opcode::CALL:
+              return "calls '" + instruction->callee + "'";
+          case Opcode::PHI:
+              return "the loop body merges values";
+          default:
+              break;
+      }
+
+      if (isScalar(instruction, counter)) {
+          scalarValues.insert(instruction);
+          return "";
+      }
+      Type type = vectorType(instruction->type);
+      if (!hasVectorForm(instruction->opcode, type)) {
+          return std::string(opcodeName(instruction->opcode)) + " on " + typeName(instruction->type) + " has no vector form";
+      }
+      for (Value* operand : instruction->getOperands()) {
+          if (!isVectorOperand(operand)) return "uses the counter as a value";
+          if (vectorType(operand->type) == Type::VOID) {
+              return std::string(opcodeName(instruction->opcode)) + " on " + typeName(operand->type) + " has no vector form";
+          }
+      }
+      vectorValues.insert(instruction);
+      return "";
+  }
+
+  // Two accesses to the same array conflict when the later one in the body
+  // reaches, fewer than four iterations back, an element the earlier one
+  // writes or reads in a later iteration: the vector loop would run them
+  // the other way round. Different pointers are checked at run time.
+  std::string checkDependences() {
+      for (size_t a = 0; a < accesses.size(); a++) {
+          for (size_t b = a + 1; b < accesses.size(); b++) {
+              const Access& first = accesses[a];
+              const Access& second = accesses[b];
+              if (first.instruction->opcode == Opcode::LOAD && second.instruction->opcode == Opcode::LOAD) continue;
+
+              if (first.base == second.base) {
+                  if (first.offset.terms != second.offset.terms) {
+                      return "accesses to the same array at a distance not known";
+                  }
+                  int64_t distance = second.offset.constant - first.offset.constant;
+                  if (distance > 0 && distance < vectorLanes) {
+                      return "accesses to the same array " + std::to_string(distance) +
+                             " elements apart depend on each other";
+                  }
+                  continue;
+              }
+
+              bool known = false;
+              for (const auto& check : checks) {
+                  known |= same(check.first, first) && same(check.second, second);
+                  known |= same(check.first, second) && same(check.second, first);
+              }
+              if (known) continue;
+              if (checks.size() == maxAliasChecks) {
+                  return "needs more than " + std::to_string(maxAliasChecks) + " runtime alias checks";
+              }
+              checks.emplace_back(first, second);
+          }
+      }
+      return "";
+  }
+
+  static bool same(const Access& a, const Access& b) {
+      return a.base == b.base && a.offset == b.offset;
+  }
+
+  Value* scalarOperand(Value* value) {
+      auto scalar = scalars.find(value);
+      if (scalar != scalars.end()) return scalar->second;
+      return uniformValue(value);
+  }
+
+  Value* uniformValue(Value* value) const {
+      if (!value->isInstruction()) return value;
+      Instruction* instruction = static_cast<Instruction*>(value);
+      if (instruction->parent == header && instruction->isPhi()) return instruction->incomingFor(counted.entering);
+      return value;
+  }
+
+  // The same value in every lane: splatted once in the preheader when it
+  // is defined outside the loop, and where it is computed otherwise
+  Value* vectorOperand(Value* value, Type type, BasicBlock* body, PreheaderBuilder& builder) {
+      auto vector = vectors.find(value);
+      if (vector != vectors.end()) return vector->second;
+      auto splat = splats.find(value);
+      if (splat != splats.end()) return splat->second;
+
+      Value* result;
+      if (isUniform(value)) {
+          result = builder.emit(Opcode::SPLAT, type, {uniformValue(value)});
+      } else {
+          result = body->append(function.create(Opcode::SPLAT, type, {scalars.at(value)}));
+      }
+      splats[value] = result;
+      return result;
+  }
+
+  void emitVector(Instruction* instruction, BasicBlock* body, PreheaderBuilder& builder) {
+      if (scalarValues.count(instruction)) {
+          std::unique_ptr<Instruction> copy = function.create(instruction->opcode, instruction->type);
+          for (Value* operand : instruction->getOperands()) {
+              copy->addOperand(scalarOperand(operand));
+          }
+          scalars[instruction] = body->append(std::move(copy));
+          return;
+      }
+
+      switch (instruction->opcode) {
+          case Opcode::LOAD: {
+              Value* index = scalarOperand(instruction->getOperand(1));
+              vectors[instruction] = body->append(function.create(
+                  Opcode::LOAD, vectorType(instruction->type), {instruction->getOperand(0), index}));
+              return;
+          }
+          case Opcode::STORE: {
+              Value* value = instruction->getOperand(2);
+              Value* index = scalarOperand(instruction->getOperand(1));
+              body->append(function.create(Opcode::STORE, Type::VOID, {
+                  instruction->getOperand(0), index, vectorOperand(value, vectorType(value->type), body, builder)}));
+              return;
+          }
+          default: {
+              std::unique_ptr<Instruction> vector = function.create(instruction->opcode, vectorType(instruction->type));
+              for (Value* operand : instruction->getOperands()) {
+                  vector->addOperand(vectorOperand(operand, vectorType(operand->type), body, builder));
+              }
+              vectors[instruction] = body->append(std::move(vector));
+              return;
+          }
+      }
+  }
+
+  void branch(BasicBlock* from, BasicBlock* to) {
+      std::unique_ptr<Instruction> jump = function.create(Opcode::BR, Type::VOID);
+      jump->blocks.push_back(to);
+      from->append(std::move(jump));
+  }
+};
+
+} // namespace
+
+bool VectorizePass::run(Function& function, AnalysisManager& analyses) {
+  if (!function.entry()) return false;
+
+  LoopInfo& loops = analyses.getLoops();
+  std::vector<Loop*> candidates;
+  for (Loop* loop : loops.loopsInnermostFirst()) {
+      if (loop->isInnermost()) candidates.push_back(loop);
+  }
+
+  bool changed = false;
+  for (Loop* loop : candidates) {
+      std::string where = "loop at bb" + std::to_string(loop->header->id);
+      if (!loop->preheader()) {
+          loops.insertPreheader(loop);
+          changed = true;
+      }
+      CountedLoop counted;
+      if (!analyzeCountedLoop(*loop, counted)) {
+          remark(function, where + " not vectorized: not a counted loop");
+          continue;
+      }
+
+      Vectorizer vectorizer(function, loop, counted, relaxedMath);
+      std::string reason = vectorizer.analyze();
+      if (!reason.empty()) {
+          remark(function, where + " not vectorized: " + reason);
+          continue;
+      }
+      vectorizer.transform(counted.entering);
+      changed = true;
+
+      std::string message = where + " vectorized with " + std::to_string(vectorLanes) + " lanes";
+      if (vectorizer.reductionCount() > 0) {
+          message += ", " + std::to_string(vectorizer.reductionCount()) + " reductions";
+      }
+      if (vectorizer.aliasChecks() > 0) {
+          message += ", " + std::to_string(vectorizer.aliasChecks()) + " runtime alias checks";
+      }
+      remark(function, message);
+  }
+  return changed;
+}
+
+} // namespace ir
+} // namespace ccc